@@ -78,14 +78,16 @@ namespace nm {
   static void (*(name)[nm::NUM_STYPES])(void*) = {	\
     nm_dense_storage_mark,											\
     nm_list_storage_mark,												\
-    nm_yale_storage_mark												\
+    nm_yale_storage_mark,												\
+    nm_bsr_storage_mark													\
   };
 
 #define STYPE_CAST_COPY_TABLE(name)                                                   \
   static STORAGE* (*(name)[nm::NUM_STYPES][nm::NUM_STYPES])(const STORAGE*, nm::dtype_t) = {      \
-    { nm_dense_storage_cast_copy,  nm_dense_storage_from_list,  nm_dense_storage_from_yale },  \
-    { nm_list_storage_from_dense,  nm_list_storage_cast_copy,   nm_list_storage_from_yale  },  \
-    { nm_yale_storage_from_dense,  nm_yale_storage_from_list,   nm_yale_storage_cast_copy  }   \
+    { nm_dense_storage_cast_copy,  nm_dense_storage_from_list,  nm_dense_storage_from_yale, nm_dense_storage_from_bsr },  \
+    { nm_list_storage_from_dense,  nm_list_storage_cast_copy,   nm_list_storage_from_yale,  nm_list_storage_from_bsr  },  \
+    { nm_yale_storage_from_dense,  nm_yale_storage_from_list,   nm_yale_storage_cast_copy,  nm_yale_storage_from_bsr  },  \
+    { nm_bsr_storage_from_dense,   nm_bsr_storage_from_list,    nm_bsr_storage_from_yale,   nm_bsr_storage_cast_copy  }   \
   };
 
 /*
@@ -108,11 +108,15 @@ $srcs = [
          'util/math.cpp',
          'util/sl_list.cpp',
          'util/io.cpp',
+         'util/simd.cpp',
+         'util/thread_pool.cpp',
          'storage/common.cpp',
          'storage/storage.cpp',
          'storage/dense.cpp',
          'storage/yale.cpp',
-         'storage/list.cpp'
+         'storage/list.cpp',
+         'storage/yale_factor.cpp',
+         'storage/bsr.cpp'
         ]
 # add smmp in to get generic transp; remove smmp2 to eliminate funcptr transp
 
@@ -155,10 +159,14 @@ have_func("clapack_dgetrf", "clapack.h")
 
 have_func("cblas_dgemm", "cblas.h")
 
+# Used to let other Ruby threads run during long computations.
+have_header("ruby/thread.h")
+have_func("rb_thread_call_without_gvl", "ruby/thread.h")
+
 # Order matters here: ATLAS has to go after LAPACK: http://mail.scipy.org/pipermail/scipy-user/2007-January/010717.html
 $libs += " -llapack -lcblas -latlas "
 
-$objs = %w{nmatrix ruby_constants data/data util/io util/math util/sl_list storage/common storage/storage storage/dense storage/yale storage/list}.map { |i| i + ".o" }
+$objs = %w{nmatrix ruby_constants data/data util/io util/math util/simd util/thread_pool util/sl_list storage/common storage/storage storage/dense storage/yale storage/yale_factor storage/list storage/bsr}.map { |i| i + ".o" }
 
 #CONFIG['CXX'] = 'clang++'
 CONFIG['CXX'] = 'g++'
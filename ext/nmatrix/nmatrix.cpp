@@ -49,6 +49,8 @@ extern "C" {
 #include "data/data.h"
 #include "util/math.h"
 #include "util/io.h"
+#include "util/simd.h"
+#include "util/thread_pool.h"
 #include "storage/storage.h"
 
 #include "nmatrix.h"
@@ -343,6 +345,16 @@ static VALUE nm_stype(VALUE self);
 static VALUE nm_dim(VALUE self);
 static VALUE nm_shape(VALUE self);
 static VALUE nm_capacity(VALUE self);
+static VALUE nm_gap(int argc, VALUE* argv, VALUE self);
+static VALUE nm_is_gapped(VALUE self);
+static VALUE nm_compact(VALUE self);
+static VALUE nm_shrink_to_fit(VALUE self);
+static VALUE nm_reserve(VALUE self, VALUE ndnz);
+static VALUE nm_pack_symmetric(int argc, VALUE* argv, VALUE self);
+static VALUE nm_unpack_symmetric(VALUE self);
+static VALUE nm_packed_symmetry(VALUE self);
+static VALUE nm_to_bsr(int argc, VALUE* argv, VALUE self);
+static VALUE nm_block_shape(VALUE self);
 static VALUE nm_each(VALUE nmatrix);
 static VALUE nm_each_stored_with_indices(VALUE nmatrix);
 
@@ -370,6 +382,20 @@ static VALUE nm_ew_##name(VALUE left_val, VALUE right_val) {  \
  */
 #define DECL_ELEMENTWISE_RUBY_ACCESSOR(name)    static VALUE nm_ew_##name(VALUE left_val, VALUE right_val);
 
+/*
+ * Macro defines an in-place element-wise accessor function for some operation (e.g., add! for addition).
+ */
+#define DEF_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(oper, name)             \
+static VALUE nm_ew_##name##_bang(VALUE left_val, VALUE right_val) {   \
+  return elementwise_op_in_place(nm::EW_##oper, left_val, right_val); \
+}
+
+#define DECL_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(name)    static VALUE nm_ew_##name##_bang(VALUE left_val, VALUE right_val);
+
+DECL_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(add)
+DECL_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(subtract)
+DECL_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(multiply)
+DECL_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(divide)
 DECL_ELEMENTWISE_RUBY_ACCESSOR(add)
 DECL_ELEMENTWISE_RUBY_ACCESSOR(subtract)
 DECL_ELEMENTWISE_RUBY_ACCESSOR(multiply)
@@ -382,18 +408,28 @@ DECL_ELEMENTWISE_RUBY_ACCESSOR(leq)
 DECL_ELEMENTWISE_RUBY_ACCESSOR(geq)
 
 static VALUE elementwise_op(nm::ewop_t op, VALUE left_val, VALUE right_val);
+static VALUE elementwise_op_in_place(nm::ewop_t op, VALUE left_val, VALUE right_val);
 
 static VALUE nm_symmetric(VALUE self);
 static VALUE nm_hermitian(VALUE self);
 
 static VALUE nm_eqeq(VALUE left, VALUE right);
 
+STORAGE_PAIR binary_storage_cast_alloc(NMATRIX* left_matrix, NMATRIX* right_matrix);
 static VALUE matrix_multiply_scalar(NMATRIX* left, VALUE scalar);
 static VALUE matrix_multiply(NMATRIX* left, NMATRIX* right);
 static VALUE nm_multiply(VALUE left_v, VALUE right_v);
+static VALUE nm_transpose_multiply(VALUE left_v, VALUE right_v);
+static VALUE nm_solve_triangular(int argc, VALUE* argv, VALUE self);
+static VALUE yale_dense_multiply(NMATRIX* left, NMATRIX* right, bool transposed);
+static VALUE bsr_dense_multiply(NMATRIX* left, NMATRIX* right);
+static VALUE nm_batch_dot(VALUE left_v, VALUE right_v);
 static VALUE nm_factorize_lu(VALUE self);
+static VALUE yale_factorize_lu(VALUE self);
+static VALUE nm_factorize_cholesky(VALUE self);
 static VALUE nm_det_exact(VALUE self);
 static VALUE nm_complex_conjugate_bang(VALUE self);
+static VALUE nm_reduce(VALUE self, VALUE op_sym, VALUE dimen);
 
 static nm::dtype_t	interpret_dtype(int argc, VALUE* argv, nm::stype_t stype);
 static void*		interpret_initial_value(VALUE arg, nm::dtype_t dtype);
@@ -403,6 +439,14 @@ static nm::stype_t	interpret_stype(VALUE arg);
 /* Singleton methods */
 static VALUE nm_itype_by_shape(VALUE self, VALUE shape_arg);
 static VALUE nm_upcast(VALUE self, VALUE t1, VALUE t2);
+static VALUE nm_simd_isa(VALUE self);
+static VALUE nm_set_simd_isa(VALUE self, VALUE isa);
+static VALUE nm_num_threads(VALUE self);
+static VALUE nm_set_num_threads(VALUE self, VALUE n);
+static VALUE nm_parallel_threshold(VALUE self);
+static VALUE nm_set_parallel_threshold(VALUE self, VALUE n);
+static VALUE nm_ew_fused(VALUE self, VALUE program);
+static VALUE nm_from_coo(VALUE self, VALUE shape, VALUE rows, VALUE cols, VALUE vals, VALUE dtype);
 
 
 #ifdef BENCHMARK
@@ -445,6 +489,14 @@ void Init_nmatrix() {
 
 	rb_define_singleton_method(cNMatrix, "upcast", (METHOD)nm_upcast, 2);
 	rb_define_singleton_method(cNMatrix, "itype_by_shape", (METHOD)nm_itype_by_shape, 1);
+	rb_define_singleton_method(cNMatrix, "simd_isa", (METHOD)nm_simd_isa, 0);
+	rb_define_singleton_method(cNMatrix, "simd_isa=", (METHOD)nm_set_simd_isa, 1);
+	rb_define_singleton_method(cNMatrix, "num_threads", (METHOD)nm_num_threads, 0);
+	rb_define_singleton_method(cNMatrix, "num_threads=", (METHOD)nm_set_num_threads, 1);
+	rb_define_singleton_method(cNMatrix, "parallel_threshold", (METHOD)nm_parallel_threshold, 0);
+	rb_define_singleton_method(cNMatrix, "parallel_threshold=", (METHOD)nm_set_parallel_threshold, 1);
+	rb_define_singleton_method(cNMatrix, "__ew_fused__", (METHOD)nm_ew_fused, 1);
+	rb_define_singleton_method(cNMatrix, "__from_coo__", (METHOD)nm_from_coo, 5);
 
 	//////////////////////
 	// Instance Methods //
@@ -489,6 +541,11 @@ void Init_nmatrix() {
 	rb_define_method(cNMatrix, "/",			(METHOD)nm_ew_divide,		1);
   //rb_define_method(cNMatrix, "%",			(METHOD)nm_ew_mod,			1);
 
+	rb_define_method(cNMatrix, "add!", (METHOD)nm_ew_add_bang,      1);
+	rb_define_method(cNMatrix, "sub!", (METHOD)nm_ew_subtract_bang, 1);
+	rb_define_method(cNMatrix, "mul!", (METHOD)nm_ew_multiply_bang, 1);
+	rb_define_method(cNMatrix, "div!", (METHOD)nm_ew_divide_bang,   1);
+
 	rb_define_method(cNMatrix, "=~", (METHOD)nm_ew_eqeq, 1);
 	rb_define_method(cNMatrix, "!~", (METHOD)nm_ew_neq, 1);
 	rb_define_method(cNMatrix, "<=", (METHOD)nm_ew_leq, 1);
@@ -500,13 +557,28 @@ void Init_nmatrix() {
 	// Matrix Math Methods //
 	/////////////////////////
 	rb_define_method(cNMatrix, "dot",		(METHOD)nm_multiply,		1);
+	rb_define_method(cNMatrix, "transpose_dot", (METHOD)nm_transpose_multiply, 1);
+	rb_define_method(cNMatrix, "solve_triangular", (METHOD)nm_solve_triangular, -1);
+	rb_define_method(cNMatrix, "batch_dot", (METHOD)nm_batch_dot, 1);
 	rb_define_method(cNMatrix, "factorize_lu", (METHOD)nm_factorize_lu, 0);
+	rb_define_method(cNMatrix, "factorize_cholesky", (METHOD)nm_factorize_cholesky, 0);
+	rb_define_private_method(cNMatrix, "__reduce__", (METHOD)nm_reduce, 2);
 
 
 	rb_define_method(cNMatrix, "symmetric?", (METHOD)nm_symmetric, 0);
 	rb_define_method(cNMatrix, "hermitian?", (METHOD)nm_hermitian, 0);
 
 	rb_define_method(cNMatrix, "capacity", (METHOD)nm_capacity, 0);
+	rb_define_method(cNMatrix, "gap!", (METHOD)nm_gap, -1);
+	rb_define_method(cNMatrix, "gapped?", (METHOD)nm_is_gapped, 0);
+	rb_define_method(cNMatrix, "compact!", (METHOD)nm_compact, 0);
+	rb_define_method(cNMatrix, "shrink_to_fit", (METHOD)nm_shrink_to_fit, 0);
+	rb_define_method(cNMatrix, "reserve", (METHOD)nm_reserve, 1);
+	rb_define_method(cNMatrix, "pack_symmetric!", (METHOD)nm_pack_symmetric, -1);
+	rb_define_method(cNMatrix, "unpack_symmetric!", (METHOD)nm_unpack_symmetric, 0);
+	rb_define_method(cNMatrix, "packed_symmetry", (METHOD)nm_packed_symmetry, 0);
+	rb_define_method(cNMatrix, "to_bsr", (METHOD)nm_to_bsr, -1);
+	rb_define_method(cNMatrix, "block_shape", (METHOD)nm_block_shape, 0);
 	
 	/////////////
 	// Aliases //
@@ -533,6 +605,13 @@ void Init_nmatrix() {
 
 	nm_math_init_blas();
 
+	//////////////////////////
+	// SIMD kernel dispatch //
+	//////////////////////////
+
+	nm_simd_init();
+	nm_thread_pool_init();
+
 	///////////////
 	// IO module //
 	///////////////
@@ -579,6 +658,10 @@ static VALUE nm_capacity(VALUE self) {
     cap = UINT2NUM(nm_list_storage_count_elements( NM_STORAGE_LIST(self) ));
     break;
 
+  case nm::BSR_STORE:
+    cap = UINT2NUM(nm_bsr_storage_count_blocks(NM_STORAGE_BSR(self)) * NM_STORAGE_BSR(self)->block_shape[0] * NM_STORAGE_BSR(self)->block_shape[1]);
+    break;
+
   default:
     rb_raise(nm_eStorageTypeError, "unrecognized stype in nm_capacity()");
   }
@@ -586,6 +669,228 @@ static VALUE nm_capacity(VALUE self) {
   return cap;
 }
 
+/*
+ * call-seq:
+ *     gap!(slack = 4) -> self
+ *
+ * Leave room for slack more entries at the end of every row of a Yale matrix. Setting a new element then only
+ * moves the elements after it in the same row, rather than everything stored after it in the matrix, which makes
+ * building a matrix up one element at a time (e.g., adding edges to a graph) much cheaper. A row which runs out of
+ * room causes every row to be given more.
+ *
+ * Reading and setting single elements work on the gapped layout; anything else (slicing by copy, iteration,
+ * arithmetic, casting, ...) first takes the slack back out, as #compact! does. Not available for references.
+ */
+static VALUE nm_gap(int argc, VALUE* argv, VALUE self) {
+  VALUE slack;
+  rb_scan_args(argc, argv, "01", &slack);
+
+  if (NM_STYPE(self) != nm::YALE_STORE)
+    rb_raise(nm_eStorageTypeError, "only yale matrices can have gapped rows");
+
+  if (nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+    rb_raise(nm_eStorageTypeError, "cannot gap the rows of a yale reference");
+
+  long n = slack == Qnil ? NM_YALE_ROW_SLACK : FIX2LONG(slack);
+  if (n < 0) rb_raise(rb_eArgError, "slack must not be negative");
+
+  nm_yale_storage_gap(NM_STORAGE_YALE(self), n);
+  return self;
+}
+
+/*
+ * call-seq:
+ *     gapped? -> Boolean
+ *
+ * Whether the rows of a Yale matrix (or of the matrix a reference looks into) currently have slack in them. See
+ * #gap!.
+ */
+static VALUE nm_is_gapped(VALUE self) {
+  if (NM_STYPE(self) != nm::YALE_STORE) return Qfalse;
+  return nm_yale_storage_is_gapped(NM_STORAGE_YALE(self)) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *     compact! -> self
+ *
+ * Take the slack left by #gap! back out of the rows of a Yale matrix, so that its entries are contiguous again.
+ * Worth doing once before heavy math on a matrix that's finished being built. Does nothing to other matrices.
+ *
+ * This leaves the capacity as it is; see #shrink_to_fit.
+ */
+static VALUE nm_compact(VALUE self) {
+  if (NM_STYPE(self) == nm::YALE_STORE) nm_yale_storage_close_gaps(NM_STORAGE_YALE(self));
+  return self;
+}
+
+/*
+ * call-seq:
+ *     shrink_to_fit -> Integer
+ *
+ * Reallocate a Yale matrix to exactly the size it needs, without any spare capacity or gaps, and with the
+ * narrowest itype that can hold its indices (which may be narrower than #itype_by_shape would give). Returns the
+ * number of bytes freed. Other matrices are left alone, and give 0.
+ *
+ * The matrix can still be added to afterwards, but the first insertion has to reallocate it again, so this is meant
+ * for matrices which have finished being built.
+ */
+static VALUE nm_shrink_to_fit(VALUE self) {
+  if (NM_STYPE(self) != nm::YALE_STORE) return INT2FIX(0);
+
+  if (nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+    rb_raise(nm_eStorageTypeError, "cannot shrink a yale reference");
+
+  return SIZET2NUM(nm_yale_storage_shrink(NM_STORAGE_YALE(self)));
+}
+
+/*
+ * call-seq:
+ *     reserve(ndnz) -> self
+ *
+ * Make room in a Yale matrix for ndnz entries off the diagonal, so that setting that many elements doesn't have to
+ * reallocate it over and over. Never makes the capacity smaller.
+ */
+static VALUE nm_reserve(VALUE self, VALUE ndnz) {
+  if (NM_STYPE(self) != nm::YALE_STORE)
+    rb_raise(nm_eStorageTypeError, "only yale matrices can reserve space");
+
+  if (nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+    rb_raise(nm_eStorageTypeError, "cannot reserve space in a yale reference");
+
+  long n = NUM2LONG(ndnz);
+  if (n < 0) rb_raise(rb_eArgError, "ndnz must not be negative");
+
+  nm_yale_storage_reserve(NM_STORAGE_YALE(self), n);
+  return self;
+}
+
+/*
+ * call-seq:
+ *     pack_symmetric!(hermitian = false) -> self
+ *
+ * Store only the diagonal and upper triangle of a symmetric (or, with hermitian set, Hermitian) Yale matrix,
+ * roughly halving its size. Raises ArgumentError if it isn't symmetric. The capacity is left as it is; see
+ * #shrink_to_fit.
+ *
+ * The matrix still looks the same from outside: reading or setting an element below the diagonal goes to its mirror
+ * image, #each_stored_with_indices yields both, and multiplying by a dense matrix reads each stored entry once for
+ * both. Other operations (besides element-wise ones between matrices packed the same way, and slices centred on
+ * the diagonal, which stay packed) work on an unpacked copy. Not available for references.
+ */
+static VALUE nm_pack_symmetric(int argc, VALUE* argv, VALUE self) {
+  VALUE hermitian;
+  rb_scan_args(argc, argv, "01", &hermitian);
+
+  if (NM_STYPE(self) != nm::YALE_STORE)
+    rb_raise(nm_eStorageTypeError, "only yale matrices can be packed");
+
+  if (nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+    rb_raise(nm_eStorageTypeError, "cannot pack a yale reference");
+
+  if (NM_SHAPE0(self) != NM_SHAPE1(self))
+    rb_raise(rb_eArgError, "only a square matrix can be symmetric");
+
+  if (!nm_yale_storage_pack(NM_STORAGE_YALE(self), RTEST(hermitian)))
+    rb_raise(rb_eArgError, RTEST(hermitian) ? "matrix is not hermitian" : "matrix is not symmetric");
+
+  return self;
+}
+
+/*
+ * call-seq:
+ *     unpack_symmetric! -> self
+ *
+ * Store the lower triangle of a matrix packed by #pack_symmetric! again. Does nothing to other matrices.
+ */
+static VALUE nm_unpack_symmetric(VALUE self) {
+  if (NM_STYPE(self) == nm::YALE_STORE && !nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+    nm_yale_storage_unpack(NM_STORAGE_YALE(self));
+
+  return self;
+}
+
+/*
+ * call-seq:
+ *     packed_symmetry -> Symbol or nil
+ *
+ * :symmetric or :hermitian if #pack_symmetric! has left only the upper triangle of this matrix stored, and nil
+ * otherwise (including for references).
+ */
+static VALUE nm_packed_symmetry(VALUE self) {
+  if (NM_STYPE(self) != nm::YALE_STORE) return Qnil;
+
+  switch (NM_STORAGE_YALE(self)->symm) {
+  case nm::SYMM: return ID2SYM(rb_intern("symmetric"));
+  case nm::HERM: return ID2SYM(rb_intern("hermitian"));
+  default:       return Qnil;
+  }
+}
+
+/*
+ * call-seq:
+ *     to_bsr(block_shape = nil, dtype = self.dtype) -> NMatrix
+ *
+ * Copy a 2D matrix into block-CSR (:bsr) storage, which keeps each block_shape block with a non-zero in it whole, with
+ * one index for the lot. block_shape is [rows, cols], or a single number for square blocks. Left out, it's the largest
+ * square block which doesn't pad the stored values out by more than a fifth with zeros, as for cast(:bsr, dtype).
+ *
+ * Meant for matrices whose non-zeros come in small dense blocks (several unknowns per node of a mesh, say), where it
+ * makes #dot with a dense matrix or vector faster than yale. Otherwise, a bsr matrix can only be read element by
+ * element, compared, transposed, and cast back.
+ */
+static VALUE nm_to_bsr(int argc, VALUE* argv, VALUE self) {
+  VALUE block_shape_v, dtype_v;
+  rb_scan_args(argc, argv, "02", &block_shape_v, &dtype_v);
+
+  NMATRIX* m;
+  UnwrapNMatrix(self, m);
+
+  if (m->storage->dim != 2)
+    rb_raise(nm_eStorageTypeError, "can only convert matrices of dim 2 to bsr");
+
+  nm::dtype_t dtype = dtype_v == Qnil ? m->storage->dtype : nm_dtype_from_rbsymbol(dtype_v);
+  STYPE_CAST_COPY_TABLE(cast_copy);
+  STYPE_MARK_TABLE(mark);
+
+  NMATRIX* result = ALLOC(NMATRIX);
+  result->stype   = nm::BSR_STORE;
+
+  if (block_shape_v == Qnil) {
+    result->storage = cast_copy[nm::BSR_STORE][m->stype](m->storage, dtype);
+
+  } else {
+    size_t dim;
+    size_t* block_shape = interpret_shape(block_shape_v, &dim);
+
+    if (dim != 2 || block_shape[0] == 0 || block_shape[1] == 0) {
+      xfree(block_shape);
+      rb_raise(rb_eArgError, "block shape must be two positive numbers, or one for square blocks");
+    }
+
+    STORAGE* yale = m->stype == nm::YALE_STORE ? m->storage : cast_copy[nm::YALE_STORE][m->stype](m->storage, m->storage->dtype);
+    result->storage = nm_bsr_storage_from_yale_blocked(reinterpret_cast<YALE_STORAGE*>(yale), dtype, block_shape);
+
+    if (yale != m->storage) nm_yale_storage_delete(yale);
+    xfree(block_shape);
+  }
+
+  return Data_Wrap_Struct(CLASS_OF(self), mark[nm::BSR_STORE], nm_delete, result);
+}
+
+/*
+ * call-seq:
+ *     block_shape -> Array or nil
+ *
+ * The shape of the blocks of a :bsr matrix; nil for the other stypes.
+ */
+static VALUE nm_block_shape(VALUE self) {
+  if (NM_STYPE(self) != nm::BSR_STORE) return Qnil;
+
+  const BSR_STORAGE* s = NM_STORAGE_BSR(self);
+  return rb_ary_new3(2, SIZET2NUM(s->block_shape[0]), SIZET2NUM(s->block_shape[1]));
+}
+
 /*
  * Destructor.
  */
@@ -593,7 +898,8 @@ static void nm_delete(NMATRIX* mat) {
   static void (*ttable[nm::NUM_STYPES])(STORAGE*) = {
     nm_dense_storage_delete,
     nm_list_storage_delete,
-    nm_yale_storage_delete
+    nm_yale_storage_delete,
+    nm_bsr_storage_delete
   };
   ttable[mat->stype](mat->storage);
 }
@@ -605,7 +911,8 @@ static void nm_delete_ref(NMATRIX* mat) {
   static void (*ttable[nm::NUM_STYPES])(STORAGE*) = {
     nm_dense_storage_delete_ref,
     nm_list_storage_delete_ref, 
-    nm_yale_storage_delete
+    nm_yale_storage_delete_ref,
+    nm_bsr_storage_delete       // never a reference
   };
   ttable[mat->stype](mat->storage);
 }
@@ -669,6 +976,90 @@ static VALUE nm_upcast(VALUE self, VALUE t1, VALUE t2) {
 
 
 
+/*
+ * call-seq:
+ *     simd_isa -> Symbol
+ *
+ * Instruction set used by the vectorized element-wise kernels: :avx512, :avx2, :sse2, or :none.
+ * The widest one supported by the CPU is chosen when NMatrix is loaded.
+ */
+static VALUE nm_simd_isa(VALUE self) {
+  return ID2SYM(rb_intern(nm::simd::ISA_NAMES[nm::simd::current_isa()]));
+}
+
+/*
+ * call-seq:
+ *     simd_isa = Symbol
+ *
+ * Restrict the vectorized element-wise kernels to a narrower instruction set (or turn them off
+ * with :none). Mostly useful for benchmarking. Raises an ArgumentError if the CPU doesn't support
+ * the requested instruction set.
+ */
+static VALUE nm_set_simd_isa(VALUE self, VALUE isa) {
+  Check_Type(isa, T_SYMBOL);
+  const char* name = rb_id2name(SYM2ID(isa));
+
+  for (int i = 0; i < nm::simd::NUM_ISAS; ++i) {
+    if (strcmp(name, nm::simd::ISA_NAMES[i]) == 0) {
+      if (i > nm::simd::max_isa())
+        rb_raise(rb_eArgError, "instruction set %s is not supported on this CPU", name);
+
+      nm::simd::select_isa(static_cast<nm::simd::isa_t>(i));
+      return isa;
+    }
+  }
+
+  rb_raise(rb_eArgError, "unrecognized instruction set %s", name);
+  return Qnil;
+}
+
+/*
+ * call-seq:
+ *     num_threads -> Fixnum
+ *
+ * Number of threads the large dense operations are split across. Defaults to the number of cores.
+ */
+static VALUE nm_num_threads(VALUE self) {
+  return SIZET2NUM(nm::thread_pool::num_threads());
+}
+
+/*
+ * call-seq:
+ *     num_threads = Fixnum
+ *
+ * Set the number of threads used by the large dense operations. For a given number of threads, results
+ * are always the same from run to run.
+ */
+static VALUE nm_set_num_threads(VALUE self, VALUE n) {
+  long threads = NUM2LONG(n);
+  if (threads < 1) rb_raise(rb_eArgError, "need at least one thread");
+
+  nm::thread_pool::set_num_threads(threads);
+  return n;
+}
+
+/*
+ * call-seq:
+ *     parallel_threshold -> Fixnum
+ *
+ * Operations smaller than this (roughly, in elements touched) run on the calling thread without releasing
+ * the GVL, since for them the overhead would outweigh the gain.
+ */
+static VALUE nm_parallel_threshold(VALUE self) {
+  return SIZET2NUM(nm::thread_pool::threshold());
+}
+
+/*
+ * call-seq:
+ *     parallel_threshold = Fixnum
+ *
+ * Set the size below which operations stay on the calling thread.
+ */
+static VALUE nm_set_parallel_threshold(VALUE self, VALUE n) {
+  nm::thread_pool::set_threshold(NUM2SIZET(n));
+  return n;
+}
+
 /*
  * call-seq:
  *     each -> Enumerator
@@ -683,8 +1074,12 @@ static VALUE nm_each(VALUE nmatrix) {
   switch(NM_STYPE(nm)) {
   case nm::DENSE_STORE:
     return nm_dense_each(nm);
+  case nm::YALE_STORE:
+    return nm_yale_each(nm);
+  case nm::BSR_STORE:
+    rb_raise(rb_eNotImpError, "please cast to yale first");
   default:
-    rb_raise(rb_eNotImpError, "only dense matrix's each method works right now");
+    rb_raise(rb_eNotImpError, "only dense and yale matrices' each methods work right now");
   }
 }
 
@@ -703,6 +1098,8 @@ static VALUE nm_each_stored_with_indices(VALUE nmatrix) {
     return nm_dense_each_with_indices(nm);
   case nm::LIST_STORE:
     return nm_list_each_stored_with_indices(nm);
+  case nm::BSR_STORE:
+    rb_raise(rb_eNotImpError, "please cast to yale first");
   default:
     rb_raise(nm_eDataTypeError, "Not a proper storage type");
   }
@@ -742,6 +1139,9 @@ static VALUE nm_eqeq(VALUE left, VALUE right) {
   case nm::YALE_STORE:
     result = nm_yale_storage_eqeq(l->storage, r->storage);
     break;
+  case nm::BSR_STORE:
+    result = nm_bsr_storage_eqeq(l->storage, r->storage);
+    break;
   }
 
   return result ? Qtrue : Qfalse;
@@ -752,6 +1152,10 @@ DEF_ELEMENTWISE_RUBY_ACCESSOR(SUB, subtract)
 DEF_ELEMENTWISE_RUBY_ACCESSOR(MUL, multiply)
 DEF_ELEMENTWISE_RUBY_ACCESSOR(DIV, divide)
 //DEF_ELEMENTWISE_RUBY_ACCESSOR(MOD, mod)
+DEF_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(ADD, add)
+DEF_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(SUB, subtract)
+DEF_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(MUL, multiply)
+DEF_ELEMENTWISE_IN_PLACE_RUBY_ACCESSOR(DIV, divide)
 DEF_ELEMENTWISE_RUBY_ACCESSOR(EQEQ, eqeq)
 DEF_ELEMENTWISE_RUBY_ACCESSOR(NEQ, neq)
 DEF_ELEMENTWISE_RUBY_ACCESSOR(LEQ, leq)
@@ -796,6 +1200,9 @@ static VALUE nm_complex_conjugate_bang(VALUE self) {
 
   } else if (m->stype == nm::YALE_STORE) {
 
+    if (nm_yale_storage_is_ref(NM_STORAGE_YALE(self)))
+      rb_raise(nm_eStorageTypeError, "cannot conjugate a yale reference in place; use #dup first");
+
     size = nm_yale_storage_get_size(NM_STORAGE_YALE(self));
     elem = NM_STORAGE_YALE(self)->a;
 
@@ -908,6 +1315,9 @@ static VALUE nm_init(int argc, VALUE* argv, VALUE nm) {
     offset = 1;
   }
 
+  if (stype == nm::BSR_STORE)
+    rb_raise(nm_eStorageTypeError, "bsr matrices are built from other matrices; use #to_bsr or #cast");
+
   // If there are 7 arguments and Yale, refer to a different init function with fewer sanity checks.
   if (argc == 7) {
   	if (stype == nm::YALE_STORE) {
@@ -1036,7 +1446,8 @@ static VALUE nm_init_transposed(VALUE self) {
   static STORAGE* (*storage_copy_transposed[nm::NUM_STYPES])(const STORAGE* rhs_base) = {
     nm_dense_storage_copy_transposed,
     nm_list_storage_copy_transposed,
-    nm_yale_storage_copy_transposed
+    nm_yale_storage_copy_transposed,
+    nm_bsr_storage_copy_transposed
   };
 
   NMATRIX* lhs = nm_create( NM_STYPE(self),
@@ -1177,7 +1588,6 @@ static VALUE nm_write(int argc, VALUE* argv, VALUE self) {
   UnwrapNMatrix( self, nmatrix );
 
   nm::symm_t symm_ = interpret_symm(symm);
-  nm::itype_t itype = (nmatrix->stype == nm::YALE_STORE) ? reinterpret_cast<YALE_STORAGE*>(nmatrix->storage)->itype : nm::UINT32;
 
   if (nmatrix->storage->dtype == nm::RUBYOBJ) {
     rb_raise(rb_eNotImpError, "Ruby Object writing is not implemented yet");
@@ -1186,12 +1596,12 @@ static VALUE nm_write(int argc, VALUE* argv, VALUE self) {
   // Get the dtype, stype, itype, and symm and ensure they're the correct number of bytes.
   uint8_t st = static_cast<uint8_t>(nmatrix->stype),
           dt = static_cast<uint8_t>(nmatrix->storage->dtype),
-          sm = static_cast<uint8_t>(symm_),
-          it = static_cast<uint8_t>(itype);
+          sm = static_cast<uint8_t>(symm_);
   uint16_t dim = nmatrix->storage->dim;
 
   // Check arguments before starting to write.
   if (nmatrix->stype == nm::LIST_STORE) rb_raise(nm_eStorageTypeError, "cannot save list matrix; cast to yale or dense first");
+  if (nmatrix->stype == nm::BSR_STORE)  rb_raise(nm_eStorageTypeError, "cannot save bsr matrix; cast to yale or dense first");
   if (symm_ != nm::NONSYMM) {
     if (dim != 2) rb_raise(rb_eArgError, "symmetry/triangularity not defined for a non-2D matrix");
     if (nmatrix->storage->shape[0] != nmatrix->storage->shape[1])
@@ -1201,6 +1611,11 @@ static VALUE nm_write(int argc, VALUE* argv, VALUE self) {
       rb_raise(rb_eArgError, "cannot save a non-complex matrix as hermitian");
   }
 
+  // A yale reference or packed matrix is written out from a plain copy, whose itype may be wider.
+  YALE_STORAGE* ys    = nmatrix->stype == nm::YALE_STORE ? nm_yale_storage_copy_if_ref(reinterpret_cast<YALE_STORAGE*>(nmatrix->storage)) : NULL;
+  nm::itype_t   itype = ys ? ys->itype : nm::UINT32;
+  uint8_t       it    = static_cast<uint8_t>(itype);
+
   ofstream f(RSTRING_PTR(file), std::ios::out | std::ios::binary);
 
   // Get the NMatrix version information.
@@ -1227,13 +1642,15 @@ static VALUE nm_write(int argc, VALUE* argv, VALUE self) {
   if (nmatrix->stype == nm::DENSE_STORE) {
     write_padded_dense_elements(f, reinterpret_cast<DENSE_STORAGE*>(nmatrix->storage), symm_, nmatrix->storage->dtype);
   } else if (nmatrix->stype == nm::YALE_STORE) {
-    YALE_STORAGE* s = reinterpret_cast<YALE_STORAGE*>(nmatrix->storage);
+    YALE_STORAGE* s = ys;
     uint32_t ndnz   = s->ndnz,
              length = nm_yale_storage_get_size(s);
     f.write(reinterpret_cast<const char*>(&ndnz),   sizeof(uint32_t));
     f.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
 
     write_padded_yale_elements(f, s, length, symm_, s->dtype, itype);
+
+    if (s != nmatrix->storage) nm_yale_storage_delete(s);
   }
 
   f.close();
@@ -1319,9 +1736,15 @@ static VALUE nm_read(int argc, VALUE* argv, VALUE self) {
     f.read(reinterpret_cast<char*>(&ndnz),     sizeof(uint32_t));
     f.read(reinterpret_cast<char*>(&length),   sizeof(uint32_t));
 
-    s = nm_yale_storage_create(dtype, shape, dim, length, itype); // set length as init capacity
+    if (dim != 2) rb_raise(rb_eNotImpError, "Can only support 2D matrices");
 
-    read_padded_yale_elements(f, reinterpret_cast<YALE_STORAGE*>(s), length, symm, dtype, itype);
+    // IJA was written in the matrix's own itype, which may be narrower than its shape calls for (see shrink_to_fit),
+    // so it has to be read back into exactly that itype.
+    YALE_STORAGE* ys = nm_yale_storage_create_with_itype(dtype, shape, length, itype); // set length as init capacity
+
+    read_padded_yale_elements(f, ys, length, symm, dtype, itype);
+    ys->ndnz = ndnz;
+    s = reinterpret_cast<STORAGE*>(ys);
   } else {
     rb_raise(nm_eStorageTypeError, "please convert to yale or dense before saving");
   }
@@ -1366,11 +1789,260 @@ static VALUE nm_init_yale_from_old_yale(VALUE shape, VALUE dtype, VALUE ia, VALU
   return nm;
 }
 
+/*
+ * Like elementwise_op, but stores the result in left_val's own storage (through to its source, if left_val is a
+ * reference) rather than allocating a new matrix. Returns left_val.
+ *
+ * Only the arithmetic operations can be done in place. Raises a DataTypeError if the result wouldn't fit in the
+ * left-hand dtype, e.g. int32.add!(float64).
+ */
+static VALUE elementwise_op_in_place(nm::ewop_t op, VALUE left_val, VALUE right_val) {
+	static void (*ew_op[nm::NUM_STYPES])(nm::ewop_t, STORAGE*, const STORAGE*, VALUE scalar) = {
+		nm_dense_storage_ew_op_in_place,
+		nm_list_storage_ew_op_in_place,
+		nm_yale_storage_ew_op_in_place,
+		nm_bsr_storage_ew_op_in_place
+	};
+
+	NMATRIX *left, *right = NULL;
+	nm::dtype_t r_dtype;
+
+	CheckNMatrixType(left_val);
+	UnwrapNMatrix(left_val, left);
+
+  if (TYPE(right_val) != T_DATA || (RDATA(right_val)->dfree != (RUBY_DATA_FUNC)nm_delete && RDATA(right_val)->dfree != (RUBY_DATA_FUNC)nm_delete_ref)) {
+    r_dtype = nm_dtype_guess_for(right_val, left->storage->dtype);
+
+  } else {
+    UnwrapNMatrix(right_val, right);
+
+    if (left->stype != right->stype) {
+      rb_raise(rb_eArgError, "Element-wise operations are not currently supported between matrices with differing stypes.");
+    }
+
+    // Dense storage checks the shapes itself, since it can broadcast right to the shape of left.
+    if (left->stype != nm::DENSE_STORE) {
+      if (NM_DIM(left_val) != NM_DIM(right_val)) {
+        rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same dimensionality.");
+      }
+
+      if (memcmp(&NM_SHAPE(left_val, 0), &NM_SHAPE(right_val, 0), sizeof(size_t) * NM_DIM(left_val)) != 0) {
+        rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same shape.");
+      }
+    }
+
+    r_dtype = right->storage->dtype;
+  }
+
+  nm::dtype_t l_dtype = left->storage->dtype;
+  if (Upcast[l_dtype][r_dtype] != l_dtype) {
+    rb_raise(nm_eDataTypeError, "in-place operation would need to upcast %s to %s; use the non-destructive operator instead",
+             DTYPE_NAMES[l_dtype], DTYPE_NAMES[Upcast[l_dtype][r_dtype]]);
+  }
+
+  ew_op[left->stype](op, left->storage, right ? right->storage : NULL, right_val);
+
+  return left_val;
+}
+
+/*
+ * call-seq:
+ *     __ew_fused__(program) -> NMatrix or nil
+ *
+ * Evaluates a postfix element-wise expression (built by NMatrix::Lazy) in a single pass. program is an
+ * Array of NMatrix operands, Numeric scalars, and the operator Symbols :+, :-, :*, and :/.
+ *
+ * Returns nil if the expression can't be fused without changing its result -- i.e., unless every matrix is
+ * dense and of the same dtype and shape, and every scalar fits that dtype -- in which case the caller should
+ * evaluate it one operation at a time.
+ */
+static VALUE nm_ew_fused(VALUE self, VALUE program) {
+  Check_Type(program, T_ARRAY);
+
+  size_t length = RARRAY_LEN(program);
+  if (length < 3) return Qnil;
+
+  nm::dense_storage::fused_instr_t* instrs = ALLOCA_N(nm::dense_storage::fused_instr_t, length);
+  DENSE_STORAGE** leaves  = ALLOCA_N(DENSE_STORAGE*, length);
+  bool*           scalar  = ALLOCA_N(bool, length); // whether each operand stack entry is a bare scalar
+  VALUE*          scalars = ALLOCA_N(VALUE, length);
+
+  size_t n_leaves = 0, n_scalars = 0, sp = 0;
+
+  for (size_t i = 0; i < length; ++i) {
+    VALUE item = rb_ary_entry(program, i);
+
+    if (SYMBOL_P(item)) {
+      const char* name = rb_id2name(SYM2ID(item));
+
+      if      (strcmp(name, "+") == 0) instrs[i].op = nm::EW_ADD;
+      else if (strcmp(name, "-") == 0) instrs[i].op = nm::EW_SUB;
+      else if (strcmp(name, "*") == 0) instrs[i].op = nm::EW_MUL;
+      else if (strcmp(name, "/") == 0) instrs[i].op = nm::EW_DIV;
+      else return Qnil;
+
+      if (sp < 2 || scalar[sp-2]) return Qnil;
+
+      instrs[i].kind  = nm::dense_storage::FUSED_OP;
+      instrs[i].index = 0;
+      scalar[--sp - 1] = false;
+
+    } else if (TYPE(item) == T_DATA && (RDATA(item)->dfree == (RUBY_DATA_FUNC)nm_delete || RDATA(item)->dfree == (RUBY_DATA_FUNC)nm_delete_ref)) {
+      if (NM_STYPE(item) != nm::DENSE_STORE) return Qnil;
+
+      DENSE_STORAGE* s = NM_STORAGE_DENSE(item);
+
+      if (n_leaves > 0) {
+        if (s->dtype != leaves[0]->dtype) return Qnil;
+
+        // Operands of different shapes are left to the eager operators, which broadcast them (or raise).
+        if (s->dim != leaves[0]->dim || memcmp(s->shape, leaves[0]->shape, sizeof(size_t) * s->dim) != 0) return Qnil;
+      }
+
+      instrs[i].kind  = nm::dense_storage::FUSED_LEAF;
+      instrs[i].index = n_leaves;
+      leaves[n_leaves++] = s;
+      scalar[sp++] = false;
+
+    } else {
+      instrs[i].kind  = nm::dense_storage::FUSED_SCALAR;
+      instrs[i].index = n_scalars;
+      scalars[n_scalars++] = item;
+      scalar[sp++] = true;
+    }
+  }
+
+  if (sp != 1 || n_leaves == 0 || instrs[length-1].kind != nm::dense_storage::FUSED_OP) return Qnil;
+
+  nm::dtype_t dtype = leaves[0]->dtype;
+  char* packed = ALLOCA_N(char, DTYPE_SIZES[dtype] * (n_scalars + 1));
+
+  // An integer scalar can also be converted to a floating point dtype up front, since the non-fused operation
+  // would have converted it anyway.
+  for (size_t k = 0; k < n_scalars; ++k) {
+    nm::dtype_t guess = nm_dtype_guess_for(scalars[k], dtype);
+    bool int_to_float = (dtype == nm::FLOAT32 || dtype == nm::FLOAT64) && guess <= nm::INT64;
+    if (guess != dtype && !int_to_float) return Qnil;
+    rubyval_to_cval(scalars[k], dtype, packed + k * DTYPE_SIZES[dtype]);
+  }
+
+  NMATRIX* result = ALLOC(NMATRIX);
+  result->stype   = nm::DENSE_STORE;
+  result->storage = nm_dense_storage_ew_fused(instrs, length, leaves, packed);
+
+  return Data_Wrap_Struct(CLASS_OF(rb_ary_entry(program, 0)), nm_dense_storage_mark, nm_delete, result);
+}
+
+/*
+ * One of the vectors given to __from_coo__: a pair of a packed binary String and its dtype, or a dense NMatrix which
+ * isn't a reference. Returns a pointer to its elements, and sets length and dtype.
+ */
+static const void* coo_operand(VALUE operand, size_t* length, nm::dtype_t* dtype) {
+  if (TYPE(operand) == T_ARRAY && RARRAY_LEN(operand) == 2 && TYPE(rb_ary_entry(operand, 0)) == T_STRING) {
+    VALUE str = rb_ary_entry(operand, 0);
+    *dtype  = nm_dtype_from_rbsymbol(rb_ary_entry(operand, 1));
+    *length = RSTRING_LEN(str) / DTYPE_SIZES[*dtype];
+    return RSTRING_PTR(str);
+  }
+
+  CheckNMatrixType(operand);
+  if (NM_STYPE(operand) != nm::DENSE_STORE || NM_DENSE_SRC(operand) != NM_STORAGE(operand))
+    rb_raise(nm_eStorageTypeError, "expected a dense matrix which isn't a reference");
+
+  *dtype  = NM_DTYPE(operand);
+  *length = nm_storage_count_max_elements(NM_STORAGE(operand));
+  return NM_STORAGE_DENSE(operand)->elements;
+}
+
+/*
+ * call-seq:
+ *     __from_coo__(shape, rows, cols, values, dtype) -> NMatrix
+ *
+ * Builds a yale matrix of the given shape and dtype from coordinate (COO) triplets. Each of rows, cols and
+ * values is either a dense NMatrix, or a packed binary String paired with its dtype, as in [str, :int32]. Indices
+ * may be of any integer dtype. Duplicate cells are summed. See NMatrix.from_coo.
+ */
+static VALUE nm_from_coo(VALUE self, VALUE shape, VALUE rows, VALUE cols, VALUE vals, VALUE dtype) {
+  size_t       n_rows, n_cols, n_vals, dim = 2;
+  nm::dtype_t  rows_dtype, cols_dtype, vals_dtype;
+
+  const void* rows_ = coo_operand(rows, &n_rows, &rows_dtype);
+  const void* cols_ = coo_operand(cols, &n_cols, &cols_dtype);
+  const void* vals_ = coo_operand(vals, &n_vals, &vals_dtype);
+
+  if (n_rows != n_cols || n_rows != n_vals)
+    rb_raise(rb_eArgError, "rows, cols and values must have the same length (got %lu, %lu and %lu)", n_rows, n_cols, n_vals);
+
+  if (rows_dtype > nm::INT64 || cols_dtype > nm::INT64)
+    rb_raise(nm_eDataTypeError, "row and column indices must be of an integer dtype");
+
+  nm::dtype_t dtype_ = nm_dtype_from_rbsymbol(dtype);
+  size_t*     shape_ = interpret_shape(shape, &dim);
+  if (dim != 2) {
+    xfree(shape_);
+    rb_raise(rb_eArgError, "yale matrices must be two-dimensional");
+  }
+
+  YALE_STORAGE* s = nm_yale_storage_create_from_coo(dtype_, shape_, n_rows, rows_, rows_dtype, cols_, cols_dtype, vals_, vals_dtype);
+  if (!s) {
+    size_t m = shape_[0], n = shape_[1];
+    xfree(shape_);
+    rb_raise(rb_eRangeError, "row or column index out of range for a %lux%lu matrix", m, n);
+  }
+
+  NMATRIX* result = nm_create(nm::YALE_STORE, reinterpret_cast<STORAGE*>(s));
+  return Data_Wrap_Struct(cNMatrix, nm_yale_storage_mark, nm_delete, result);
+}
+
+/*
+ * call-seq:
+ *     __reduce__(op, dimen) -> NMatrix or nil
+ *
+ * Native reduction along dimension dimen, where op is one of :sum, :prod, :min, :max, :mean, :variance or :std.
+ * The result is a :float64 dense matrix with the same shape as self except that dimension dimen has length 1.
+ *
+ * Returns nil when there's no native version (complex matrices and list references), in which case the caller
+ * falls back on reduce_along_dim.
+ */
+static VALUE nm_reduce(VALUE self, VALUE op_sym, VALUE dimen) {
+  static STORAGE* (*reduce[nm::NUM_STYPES])(nm::reduce_t, const STORAGE*, size_t) = {
+    nm_dense_storage_reduce,
+    nm_list_storage_reduce,
+    nm_yale_storage_reduce,
+    nm_bsr_storage_reduce
+  };
+
+  Check_Type(op_sym, T_SYMBOL);
+
+  const char* name = rb_id2name(SYM2ID(op_sym));
+  int op = 0;
+  while (op < nm::NUM_REDUCE_OPS && strcmp(name, nm::REDUCE_NAMES[op])) ++op;
+
+  if (op == nm::NUM_REDUCE_OPS)
+    rb_raise(rb_eArgError, "unknown reduction %s", name);
+
+  NMATRIX* nm;
+  UnwrapNMatrix(self, nm);
+
+  long dim = FIX2LONG(dimen);
+  if (dim < 0 || dim >= (long)(nm->storage->dim))
+    rb_raise(rb_eArgError, "requested dimension (%ld) does not exist (shape: %s)", dim,
+             RSTRING_PTR(rb_inspect(nm_shape(self))));
+
+  STORAGE* s = reduce[nm->stype](static_cast<nm::reduce_t>(op), nm->storage, dim);
+  if (!s) return Qnil;
+
+  NMATRIX* result = ALLOC(NMATRIX);
+  result->stype   = nm::DENSE_STORE;
+  result->storage = s;
+
+  return Data_Wrap_Struct(CLASS_OF(self), nm_dense_storage_mark, nm_delete, result);
+}
+
 /*
  * Check to determine whether matrix is a reference to another matrix.
  */
 static VALUE nm_is_ref(VALUE self) {
-	// Refs only allowed for dense and list matrices.
   if (NM_STYPE(self) == nm::DENSE_STORE) {
     return (NM_DENSE_SRC(self) == NM_STORAGE(self)) ? Qfalse : Qtrue;
   }
@@ -1379,7 +2051,7 @@ static VALUE nm_is_ref(VALUE self) {
     return (NM_LIST_SRC(self) == NM_STORAGE(self)) ? Qfalse : Qtrue;
   }
 
-  return Qfalse;
+  return (NM_YALE_SRC(self) == NM_STORAGE(self)) ? Qfalse : Qtrue;
 }
 
 /*
@@ -1396,7 +2068,8 @@ static VALUE nm_mget(int argc, VALUE* argv, VALUE self) {
   static void* (*ttable[nm::NUM_STYPES])(STORAGE*, SLICE*) = {
     nm_dense_storage_get,
     nm_list_storage_get,
-    nm_yale_storage_get
+    nm_yale_storage_get,
+    nm_bsr_storage_get
   };
   
   return nm_xslice(argc, argv, ttable[NM_STYPE(self)], nm_delete, self);
@@ -1416,7 +2089,8 @@ static VALUE nm_mref(int argc, VALUE* argv, VALUE self) {
   static void* (*ttable[nm::NUM_STYPES])(STORAGE*, SLICE*) = {
     nm_dense_storage_ref,
     nm_list_storage_ref,
-    nm_yale_storage_ref
+    nm_yale_storage_ref,
+    nm_bsr_storage_ref
   };
   return nm_xslice(argc, argv, ttable[NM_STYPE(self)], nm_delete_ref, self);
 }
@@ -1461,6 +2135,10 @@ static VALUE nm_mset(int argc, VALUE* argv, VALUE self) {
     case nm::YALE_STORE:
       nm_yale_storage_set(NM_STORAGE(self), slice, value);
       break;
+    case nm::BSR_STORE:
+      free(value);
+      free(slice);
+      rb_raise(nm_eStorageTypeError, "bsr matrices can't be modified; cast to yale first");
     }
 
     return argv[dim];
@@ -1478,7 +2156,8 @@ static VALUE nm_mset(int argc, VALUE* argv, VALUE self) {
  *
  * For elementwise, use * instead.
  *
- * The two matrices must be of the same stype (for now). If dtype differs, an upcast will occur.
+ * The two matrices must be of the same stype (for now), except that a yale matrix can be multiplied by a dense one
+ * (e.g., an NVector), giving a dense result. If dtype differs, an upcast will occur.
  */
 static VALUE nm_multiply(VALUE left_v, VALUE right_v) {
   NMATRIX *left, *right;
@@ -1502,6 +2181,12 @@ static VALUE nm_multiply(VALUE left_v, VALUE right_v) {
     if (left->storage->shape[1] != right->storage->shape[0])
       rb_raise(rb_eArgError, "incompatible dimensions");
 
+    if (left->stype == nm::YALE_STORE && right->stype == nm::DENSE_STORE)
+      return yale_dense_multiply(left, right, false);
+
+    if (left->stype == nm::BSR_STORE && right->stype == nm::DENSE_STORE)
+      return bsr_dense_multiply(left, right);
+
     if (left->stype != right->stype)
       rb_raise(rb_eNotImpError, "matrices must have same stype");
 
@@ -1512,18 +2197,168 @@ static VALUE nm_multiply(VALUE left_v, VALUE right_v) {
   return Qnil;
 }
 
+/*
+ * call-seq:
+ *     transpose_dot(other) -> NMatrix
+ *
+ * The same as transpose.dot(other). For a yale matrix and a dense other, the product is computed directly from self,
+ * without building the transpose.
+ */
+static VALUE nm_transpose_multiply(VALUE left_v, VALUE right_v) {
+  NMATRIX *left, *right;
+
+  CheckNMatrixType(left_v);
+  UnwrapNMatrix(left_v, left);
+
+  if (left->stype == nm::YALE_STORE && TYPE(right_v) == T_DATA &&
+      (RDATA(right_v)->dfree == (RUBY_DATA_FUNC)nm_delete || RDATA(right_v)->dfree == (RUBY_DATA_FUNC)nm_delete_ref)) {
+    UnwrapNMatrix(right_v, right);
+
+    if (right->stype == nm::DENSE_STORE) {
+      if (left->storage->shape[0] != right->storage->shape[0])
+        rb_raise(rb_eArgError, "incompatible dimensions");
+
+      return yale_dense_multiply(left, right, true);
+    }
+  }
+
+  return nm_multiply(nm_init_transposed(left_v), right_v);
+}
+
+/*
+ * call-seq:
+ *     solve_triangular(b, uplo = :lower, diag = :nonunit) -> NMatrix
+ *
+ * Solve L x = b for x by forward substitution, where L is the lower triangle and diagonal of self, a square yale
+ * matrix; with uplo :upper, solve U x = b by back substitution instead. The other triangle is ignored, as is the
+ * diagonal if diag is :unit (it's taken to be all ones). b is dense, with a column for each right-hand side, and so
+ * is the result. If the dtypes differ, an upcast will occur.
+ *
+ * Raises ZeroDivisionError if the diagonal is read and has a zero on it.
+ *
+ * Large solves are split among the threads by levels: sets of rows which only depend on rows in earlier sets. The
+ * levels are worked out on the first such solve and kept with the matrix until its structure changes, so solving
+ * repeatedly with the same factor only pays for them once.
+ */
+static VALUE nm_solve_triangular(int argc, VALUE* argv, VALUE self) {
+  VALUE b_v, uplo, diag;
+  rb_scan_args(argc, argv, "12", &b_v, &uplo, &diag);
+
+  NMATRIX *left, *right;
+  UnwrapNMatrix(self, left);
+
+  if (left->stype != nm::YALE_STORE)
+    rb_raise(nm_eStorageTypeError, "sparse triangular solves are only implemented for yale matrices");
+
+  if (left->storage->shape[0] != left->storage->shape[1])
+    rb_raise(rb_eArgError, "can only solve with a square matrix");
+
+  CheckNMatrixType(b_v);
+  UnwrapNMatrix(b_v, right);
+
+  if (right->stype != nm::DENSE_STORE || right->storage->dim != 2)
+    rb_raise(rb_eArgError, "right-hand side must be a 2-dimensional dense matrix");
+
+  if (right->storage->shape[0] != left->storage->shape[0])
+    rb_raise(rb_eArgError, "incompatible dimensions");
+
+  if (uplo != Qnil && rb_to_id(uplo) != nm_rb_lower && rb_to_id(uplo) != nm_rb_upper)
+    rb_raise(rb_eArgError, "uplo must be :lower or :upper");
+
+  if (diag != Qnil && rb_to_id(diag) != nm_rb_unit && rb_to_id(diag) != nm_rb_nonunit)
+    rb_raise(rb_eArgError, "diag must be :unit or :nonunit");
+
+  const bool lower = uplo == Qnil || rb_to_id(uplo) == nm_rb_lower,
+             unit  = diag != Qnil && rb_to_id(diag) == nm_rb_unit;
+
+  STORAGE_PAIR casted = binary_storage_cast_alloc(left, right);
+  STORAGE*     x      = nm_yale_storage_triangular_solve(casted, lower, unit);
+
+  if (left->storage != casted.left)   nm_yale_storage_delete(casted.left);
+  if (right->storage != casted.right) nm_dense_storage_delete(casted.right);
+
+  return Data_Wrap_Struct(CLASS_OF(b_v), nm_dense_storage_mark, nm_delete, nm_create(nm::DENSE_STORE, x));
+}
+
+/*
+ * call-seq:
+ *     batch_dot(other) -> NMatrix
+ *
+ * Batched matrix multiplication. self is a stack of B matrices, with shape [B, M, K], and other either a stack of
+ * the same number of matrices, [B, K, N], or a single [K, N] matrix to multiply every one of them by. The result has
+ * shape [B, M, N]; its b-th matrix is self[b] dot other[b] (or other).
+ *
+ * Only dense storage is supported. If the dtypes differ, an upcast will occur, as for #dot.
+ */
+static VALUE nm_batch_dot(VALUE left_v, VALUE right_v) {
+  NMATRIX *left, *right;
+
+  CheckNMatrixType(left_v);
+  CheckNMatrixType(right_v);
+  UnwrapNMatrix(left_v, left);
+  UnwrapNMatrix(right_v, right);
+
+  if (left->stype != nm::DENSE_STORE || right->stype != nm::DENSE_STORE)
+    rb_raise(rb_eNotImpError, "batch_dot is only implemented for dense matrices");
+
+  const STORAGE *l = left->storage, *r = right->storage;
+
+  if (l->dim != 3 || (r->dim != 3 && r->dim != 2))
+    rb_raise(rb_eArgError, "batch_dot expects a 3-dimensional left-hand side and a 2- or 3-dimensional right-hand side");
+
+  if (l->shape[2] != r->shape[r->dim - 2] || (r->dim == 3 && l->shape[0] != r->shape[0]))
+    rb_raise(rb_eArgError, "incompatible dimensions");
+
+  STORAGE_PAIR casted = binary_storage_cast_alloc(left, right);
+
+  size_t* resulting_shape = ALLOC_N(size_t, 3);
+  resulting_shape[0] = l->shape[0];
+  resulting_shape[1] = l->shape[1];
+  resulting_shape[2] = r->shape[r->dim - 1];
+
+  NMATRIX* result = nm_create(nm::DENSE_STORE, nm_dense_storage_batch_multiply(casted, resulting_shape));
+
+  if (left->storage != casted.left)   nm_dense_storage_delete(casted.left);
+  if (right->storage != casted.right) nm_dense_storage_delete(casted.right);
+
+  return Data_Wrap_Struct(CLASS_OF(left_v), nm_dense_storage_mark, nm_delete, result);
+}
+
+/*
+ * Wraps a permutation, as from a sparse factorization, in an Array, and frees it.
+ */
+static VALUE permutation_to_ary(size_t* perm, size_t n) {
+  VALUE ary = rb_ary_new2(n);
+  for (size_t i = 0; i < n; ++i) rb_ary_push(ary, SIZET2NUM(perm[i]));
+
+  xfree(perm);
+  return ary;
+}
+
 /*
  * call-seq:
  *     matrix.factorize_lu -> ...
  *
  * LU factorization of a matrix.
  *
+ * For a dense matrix, the factors are returned packed into one matrix, as getrf leaves them. A square yale matrix
+ * (of a floating-point dtype) gives [l, u, p, q] instead: sparse L, with ones on its diagonal, and U, where row i and
+ * column j of L.dot(U) are row p[i] and column q[j] of the matrix. q is a fill-reducing column ordering, and p comes
+ * from partial pivoting. Raises ZeroDivisionError if the matrix is singular.
+ *
+ * The ordering is kept with the yale matrix until its structure changes, so factorizing again after replacing
+ * values only does the numeric part.
+ *
  * FIXME: For some reason, getrf seems to require that the matrix be transposed first -- and then you have to transpose the
  * FIXME: result again. Ideally, this would be an in-place factorize instead, and would be called nm_factorize_lu_bang.
  */
 static VALUE nm_factorize_lu(VALUE self) {
+  if (NM_STYPE(self) == nm::YALE_STORE) {
+    return yale_factorize_lu(self);
+  }
+
   if (NM_STYPE(self) != nm::DENSE_STORE) {
-    rb_raise(rb_eNotImpError, "only implemented for dense storage");
+    rb_raise(rb_eNotImpError, "only implemented for dense and yale storage");
   }
 
   if (NM_DIM(self) != 2) {
@@ -1534,13 +2369,13 @@ static VALUE nm_factorize_lu(VALUE self) {
 
   static int (*ttable[nm::NUM_DTYPES])(const enum CBLAS_ORDER, const int m, const int n, void* a, const int lda, int* ipiv) = {
       NULL, NULL, NULL, NULL, NULL, // integers not allowed due to division
-      nm::math::clapack_getrf<float>,
-      nm::math::clapack_getrf<double>,
+      nm::math::clapack_getrf_parallel<float>,
+      nm::math::clapack_getrf_parallel<double>,
 #ifdef HAVE_CLAPACK_H
       clapack_cgetrf, clapack_zgetrf, // call directly, same function signature!
 #else
-      nm::math::clapack_getrf<nm::Complex64>,
-      nm::math::clapack_getrf<nm::Complex128>,
+      nm::math::clapack_getrf_parallel<nm::Complex64>,
+      nm::math::clapack_getrf_parallel<nm::Complex128>,
 #endif
       nm::math::clapack_getrf<nm::Rational32>,
       nm::math::clapack_getrf<nm::Rational64>,
@@ -1550,13 +2385,83 @@ static VALUE nm_factorize_lu(VALUE self) {
 
   int* ipiv = ALLOCA_N(int, std::min(NM_SHAPE0(copy), NM_SHAPE1(copy)));
 
-  // In-place factorize
-  ttable[NM_DTYPE(copy)](CblasRowMajor, NM_SHAPE0(copy), NM_SHAPE1(copy), NM_STORAGE_DENSE(copy)->elements, NM_SHAPE1(copy), ipiv);
+  // In-place factorize. The floating point versions don't touch Ruby, so big ones run without the GVL, and
+  // (unless they're LAPACK's) split their trailing updates between the threads of the pool.
+  nm::dtype_t dtype = NM_DTYPE(copy);
+  size_t      m     = NM_SHAPE0(copy),
+              n     = NM_SHAPE1(copy);
+  void*       elems = NM_STORAGE_DENSE(copy)->elements;
+
+  if (dtype >= nm::FLOAT32 && dtype <= nm::COMPLEX128 && m * n * std::min(m, n) >= nm::thread_pool::threshold()) {
+    nm::thread_pool::without_gvl([&]() { ttable[dtype](CblasRowMajor, m, n, elems, n, ipiv); });
+  } else {
+    ttable[dtype](CblasRowMajor, m, n, elems, n, ipiv);
+  }
 
   // Transpose the result
   return nm_init_transposed(copy);
 }
 
+/*
+ * Sparse LU factorization, for factorize_lu.
+ */
+static VALUE yale_factorize_lu(VALUE self) {
+  const YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  const size_t        n = s->shape[0];
+
+  if (n != s->shape[1])
+    rb_raise(rb_eArgError, "can only factorize a square matrix");
+
+  YALE_STORAGE *l, *u;
+  size_t       *p, *q;
+
+  nm_yale_storage_lu(s, &l, &u, &p, &q);
+
+  VALUE result = rb_ary_new2(4);
+  rb_ary_push(result, Data_Wrap_Struct(cNMatrix, nm_yale_storage_mark, nm_delete, nm_create(nm::YALE_STORE, l)));
+  rb_ary_push(result, Data_Wrap_Struct(cNMatrix, nm_yale_storage_mark, nm_delete, nm_create(nm::YALE_STORE, u)));
+  rb_ary_push(result, permutation_to_ary(p, n));
+  rb_ary_push(result, permutation_to_ary(q, n));
+
+  return result;
+}
+
+/*
+ * call-seq:
+ *     matrix.factorize_cholesky -> [l, perm]
+ *
+ * Sparse Cholesky factorization of a square yale matrix of a floating-point dtype. Only its lower triangle is read:
+ * the matrix is taken to be the symmetric (Hermitian, if complex) one with that lower triangle, so the upper one may
+ * be left out, and isn't checked against it. That must be positive definite. l is lower triangular, and
+ * l.dot(l.transpose) (conjugated, if complex) is the matrix with its rows and columns both reordered by perm: row i
+ * and column j of the product are row perm[i] and column perm[j] of the matrix. perm is a fill-reducing ordering
+ * (approximate minimum degree).
+ *
+ * Raises ArgumentError if the matrix turns out not to be positive definite.
+ *
+ * The ordering and the pattern of l are kept with the matrix until its structure changes, so factorizing again
+ * after replacing values only does the numeric part.
+ */
+static VALUE nm_factorize_cholesky(VALUE self) {
+  if (NM_STYPE(self) != nm::YALE_STORE)
+    rb_raise(nm_eStorageTypeError, "sparse factorization is only implemented for yale matrices");
+
+  const YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  const size_t        n = s->shape[0];
+
+  if (n != s->shape[1])
+    rb_raise(rb_eArgError, "can only factorize a square matrix");
+
+  size_t*       perm;
+  YALE_STORAGE* l    = nm_yale_storage_cholesky(s, &perm);
+
+  VALUE result = rb_ary_new2(2);
+  rb_ary_push(result, Data_Wrap_Struct(cNMatrix, nm_yale_storage_mark, nm_delete, nm_create(nm::YALE_STORE, l)));
+  rb_ary_push(result, permutation_to_ary(perm, n));
+
+  return result;
+}
+
 /*
  * call-seq:
  *     dim -> Integer
@@ -1625,7 +2530,8 @@ static VALUE nm_xslice(int argc, VALUE* argv, void* (*slice_func)(STORAGE*, SLIC
       static void* (*ttable[nm::NUM_STYPES])(STORAGE*, SLICE*) = {
         nm_dense_storage_ref,
         nm_list_storage_ref,
-        nm_yale_storage_ref
+        nm_yale_storage_ref,
+        nm_bsr_storage_ref
       };
 
       if (NM_DTYPE(self) == nm::RUBYOBJ)  result = *reinterpret_cast<VALUE*>( ttable[NM_STYPE(self)](NM_STORAGE(self), slice) );
@@ -1661,13 +2567,20 @@ static VALUE nm_xslice(int argc, VALUE* argv, void* (*slice_func)(STORAGE*, SLIC
 // Helper Functions //
 //////////////////////
 
+/*
+ * Element-wise operation between two matrices of the same stype, or a matrix and a scalar. The result has the
+ * stype of the left-hand matrix, except that a Yale matrix op a scalar which would change its zeros (such as
+ * m + 1, m == 0, or a float matrix / 0) gives a dense matrix. Scaling, and any other operation leaving zeros alone,
+ * only touches the stored entries and keeps the sparsity structure.
+ */
 static VALUE elementwise_op(nm::ewop_t op, VALUE left_val, VALUE right_val) {
 	STYPE_MARK_TABLE(mark);
 
 	static STORAGE* (*ew_op[nm::NUM_STYPES])(nm::ewop_t, const STORAGE*, const STORAGE*, VALUE scalar) = {
 		nm_dense_storage_ew_op,
 		nm_list_storage_ew_op,
-		nm_yale_storage_ew_op
+		nm_yale_storage_ew_op,
+		nm_bsr_storage_ew_op
 	};
 	
 	NMATRIX *result = ALLOC(NMATRIX), *left;
@@ -1678,28 +2591,37 @@ static VALUE elementwise_op(nm::ewop_t op, VALUE left_val, VALUE right_val) {
   if (TYPE(right_val) != T_DATA || (RDATA(right_val)->dfree != (RUBY_DATA_FUNC)nm_delete && RDATA(right_val)->dfree != (RUBY_DATA_FUNC)nm_delete_ref)) {
     // This is a matrix-scalar element-wise operation.
 
-    if (left->stype != nm::YALE_STORE) {
-      result->storage = ew_op[left->stype](op, reinterpret_cast<STORAGE*>(left->storage), NULL, right_val);
-      result->stype   = left->stype;
-    } else {
-      rb_raise(rb_eNotImpError, "Scalar element-wise operations not implemented for Yale storage yet");
-    }
+    result->storage = ew_op[left->stype](op, reinterpret_cast<STORAGE*>(left->storage), NULL, right_val);
+    result->stype   = left->stype;
 
-  } else {
+    if (!result->storage) {
+      // Yale declines when the entries it doesn't store wouldn't be zero any more (e.g., m + 1), and then the result
+      // is dense.
+      STORAGE* dense  = nm_dense_storage_from_yale(left->storage, left->storage->dtype);
+      result->storage = nm_dense_storage_ew_op(op, dense, NULL, right_val);
+      result->stype   = nm::DENSE_STORE;
 
-    // Check that the left- and right-hand sides have the same dimensionality.
-    if (NM_DIM(left_val) != NM_DIM(right_val)) {
-      rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same dimensionality.");
+      nm_dense_storage_delete(dense);
     }
 
-    // Check that the left- and right-hand sides have the same shape.
-    if (memcmp(&NM_SHAPE(left_val, 0), &NM_SHAPE(right_val, 0), sizeof(size_t) * NM_DIM(left_val)) != 0) {
-      rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same shape.");
-    }
+  } else {
 
     NMATRIX* right;
     UnwrapNMatrix(right_val, right);
-	
+
+    // Dense matrices are broadcast against each other if their shapes differ; the other stypes must match exactly.
+    if (left->stype != nm::DENSE_STORE || right->stype != nm::DENSE_STORE) {
+      // Check that the left- and right-hand sides have the same dimensionality.
+      if (NM_DIM(left_val) != NM_DIM(right_val)) {
+        rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same dimensionality.");
+      }
+
+      // Check that the left- and right-hand sides have the same shape.
+      if (memcmp(&NM_SHAPE(left_val, 0), &NM_SHAPE(right_val, 0), sizeof(size_t) * NM_DIM(left_val)) != 0) {
+        rb_raise(rb_eArgError, "The left- and right-hand sides of the operation must have the same shape.");
+      }
+    }
+
     if (left->stype == right->stype) {
 
       result->storage	= ew_op[left->stype](op, reinterpret_cast<STORAGE*>(left->storage), reinterpret_cast<STORAGE*>(right->storage), Qnil);
@@ -1719,12 +2641,12 @@ static VALUE elementwise_op(nm::ewop_t op, VALUE left_val, VALUE right_val) {
  * Check to determine whether matrix is a reference to another matrix.
  */
 bool is_ref(const NMATRIX* matrix) {
-  // FIXME: Needs to work for other types
-  if (matrix->stype != nm::DENSE_STORE) {
+  // FIXME: Needs to work for list too
+  if (matrix->stype == nm::LIST_STORE) {
     return false;
   }
   
-  return ((DENSE_STORAGE*)(matrix->storage))->src != matrix->storage;
+  return matrix->storage->src != matrix->storage;
 }
 
 /*
@@ -1743,6 +2665,9 @@ static VALUE is_symmetric(VALUE self, bool hermitian) {
       	nm_dense_storage_is_symmetric((DENSE_STORAGE*)(m->storage), m->storage->shape[0]);
       }
       
+    } else if (NM_STYPE(self) == nm::YALE_STORE && NM_STORAGE_YALE(self)->symm == (hermitian ? nm::HERM : nm::SYMM)) {
+      return Qtrue;
+
     } else {
       // TODO: Implement, at the very least, yale_is_symmetric. Model it after yale/transp.template.c.
       rb_raise(rb_eNotImpError, "symmetric? and hermitian? only implemented for dense currently");
@@ -1835,6 +2760,37 @@ nm::dtype_t nm_dtype_guess(VALUE v) {
   }
 }
 
+/*
+ * Like nm_dtype_guess, but prefers target when v is an integer which an integer target dtype can represent
+ * exactly. Operations on such a scalar give the same results either way, and matching dtypes avoid an upcast.
+ */
+nm::dtype_t nm_dtype_guess_for(VALUE v, nm::dtype_t target) {
+  if (FIXNUM_P(v)) {
+    long i = FIX2LONG(v);
+
+    switch (target) {
+    case nm::BYTE:
+      if (i >= 0 && i <= std::numeric_limits<uint8_t>::max()) return target;
+      break;
+    case nm::INT8:
+      if (i >= std::numeric_limits<int8_t>::min() && i <= std::numeric_limits<int8_t>::max()) return target;
+      break;
+    case nm::INT16:
+      if (i >= std::numeric_limits<int16_t>::min() && i <= std::numeric_limits<int16_t>::max()) return target;
+      break;
+    case nm::INT32:
+      if (i >= std::numeric_limits<int32_t>::min() && i <= std::numeric_limits<int32_t>::max()) return target;
+      break;
+    case nm::INT64:
+      return target;
+    default:
+      break;
+    }
+  }
+
+  return nm_dtype_guess(v);
+}
+
 /*
  * Documentation goes here.
  */
@@ -2041,7 +2997,8 @@ static VALUE matrix_multiply(NMATRIX* left, NMATRIX* right) {
   static STORAGE* (*storage_matrix_multiply[nm::NUM_STYPES])(const STORAGE_PAIR&, size_t*, bool) = {
     nm_dense_storage_matrix_multiply,
     nm_list_storage_matrix_multiply,
-    nm_yale_storage_matrix_multiply
+    nm_yale_storage_matrix_multiply,
+    nm_bsr_storage_matrix_multiply
   };
 
   STORAGE* resulting_storage = storage_matrix_multiply[left->stype](casted, resulting_shape, vector);
@@ -2054,7 +3011,8 @@ static VALUE matrix_multiply(NMATRIX* left, NMATRIX* right) {
   static void (*free_storage[nm::NUM_STYPES])(STORAGE*) = {
     nm_dense_storage_delete,
     nm_list_storage_delete,
-    nm_yale_storage_delete
+    nm_yale_storage_delete,
+    nm_bsr_storage_delete
   };
 
   if (left->storage != casted.left)   free_storage[result->stype](casted.left);
@@ -2067,6 +3025,60 @@ static VALUE matrix_multiply(NMATRIX* left, NMATRIX* right) {
   return Qnil; // Only if we try to multiply list matrices should we return Qnil.
 }
 
+/*
+ * Multiply a yale matrix (or its transpose) by a dense one, without converting either. The result is dense.
+ */
+static VALUE yale_dense_multiply(NMATRIX* left, NMATRIX* right, bool transposed) {
+  if (right->storage->dim != 2)
+    rb_raise(rb_eArgError, "can only multiply a yale matrix by a 2-dimensional dense matrix");
+
+  const YALE_STORAGE* l_storage = reinterpret_cast<const YALE_STORAGE*>(left->storage);
+  nm::dtype_t         new_dtype = Upcast[left->storage->dtype][right->storage->dtype];
+
+  // A reference is multiplied through its source rather than copied, unless that's packed (or the dtype changes).
+  STORAGE_PAIR casted;
+  casted.left  = is_ref(left) && l_storage->dtype == new_dtype && !nm_yale_storage_is_packed(l_storage)
+               ? left->storage
+               : matrix_storage_cast_alloc(left, new_dtype);
+  casted.right = matrix_storage_cast_alloc(right, new_dtype);
+
+  // The column index lets A^T x be done a row of the result at a time. It's kept, so only build it for left itself.
+  if (transposed && casted.left == left->storage && !is_ref(left))
+    nm_yale_storage_build_col_index(reinterpret_cast<const YALE_STORAGE*>(casted.left));
+
+  size_t* resulting_shape = ALLOC_N(size_t, 2);
+  resulting_shape[0] = left->storage->shape[transposed ? 1 : 0];
+  resulting_shape[1] = right->storage->shape[1];
+
+  NMATRIX* result = nm_create(nm::DENSE_STORE, nm_yale_storage_dense_multiply(casted, resulting_shape, transposed));
+
+  if (left->storage != casted.left)   nm_yale_storage_delete(casted.left);
+  if (right->storage != casted.right) nm_dense_storage_delete(casted.right);
+
+  return Data_Wrap_Struct(cNMatrix, nm_dense_storage_mark, nm_delete, result);
+}
+
+/*
+ * Multiply a block-CSR matrix by a dense one. The result is dense.
+ */
+static VALUE bsr_dense_multiply(NMATRIX* left, NMATRIX* right) {
+  if (right->storage->dim != 2)
+    rb_raise(rb_eArgError, "can only multiply a bsr matrix by a 2-dimensional dense matrix");
+
+  STORAGE_PAIR casted = binary_storage_cast_alloc(left, right);
+
+  size_t* resulting_shape = ALLOC_N(size_t, 2);
+  resulting_shape[0] = left->storage->shape[0];
+  resulting_shape[1] = right->storage->shape[1];
+
+  NMATRIX* result = nm_create(nm::DENSE_STORE, nm_bsr_storage_dense_multiply(casted, resulting_shape));
+
+  if (left->storage != casted.left)   nm_bsr_storage_delete(casted.left);
+  if (right->storage != casted.right) nm_dense_storage_delete(casted.right);
+
+  return Data_Wrap_Struct(cNMatrix, nm_dense_storage_mark, nm_delete, result);
+}
+
 /*
  * Calculate the exact determinant of a dense matrix.
  *
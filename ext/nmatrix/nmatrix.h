@@ -199,7 +199,7 @@
 
 #define NM_NUM_DTYPES 13  // data/data.h
 #define NM_NUM_ITYPES 4   // data/data.h
-#define NM_NUM_STYPES 3   // storage/storage.h
+#define NM_NUM_STYPES 4   // storage/storage.h
 
 //#ifdef __cplusplus
 //namespace nm {
@@ -208,7 +208,8 @@
 /* Storage Type -- Dense or Sparse */
 NM_DEF_ENUM(stype_t,  DENSE_STORE = 0,
                       LIST_STORE = 1,
-                      YALE_STORE = 2);
+                      YALE_STORE = 2,
+                      BSR_STORE  = 3);
 
 /* Data Type */
 NM_DEF_ENUM(dtype_t,	BYTE				=  0,  // unsigned char
@@ -251,6 +252,29 @@ NM_DEF_STORAGE_CHILD_STRUCT_PRE(DENSE_STORAGE); // struct DENSE_STORAGE : STORAG
 	void*		elements;
 NM_DEF_STORAGE_STRUCT_POST(DENSE_STORAGE);     // };
 
+/* Column index of a Yale matrix (see yale.h) */
+NM_DEF_STRUCT_PRE(YALE_COL_INDEX); // struct YALE_COL_INDEX {
+	void*		ptr;  // column j's non-diagonal entries are pos[ptr[j]...ptr[j+1]) (itype)
+	void*		pos;  // where each one is in A, in order of row (itype)
+	void*		row;  // and which row it's in (itype)
+NM_DEF_STRUCT_POST(YALE_COL_INDEX); // };
+
+/* Level schedule of one triangle of a Yale matrix (see yale.h) */
+NM_DEF_STRUCT_PRE(YALE_LEVELS);    // struct YALE_LEVELS {
+	size_t	count; // how many levels
+	void*		ptr;   // level l's rows are row[ptr[l]...ptr[l+1]) (itype)
+	void*		row;   // in order within each level (itype)
+NM_DEF_STRUCT_POST(YALE_LEVELS);   // };
+
+/* Symbolic analysis of a Yale matrix for sparse factorization (see yale.h) */
+NM_DEF_STRUCT_PRE(YALE_SYMBOLIC);  // struct YALE_SYMBOLIC {
+	size_t*	perm;    // fill-reducing ordering: row (Cholesky) and column k of the factors come from perm[k]
+	size_t*	parent;  // Cholesky: elimination tree, with parent[k] == n at a root
+	size_t*	l_ptr;   // Cholesky: column j of L has l_ptr[j+1] - l_ptr[j] entries below the diagonal
+	size_t	lnz;     // LU: how many entries L and U had the last time, to allocate for
+	size_t	unz;
+NM_DEF_STRUCT_POST(YALE_SYMBOLIC); // };
+
 /* Yale Storage */
 NM_DEF_STORAGE_CHILD_STRUCT_PRE(YALE_STORAGE);
 	void* a;      // should go first
@@ -258,8 +282,21 @@ NM_DEF_STORAGE_CHILD_STRUCT_PRE(YALE_STORAGE);
 	size_t	capacity;
 	NM_DECL_ENUM(itype_t, itype);
 	void*		ija;
+	void*		row_end;  // gapped rows only: where each row's entries stop (itype); NULL when compact
+	NM_DECL_ENUM(symm_t, symm); // SYMM or HERM: only the diagonal and strict upper triangle are stored (NONSYMM for references)
+	NM_DECL_STRUCT(YALE_COL_INDEX*, col_index); // built on demand, and dropped when the layout changes; NULL meanwhile (and for references)
+	NM_DECL_STRUCT(YALE_LEVELS*, levels[2]);    // likewise, for triangular solves: [0] with the lower triangle, [1] with the upper
+	NM_DECL_STRUCT(YALE_SYMBOLIC*, symbolic[2]); // likewise, for factorization: [0] Cholesky, [1] LU
 NM_DEF_STORAGE_STRUCT_POST(YALE_STORAGE);
 
+/* Block-CSR Storage */
+NM_DEF_STORAGE_CHILD_STRUCT_PRE(BSR_STORAGE);
+	void*   a;            // the stored blocks, one after another; each is row-major
+	size_t  block_shape[2];
+	size_t* ptr;          // block row i's blocks are ptr[i]...ptr[i+1]
+	size_t* idx;          // block column of each stored block
+NM_DEF_STORAGE_STRUCT_POST(BSR_STORAGE);
+
 // FIXME: NODE and LIST should be put in some kind of namespace or something, at least in C++.
 NM_DEF_STRUCT_PRE(NODE); // struct NODE {
   size_t key;
@@ -296,15 +333,18 @@ NM_DEF_STRUCT_POST(NMATRIX);  // };
   #define NM_STORAGE_LIST(val)        ((LIST_STORAGE*)(NM_STORAGE(val)))
   #define NM_STORAGE_YALE(val)        ((YALE_STORAGE*)(NM_STORAGE(val)))
   #define NM_STORAGE_DENSE(val)       ((DENSE_STORAGE*)(NM_STORAGE(val)))
+  #define NM_STORAGE_BSR(val)         ((BSR_STORAGE*)(NM_STORAGE(val)))
 #else
   #define NM_STRUCT(val)              ((struct NM_NMATRIX*)(DATA_PTR(val)))
   #define NM_STORAGE_LIST(val)        ((struct NM_LIST_STORAGE*)(NM_STORAGE(val)))
   #define NM_STORAGE_YALE(val)        ((struct NM_YALE_STORAGE*)(NM_STORAGE(val)))
   #define NM_STORAGE_DENSE(val)       ((struct NM_DENSE_STORAGE*)(NM_STORAGE(val)))
+  #define NM_STORAGE_BSR(val)         ((struct NM_BSR_STORAGE*)(NM_STORAGE(val)))
 #endif
 
 #define NM_DENSE_SRC(val)       (NM_STORAGE_DENSE(val)->src)
 #define NM_LIST_SRC(val)        (NM_STORAGE_LIST(val)->src)
+#define NM_YALE_SRC(val)        (NM_STORAGE_YALE(val)->src)
 #define NM_DIM(val)             (NM_STORAGE(val)->dim)
 #define NM_DTYPE(val)           (NM_STORAGE(val)->dtype)
 #define NM_ITYPE(val)           (NM_STORAGE_YALE(val)->itype)
@@ -353,6 +393,7 @@ extern "C" {
 	VALUE rb_nvector_dense_create(NM_DECL_ENUM(dtype_t, dtype), void* elements, size_t length);
 
 	NM_DECL_ENUM(dtype_t, nm_dtype_guess(VALUE));   // (This is a function)
+	NM_DECL_ENUM(dtype_t, nm_dtype_guess_for(VALUE, NM_DECL_ENUM(dtype_t, target)));
 
 #ifdef __cplusplus
 }
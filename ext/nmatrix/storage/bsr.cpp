@@ -0,0 +1,440 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == bsr.c
+//
+// Block compressed sparse row storage for 2D matrices. See bsr.h.
+
+/*
+ * Standard Includes
+ */
+
+#include <ruby.h>
+#include <algorithm> // std::lower_bound
+
+/*
+ * Project Includes
+ */
+
+#include "util/thread_pool.h"
+
+#include "data/data.h"
+#include "common.h"
+#include "dense.h"
+#include "yale.h"
+#include "bsr.h"
+#include "storage.h"
+
+/*
+ * Macros
+ */
+
+/*
+ * Global Variables
+ */
+
+/*
+ * Forward Declarations
+ */
+
+namespace nm { namespace bsr_storage {
+
+  template <typename LDType, typename RDType>
+  static BSR_STORAGE* cast_copy(const BSR_STORAGE* rhs, dtype_t new_dtype);
+
+  template <typename DType>
+  static void transpose(const BSR_STORAGE* rhs, BSR_STORAGE* lhs);
+
+  template <typename DType>
+  static void dense_multiply(const BSR_STORAGE* left, const void* x, size_t nrhs, void* y);
+
+/*
+ * Functions
+ */
+
+/*
+ * Creates a copy of rhs with a different dtype; the blocks stay where they are.
+ */
+template <typename LDType, typename RDType>
+static BSR_STORAGE* cast_copy(const BSR_STORAGE* rhs, dtype_t new_dtype) {
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = rhs->shape[0];
+  shape[1] = rhs->shape[1];
+
+  const size_t nblocks = nm_bsr_storage_count_blocks(rhs),
+               mb      = nm_bsr_storage_block_rows(rhs),
+               n       = nblocks * rhs->block_shape[0] * rhs->block_shape[1];
+
+  BSR_STORAGE* lhs = nm_bsr_storage_create(new_dtype, shape, rhs->block_shape, nblocks);
+
+  memcpy(lhs->ptr, rhs->ptr, (mb+1) * sizeof(size_t));
+  memcpy(lhs->idx, rhs->idx, nblocks * sizeof(size_t));
+
+  LDType*       la = reinterpret_cast<LDType*>(lhs->a);
+  RDType*       ra = reinterpret_cast<RDType*>(rhs->a);
+  for (size_t p = 0; p < n; ++p) la[p] = ra[p];
+
+  return lhs;
+}
+
+/*
+ * Fills in lhs, which must have the transposed shape and block shape of rhs and room for as many blocks, with the
+ * transpose of rhs: block (I,J) becomes block (J,I), itself transposed. The blocks are bucketed by block column, so
+ * each block row of the result comes out in order.
+ */
+template <typename DType>
+static void transpose(const BSR_STORAGE* rhs, BSR_STORAGE* lhs) {
+  const size_t  mb  = nm_bsr_storage_block_rows(rhs),
+                nbc = nm_bsr_storage_block_cols(rhs),
+                br  = rhs->block_shape[0],
+                bc  = rhs->block_shape[1];
+  const DType*  ra  = reinterpret_cast<const DType*>(rhs->a);
+  DType*        la  = reinterpret_cast<DType*>(lhs->a);
+
+  for (size_t J = 0; J <= nbc; ++J) lhs->ptr[J] = 0;
+  for (size_t k = 0; k < rhs->ptr[mb]; ++k) ++lhs->ptr[rhs->idx[k]+1];
+  for (size_t J = 0; J < nbc; ++J) lhs->ptr[J+1] += lhs->ptr[J];
+
+  size_t* next = ALLOC_N(size_t, nbc);
+  memcpy(next, lhs->ptr, nbc * sizeof(size_t));
+
+  for (size_t I = 0; I < mb; ++I) {
+    for (size_t k = rhs->ptr[I]; k < rhs->ptr[I+1]; ++k) {
+      const size_t dest = next[rhs->idx[k]]++;
+      const DType* rb   = ra + k*br*bc;
+      DType*       lb   = la + dest*br*bc;
+
+      lhs->idx[dest] = I;
+      for (size_t r = 0; r < br; ++r)
+        for (size_t c = 0; c < bc; ++c)
+          lb[c*br + r] = rb[r*bc + c];
+    }
+  }
+
+  xfree(next);
+}
+
+/*
+ * y = A x for block rows [begin, end) of A, where x and y are row-major dense matrices with nrhs columns and enough
+ * rows for every block row and column of A (including any that stick out past its shape).
+ *
+ * R and C are the block shape, or 0 to read it from A. With them fixed, the loops over a block have constant trip
+ * counts, and the compiler unrolls and vectorizes them; that's what makes a block worth storing whole.
+ */
+template <typename DType, size_t R, size_t C>
+static void multiply_block_rows(const BSR_STORAGE* left, const DType* x, size_t nrhs, DType* y, size_t begin, size_t end) {
+  const size_t  br  = R ? R : left->block_shape[0],
+                bc  = C ? C : left->block_shape[1];
+  const DType*  a   = reinterpret_cast<const DType*>(left->a);
+  const size_t* ptr = left->ptr;
+  const size_t* idx = left->idx;
+
+  for (size_t I = begin; I < end; ++I) {
+    DType* yI = y + I*br*nrhs;
+    for (size_t p = 0; p < br*nrhs; ++p) yI[p] = 0;
+
+    for (size_t k = ptr[I]; k < ptr[I+1]; ++k) {
+      const DType* b  = a + k*br*bc;
+      const DType* xJ = x + idx[k]*bc*nrhs;
+
+      if (nrhs == 1) {
+        for (size_t r = 0; r < br; ++r) {
+          DType sum = yI[r];
+          for (size_t c = 0; c < bc; ++c) sum += b[r*bc + c] * xJ[c];
+          yI[r] = sum;
+        }
+
+      } else {
+        for (size_t r = 0; r < br; ++r) {
+          DType* yr = yI + r*nrhs;
+          for (size_t c = 0; c < bc; ++c) {
+            const DType  brc = b[r*bc + c];
+            const DType* xc  = xJ + c*nrhs;
+            for (size_t q = 0; q < nrhs; ++q) yr[q] += brc * xc[q];
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Block sparse times dense: y = A x, where x is a row-major dense matrix with nrhs columns (one for a vector). Split
+ * over the block rows of A, each of which fills its own rows of y.
+ *
+ * If the shape of A isn't a multiple of its block shape, x and y are padded out to whole blocks, so that the kernel
+ * never has to check where a block ends.
+ */
+template <typename DType>
+static void dense_multiply(const BSR_STORAGE* left, const void* x_, size_t nrhs, void* y_) {
+  typedef void (*rows_t)(const BSR_STORAGE*, const DType*, size_t, DType*, size_t, size_t);
+
+  const size_t br   = left->block_shape[0],
+               bc   = left->block_shape[1],
+               n    = left->shape[0],
+               m    = left->shape[1],
+               mb   = nm_bsr_storage_block_rows(left),
+               work = nm_bsr_storage_count_blocks(left) * br * bc * nrhs;
+  const bool   nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+
+  rows_t rows = multiply_block_rows<DType,0,0>;
+  if (br == bc) {
+    switch (br) {
+    case 1: rows = multiply_block_rows<DType,1,1>; break;
+    case 2: rows = multiply_block_rows<DType,2,2>; break;
+    case 3: rows = multiply_block_rows<DType,3,3>; break;
+    case 4: rows = multiply_block_rows<DType,4,4>; break;
+    case 6: rows = multiply_block_rows<DType,6,6>; break;
+    case 8: rows = multiply_block_rows<DType,8,8>; break;
+    }
+  }
+
+  const DType* x = reinterpret_cast<const DType*>(x_);
+  DType*       y = reinterpret_cast<DType*>(y_);
+  DType*       x_padded = NULL;
+  DType*       y_padded = NULL;
+
+  if (m % bc) {
+    const size_t len = nm_bsr_storage_block_cols(left) * bc * nrhs;
+    x_padded = ALLOC_N(DType, len);
+    for (size_t p = 0; p < m*nrhs; ++p)   x_padded[p] = x[p];
+    for (size_t p = m*nrhs; p < len; ++p) x_padded[p] = 0;
+    x = x_padded;
+  }
+
+  if (n % br) {
+    y_padded = ALLOC_N(DType, mb * br * nrhs);
+    y = y_padded;
+  }
+
+  thread_pool::parallel_for(work, nogvl, mb, [&](size_t begin, size_t end) {
+    rows(left, x, nrhs, y, begin, end);
+  });
+
+  if (y_padded) {
+    DType* y_out = reinterpret_cast<DType*>(y_);
+    for (size_t p = 0; p < n*nrhs; ++p) y_out[p] = y_padded[p];
+    xfree(y_padded);
+  }
+
+  if (x_padded) xfree(x_padded);
+}
+
+/*
+ * A zero of the given dtype, constructed as one (all-zero bytes aren't a valid rational), for the entries of blocks
+ * which aren't stored.
+ */
+template <typename DType>
+static const void* zero() {
+  static const DType z = 0;
+  return &z;
+}
+
+}} // end of namespace nm::bsr_storage
+
+extern "C" {
+
+///////////////
+// Lifecycle //
+///////////////
+
+/*
+ * Creates block-CSR storage with room for nblocks blocks, whose contents (and ptr and idx) are left to the caller.
+ * Takes ownership of shape.
+ */
+BSR_STORAGE* nm_bsr_storage_create(nm::dtype_t dtype, size_t* shape, const size_t* block_shape, size_t nblocks) {
+  BSR_STORAGE* s = ALLOC(BSR_STORAGE);
+
+  s->dtype          = dtype;
+  s->dim            = 2;
+  s->shape          = shape;
+  s->offset         = ALLOC_N(size_t, 2);
+  s->offset[0]      = 0;
+  s->offset[1]      = 0;
+  s->count          = 1;
+  s->src            = s;
+  s->block_shape[0] = block_shape[0];
+  s->block_shape[1] = block_shape[1];
+
+  s->ptr = ALLOC_N(size_t, nm_bsr_storage_block_rows(s) + 1);
+  s->idx = ALLOC_N(size_t, nblocks);
+  s->a   = ALLOC_N(char, nblocks * block_shape[0] * block_shape[1] * DTYPE_SIZES[dtype]);
+
+  return s;
+}
+
+void nm_bsr_storage_delete(STORAGE* s) {
+  if (s) {
+    BSR_STORAGE* storage = reinterpret_cast<BSR_STORAGE*>(s);
+
+    xfree(storage->shape);
+    xfree(storage->offset);
+    xfree(storage->ptr);
+    xfree(storage->idx);
+    xfree(storage->a);
+    xfree(storage);
+  }
+}
+
+void nm_bsr_storage_mark(void* storage_base) {
+  BSR_STORAGE* storage = reinterpret_cast<BSR_STORAGE*>(storage_base);
+
+  if (storage && storage->dtype == nm::RUBYOBJ) {
+    VALUE* a = reinterpret_cast<VALUE*>(storage->a);
+
+    for (size_t p = nm_bsr_storage_count_blocks(storage) * storage->block_shape[0] * storage->block_shape[1]; p-- > 0;)
+      rb_gc_mark(a[p]);
+  }
+}
+
+///////////////
+// Accessors //
+///////////////
+
+/*
+ * Block-CSR matrices can't be sliced, only read one element at a time (see nm_bsr_storage_ref).
+ */
+void* nm_bsr_storage_get(STORAGE* s, SLICE* slice) {
+  rb_raise(rb_eNotImpError, "bsr matrices can't be sliced; cast to yale or dense first");
+  return NULL;
+}
+
+/*
+ * Pointer to a single element. Those in blocks which aren't stored point at a shared zero, which mustn't be written
+ * to.
+ */
+void* nm_bsr_storage_ref(STORAGE* storage, SLICE* slice) {
+  NAMED_DTYPE_TEMPLATE_TABLE(zeros, nm::bsr_storage::zero, const void*, void);
+
+  if (!slice->single)
+    return nm_bsr_storage_get(storage, slice);
+
+  const BSR_STORAGE* s = reinterpret_cast<const BSR_STORAGE*>(storage);
+  const size_t i  = slice->coords[0],
+               j  = slice->coords[1],
+               br = s->block_shape[0],
+               bc = s->block_shape[1],
+               I  = i / br,
+               J  = j / bc;
+
+  const size_t* first = s->idx + s->ptr[I];
+  const size_t* last  = s->idx + s->ptr[I+1];
+  const size_t* found = std::lower_bound(first, last, J);
+
+  if (found == last || *found != J)
+    return const_cast<void*>(zeros[s->dtype]());
+
+  const size_t k = found - s->idx;
+  return reinterpret_cast<char*>(s->a) + (k*br*bc + (i % br)*bc + (j % bc)) * DTYPE_SIZES[s->dtype];
+}
+
+///////////
+// Tests //
+///////////
+
+/*
+ * Two block-CSR matrices are equal if their entries are, whatever their block shapes; they're compared as yale.
+ */
+bool nm_bsr_storage_eqeq(const STORAGE* left, const STORAGE* right) {
+  STORAGE* l = nm_yale_storage_from_bsr(left, left->dtype);
+  STORAGE* r = nm_yale_storage_from_bsr(right, right->dtype);
+
+  bool result = nm_yale_storage_eqeq(l, r);
+
+  nm_yale_storage_delete(l);
+  nm_yale_storage_delete(r);
+
+  return result;
+}
+
+//////////
+// Math //
+//////////
+
+STORAGE* nm_bsr_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar) {
+  rb_raise(rb_eNotImpError, "element-wise operations are not implemented for bsr matrices; cast to yale first");
+  return NULL;
+}
+
+void nm_bsr_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar) {
+  rb_raise(rb_eNotImpError, "element-wise operations are not implemented for bsr matrices; cast to yale first");
+}
+
+STORAGE* nm_bsr_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim) {
+  rb_raise(rb_eNotImpError, "reductions are not implemented for bsr matrices; cast to yale first");
+  return NULL;
+}
+
+/*
+ * Only a product with a dense right-hand side is native (see nm_bsr_storage_dense_multiply).
+ */
+STORAGE* nm_bsr_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector) {
+  xfree(resulting_shape);
+  rb_raise(rb_eNotImpError, "bsr matrices can only be multiplied by dense ones; cast to yale first");
+  return NULL;
+}
+
+/*
+ * Block-CSR times dense. The result is dense; resulting_shape is taken over by it.
+ */
+STORAGE* nm_bsr_storage_dense_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape) {
+  NAMED_DTYPE_TEMPLATE_TABLE(ttable, nm::bsr_storage::dense_multiply, void, const BSR_STORAGE*, const void*, size_t, void*);
+
+  const BSR_STORAGE*   left  = reinterpret_cast<const BSR_STORAGE*>(casted_storage.left);
+  const DENSE_STORAGE* right = reinterpret_cast<const DENSE_STORAGE*>(casted_storage.right);
+
+  DENSE_STORAGE* result = nm_dense_storage_create(left->dtype, resulting_shape, 2, NULL, 0);
+  ttable[left->dtype](left, right->elements, right->shape[1], result->elements);
+
+  return result;
+}
+
+/////////////////////////
+// Copying and Casting //
+/////////////////////////
+
+STORAGE* nm_bsr_storage_cast_copy(const STORAGE* rhs, nm::dtype_t new_dtype) {
+  NAMED_LR_DTYPE_TEMPLATE_TABLE(ttable, nm::bsr_storage::cast_copy, BSR_STORAGE*, const BSR_STORAGE*, nm::dtype_t);
+
+  return ttable[new_dtype][rhs->dtype](reinterpret_cast<const BSR_STORAGE*>(rhs), new_dtype);
+}
+
+STORAGE* nm_bsr_storage_copy_transposed(const STORAGE* rhs_base) {
+  NAMED_DTYPE_TEMPLATE_TABLE(ttable, nm::bsr_storage::transpose, void, const BSR_STORAGE*, BSR_STORAGE*);
+
+  const BSR_STORAGE* rhs = reinterpret_cast<const BSR_STORAGE*>(rhs_base);
+
+  size_t* shape       = ALLOC_N(size_t, 2);
+  size_t  block_shape[2];
+  shape[0]       = rhs->shape[1];
+  shape[1]       = rhs->shape[0];
+  block_shape[0] = rhs->block_shape[1];
+  block_shape[1] = rhs->block_shape[0];
+
+  BSR_STORAGE* lhs = nm_bsr_storage_create(rhs->dtype, shape, block_shape, nm_bsr_storage_count_blocks(rhs));
+  ttable[rhs->dtype](rhs, lhs);
+
+  return lhs;
+}
+
+} // end of extern "C" block
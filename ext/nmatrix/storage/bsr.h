@@ -0,0 +1,144 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == bsr.h
+//
+// Block compressed sparse row ("block-CSR") storage for 2D matrices
+// whose non-zeros come in small dense sub-blocks.
+//
+// Specifications:
+// * the matrix is tiled into block_shape[0] x block_shape[1] blocks;
+//   a block is stored whole if any of its entries is non-zero
+//      * block row i's blocks are a[ptr[i]...ptr[i+1]), in order of
+//        block column, which idx holds -- one index per block
+//      * each block is row-major, so a stored block is a small dense
+//        matrix and a product with it has no indirection in it
+// * when the shape isn't a multiple of the block shape, the last
+//   block row and column stick out past it; those entries are zero
+// * built by conversion (from yale, or from anything via yale) and
+//   never modified in place; there are no references
+
+#ifndef BSR_H
+#define BSR_H
+
+/*
+ * Standard Includes
+ */
+
+#include <stdlib.h>
+
+/*
+ * Project Includes
+ */
+
+#include "types.h"
+
+#include "data/data.h"
+
+#include "common.h"
+
+#include "nmatrix.h"
+
+/*
+ * Macros
+ */
+
+#define NM_BSR_MAX_FILL 1.2 // automatic block shapes may pad out the stored values by at most this factor
+
+/*
+ * Types
+ */
+
+/*
+ * Data
+ */
+
+extern "C" {
+
+/*
+ * Functions
+ */
+
+///////////////
+// Lifecycle //
+///////////////
+
+BSR_STORAGE*  nm_bsr_storage_create(nm::dtype_t dtype, size_t* shape, const size_t* block_shape, size_t nblocks);
+void          nm_bsr_storage_delete(STORAGE* s);
+void          nm_bsr_storage_mark(void*);
+
+///////////////
+// Accessors //
+///////////////
+
+void* nm_bsr_storage_get(STORAGE* s, SLICE* slice);
+void* nm_bsr_storage_ref(STORAGE* s, SLICE* slice);
+
+///////////
+// Tests //
+///////////
+
+bool nm_bsr_storage_eqeq(const STORAGE* left, const STORAGE* right);
+
+//////////
+// Math //
+//////////
+
+STORAGE* nm_bsr_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar);
+void     nm_bsr_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar);
+STORAGE* nm_bsr_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim);
+STORAGE* nm_bsr_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
+STORAGE* nm_bsr_storage_dense_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape);
+
+/////////////
+// Utility //
+/////////////
+
+/*
+ * Number of block rows and block columns of s.
+ */
+inline size_t nm_bsr_storage_block_rows(const BSR_STORAGE* s) {
+  return (s->shape[0] + s->block_shape[0] - 1) / s->block_shape[0];
+}
+
+inline size_t nm_bsr_storage_block_cols(const BSR_STORAGE* s) {
+  return (s->shape[1] + s->block_shape[1] - 1) / s->block_shape[1];
+}
+
+/*
+ * Number of stored blocks.
+ */
+inline size_t nm_bsr_storage_count_blocks(const BSR_STORAGE* s) {
+  return s->ptr[nm_bsr_storage_block_rows(s)];
+}
+
+/////////////////////////
+// Copying and Casting //
+/////////////////////////
+
+STORAGE*  nm_bsr_storage_cast_copy(const STORAGE* rhs, nm::dtype_t new_dtype);
+STORAGE*  nm_bsr_storage_copy_transposed(const STORAGE* rhs_base);
+
+} // end of extern "C" block
+
+#endif // BSR_H
@@ -43,6 +43,10 @@
  * Global Variables
  */
 
+namespace nm {
+  const char* const REDUCE_NAMES[NUM_REDUCE_OPS] = { "sum", "prod", "min", "max", "mean", "variance", "std" };
+}
+
 /*
  * Forward Declarations
  */
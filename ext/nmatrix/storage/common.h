@@ -32,6 +32,12 @@
  * Standard Includes
  */
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
 /*
  * Project Includes
  */
@@ -102,6 +108,62 @@ namespace nm {
     return 0;
   }
 
+  /*
+   * Templated helper for element-wise comparisons, which always produce a BYTE (0 or 1).
+   */
+  template <ewop_t op, typename LDType, typename RDType>
+  inline uint8_t ew_comp_switch(const LDType& left, const RDType& right) {
+    switch (op) {
+      case EW_EQEQ:
+        return left == right;
+
+      case EW_NEQ:
+        return left != right;
+
+      case EW_LT:
+        return left < right;
+
+      case EW_GT:
+        return left > right;
+
+      case EW_LEQ:
+        return left <= right;
+
+      case EW_GEQ:
+        return left >= right;
+
+      default:
+        rb_raise(rb_eStandardError, "this should not happen");
+    }
+    return 0;
+  }
+
+  /*
+   * One element of an element-wise operation between dtypes: arithmetic keeps the left dtype, comparisons produce
+   * BYTEs.
+   */
+  template <ewop_t op, typename LDType, typename RDType, bool comparison = (static_cast<int>(op) >= NUM_NONCOMP_EWOPS)>
+  struct ew_elem {
+    typedef LDType result_type;
+    static inline LDType apply(const LDType& l, const RDType& r) { return ew_op_switch<op,LDType,RDType>(l, r); }
+  };
+
+  template <ewop_t op, typename LDType, typename RDType>
+  struct ew_elem<op,LDType,RDType,true> {
+    typedef uint8_t result_type;
+    static inline uint8_t apply(const LDType& l, const RDType& r) { return ew_comp_switch<op,LDType,RDType>(l, r); }
+  };
+
+  /*
+   * Whether an element-wise operation on these types can run with the GVL released (see util/thread_pool.h).
+   * RubyObjects call back into Ruby, and integer division and modulo can raise.
+   */
+  template <ewop_t op, typename LDType, typename RDType>
+  struct ew_op_nogvl {
+    static const bool value = !std::is_same<LDType, RubyObject>::value && !std::is_same<RDType, RubyObject>::value &&
+                              op != EW_MOD && !(op == EW_DIV && std::is_integral<LDType>::value && std::is_integral<RDType>::value);
+  };
+
   #define EWOP_INT_INT_DIV(ltype, rtype)       template <>       \
   inline ltype ew_op_switch<EW_DIV>( ltype left, rtype right) { \
     if (right == 0) rb_raise(rb_eZeroDivError, "cannot divide type by 0, would throw SIGFPE");  \
@@ -165,6 +227,119 @@ namespace nm {
   EWOP_FLOAT_INT_DIV(double, int32_t)
   EWOP_FLOAT_INT_DIV(double, int64_t)
 
+  /*
+   * Reductions along a single dimension (see NMatrix#sum and friends). All of them produce FLOAT64 results.
+   */
+  enum reduce_t {
+    REDUCE_SUM,
+    REDUCE_PROD,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_MEAN,
+    REDUCE_VARIANCE, // sample variance, dividing by n-1
+    REDUCE_STD
+  };
+
+  const int NUM_REDUCE_OPS = 7;
+
+  extern const char* const REDUCE_NAMES[NUM_REDUCE_OPS];
+
+  /*
+   * Element value as seen by a reduction. (RubyObject's conversion operators aren't const.)
+   */
+  template <typename To = double, typename DType>
+  inline To reduce_value(const DType& x) {
+    return static_cast<To>(const_cast<DType&>(x));
+  }
+
+  /*
+   * Initial accumulator value for a reduction.
+   */
+  inline double reduce_identity(reduce_t op) {
+    switch (op) {
+      case REDUCE_PROD: return 1;
+      case REDUCE_MIN:  return std::numeric_limits<double>::infinity();
+      case REDUCE_MAX:  return -std::numeric_limits<double>::infinity();
+      default:          return 0;
+    }
+  }
+
+  /*
+   * Reduction of a sparse matrix, built up from its stored entries. Each output slot counts the entries which
+   * were added to it, and finish() accounts for the rest, which all hold the default value.
+   *
+   * Variance and standard deviation take two passes: add() every entry, call second_pass(), then add() every
+   * entry again.
+   */
+  class sparse_reduction {
+  public:
+    sparse_reduction(reduce_t op, size_t n_out, size_t length, double default_val)
+      : op(op), length(length), default_val(default_val), pass(0),
+        acc(n_out, reduce_identity(op)), stored(n_out, 0)
+    { }
+
+    inline void add(size_t out, double x) {
+      if (pass == 1) {
+        double d = x - means[out];
+        acc[out] += d * d;
+        return;
+      }
+
+      ++stored[out];
+
+      switch (op) {
+        case REDUCE_PROD: acc[out] *= x;                    break;
+        case REDUCE_MIN:  acc[out]  = std::min(acc[out], x); break;
+        case REDUCE_MAX:  acc[out]  = std::max(acc[out], x); break;
+        default:          acc[out] += x;
+      }
+    }
+
+    /*
+     * Returns true (and turns the sums into means) if the reduction needs to see every entry a second time, or
+     * false if that's not needed or has already been done.
+     */
+    bool second_pass() {
+      if (pass == 1 || (op != REDUCE_VARIANCE && op != REDUCE_STD)) return false;
+
+      means.resize(acc.size());
+      for (size_t o = 0; o < acc.size(); ++o) {
+        means[o] = (acc[o] + default_val * (length - stored[o])) / length;
+        acc[o]   = 0;
+      }
+
+      pass = 1;
+      return true;
+    }
+
+    void finish(double* result) const {
+      for (size_t o = 0; o < acc.size(); ++o) {
+        size_t unstored = length - stored[o];
+
+        switch (op) {
+          case REDUCE_SUM:  result[o] = acc[o] + default_val * unstored;                             break;
+          case REDUCE_MEAN: result[o] = (acc[o] + default_val * unstored) / length;                  break;
+          case REDUCE_PROD: result[o] = acc[o] * std::pow(default_val, (double)unstored);            break;
+          case REDUCE_MIN:  result[o] = unstored ? std::min(acc[o], default_val) : acc[o];           break;
+          case REDUCE_MAX:  result[o] = unstored ? std::max(acc[o], default_val) : acc[o];           break;
+          default: {
+            double d   = default_val - means[o];
+            result[o]  = (acc[o] + d * d * unstored) / (length - 1);
+            if (op == REDUCE_STD) result[o] = std::sqrt(result[o]);
+          }
+        }
+      }
+    }
+
+  private:
+    reduce_t            op;
+    size_t              length;
+    double              default_val;
+    int                 pass;
+    std::vector<double> acc, means;
+    std::vector<size_t> stored;
+  };
+
 }
 
 #endif // STORAGE_COMMON_H
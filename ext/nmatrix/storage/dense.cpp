@@ -30,21 +30,28 @@
  */
 
 #include <ruby.h>
+#include <algorithm>
 
 /*
  * Project Includes
  */
 // #include "types.h"
 #include "util/math.h"
+#include "util/simd.h"
+#include "util/thread_pool.h"
 
 #include "data/data.h"
 #include "common.h"
 #include "dense.h"
+#include "dense_iterator.h"
 
 /*
  * Macros
  */
 
+// Elements per chunk when evaluating a fused expression; each intermediate gets a buffer this long.
+#define FUSED_BLOCK_SIZE 256
+
 /*
  * Global Variables
  */
@@ -67,9 +74,21 @@ namespace nm { namespace dense_storage {
 	template <ewop_t op, typename LDType, typename RDType>
 	static DENSE_STORAGE* ew_op(const DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar);
 
+	template <ewop_t op, typename LDType, typename RDType>
+	static void ew_op_in_place(DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar);
+
+  template <typename DType>
+  static DENSE_STORAGE* reduce(reduce_t op, const DENSE_STORAGE* s, size_t dim);
+
+  template <typename DType>
+  static void ew_fused(DENSE_STORAGE* result, const fused_instr_t* program, size_t length, size_t depth, DENSE_STORAGE** leaves, size_t n_leaves, const void* scalars);
+
   template <typename DType>
   static DENSE_STORAGE* matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
 
+  template <typename DType>
+  static DENSE_STORAGE* batch_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape);
+
   template <typename DType>
   bool is_hermitian(const DENSE_STORAGE* mat, int lda);
 
@@ -84,6 +103,18 @@ extern "C" {
 static size_t* stride(size_t* shape, size_t dim);
 static void slice_copy(DENSE_STORAGE *dest, const DENSE_STORAGE *src, size_t* lengths, size_t pdest, size_t psrc, size_t n);
 
+/*
+ * A dense operand stretched to a broadcast shape without copying its elements (see broadcast_view). Only
+ * lives as long as the operation it's used for.
+ */
+struct BROADCAST_VIEW {
+  DENSE_STORAGE storage;
+  size_t        shape[NM_MAX_RANK], offset[NM_MAX_RANK], stride[NM_MAX_RANK];
+};
+
+static bool broadcast_shape(const DENSE_STORAGE* left, const DENSE_STORAGE* right, size_t* shape, size_t* dim);
+static const DENSE_STORAGE* broadcast_view(const DENSE_STORAGE* s, const size_t* shape, size_t dim, BROADCAST_VIEW* view);
+
 /*
  * Functions
  */
@@ -425,14 +456,28 @@ bool nm_dense_storage_is_symmetric(const DENSE_STORAGE* mat, int lda) {
  * Dense matrix-matrix and matrix-scalar element-wise operations.
  *
  * right or rscalar should be NULL; they should not both be initialized. If right is NULL, it'll use the scalar value instead.
+ *
+ * Matrices of different shapes are broadcast against one another (see broadcast_shape) without copying either.
  */
 STORAGE* nm_dense_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar) {
 	OP_LR_DTYPE_TEMPLATE_TABLE(nm::dense_storage::ew_op, DENSE_STORAGE*, const DENSE_STORAGE* left, const DENSE_STORAGE* right, const void*);
 
-	if (right)
-	  return ttable[op][left->dtype][right->dtype](reinterpret_cast<const DENSE_STORAGE*>(left), reinterpret_cast<const DENSE_STORAGE*>(right), NULL);
-	else {
-	  nm::dtype_t r_dtype = nm_dtype_guess(scalar);
+	if (right) {
+	  // Operands of different shapes are broadcast against each other.
+	  size_t shape[NM_MAX_RANK], dim;
+	  BROADCAST_VIEW l_view, r_view;
+
+	  if (!broadcast_shape(reinterpret_cast<const DENSE_STORAGE*>(left), reinterpret_cast<const DENSE_STORAGE*>(right), shape, &dim))
+	    rb_raise(rb_eArgError, "The left- and right-hand sides of the operation have shapes which can't be broadcast together.");
+
+	  const DENSE_STORAGE* l = broadcast_view(reinterpret_cast<const DENSE_STORAGE*>(left),  shape, dim, &l_view);
+	  const DENSE_STORAGE* r = broadcast_view(reinterpret_cast<const DENSE_STORAGE*>(right), shape, dim, &r_view);
+
+	  return ttable[op][left->dtype][right->dtype](l, r, NULL);
+
+	} else {
+	  // When the scalar fits the left dtype, matching dtypes lets the operation use the vectorized kernels.
+	  nm::dtype_t r_dtype = nm_dtype_guess_for(scalar, left->dtype);
 	  void* r_scalar  = ALLOCA_N(char, DTYPE_SIZES[r_dtype]);
 	  rubyval_to_cval(scalar, r_dtype, r_scalar);
 
@@ -440,6 +485,87 @@ STORAGE* nm_dense_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAG
 	}
 }
 
+/*
+ * Evaluates a postfix expression of arithmetic element-wise operations (see fused_instr_t) in a single pass,
+ * without allocating a matrix for each intermediate result.
+ *
+ * All leaves must be dense, with the same shape and dtype; scalars are packed one after another, already
+ * converted to that dtype. No scalar may be the left operand of an operation. The caller checks all of this.
+ */
+STORAGE* nm_dense_storage_ew_fused(const nm::dense_storage::fused_instr_t* program, size_t length, DENSE_STORAGE** leaves, const void* scalars) {
+	DTYPE_TEMPLATE_TABLE(nm::dense_storage::ew_fused, void, DENSE_STORAGE*, const nm::dense_storage::fused_instr_t*, size_t, size_t, DENSE_STORAGE**, size_t, const void*);
+
+  size_t depth = 0, max_depth = 0, n_leaves = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (program[i].kind == nm::dense_storage::FUSED_OP) --depth;
+    else                                               max_depth = std::max(max_depth, ++depth);
+
+    if (program[i].kind == nm::dense_storage::FUSED_LEAF) ++n_leaves;
+  }
+
+  const DENSE_STORAGE* first = leaves[0];
+
+	size_t* shape = ALLOC_N(size_t, first->dim);
+	memcpy(shape, first->shape, sizeof(size_t) * first->dim);
+
+	DENSE_STORAGE* result = nm_dense_storage_create(first->dtype, shape, first->dim, NULL, 0);
+
+  ttable[first->dtype](result, program, length, max_depth, leaves, n_leaves, scalars);
+
+  return result;
+}
+
+/*
+ * Reduce a dense matrix along dimension dim (sum, mean, etc.), giving a FLOAT64 matrix of the same shape except
+ * that dim has length 1. Returns NULL for complex matrices, which the caller handles some other way.
+ */
+STORAGE* nm_dense_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim) {
+	DTYPE_TEMPLATE_TABLE(nm::dense_storage::reduce, DENSE_STORAGE*, nm::reduce_t, const DENSE_STORAGE*, size_t);
+
+  if (s->dtype == nm::COMPLEX64 || s->dtype == nm::COMPLEX128) return NULL;
+
+  return ttable[s->dtype](op, reinterpret_cast<const DENSE_STORAGE*>(s), dim);
+}
+
+/*
+ * Dense in-place element-wise operations: left = left op right (or left op scalar), where left may be a reference.
+ *
+ * Only the arithmetic operations are allowed, and the caller must have checked that the result fits in the
+ * left-hand dtype. right may be broadcast to the shape of left.
+ */
+void nm_dense_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar) {
+	OP_LR_DTYPE_TEMPLATE_TABLE(nm::dense_storage::ew_op_in_place, void, DENSE_STORAGE* left, const DENSE_STORAGE* right, const void*);
+
+  if (static_cast<uint8_t>(op) >= nm::NUM_NONCOMP_EWOPS)
+    rb_raise(rb_eArgError, "comparisons cannot be done in place");
+
+	if (right) {
+	  const DENSE_STORAGE* l = reinterpret_cast<const DENSE_STORAGE*>(left);
+	  const DENSE_STORAGE* r = reinterpret_cast<const DENSE_STORAGE*>(right);
+
+	  // right may be broadcast up to the shape of left, but not the other way around.
+	  size_t shape[NM_MAX_RANK], dim;
+	  if (!broadcast_shape(l, r, shape, &dim) || dim != l->dim || memcmp(shape, l->shape, sizeof(size_t) * dim) != 0)
+	    rb_raise(rb_eArgError, "The right-hand side of an in-place operation must have (or broadcast to) the shape of the left.");
+
+	  // If right views the same elements as left, it may read values that this operation has already overwritten.
+	  bool overlaps = right != left && right->src == left->src;
+	  const DENSE_STORAGE* r_copy = overlaps ? nm_dense_storage_copy(r) : r;
+
+	  BROADCAST_VIEW r_view;
+	  ttable[op][left->dtype][right->dtype](reinterpret_cast<DENSE_STORAGE*>(left), broadcast_view(r_copy, shape, dim, &r_view), NULL);
+
+	  if (overlaps) nm_dense_storage_delete(reinterpret_cast<STORAGE*>(const_cast<DENSE_STORAGE*>(r_copy)));
+
+	} else {
+	  nm::dtype_t r_dtype = nm_dtype_guess_for(scalar, left->dtype);
+	  void* r_scalar  = ALLOCA_N(char, DTYPE_SIZES[r_dtype]);
+	  rubyval_to_cval(scalar, r_dtype, r_scalar);
+
+    ttable[op][left->dtype][r_dtype](reinterpret_cast<DENSE_STORAGE*>(left), NULL, r_scalar);
+	}
+}
+
 /*
  * Dense matrix-matrix multiplication.
  */
@@ -449,6 +575,15 @@ STORAGE* nm_dense_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, si
   return ttable[casted_storage.left->dtype](casted_storage, resulting_shape, vector);
 }
 
+/*
+ * Batched dense matrix multiplication: left is [B,M,K], right [B,K,N] or [K,N], and the result [B,M,N].
+ */
+STORAGE* nm_dense_storage_batch_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape) {
+  DTYPE_TEMPLATE_TABLE(nm::dense_storage::batch_multiply, DENSE_STORAGE*, const STORAGE_PAIR& casted_storage, size_t* resulting_shape);
+
+  return ttable[casted_storage.left->dtype](casted_storage, resulting_shape);
+}
+
 /////////////
 // Utility //
 /////////////
@@ -521,6 +656,60 @@ static void slice_copy(DENSE_STORAGE *dest, const DENSE_STORAGE *src, size_t* le
 
 }
 
+/*
+ * Work out the shape that left and right broadcast to. As in NumPy, shapes are lined up at their last
+ * dimension, missing leading dimensions count as 1, and a dimension of 1 stretches to match the other side.
+ * Returns false if the shapes are incompatible.
+ */
+static bool broadcast_shape(const DENSE_STORAGE* left, const DENSE_STORAGE* right, size_t* shape, size_t* dim) {
+  *dim = std::max(left->dim, right->dim);
+
+  for (size_t d = 0; d < *dim; ++d) {
+    size_t l = d + left->dim  >= *dim ? left->shape[d + left->dim - *dim]   : 1,
+           r = d + right->dim >= *dim ? right->shape[d + right->dim - *dim] : 1;
+
+    if      (l == r || r == 1) shape[d] = l;
+    else if (l == 1)           shape[d] = r;
+    else                       return false;
+  }
+
+  return true;
+}
+
+/*
+ * Make s look like a matrix of the given (broadcast) shape. Stretched and missing leading dimensions get a
+ * stride of zero, so the iterator just reads the same elements again. A stretched dimension's offset (when s is
+ * a reference) is moved into the elements pointer, since a zero stride would otherwise drop it. Returns s itself
+ * if no stretching is needed.
+ */
+static const DENSE_STORAGE* broadcast_view(const DENSE_STORAGE* s, const size_t* shape, size_t dim, BROADCAST_VIEW* view) {
+  if (s->dim == dim && memcmp(s->shape, shape, sizeof(size_t) * dim) == 0) return s;
+
+  size_t lead = dim - s->dim,
+         base = 0;
+
+  for (size_t d = 0; d < dim; ++d) {
+    bool stretched = d < lead || s->shape[d - lead] != shape[d];
+
+    if (stretched && d >= lead) base += s->offset[d - lead] * s->stride[d - lead];
+
+    view->shape[d]  = shape[d];
+    view->offset[d] = stretched ? 0 : s->offset[d - lead];
+    view->stride[d] = stretched ? 0 : s->stride[d - lead];
+  }
+
+  view->storage.dtype    = s->dtype;
+  view->storage.dim      = dim;
+  view->storage.shape    = view->shape;
+  view->storage.offset   = view->offset;
+  view->storage.stride   = view->stride;
+  view->storage.count    = 1;
+  view->storage.src      = s->src;
+  view->storage.elements = reinterpret_cast<char*>(s->elements) + base * DTYPE_SIZES[s->dtype];
+
+  return &view->storage;
+}
+
 /////////////////////////
 // Copying and Casting //
 /////////////////////////
@@ -651,9 +840,13 @@ DENSE_STORAGE* cast_copy(const DENSE_STORAGE* rhs, dtype_t new_dtype) {
       }
       nm_dense_storage_delete(tmp);
     } else {
-      /* Make a regular copy. */
+      /* Make a regular copy. Conversions between machine types can't call into Ruby, so big ones are split up. */
+
+      bool nogvl = std::is_arithmetic<LDType>::value && std::is_arithmetic<RDType>::value;
 
-    	while (count-- > 0)     		lhs_els[count] = rhs_els[count];
+      thread_pool::parallel_for(count, nogvl, count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) lhs_els[i] = rhs_els[i];
+      });
     }
   }
 	
@@ -738,16 +931,120 @@ bool is_symmetric(const DENSE_STORAGE* mat, int lda) {
 }
 
 /*
- * Templated dense storage element-wise operations which return the same DType.
+ * Applies a single element-wise operation to one run handed out by StridedIterator. The first
+ * loops cover the common case of unit strides everywhere (or a scalar on the right), which the
+ * compiler can vectorize; anything else falls through to the general strided loop.
  */
 template <ewop_t op, typename LDType, typename RDType>
-static DENSE_STORAGE* ew_op(const DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar) {
-	unsigned int count;
-  size_t l_count;
-  size_t r_count;
+static inline void ew_op_run(size_t n, typename ew_elem<op,LDType,RDType>::result_type* res, size_t res_stride,
+                             const LDType* l, size_t l_stride, const RDType* r, size_t r_stride) {
+  typedef ew_elem<op,LDType,RDType> elem;
+
+  if (res_stride == 1 && l_stride == 1 && r_stride == 1) {
+    for (size_t i = 0; i < n; ++i) res[i] = elem::apply(l[i], r[i]);
 
-	size_t* temp_coords = ALLOCA_N(size_t, left->dim);
+  } else if (res_stride == 1 && l_stride == 1 && r_stride == 0) {
+    const RDType rval = *r;
+    for (size_t i = 0; i < n; ++i) res[i] = elem::apply(l[i], rval);
+
+  } else {
+    for (size_t i = 0; i < n; ++i, res += res_stride, l += l_stride, r += r_stride)
+      *res = elem::apply(*l, *r);
+  }
+}
+
+/*
+ * Splits the common shape of N operands into one box per thread, cutting along a single dimension (the
+ * outermost one with at least as many entries as there are threads, or failing that the longest), and calls
+ * fn(shape, offsets) for each box. offsets[k] may be NULL for an operand which starts at the origin.
+ *
+ * Operations below the parallel threshold, or with nogvl false, are a single call covering the whole shape.
+ * If keep is given, that dimension is never cut (e.g., because it's being reduced).
+ */
+template <size_t N, typename F>
+static void parallel_boxes(const size_t* shape, size_t dim, const size_t* const* offsets, bool nogvl, F fn, size_t keep = NM_MAX_RANK) {
+  size_t count = 1, split = NM_MAX_RANK;
+  for (size_t d = 0; d < dim; ++d) {
+    count *= shape[d];
+    if (d != keep && (split == NM_MAX_RANK || shape[d] > shape[split])) split = d;
+  }
+
+  for (size_t d = 0; d < dim; ++d) {
+    if (d != keep && shape[d] >= thread_pool::num_threads()) {
+      split = d;
+      break;
+    }
+  }
+
+  if (split == NM_MAX_RANK) {
+    fn(shape, offsets);
+    return;
+  }
+
+  thread_pool::parallel_for(count, nogvl, shape[split], [&](size_t begin, size_t end) {
+    size_t        sub_shape[NM_MAX_RANK];
+    size_t        sub_offsets[N][NM_MAX_RANK];
+    const size_t* sub_offset_ptrs[N];
+
+    memcpy(sub_shape, shape, sizeof(size_t) * dim);
+    sub_shape[split] = end - begin;
+
+    for (size_t k = 0; k < N; ++k) {
+      for (size_t d = 0; d < dim; ++d) sub_offsets[k][d] = offsets[k] ? offsets[k][d] : 0;
+      sub_offsets[k][split] += begin;
+      sub_offset_ptrs[k] = sub_offsets[k];
+    }
+
+    fn(sub_shape, sub_offset_ptrs);
+  });
+}
+
+/*
+ * Walks left, right (or the scalar, as an operand with zero strides), and the result together, one
+ * innermost run at a time. The result is usually freshly allocated, but for in-place operations it
+ * is left itself (possibly a reference, in which case we write through to its source).
+ *
+ * Large operations are split across the thread pool; each thread gets its own box of the result.
+ */
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_strided(DENSE_STORAGE* result, const DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar) {
+  size_t* zero = ALLOCA_N(size_t, left->dim);
+  memset(zero, 0, sizeof(size_t) * left->dim);
+
+  const size_t* strides[3] = { result->stride, left->stride, right ? right->stride : zero };
+  const size_t* offsets[3] = { result->offset, left->offset, right ? right->offset : NULL };
+
+  typedef typename ew_elem<op,LDType,RDType>::result_type OutDType;
+
+  OutDType*     res_elems = reinterpret_cast<OutDType*>(result->elements);
+  const LDType* l_elems   = reinterpret_cast<const LDType*>(left->elements);
+  const RDType* r_elems   = right ? reinterpret_cast<const RDType*>(right->elements) : reinterpret_cast<const RDType*>(rscalar);
+
+  // Vectorized kernel for this op and dtype pair, if the current ISA has one.
+  simd::ew_kernel_t kernel = simd::ew_kernel<op,LDType,RDType>();
+
+  parallel_boxes<3>(left->shape, left->dim, offsets, ew_op_nogvl<op,LDType,RDType>::value,
+                    [&](const size_t* shape, const size_t* const* box_offsets) {
+    StridedIterator<3> it(shape, left->dim, strides, box_offsets);
+    do {
+      if (kernel && it.stride(0) == 1 && it.stride(1) == 1 && it.stride(2) <= 1) {
+        kernel(it.run_length(), l_elems + it.pos(1), r_elems + it.pos(2), it.stride(2) == 0, res_elems + it.pos(0));
+
+      } else {
+        ew_op_run<op,LDType,RDType>(it.run_length(),
+                                    res_elems + it.pos(0), it.stride(0),
+                                    l_elems   + it.pos(1), it.stride(1),
+                                    r_elems   + it.pos(2), it.stride(2));
+      }
+    } while (it.next());
+  });
+}
 
+/*
+ * Templated dense storage element-wise operations which return the same DType.
+ */
+template <ewop_t op, typename LDType, typename RDType>
+static DENSE_STORAGE* ew_op(const DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar) {
 	size_t* new_shape = ALLOC_N(size_t, left->dim);
 	memcpy(new_shape, left->shape, sizeof(size_t) * left->dim);
 
@@ -756,115 +1053,344 @@ static DENSE_STORAGE* ew_op(const DENSE_STORAGE* left, const DENSE_STORAGE* righ
   dtype_t new_dtype = static_cast<uint8_t>(op) < NUM_NONCOMP_EWOPS ? left->dtype : BYTE;
 
 	DENSE_STORAGE* result = nm_dense_storage_create(new_dtype, new_shape, left->dim, NULL, 0);
-	
-	LDType* l_elems = reinterpret_cast<LDType*>(left->elements);
 
-	if (right) { // matrix-matrix operation
-	  RDType* r_elems = reinterpret_cast<RDType*>(right->elements);
+  ew_op_strided<op,LDType,RDType>(result, left, right, rscalar);
+
+	return result;
+}
 
-    if (static_cast<uint8_t>(op) < NUM_NONCOMP_EWOPS) { // use left-dtype
 
-      for (count = nm_storage_count_max_elements(result); count-- > 0;) {
-        nm_dense_storage_coords(result, count, temp_coords);
-        l_count = nm_dense_storage_pos(left, temp_coords);
-        r_count = nm_dense_storage_pos(right, temp_coords);
-        
-        reinterpret_cast<LDType*>(result->elements)[count] = ew_op_switch<op,LDType,RDType>(l_elems[l_count], r_elems[r_count]);
-      }
+/*
+ * Templated dense storage in-place element-wise operations. Only arithmetic operations are ever dispatched
+ * here, since comparisons change the dtype.
+ */
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_in_place(DENSE_STORAGE* left, const DENSE_STORAGE* right, const void* rscalar) {
+  ew_op_strided<op,LDType,RDType>(left, left, right, rscalar);
+}
+
+/*
+ * One operation of a fused expression on a chunk of n contiguous elements. r is either a chunk as well or,
+ * if r_scalar, a single value.
+ */
+template <ewop_t op, typename DType>
+static inline void fused_run(size_t n, DType* res, const DType* l, const DType* r, bool r_scalar) {
+  simd::ew_kernel_t kernel = simd::ew_kernel<op,DType,DType>();
+
+  if (kernel) kernel(n, l, r, r_scalar, res);
+  else        ew_op_run<op,DType,DType>(n, res, 1, l, 1, r, r_scalar ? 0 : 1);
+}
+
+template <typename DType>
+static inline void fused_apply(ewop_t op, size_t n, DType* res, const DType* l, const DType* r, bool r_scalar) {
+  switch (op) {
+    case EW_ADD: fused_run<EW_ADD,DType>(n, res, l, r, r_scalar); break;
+    case EW_SUB: fused_run<EW_SUB,DType>(n, res, l, r, r_scalar); break;
+    case EW_MUL: fused_run<EW_MUL,DType>(n, res, l, r, r_scalar); break;
+    case EW_DIV: fused_run<EW_DIV,DType>(n, res, l, r, r_scalar); break;
+    default:     rb_raise(rb_eArgError, "only arithmetic operations can be fused");
+  }
+}
+
+/*
+ * Fused element-wise evaluation. The result is produced FUSED_BLOCK_SIZE elements at a time: the program runs
+ * once per chunk, reading the leaves in place and keeping each intermediate in a chunk-sized buffer (one per
+ * level of the operand stack), so memory traffic is one read of each leaf and one write of the result.
+ *
+ * Unsliced leaves are walked as a single run. If any leaf is a reference, we go one innermost row at a time,
+ * since only the last dimension is guaranteed to be contiguous in every leaf. Chunks are divided among the
+ * thread pool for large matrices.
+ */
+template <typename DType>
+static void ew_fused(DENSE_STORAGE* result, const fused_instr_t* program, size_t length, size_t depth, DENSE_STORAGE** leaves, size_t n_leaves, const void* scalars) {
+  struct operand {
+    const DType* p;
+    bool         scalar;
+  };
+
+  DType*       res_elems = reinterpret_cast<DType*>(result->elements);
+  const DType* s_elems   = reinterpret_cast<const DType*>(scalars);
+
+  size_t count = nm_storage_count_max_elements(result), row_length = count;
+  bool   divides = false;
+
+  for (size_t k = 0; k < n_leaves; ++k) {
+    if (leaves[k]->src != leaves[k]) row_length = result->shape[result->dim - 1];
+  }
+
+  for (size_t pc = 0; pc < length; ++pc) {
+    if (program[pc].kind == FUSED_OP && program[pc].op == EW_DIV) divides = true;
+  }
 
-    } else { // new_dtype is BYTE: comparison operators
-      uint8_t* res_elems = reinterpret_cast<uint8_t*>(result->elements);
+  if (row_length == 0) return;
 
-      for (count = nm_storage_count_max_elements(result); count-- > 0;) {
-        nm_dense_storage_coords(result, count, temp_coords);
-        l_count = nm_dense_storage_pos(left, temp_coords);
-        r_count = nm_dense_storage_pos(right, temp_coords);
+  size_t chunks_per_row = (row_length + FUSED_BLOCK_SIZE - 1) / FUSED_BLOCK_SIZE;
+  size_t n_chunks       = count / row_length * chunks_per_row;
+  bool   nogvl          = divides ? ew_op_nogvl<EW_DIV,DType,DType>::value : ew_op_nogvl<EW_ADD,DType,DType>::value;
 
-        switch (op) {
-          case EW_EQEQ:
-            res_elems[count] = l_elems[l_count] == r_elems[r_count];
-            break;
+  thread_pool::parallel_for(count * length, nogvl, n_chunks, [&](size_t begin, size_t end) {
+    DType*        buffers = ALLOCA_N(DType, depth * FUSED_BLOCK_SIZE);
+    operand*      stack   = ALLOCA_N(operand, depth);
+    const DType** rows    = ALLOCA_N(const DType*, n_leaves);
+    size_t*       coords  = ALLOCA_N(size_t, result->dim);
 
-          case EW_NEQ:
-            res_elems[count] = l_elems[l_count] != r_elems[r_count];
-            break;
+    for (size_t c = begin; c < end; ++c) {
+      size_t row = c / chunks_per_row * row_length,
+             i   = c % chunks_per_row * FUSED_BLOCK_SIZE;
 
-          case EW_LT:
-            res_elems[count] = l_elems[l_count] < r_elems[r_count];
-            break;
+      if (c == begin || i == 0) {
+        nm_dense_storage_coords(result, row, coords);
+        for (size_t k = 0; k < n_leaves; ++k)
+          rows[k] = reinterpret_cast<const DType*>(leaves[k]->elements) + nm_dense_storage_pos(leaves[k], coords);
+      }
+
+      size_t n  = std::min<size_t>(FUSED_BLOCK_SIZE, row_length - i);
+      size_t sp = 0;
+
+      for (size_t pc = 0; pc < length; ++pc) {
+        const fused_instr_t& instr = program[pc];
+
+        if (instr.kind == FUSED_LEAF) {
+          stack[sp].p      = rows[instr.index] + i;
+          stack[sp].scalar = false;
+          ++sp;
 
-          case EW_GT:
-            res_elems[count] = l_elems[l_count] > r_elems[r_count];
-            break;
+        } else if (instr.kind == FUSED_SCALAR) {
+          stack[sp].p      = s_elems + instr.index;
+          stack[sp].scalar = true;
+          ++sp;
 
-          case EW_LEQ:
-            res_elems[count] = l_elems[l_count] <= r_elems[r_count];
-            break;
+        } else {
+          const operand& r = stack[--sp];
+          DType* dst = pc + 1 == length ? res_elems + row + i : buffers + (sp - 1) * FUSED_BLOCK_SIZE;
 
-          case EW_GEQ:
-            res_elems[count] = l_elems[l_count] >= r_elems[r_count];
-            break;
+          fused_apply<DType>(instr.op, n, dst, stack[sp - 1].p, r.p, r.scalar);
 
-          default:
-            rb_raise(rb_eStandardError, "this should not happen");
+          stack[sp - 1].p = dst;
         }
       }
     }
+  });
+}
 
-  } else { // matrix-scalar operation
-    const RDType* r_elem = reinterpret_cast<const RDType*>(rscalar);
-
-    if (static_cast<uint8_t>(op) < NUM_NONCOMP_EWOPS) { // use left-dtype
+/*
+ * Accumulator for sums: exact for the integer dtypes, double for everything else.
+ */
+template <typename DType> struct reduce_sum_type          { typedef double  type; };
+template <>               struct reduce_sum_type<uint8_t> { typedef int64_t type; };
+template <>               struct reduce_sum_type<int8_t>  { typedef int64_t type; };
+template <>               struct reduce_sum_type<int16_t> { typedef int64_t type; };
+template <>               struct reduce_sum_type<int32_t> { typedef int64_t type; };
+template <>               struct reduce_sum_type<int64_t> { typedef int64_t type; };
 
-      for (count = nm_storage_count_max_elements(result); count-- > 0;) {
-        nm_dense_storage_coords(result, count, temp_coords);
-        l_count = nm_dense_storage_pos(left, temp_coords);
+/*
+ * Calls fn(n, x, x_stride, a, a_stride) for each run of s, where x points into s and a is the index of the
+ * accumulator for x[0]. Accumulators are laid out like the result (s with dim collapsed to 1), so a_stride
+ * is 0 along dim. Runs are split among the threads along some other dimension, so that no two threads ever
+ * share an accumulator, and the order each accumulator sees its elements in is always the same.
+ */
+template <typename DType, typename F>
+static void reduce_runs(const DENSE_STORAGE* s, const DENSE_STORAGE* result, size_t dim, F fn) {
+  size_t a_stride[NM_MAX_RANK];
+  memcpy(a_stride, result->stride, sizeof(size_t) * s->dim);
+  a_stride[dim] = 0;
+
+  const size_t* strides[2] = { s->stride, a_stride };
+  const size_t* offsets[2] = { s->offset, NULL };
+  const DType*  elems      = reinterpret_cast<const DType*>(s->elements);
+
+  // RubyObjects are converted to double through Ruby.
+  bool nogvl = !std::is_same<DType, RubyObject>::value;
+
+  parallel_boxes<2>(s->shape, s->dim, offsets, nogvl, [&](const size_t* shape, const size_t* const* box_offsets) {
+    StridedIterator<2> it(shape, s->dim, strides, box_offsets);
+    do {
+      fn(it.run_length(), elems + it.pos(0), it.stride(0), it.pos(1), it.stride(1));
+    } while (it.next());
+  }, dim);
+}
 
-        reinterpret_cast<LDType*>(result->elements)[count] = ew_op_switch<op,LDType,RDType>(l_elems[l_count], *r_elem);
+/*
+ * Reduction along one dimension. Rather than walking each output element's column in turn, this makes one pass
+ * over s in memory order, updating whichever accumulator each element belongs to.
+ */
+template <typename DType>
+static DENSE_STORAGE* reduce(reduce_t op, const DENSE_STORAGE* s, size_t dim) {
+  typedef typename reduce_sum_type<DType>::type SumDType;
+
+  size_t* shape = ALLOC_N(size_t, s->dim);
+  memcpy(shape, s->shape, sizeof(size_t) * s->dim);
+  shape[dim] = 1;
+
+  DENSE_STORAGE* result = nm_dense_storage_create(FLOAT64, shape, s->dim, NULL, 0);
+  double*        res    = reinterpret_cast<double*>(result->elements);
+  size_t         n_out  = nm_storage_count_max_elements(result),
+                 length = s->shape[dim];
+
+  switch (op) {
+  case REDUCE_PROD:
+  case REDUCE_MIN:
+  case REDUCE_MAX:
+    std::fill(res, res + n_out, reduce_identity(op));
+
+    reduce_runs<DType>(s, result, dim, [&](size_t n, const DType* x, size_t xs, size_t a, size_t as) {
+      for (size_t i = 0; i < n; ++i, x += xs, a += as) {
+        double v = reduce_value(*x);
+        if      (op == REDUCE_PROD) res[a] *= v;
+        else if (op == REDUCE_MIN)  res[a]  = std::min(res[a], v);
+        else                        res[a]  = std::max(res[a], v);
       }
+    });
+    break;
 
-    } else {
-      uint8_t* res_elems = reinterpret_cast<uint8_t*>(result->elements);
+  default: {
+    // Sums first; the mean, variance and standard deviation all start from there.
+    std::vector<SumDType> sums(n_out, 0);
 
-      for (count = nm_storage_count_max_elements(result); count-- > 0;) {
-        nm_dense_storage_coords(result, count, temp_coords);
-        l_count = nm_dense_storage_pos(left, temp_coords);
-        
-        switch (op) {
-          case EW_EQEQ:
-            res_elems[count] = l_elems[l_count] == *r_elem;
-            break;
+    reduce_runs<DType>(s, result, dim, [&](size_t n, const DType* x, size_t xs, size_t a, size_t as) {
+      SumDType* acc = &sums[a];
 
-          case EW_NEQ:
-            res_elems[count] = l_elems[l_count] != *r_elem;
-            break;
+      if (as == 0) {
+        SumDType total = 0;
+        for (size_t i = 0; i < n; ++i, x += xs) total += reduce_value<SumDType>(*x);
+        *acc += total;
 
-          case EW_LT:
-            res_elems[count] = l_elems[l_count] < *r_elem;
-            break;
+      } else if (xs == 1 && as == 1) {
+        for (size_t i = 0; i < n; ++i) acc[i] += reduce_value<SumDType>(x[i]);
 
-          case EW_GT:
-            res_elems[count] = l_elems[l_count] > *r_elem;
-            break;
+      } else {
+        for (size_t i = 0; i < n; ++i, x += xs, acc += as) *acc += reduce_value<SumDType>(*x);
+      }
+    });
 
-          case EW_LEQ:
-            res_elems[count] = l_elems[l_count] <= *r_elem;
-            break;
+    for (size_t o = 0; o < n_out; ++o)
+      res[o] = op == REDUCE_SUM ? static_cast<double>(sums[o]) : static_cast<double>(sums[o]) / length;
 
-          case EW_GEQ:
-            res_elems[count] = l_elems[l_count] >= *r_elem;
-            break;
+    if (op == REDUCE_VARIANCE || op == REDUCE_STD) {
+      // Second pass for the sum of squared deviations from the mean, which is more accurate than sum(x^2) - n*mean^2.
+      std::vector<double> devs(n_out, 0);
 
-          default:
-            rb_raise(rb_eStandardError, "this should not happen");
+      reduce_runs<DType>(s, result, dim, [&](size_t n, const DType* x, size_t xs, size_t a, size_t as) {
+        for (size_t i = 0; i < n; ++i, x += xs, a += as) {
+          double d = reduce_value(*x) - res[a];
+          devs[a] += d * d;
         }
+      });
+
+      for (size_t o = 0; o < n_out; ++o) {
+        res[o] = devs[o] / (length - 1);
+        if (op == REDUCE_STD) res[o] = std::sqrt(res[o]);
       }
+    }
+  }
+  }
 
+  return result;
+}
+
+/*
+ * Which dimension a parallel matrix product is split along.
+ */
+enum product_split_t { SPLIT_M, SPLIT_N, SPLIT_K };
+
+/*
+ * Splitting along M (rows of the result) or N (columns) needs no extra memory or synchronization, so those are
+ * preferred whenever there are enough rows or columns to go round. Otherwise -- a short, wide times tall, narrow
+ * product -- K is split, and each thread computes a partial product which is then summed.
+ *
+ * The choice depends only on the shape and the thread count, never on timing.
+ */
+static product_split_t product_split(size_t M, size_t N, size_t K, size_t work, bool nogvl) {
+  size_t threads = thread_pool::num_threads();
+
+  if (M >= threads) return SPLIT_M;
+  if (N >= threads) return SPLIT_N;
+  if (K >= threads && nogvl && work >= thread_pool::threshold()) return SPLIT_K;
+  return SPLIT_M;
+}
+
+/*
+ * For a split along K: calls partial(t, k_begin, k_end, out, ld) for each of T chunks of [0, K), where out is result
+ * (leading dimension ld) for the first chunk and a scratch buffer (leading dimension cols) for the others. The
+ * scratch buffers are then added into result in chunk order, so the rounding is the same from run to run.
+ */
+template <typename DType, typename F>
+static void sum_k_chunks(size_t rows, size_t cols, size_t K, DType* result, size_t ld, size_t work, F partial) {
+  const size_t T = std::min(K, thread_pool::num_threads());
+  DType* scratch = ALLOC_N(DType, (T - 1) * rows * cols);
+
+  thread_pool::parallel_for(work, true, T, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; ++t) {
+      if (t == 0) partial(K * t / T, K * (t+1) / T, result, ld);
+      else        partial(K * t / T, K * (t+1) / T, scratch + (t-1) * rows * cols, cols);
     }
+  });
+
+  for (size_t t = 1; t < T; ++t) {
+    const DType* part = scratch + (t-1) * rows * cols;
+    for (size_t i = 0; i < rows; ++i)
+      for (size_t j = 0; j < cols; ++j)
+        result[i*ld + j] += part[i*cols + j];
+  }
+
+  xfree(scratch);
+}
+
+/*
+ * C = A * B, row-major, with A M x K and B K x N, split across the thread pool (see product_split). Each piece is an
+ * ordinary call to nm::math::gemm, so this works the same way whether that's CBLAS, the blocked integer version,
+ * or the reference loop. Dtypes whose arithmetic can call into Ruby just run on this thread, as one piece.
+ */
+template <typename DType>
+static void gemm_parallel(size_t M, size_t N, size_t K, const DType* A, size_t lda, const DType* B, size_t ldb, DType* C, size_t ldc) {
+  const DType one = 1, zero = 0;
+  const bool  nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+  size_t      work  = M * N * K;
+
+  switch (product_split(M, N, K, work, nogvl)) {
+  case SPLIT_M:
+    thread_pool::parallel_for(work, nogvl, M, [&](size_t begin, size_t end) {
+      nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, end - begin, N, K,
+                            &one, A + begin*lda, lda, B, ldb, &zero, C + begin*ldc, ldc);
+    });
+    break;
+
+  case SPLIT_N:
+    thread_pool::parallel_for(work, nogvl, N, [&](size_t begin, size_t end) {
+      nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, end - begin, K,
+                            &one, A, lda, B + begin, ldb, &zero, C + begin, ldc);
+    });
+    break;
+
+  case SPLIT_K:
+    sum_k_chunks<DType>(M, N, K, C, ldc, work, [&](size_t begin, size_t end, DType* out, size_t ldo) {
+      nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, end - begin,
+                            &one, A + begin, lda, B + begin*ldb, ldb, &zero, out, ldo);
+    });
   }
-	return result;
 }
 
+/*
+ * y = A * x, with A M x K (row-major) and x and y contiguous; otherwise as gemm_parallel. There's only one column,
+ * so the split is along M if there are enough rows, and otherwise along K.
+ */
+template <typename DType>
+static void gemv_parallel(size_t M, size_t K, const DType* A, size_t lda, const DType* x, DType* y) {
+  const DType one = 1, zero = 0;
+  const bool  nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+  size_t      work  = M * K;
+
+  if (product_split(M, 1, K, work, nogvl) == SPLIT_K) {
+    sum_k_chunks<DType>(M, 1, K, y, 1, work, [&](size_t begin, size_t end, DType* out, size_t) {
+      nm::math::gemv<DType>(CblasNoTrans, M, end - begin, &one, A + begin, lda, x + begin, 1, &zero, out, 1);
+    });
+
+  } else {
+    thread_pool::parallel_for(work, nogvl, M, [&](size_t begin, size_t end) {
+      nm::math::gemv<DType>(CblasNoTrans, end - begin, K, &one, A + begin*lda, lda, x, 1, &zero, y + begin, 1);
+    });
+  }
+}
 
 /*
  * DType-templated matrix-matrix multiplication for dense storage.
@@ -877,20 +1403,75 @@ static DENSE_STORAGE* matrix_multiply(const STORAGE_PAIR& casted_storage, size_t
   // Create result storage.
   DENSE_STORAGE* result = nm_dense_storage_create(left->dtype, resulting_shape, 2, NULL, 0);
 
-  DType *pAlpha = ALLOCA_N(DType, 1),
-        *pBeta  = ALLOCA_N(DType, 1);
-
-  *pAlpha = 1;
-  *pBeta = 0;
-  // Do the multiplication
-  if (vector) nm::math::gemv<DType>(CblasNoTrans, left->shape[0], left->shape[1], pAlpha,
-                                    reinterpret_cast<DType*>(left->elements), left->shape[1],
-                                    reinterpret_cast<DType*>(right->elements), 1, pBeta,
-                                    reinterpret_cast<DType*>(result->elements), 1);
-  else        nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, left->shape[0], right->shape[1], left->shape[1],
-                                    pAlpha, reinterpret_cast<DType*>(left->elements), left->shape[1],
-                                    reinterpret_cast<DType*>(right->elements), right->shape[1], pBeta,
-                                    reinterpret_cast<DType*>(result->elements), result->shape[1]);
+  // Do the multiplication, on the thread pool if it's a big one.
+  if (vector) gemv_parallel<DType>(left->shape[0], left->shape[1],
+                                   reinterpret_cast<DType*>(left->elements), left->shape[1],
+                                   reinterpret_cast<DType*>(right->elements),
+                                   reinterpret_cast<DType*>(result->elements));
+  else        gemm_parallel<DType>(left->shape[0], right->shape[1], left->shape[1],
+                                   reinterpret_cast<DType*>(left->elements), left->shape[1],
+                                   reinterpret_cast<DType*>(right->elements), right->shape[1],
+                                   reinterpret_cast<DType*>(result->elements), result->shape[1]);
+
+  return result;
+}
+
+/*
+ * c = a * b for small row-major matrices, a M x K and b K x N. The innermost loop runs along a row of b and c, so it
+ * vectorizes; when the sizes are compile-time constants the whole thing unrolls.
+ */
+template <typename DType>
+static inline void small_product(size_t M, size_t N, size_t K, const DType* a, const DType* b, DType* c) {
+  for (size_t i = 0; i < M; ++i, a += K, c += N) {
+    for (size_t j = 0; j < N; ++j) c[j] = 0;
+
+    for (size_t l = 0; l < K; ++l) {
+      const DType  a_il = a[l];
+      const DType* b_l  = b + l*N;
+      for (size_t j = 0; j < N; ++j) c[j] += a_il * b_l[j];
+    }
+  }
+}
+
+template <typename DType, size_t S>
+static void small_square_products(size_t begin, size_t end, const DType* a, const DType* b, size_t b_step, DType* c) {
+  for (size_t t = begin; t < end; ++t)
+    small_product<DType>(S, S, S, a + t*S*S, b + t*b_step, c + t*S*S);
+}
+
+/*
+ * Each product is independent, so the batch is split across the thread pool a block of products at a time, and
+ * each thread walks its block in memory order. Products too small to be worth handing to gemm -- which is most
+ * of the point of batching -- are done inline, with the common 4x4 and 8x8 cases fully unrolled.
+ */
+template <typename DType>
+static DENSE_STORAGE* batch_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape) {
+  DENSE_STORAGE *left  = (DENSE_STORAGE*)(casted_storage.left),
+                *right = (DENSE_STORAGE*)(casted_storage.right);
+
+  DENSE_STORAGE* result = nm_dense_storage_create(left->dtype, resulting_shape, 3, NULL, 0);
+
+  const size_t B = left->shape[0], M = left->shape[1], K = left->shape[2], N = right->shape[right->dim - 1];
+  const size_t b_step = right->dim == 3 ? K*N : 0; // a 2-D right-hand side is used for every product
+
+  const DType* a = reinterpret_cast<const DType*>(left->elements);
+  const DType* b = reinterpret_cast<const DType*>(right->elements);
+  DType*       c = reinterpret_cast<DType*>(result->elements);
+
+  const DType one = 1, zero = 0;
+
+  thread_pool::parallel_for(B * M * N * K, ew_op_nogvl<EW_MUL,DType,DType>::value, B, [&](size_t begin, size_t end) {
+    if      (M == 4 && N == 4 && K == 4) small_square_products<DType,4>(begin, end, a, b, b_step, c);
+    else if (M == 8 && N == 8 && K == 8) small_square_products<DType,8>(begin, end, a, b, b_step, c);
+    else if (M * N * K < NM_GEMM_MIN_WORK) {
+      for (size_t t = begin; t < end; ++t)
+        small_product<DType>(M, N, K, a + t*M*K, b + t*b_step, c + t*M*N);
+    } else {
+      for (size_t t = begin; t < end; ++t)
+        nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K,
+                              &one, a + t*M*K, K, b + t*b_step, N, &zero, c + t*M*N, N);
+    }
+  });
 
   return result;
 }
@@ -55,6 +55,26 @@
  * Types
  */
 
+namespace nm { namespace dense_storage {
+
+  enum fused_kind_t {
+    FUSED_LEAF,   // push a dense matrix
+    FUSED_SCALAR, // push a scalar
+    FUSED_OP      // pop two operands, push the result of op
+  };
+
+  /*
+   * One step of a fused element-wise expression, in postfix order. index refers to the leaves or
+   * scalars passed alongside the program to nm_dense_storage_ew_fused.
+   */
+  struct fused_instr_t {
+    fused_kind_t kind;
+    ewop_t       op;
+    size_t       index;
+  };
+
+}} // end of namespace nm::dense_storage
+
 /*
  * Data
  */
@@ -97,7 +117,11 @@ bool nm_dense_storage_is_hermitian(const DENSE_STORAGE* mat, int lda);
 //////////
 
 STORAGE* nm_dense_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar);
+void     nm_dense_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar);
+STORAGE* nm_dense_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim);
+STORAGE* nm_dense_storage_ew_fused(const nm::dense_storage::fused_instr_t* program, size_t length, DENSE_STORAGE** leaves, const void* scalars);
 STORAGE* nm_dense_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
+STORAGE* nm_dense_storage_batch_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape);
 
 /////////////
 // Utility //
@@ -0,0 +1,187 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == dense_iterator.h
+//
+// Strided n-dimensional iteration over several dense operands at
+// once. Rather than converting a linear index to coordinates and
+// back for every element, the iterator walks the shape as an
+// odometer and hands out runs along the innermost dimension, each
+// with a per-operand base position and stride. Dimensions which are
+// laid out contiguously in every operand are merged before
+// iteration begins, so an unsliced matrix is a single run.
+
+#ifndef DENSE_ITERATOR_H
+#define DENSE_ITERATOR_H
+
+/*
+ * Standard Includes
+ */
+
+#include <cstddef>
+
+/*
+ * Project Includes
+ */
+
+#include "nmatrix.h"
+
+/*
+ * Macros
+ */
+
+/*
+ * Types
+ */
+
+namespace nm { namespace dense_storage {
+
+/*
+ * Walks N operands which share a shape but may have different strides and
+ * offsets (e.g., a reference slice, a freshly allocated result, or a scalar
+ * given zero strides).
+ *
+ * Typical usage:
+ *
+ *   StridedIterator<2> it(shape, dim, strides, offsets);
+ *   do {
+ *     for (size_t i = 0; i < it.run_length(); ++i)
+ *       dst[it.pos(0) + i*it.stride(0)] = src[it.pos(1) + i*it.stride(1)];
+ *   } while (it.next());
+ */
+template <size_t N>
+class StridedIterator {
+public:
+  /*
+   * shape is shared by all operands; strides[k] and offsets[k] describe operand k
+   * in elements (offsets may be NULL for operands which start at the origin).
+   */
+  StridedIterator(const size_t* shape, size_t dim, const size_t* const* strides, const size_t* const* offsets)
+    : rank(0)
+  {
+    for (size_t k = 0; k < N; ++k) {
+      base[k] = 0;
+      if (offsets && offsets[k]) {
+        for (size_t d = 0; d < dim; ++d) base[k] += offsets[k][d] * strides[k][d];
+      }
+    }
+
+    empty = false;
+    for (size_t d = 0; d < dim; ++d)
+      if (shape[d] == 0) empty = true;
+
+    // Collapse the shape from the innermost dimension outward. Size-1 dimensions
+    // contribute nothing, and a dimension can be folded into the one inside it
+    // whenever every operand steps over it as though the two were one longer row.
+    for (size_t d = dim; d-- > 0;) {
+      if (shape[d] == 1) continue;
+
+      if (rank > 0) {
+        bool mergeable = true;
+        for (size_t k = 0; k < N; ++k) {
+          if (strides[k][d] != step[rank-1][k] * extent[rank-1]) {
+            mergeable = false;
+            break;
+          }
+        }
+
+        if (mergeable) {
+          extent[rank-1] *= shape[d];
+          continue;
+        }
+      }
+
+      extent[rank] = shape[d];
+      for (size_t k = 0; k < N; ++k) step[rank][k] = strides[k][d];
+      ++rank;
+    }
+
+    // A matrix of 1x1x...x1 still has one element to visit.
+    if (rank == 0) {
+      extent[0] = 1;
+      for (size_t k = 0; k < N; ++k) step[0][k] = 1;
+      rank = 1;
+    }
+
+    for (size_t r = 0; r < rank; ++r) counter[r] = 0;
+    for (size_t k = 0; k < N; ++k) cur[k] = base[k];
+  }
+
+  /*
+   * Number of elements in the current innermost run.
+   */
+  inline size_t run_length() const { return empty ? 0 : extent[0]; }
+
+  /*
+   * Position (in elements) of the first element of the current run in operand k.
+   */
+  inline size_t pos(size_t k) const { return cur[k]; }
+
+  /*
+   * Distance (in elements) between consecutive elements of the current run in operand k.
+   */
+  inline size_t stride(size_t k) const { return step[0][k]; }
+
+  /*
+   * True if the whole iteration is one run in which every operand is contiguous.
+   */
+  inline bool contiguous() const {
+    if (rank != 1) return false;
+    for (size_t k = 0; k < N; ++k)
+      if (step[0][k] != 1) return false;
+    return true;
+  }
+
+  /*
+   * Advance to the next run. Returns false once every run has been visited.
+   */
+  inline bool next() {
+    if (empty) return false;
+
+    for (size_t r = 1; r < rank; ++r) {
+      if (++counter[r] < extent[r]) {
+        for (size_t k = 0; k < N; ++k) cur[k] += step[r][k];
+        return true;
+      }
+
+      // Wrap this dimension and carry into the next one out.
+      counter[r] = 0;
+      for (size_t k = 0; k < N; ++k) cur[k] -= step[r][k] * (extent[r] - 1);
+    }
+
+    return false;
+  }
+
+private:
+  size_t rank;
+  bool   empty;
+  size_t extent[NM_MAX_RANK];
+  size_t step[NM_MAX_RANK][N];
+  size_t counter[NM_MAX_RANK];
+  size_t base[N];
+  size_t cur[N];
+};
+
+}} // end of namespace nm::dense_storage
+
+#endif // DENSE_ITERATOR_H
@@ -43,6 +43,7 @@
 #include "data/data.h"
 
 #include "common.h"
+#include "dense.h"
 #include "list.h"
 
 #include "util/math.h"
@@ -77,6 +78,15 @@ static void ew_op_prime(LIST* dest, LDType d_default, const LIST* left, LDType l
 template <ewop_t op, typename LDType, typename RDType>
 static void ew_comp_prime(LIST* dest, uint8_t d_default, const LIST* left, LDType l_default, const LIST* right, RDType r_default, const size_t* shape, size_t last_level, size_t level);
 
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_in_place(LIST* left, void* l_default, const LIST* right, const void* r_default, size_t recursions);
+
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_in_place_r(LIST* left, LDType l_default, const LIST* right, RDType r_default, LDType d_default, size_t recursions);
+
+template <typename DType>
+static void reduce(reduce_t op, const LIST_STORAGE* s, size_t dim, double* result);
+
 } // end of namespace list_storage
 
 extern "C" {
@@ -459,6 +469,57 @@ STORAGE* nm_list_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 }
 
 
+/*
+ * In-place element-wise operations for list storage: left = left op right, or left op scalar when right is NULL.
+ *
+ * Only arithmetic operations can be done in place, and the caller must have checked that the result fits in the
+ * left-hand dtype. The default value of left changes to (left default) op (right default or scalar).
+ */
+void nm_list_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar) {
+  OP_LR_DTYPE_TEMPLATE_TABLE(nm::list_storage::ew_op_in_place, void, LIST* left, void* l_default, const LIST* right, const void* r_default, size_t recursions);
+
+  LIST_STORAGE* l = reinterpret_cast<LIST_STORAGE*>(left);
+
+  if (static_cast<uint8_t>(op) >= NUM_NONCOMP_EWOPS)
+    rb_raise(rb_eArgError, "comparisons cannot be done in place");
+
+  // The default value belongs to the whole source matrix, so a reference can't change it.
+  if (l->src != l || (right && right->src != right))
+    rb_raise(rb_eNotImpError, "in-place element-wise operations are not supported on list references");
+
+  if (right) {
+    const LIST_STORAGE* r = reinterpret_cast<const LIST_STORAGE*>(right);
+    ttable[op][l->dtype][r->dtype](l->rows, l->default_val, r->rows, r->default_val, l->dim - 1);
+
+  } else {
+    dtype_t r_dtype = nm_dtype_guess_for(scalar, l->dtype);
+    void* r_scalar  = ALLOCA_N(char, DTYPE_SIZES[r_dtype]);
+    rubyval_to_cval(scalar, r_dtype, r_scalar);
+
+    ttable[op][l->dtype][r_dtype](l->rows, l->default_val, NULL, r_scalar, l->dim - 1);
+  }
+}
+
+/*
+ * Reduce a list matrix along dimension dim, giving a FLOAT64 dense matrix with that dimension collapsed to 1.
+ * Only the stored entries are visited; the rest all contribute the default value. Returns NULL for references
+ * and complex matrices, which the caller handles some other way.
+ */
+STORAGE* nm_list_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim) {
+  DTYPE_TEMPLATE_TABLE(nm::list_storage::reduce, void, nm::reduce_t, const LIST_STORAGE*, size_t, double*);
+
+  if (s->src != s || s->dtype == nm::COMPLEX64 || s->dtype == nm::COMPLEX128) return NULL;
+
+  size_t* shape = ALLOC_N(size_t, s->dim);
+  memcpy(shape, s->shape, sizeof(size_t) * s->dim);
+  shape[dim] = 1;
+
+  DENSE_STORAGE* result = nm_dense_storage_create(nm::FLOAT64, shape, s->dim, NULL, 0);
+  ttable[s->dtype](op, reinterpret_cast<const LIST_STORAGE*>(s), dim, reinterpret_cast<double*>(result->elements));
+
+  return result;
+}
+
 /*
  * List storage matrix multiplication.
  */
@@ -1154,5 +1215,121 @@ static void ew_op_prime(LIST* dest, LDType d_default, const LIST* left, LDType l
 	}
 }
 
-}} // end of namespace nm::list_storage
+/*
+ * List storage in-place element-wise operations. right may be NULL, in which case every element of left is
+ * combined with r_default (this is how scalars are handled).
+ */
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_in_place(LIST* left, void* l_default, const LIST* right, const void* r_default, size_t recursions) {
+  LDType* l_def = reinterpret_cast<LDType*>(l_default);
+  RDType  r_def = *reinterpret_cast<const RDType*>(r_default);
+  LDType  d_def = ew_op_switch<op, LDType, RDType>(*l_def, r_def);
+
+  ew_op_in_place_r<op, LDType, RDType>(left, *l_def, right, r_def, d_def, recursions);
+
+  *l_def = d_def;
+}
 
+/*
+ * Recursive helper for ew_op_in_place. Keys which only right has are added to left (combined with the old left
+ * default), and entries which end up equal to the new default d_default are dropped so the list stays sparse.
+ */
+template <ewop_t op, typename LDType, typename RDType>
+static void ew_op_in_place_r(LIST* left, LDType l_default, const LIST* right, RDType r_default, LDType d_default, size_t recursions) {
+  static LIST EMPTY_LIST = {NULL};
+
+  NODE *prev = NULL, *l_node = left->first;
+  const NODE* r_node = right ? right->first : NULL;
+
+  while (l_node || r_node) {
+    NODE* curr;
+    const NODE* r_match = NULL;
+
+    if (!r_node || (l_node && l_node->key < r_node->key)) {
+      // Only left has this key.
+      curr    = l_node;
+      l_node  = l_node->next;
+
+    } else if (!l_node || r_node->key < l_node->key) {
+      // Only right has this key: give left an entry holding its old default.
+      void* val;
+      if (recursions == 0) {
+        val = ALLOC(LDType);
+        *reinterpret_cast<LDType*>(val) = l_default;
+      } else {
+        val = list::create();
+      }
+
+      curr    = prev ? list::insert_after(prev, r_node->key, val) : list::insert(left, false, r_node->key, val);
+      r_match = r_node;
+      r_node  = r_node->next;
+
+    } else {
+      curr    = l_node;
+      r_match = r_node;
+      l_node  = l_node->next;
+      r_node  = r_node->next;
+    }
+
+    bool empty;
+
+    if (recursions == 0) {
+      LDType* v = reinterpret_cast<LDType*>(curr->val);
+      *v    = ew_op_switch<op, LDType, RDType>(*v, r_match ? *reinterpret_cast<const RDType*>(r_match->val) : r_default);
+      empty = *v == d_default;
+
+    } else {
+      LIST* sub = reinterpret_cast<LIST*>(curr->val);
+      ew_op_in_place_r<op, LDType, RDType>(sub, l_default, r_match ? reinterpret_cast<const LIST*>(r_match->val) : &EMPTY_LIST,
+                                           r_default, d_default, recursions - 1);
+      empty = sub->first == NULL;
+    }
+
+    if (empty) {
+      // Unlink curr; prev stays where it is.
+      if (prev) prev->next  = curr->next;
+      else      left->first = curr->next;
+
+      if (recursions == 0) free(curr->val);
+      else                 list::del(reinterpret_cast<LIST*>(curr->val), recursions - 1);
+      free(curr);
+
+    } else {
+      prev = curr;
+    }
+  }
+}
+
+/*
+ * Recursive helper for reduce: out is the index into the result of the current sublist's first entry, and
+ * stride[d] how far to move along it per step in dimension d (0 for the dimension being reduced).
+ */
+template <typename DType>
+static void reduce_r(sparse_reduction& red, const LIST* l, size_t out, const size_t* stride, size_t recursions) {
+  for (const NODE* curr = l->first; curr; curr = curr->next) {
+    size_t pos = out + curr->key * stride[0];
+
+    if (recursions) reduce_r<DType>(red, reinterpret_cast<const LIST*>(curr->val), pos, stride + 1, recursions - 1);
+    else            red.add(pos, reduce_value(*reinterpret_cast<const DType*>(curr->val)));
+  }
+}
+
+template <typename DType>
+static void reduce(reduce_t op, const LIST_STORAGE* s, size_t dim, double* result) {
+  size_t* stride = ALLOCA_N(size_t, s->dim);
+  size_t  n_out  = 1;
+
+  for (size_t d = s->dim; d-- > 0;) {
+    stride[d] = d == dim ? 0 : n_out;
+    if (d != dim) n_out *= s->shape[d];
+  }
+
+  sparse_reduction red(op, n_out, s->shape[dim], reduce_value(*reinterpret_cast<const DType*>(s->default_val)));
+
+  reduce_r<DType>(red, s->rows, 0, stride, s->dim - 1);
+  if (red.second_pass()) reduce_r<DType>(red, s->rows, 0, stride, s->dim - 1);
+
+  red.finish(result);
+}
+
+}} // end of namespace nm::list_storage
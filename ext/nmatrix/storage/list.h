@@ -99,6 +99,8 @@ extern "C" {
   //////////
 
   STORAGE* nm_list_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar);
+  void     nm_list_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar);
+  STORAGE* nm_list_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim);
   STORAGE* nm_list_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
 
 
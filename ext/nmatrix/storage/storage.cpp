@@ -29,6 +29,8 @@
  * Standard Includes
  */
 
+#include <algorithm> // std::sort
+
 /*
  * Project Includes
  */
@@ -52,13 +54,15 @@ extern "C" {
 const char* const STYPE_NAMES[nm::NUM_STYPES] = {
 	"dense",
 	"list",
-	"yale"
+	"yale",
+	"bsr"
 };
 
 void (* const STYPE_MARK[nm::NUM_STYPES])(void*) = {
 	nm_dense_storage_mark,
 	nm_list_storage_mark,
-	nm_yale_storage_mark
+	nm_yale_storage_mark,
+	nm_bsr_storage_mark
 };
 
 } // end extern "C" block
@@ -201,6 +205,39 @@ DENSE_STORAGE* create_from_yale_storage(const YALE_STORAGE* rhs, dtype_t l_dtype
 }
 
 
+/*
+ * Create/allocate dense storage, copying into it the contents of a block-CSR matrix.
+ */
+template <typename LDType, typename RDType>
+DENSE_STORAGE* create_from_bsr_storage(const BSR_STORAGE* rhs, dtype_t l_dtype) {
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = rhs->shape[0];
+  shape[1] = rhs->shape[1];
+
+  DENSE_STORAGE* lhs = nm_dense_storage_create(l_dtype, shape, 2, NULL, 0);
+  LDType* lhs_elements = reinterpret_cast<LDType*>(lhs->elements);
+  RDType* rhs_a        = reinterpret_cast<RDType*>(rhs->a);
+
+  for (size_t p = 0; p < shape[0]*shape[1]; ++p) lhs_elements[p] = 0;
+
+  const size_t br = rhs->block_shape[0],
+               bc = rhs->block_shape[1];
+
+  for (size_t I = 0; I < nm_bsr_storage_block_rows(rhs); ++I) {
+    for (size_t k = rhs->ptr[I]; k < rhs->ptr[I+1]; ++k) {
+      // Leave out the part of a block which sticks out past the edge of the matrix.
+      const size_t rows = std::min(br, shape[0] - I*br),
+                   cols = std::min(bc, shape[1] - rhs->idx[k]*bc);
+
+      for (size_t r = 0; r < rows; ++r)
+        for (size_t c = 0; c < cols; ++c)
+          lhs_elements[(I*br + r)*shape[1] + rhs->idx[k]*bc + c] = rhs_a[k*br*bc + r*bc + c];
+    }
+  }
+
+  return lhs;
+}
+
 /*
  * Copy list contents into dense recursively.
  */
@@ -597,7 +634,204 @@ namespace yale_storage { // FIXME: Move to yale.cpp
     return lhs;
   }
 
+  /*
+   * Creation of yale storage from block-CSR storage. The zeros stored in each block are left out.
+   */
+  template <typename LDType, typename RDType, typename LIType>
+  YALE_STORAGE* create_from_bsr_storage(const BSR_STORAGE* rhs, dtype_t l_dtype) {
+    RDType*       rhs_a = reinterpret_cast<RDType*>(rhs->a);
+    const size_t  br    = rhs->block_shape[0],
+                  bc    = rhs->block_shape[1],
+                  mb    = nm_bsr_storage_block_rows(rhs);
+
+    RDType R_ZERO; // need zero for easier comparisons
+    if (rhs->dtype == RUBYOBJ)  R_ZERO = INT2FIX(0);
+    else                        R_ZERO = 0;
+
+    // Count the non-diagonal nonzeros. Within a block row, the entries of each row are spread across its blocks.
+    size_t ndnz = 0;
+    for (size_t I = 0; I < mb; ++I) {
+      for (size_t k = rhs->ptr[I]; k < rhs->ptr[I+1]; ++k) {
+        const size_t rows = std::min(br, rhs->shape[0] - I*br),
+                     cols = std::min(bc, rhs->shape[1] - rhs->idx[k]*bc);
+
+        for (size_t r = 0; r < rows; ++r)
+          for (size_t c = 0; c < cols; ++c)
+            if (I*br + r != rhs->idx[k]*bc + c && rhs_a[k*br*bc + r*bc + c] != R_ZERO) ++ndnz;
+      }
+    }
+
+    size_t* shape = ALLOC_N(size_t, 2);
+    shape[0] = rhs->shape[0];
+    shape[1] = rhs->shape[1];
+
+    size_t request_capacity = shape[0] + ndnz + 1;
+    YALE_STORAGE* lhs = nm_yale_storage_create(l_dtype, shape, 2, request_capacity, UINT8);
+
+    if (lhs->capacity < request_capacity)
+      rb_raise(nm_eStorageTypeError, "conversion failed; capacity of %ld requested, max allowable is %ld", (unsigned long)request_capacity, (unsigned long)(lhs->capacity));
+
+    init<LDType,LIType>(lhs);
+
+    LDType* lhs_a   = reinterpret_cast<LDType*>(lhs->a);
+    LIType* lhs_ija = reinterpret_cast<LIType*>(lhs->ija);
+    LIType  ija     = shape[0]+1;
+
+    // The blocks of a block row are in order of block column, so going through them once per row gives each row's
+    // entries in order of column.
+    for (size_t i = 0; i < shape[0]; ++i) {
+      const size_t I = i / br, r = i % br;
+      lhs_ija[i] = ija;
+
+      for (size_t k = rhs->ptr[I]; k < rhs->ptr[I+1]; ++k) {
+        const size_t cols = std::min(bc, shape[1] - rhs->idx[k]*bc);
+
+        for (size_t c = 0; c < cols; ++c) {
+          const size_t  j = rhs->idx[k]*bc + c;
+          RDType&       v = rhs_a[k*br*bc + r*bc + c];
+
+          if (i == j) {
+            lhs_a[i] = v;
+          } else if (v != R_ZERO) {
+            lhs_ija[ija] = j;
+            lhs_a[ija]   = v;
+            ++ija;
+          }
+        }
+      }
+    }
+
+    lhs_ija[shape[0]] = ija;
+    lhs->ndnz = ndnz;
+
+    return lhs;
+  }
+
 } // end of namespace yale_storage
+
+namespace bsr_storage {
+
+  /*
+   * Number of block_shape[0] x block_shape[1] blocks needed to hold the non-zeros of a yale matrix (which must not be
+   * a reference). If ptr isn't NULL, it's filled in as the block row pointers of the block-CSR matrix.
+   */
+  template <typename RDType, typename RIType>
+  size_t count_blocks(const YALE_STORAGE* rhs, size_t br, size_t bc, size_t* ptr) {
+    const RIType* ija = reinterpret_cast<const RIType*>(rhs->ija);
+    RDType*       a   = reinterpret_cast<RDType*>(rhs->a);
+    const size_t  n   = rhs->shape[0],
+                  d   = std::min(n, rhs->shape[1]),
+                  mb  = (n + br - 1) / br,
+                  nbc = (rhs->shape[1] + bc - 1) / bc;
+    const RDType  R_ZERO = a[n];
+
+    // last[J] is the last block row found to have a block in block column J.
+    size_t* last  = ALLOC_N(size_t, nbc);
+    size_t  count = 0;
+    for (size_t J = 0; J < nbc; ++J) last[J] = mb;
+
+    if (ptr) ptr[0] = 0;
+
+    for (size_t I = 0; I < mb; ++I) {
+      for (size_t i = I*br; i < std::min(n, (I+1)*br); ++i) {
+        if (i < d && a[i] != R_ZERO && last[i/bc] != I) {
+          last[i/bc] = I;
+          ++count;
+        }
+
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          if (a[k] != R_ZERO && last[ija[k]/bc] != I) {
+            last[ija[k]/bc] = I;
+            ++count;
+          }
+        }
+      }
+
+      if (ptr) ptr[I+1] = count;
+    }
+
+    xfree(last);
+    return count;
+  }
+
+  /*
+   * Creation of block-CSR storage from yale storage (which must not be a reference), with the given block shape.
+   * Only the blocks with a non-zero in them are stored.
+   */
+  template <typename LDType, typename RDType, typename RIType>
+  BSR_STORAGE* create_from_yale_storage(const YALE_STORAGE* rhs, dtype_t l_dtype, const size_t* block_shape) {
+    const RIType* ija = reinterpret_cast<const RIType*>(rhs->ija);
+    RDType*       a   = reinterpret_cast<RDType*>(rhs->a);
+    const size_t  br  = block_shape[0],
+                  bc  = block_shape[1],
+                  n   = rhs->shape[0],
+                  d   = std::min(n, rhs->shape[1]),
+                  mb  = (n + br - 1) / br,
+                  nbc = (rhs->shape[1] + bc - 1) / bc;
+    const RDType  R_ZERO = a[n];
+
+    size_t* ptr     = ALLOC_N(size_t, mb+1);
+    size_t  nblocks = count_blocks<RDType,RIType>(rhs, br, bc, ptr);
+
+    size_t* shape = ALLOC_N(size_t, 2);
+    shape[0] = rhs->shape[0];
+    shape[1] = rhs->shape[1];
+
+    BSR_STORAGE* lhs = nm_bsr_storage_create(l_dtype, shape, block_shape, nblocks);
+    memcpy(lhs->ptr, ptr, (mb+1) * sizeof(size_t));
+    xfree(ptr);
+
+    LDType* lhs_a = reinterpret_cast<LDType*>(lhs->a);
+    for (size_t p = 0; p < nblocks*br*bc; ++p) lhs_a[p] = 0;
+
+    // slot[J] is where block (I,J) of the current block row I went; last[J] as in count_blocks.
+    size_t* slot = ALLOC_N(size_t, nbc);
+    size_t* last = ALLOC_N(size_t, nbc);
+    for (size_t J = 0; J < nbc; ++J) last[J] = mb;
+
+    for (size_t I = 0; I < mb; ++I) {
+      const size_t end = std::min(n, (I+1)*br);
+      size_t q = lhs->ptr[I];
+
+      // Find this block row's block columns, then put them in order.
+      for (size_t i = I*br; i < end; ++i) {
+        if (i < d && a[i] != R_ZERO && last[i/bc] != I) {
+          last[i/bc] = I;
+          lhs->idx[q++] = i/bc;
+        }
+
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          if (a[k] != R_ZERO && last[ija[k]/bc] != I) {
+            last[ija[k]/bc] = I;
+            lhs->idx[q++] = ija[k]/bc;
+          }
+        }
+      }
+
+      std::sort(lhs->idx + lhs->ptr[I], lhs->idx + q);
+      for (size_t k = lhs->ptr[I]; k < q; ++k) slot[lhs->idx[k]] = k;
+
+      // Then copy the entries into their blocks.
+      for (size_t i = I*br; i < end; ++i) {
+        const size_t r = i % br;
+
+        if (i < d && a[i] != R_ZERO)
+          lhs_a[slot[i/bc]*br*bc + r*bc + i%bc] = a[i];
+
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          if (a[k] != R_ZERO)
+            lhs_a[slot[ija[k]/bc]*br*bc + r*bc + ija[k]%bc] = a[k];
+        }
+      }
+    }
+
+    xfree(slot);
+    xfree(last);
+
+    return lhs;
+  }
+
+} // end of namespace bsr_storage
 } // end of namespace nm
 
 extern "C" {
@@ -614,7 +848,7 @@ extern "C" {
   STORAGE* nm_yale_storage_from_dense(const STORAGE* right, nm::dtype_t l_dtype) {
     NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::create_from_dense_storage, YALE_STORAGE*, const DENSE_STORAGE* rhs, nm::dtype_t l_dtype);
 
-    nm::itype_t itype = nm_yale_storage_default_itype((const YALE_STORAGE*)right);
+    nm::itype_t itype = nm_yale_storage_itype_by_shape(right->shape);
 
     return (STORAGE*)ttable[l_dtype][right->dtype][itype]((const DENSE_STORAGE*)right, l_dtype);
   }
@@ -622,7 +856,7 @@ extern "C" {
   STORAGE* nm_yale_storage_from_list(const STORAGE* right, nm::dtype_t l_dtype) {
     NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::create_from_list_storage, YALE_STORAGE*, const LIST_STORAGE* rhs, nm::dtype_t l_dtype);
 
-    nm::itype_t itype = nm_yale_storage_default_itype((const YALE_STORAGE*)right);
+    nm::itype_t itype = nm_yale_storage_itype_by_shape(right->shape);
 
     return (STORAGE*)ttable[l_dtype][right->dtype][itype]((const LIST_STORAGE*)right, l_dtype);
   }
@@ -636,8 +870,11 @@ extern "C" {
   STORAGE* nm_dense_storage_from_yale(const STORAGE* right, nm::dtype_t l_dtype) {
     NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::dense_storage::create_from_yale_storage, DENSE_STORAGE*, const YALE_STORAGE* rhs, nm::dtype_t l_dtype);
 
-    const YALE_STORAGE* casted_right = reinterpret_cast<const YALE_STORAGE*>(right);
-    return reinterpret_cast<STORAGE*>(ttable[l_dtype][right->dtype][casted_right->itype](casted_right, l_dtype));
+    YALE_STORAGE* casted_right = nm_yale_storage_copy_if_ref(reinterpret_cast<const YALE_STORAGE*>(right));
+    STORAGE* result = reinterpret_cast<STORAGE*>(ttable[l_dtype][right->dtype][casted_right->itype](casted_right, l_dtype));
+
+    if (casted_right != right) nm_yale_storage_delete(casted_right);
+    return result;
   }
 
   STORAGE* nm_list_storage_from_dense(const STORAGE* right, nm::dtype_t l_dtype) {
@@ -649,9 +886,91 @@ extern "C" {
   STORAGE* nm_list_storage_from_yale(const STORAGE* right, nm::dtype_t l_dtype) {
     NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::list_storage::create_from_yale_storage, LIST_STORAGE*, const YALE_STORAGE* rhs, nm::dtype_t l_dtype);
 
-    const YALE_STORAGE* casted_right = reinterpret_cast<const YALE_STORAGE*>(right);
+    YALE_STORAGE* casted_right = nm_yale_storage_copy_if_ref(reinterpret_cast<const YALE_STORAGE*>(right));
+    STORAGE* result = (STORAGE*)ttable[l_dtype][right->dtype][casted_right->itype](casted_right, l_dtype);
+
+    if (casted_right != right) nm_yale_storage_delete(casted_right);
+    return result;
+  }
+
+  STORAGE* nm_yale_storage_from_bsr(const STORAGE* right, nm::dtype_t l_dtype) {
+    NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::create_from_bsr_storage, YALE_STORAGE*, const BSR_STORAGE* rhs, nm::dtype_t l_dtype);
+
+    nm::itype_t itype = nm_yale_storage_itype_by_shape(right->shape);
+
+    return (STORAGE*)ttable[l_dtype][right->dtype][itype]((const BSR_STORAGE*)right, l_dtype);
+  }
+
+  STORAGE* nm_dense_storage_from_bsr(const STORAGE* right, nm::dtype_t l_dtype) {
+    NAMED_LR_DTYPE_TEMPLATE_TABLE(ttable, nm::dense_storage::create_from_bsr_storage, DENSE_STORAGE*, const BSR_STORAGE* rhs, nm::dtype_t l_dtype);
+
+    return (STORAGE*)ttable[l_dtype][right->dtype]((const BSR_STORAGE*)right, l_dtype);
+  }
+
+  STORAGE* nm_list_storage_from_bsr(const STORAGE* right, nm::dtype_t l_dtype) {
+    STORAGE* yale   = nm_yale_storage_from_bsr(right, right->dtype);
+    STORAGE* result = nm_list_storage_from_yale(yale, l_dtype);
+
+    nm_yale_storage_delete(yale);
+    return result;
+  }
+
+  /*
+   * Block-CSR storage with the given block shape, from a yale matrix.
+   */
+  BSR_STORAGE* nm_bsr_storage_from_yale_blocked(const YALE_STORAGE* right, nm::dtype_t l_dtype, const size_t* block_shape) {
+    NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::bsr_storage::create_from_yale_storage, BSR_STORAGE*, const YALE_STORAGE*, nm::dtype_t, const size_t*);
+
+    YALE_STORAGE* casted_right = nm_yale_storage_copy_if_ref(right);
+    BSR_STORAGE* result = ttable[l_dtype][right->dtype][casted_right->itype](casted_right, l_dtype, block_shape);
+
+    if (casted_right != right) nm_yale_storage_delete(casted_right);
+    return result;
+  }
+
+  /*
+   * Block-CSR storage from a yale matrix, with the largest square block shape which doesn't pad out the stored values
+   * by more than NM_BSR_MAX_FILL. Each candidate costs a pass over the entries.
+   */
+  STORAGE* nm_bsr_storage_from_yale(const STORAGE* right, nm::dtype_t l_dtype) {
+    NAMED_LI_DTYPE_TEMPLATE_TABLE(count, nm::bsr_storage::count_blocks, size_t, const YALE_STORAGE*, size_t, size_t, size_t*);
+    static const size_t candidates[] = { 8, 6, 4, 3, 2 };
+
+    YALE_STORAGE* casted_right = nm_yale_storage_copy_if_ref(reinterpret_cast<const YALE_STORAGE*>(right));
+
+    size_t block_shape[2] = { 1, 1 };
+    size_t nnz = count[right->dtype][casted_right->itype](casted_right, 1, 1, NULL);
+
+    for (size_t t = 0; nnz && t < sizeof(candidates) / sizeof(size_t); ++t) {
+      size_t b = candidates[t];
+      if (b > right->shape[0] || b > right->shape[1]) continue;
+
+      if (count[right->dtype][casted_right->itype](casted_right, b, b, NULL) * b * b <= NM_BSR_MAX_FILL * nnz) {
+        block_shape[0] = block_shape[1] = b;
+        break;
+      }
+    }
+
+    BSR_STORAGE* result = nm_bsr_storage_from_yale_blocked(casted_right, l_dtype, block_shape);
+
+    if (casted_right != right) nm_yale_storage_delete(casted_right);
+    return result;
+  }
+
+  STORAGE* nm_bsr_storage_from_dense(const STORAGE* right, nm::dtype_t l_dtype) {
+    STORAGE* yale   = nm_yale_storage_from_dense(right, right->dtype);
+    STORAGE* result = nm_bsr_storage_from_yale(yale, l_dtype);
+
+    nm_yale_storage_delete(yale);
+    return result;
+  }
+
+  STORAGE* nm_bsr_storage_from_list(const STORAGE* right, nm::dtype_t l_dtype) {
+    STORAGE* yale   = nm_yale_storage_from_list(right, right->dtype);
+    STORAGE* result = nm_bsr_storage_from_yale(yale, l_dtype);
 
-    return (STORAGE*)ttable[l_dtype][right->dtype][casted_right->itype](casted_right, l_dtype);
+    nm_yale_storage_delete(yale);
+    return result;
   }
 
 } // end of extern "C"
@@ -48,6 +48,7 @@
 #include "dense.h"
 #include "list.h"
 #include "yale.h"
+#include "bsr.h"
 
 /*
  * Macros
@@ -70,7 +71,7 @@
  */
 
 namespace nm {
-	const int NUM_STYPES = 3;
+	const int NUM_STYPES = 4;
 }
 
 extern "C" {
@@ -92,6 +93,13 @@ extern "C" {
   STORAGE*		nm_list_storage_from_yale(const STORAGE* right,  nm::dtype_t l_dtype);
   STORAGE*		nm_yale_storage_from_list(const STORAGE* right,  nm::dtype_t l_dtype);
   STORAGE*		nm_yale_storage_from_dense(const STORAGE* right, nm::dtype_t l_dtype);
+  STORAGE*		nm_yale_storage_from_bsr(const STORAGE* right,   nm::dtype_t l_dtype);
+  STORAGE*	  nm_dense_storage_from_bsr(const STORAGE* right,  nm::dtype_t l_dtype);
+  STORAGE*		nm_list_storage_from_bsr(const STORAGE* right,   nm::dtype_t l_dtype);
+  STORAGE*		nm_bsr_storage_from_yale(const STORAGE* right,   nm::dtype_t l_dtype);
+  STORAGE*		nm_bsr_storage_from_dense(const STORAGE* right,  nm::dtype_t l_dtype);
+  STORAGE*		nm_bsr_storage_from_list(const STORAGE* right,   nm::dtype_t l_dtype);
+  BSR_STORAGE* nm_bsr_storage_from_yale_blocked(const YALE_STORAGE* right, nm::dtype_t l_dtype, const size_t* block_shape);
 
 } // end of extern "C" block
 
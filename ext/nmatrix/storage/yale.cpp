@@ -51,10 +51,12 @@
 
 // #include "types.h"
 #include "util/math.h"
+#include "util/thread_pool.h"
 
 #include "data/data.h"
 
 #include "common.h"
+#include "dense.h"
 #include "yale.h"
 
 #include "nmatrix.h"
@@ -76,6 +78,14 @@
 extern "C" {
   static YALE_STORAGE*  nm_copy_alloc_struct(const YALE_STORAGE* rhs, const nm::dtype_t new_dtype, const size_t new_capacity, const size_t new_size);
   static YALE_STORAGE*	alloc(nm::dtype_t dtype, size_t* shape, size_t dim, nm::itype_t min_itype);
+  static YALE_STORAGE*  alloc_vectors(YALE_STORAGE* s, size_t init_capacity);
+  static YALE_STORAGE*  create_with_itype(nm::dtype_t dtype, size_t* shape, size_t init_capacity, nm::itype_t itype);
+  static YALE_STORAGE*  unpacked_copy(const YALE_STORAGE* s);
+  static void           resize_vectors(YALE_STORAGE* s, nm::itype_t itype, size_t capacity);
+  static YALE_STORAGE*  widen_copy(YALE_STORAGE* s, const STORAGE* original, nm::itype_t itype);
+  static nm::itype_t    itype_for_capacity(const YALE_STORAGE* s, size_t capacity);
+  static void           reserve_growth(YALE_STORAGE* s, size_t n);
+  static void           drop_caches(YALE_STORAGE* s);
 
   /* Ruby-accessible functions */
   static VALUE nm_size(VALUE self);
@@ -123,9 +133,18 @@ static char           vector_insert(YALE_STORAGE* s, size_t pos, size_t* j, void
 template <typename DType, typename IType>
 static char           vector_insert_resize(YALE_STORAGE* s, size_t current_size, size_t pos, size_t* j, size_t n, bool struct_only);
 
+template <typename DType, typename IType>
+static char           gapped_set(YALE_STORAGE* s, size_t i, size_t j, const DType& v);
+
 template <typename nm::ewop_t op, typename IType, typename DType>
 YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t dtype);
 
+template <typename nm::ewop_t op, typename IType, typename DType>
+static void ew_op_in_place(YALE_STORAGE* left, const YALE_STORAGE* right, const void* rscalar);
+
+template <typename DType, typename IType>
+static void reduce(reduce_t op, const YALE_STORAGE* s, size_t dim, double* result);
+
 /*
  * Functions
  */
@@ -208,6 +227,229 @@ YALE_STORAGE* create_from_old_yale(dtype_t dtype, size_t* shape, void* r_ia, voi
 }
 
 
+/*
+ * Reads the k-th entry of a COO index vector, which may be of any integer dtype. Negative indices come out as huge
+ * ones, and so fail the bounds check like any other index that's out of range.
+ */
+static inline size_t coo_index(const void* v, dtype_t dtype, size_t k) {
+  switch (dtype) {
+  case BYTE:  return reinterpret_cast<const uint8_t*>(v)[k];
+  case INT8:  return static_cast<size_t>(reinterpret_cast<const int8_t*>(v)[k]);
+  case INT16: return static_cast<size_t>(reinterpret_cast<const int16_t*>(v)[k]);
+  case INT32: return static_cast<size_t>(reinterpret_cast<const int32_t*>(v)[k]);
+  default:    return static_cast<size_t>(reinterpret_cast<const int64_t*>(v)[k]);
+  }
+}
+
+/*
+ * The zero of DType: INT2FIX(0) for Ruby objects, plain 0 otherwise.
+ */
+template <typename DType>
+static inline DType zero_of() {
+  return typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0;
+}
+
+/*
+ * Reads and writes the k-th entry of an IJA vector of the given itype.
+ */
+static inline size_t ija_at(const void* ija, itype_t itype, size_t k) {
+  switch (itype) {
+  case UINT8:  return reinterpret_cast<const uint8_t*>(ija)[k];
+  case UINT16: return reinterpret_cast<const uint16_t*>(ija)[k];
+  case UINT32: return reinterpret_cast<const uint32_t*>(ija)[k];
+  default:     return reinterpret_cast<const uint64_t*>(ija)[k];
+  }
+}
+
+static inline void ija_set(void* ija, itype_t itype, size_t k, size_t v) {
+  switch (itype) {
+  case UINT8:  reinterpret_cast<uint8_t*>(ija)[k]  = v; break;
+  case UINT16: reinterpret_cast<uint16_t*>(ija)[k] = v; break;
+  case UINT32: reinterpret_cast<uint32_t*>(ija)[k] = v; break;
+  default:     reinterpret_cast<uint64_t*>(ija)[k] = v;
+  }
+}
+
+/*
+ * The value held in the mirror image of a cell holding v, in a symmetric matrix, or in a Hermitian one if hermitian
+ * is set (its complex conjugate). Only complex matrices are ever packed as Hermitian.
+ */
+template <typename DType>
+static inline DType mirror(const DType& v, bool hermitian) {
+  return v;
+}
+
+template <typename Type>
+static inline Complex<Type> mirror(const Complex<Type>& v, bool hermitian) {
+  return hermitian ? v.conjugate() : v;
+}
+
+/*
+ * The itype tag for an IJA element type.
+ */
+template <typename IType>
+static inline itype_t itype_of() {
+  return sizeof(IType) == 1 ? UINT8 : sizeof(IType) == 2 ? UINT16 : sizeof(IType) == 4 ? UINT32 : UINT64;
+}
+
+/*
+ * Create Yale storage from n (row, column, value) triplets, in any order. Values given more than once for the same
+ * cell are summed, and cells which come out zero aren't stored.
+ *
+ * Rather than inserting the entries one at a time (which moves everything after each one along), this sorts them
+ * into place and writes IJA and A in a single pass:
+ *
+ * 1. Each thread counts the rows of a contiguous block of the entries.
+ * 2. Those counts give every thread its own range within each row, so the entries are scattered into row order
+ *    without any synchronization. This is one pass of a radix sort, with the row index as the digit; since the
+ *    threads' ranges are in block order, the entries of a row keep their input order.
+ * 3. Each row is then sorted by column and its duplicates summed, rows in parallel.
+ * 4. The row sizes give IA, and the rows are copied out, again in parallel.
+ *
+ * Returns NULL if an index is out of range (the caller raises), having freed everything. Otherwise O(n + rows) work
+ * plus the sorting within rows, and the memory for one extra copy of the entries.
+ */
+template <typename LDType, typename RDType, typename IType>
+YALE_STORAGE* create_from_coo(dtype_t dtype, size_t* shape, size_t n, const void* rows, dtype_t row_dtype,
+                              const void* cols, dtype_t col_dtype, const void* r_vals) {
+  struct entry {
+    IType  j;
+    LDType v;
+  };
+
+  RDType*       vals  = reinterpret_cast<RDType*>(const_cast<void*>(r_vals));
+  const size_t  M     = shape[0],
+                N     = shape[1];
+  const bool    nogvl = ew_op_nogvl<EW_ADD, LDType, RDType>::value;
+
+  // Every counting thread needs a histogram of all the rows, so only use several when that's cheap next to n.
+  size_t T = nogvl ? thread_pool::num_threads() : 1;
+  if (n < thread_pool::threshold() || T * (M + 1) > n) T = 1;
+
+  size_t* hist      = reinterpret_cast<size_t*>(calloc(T * (M + 1), sizeof(size_t)));
+  size_t* row_start = reinterpret_cast<size_t*>(malloc((M + 1) * sizeof(size_t)));
+  size_t* nd_count  = reinterpret_cast<size_t*>(malloc(M * sizeof(size_t)));
+  char*   bad       = reinterpret_cast<char*>(calloc(T, 1));
+  entry*  entries   = reinterpret_cast<entry*>(malloc(std::max<size_t>(n, 1) * sizeof(entry)));
+  LDType* diag      = reinterpret_cast<LDType*>(malloc(std::max<size_t>(M, 1) * sizeof(LDType)));
+
+  if (!hist || !row_start || !nd_count || !bad || !entries || !diag) {
+    free(hist); free(row_start); free(nd_count); free(bad); free(entries); free(diag);
+    rb_raise(rb_eNoMemError, "insufficient memory");
+  }
+
+  // 1. Count.
+  thread_pool::parallel_for(n, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      size_t* h = hist + t * (M + 1);
+
+      for (size_t k = n * t / T; k < n * (t+1) / T; ++k) {
+        size_t i = coo_index(rows, row_dtype, k);
+        if (i >= M || coo_index(cols, col_dtype, k) >= N) {
+          bad[t] = 1;
+          break;
+        }
+        ++h[i];
+      }
+    }
+  });
+
+  if (std::find(bad, bad + T, 1) != bad + T) {
+    free(hist); free(row_start); free(nd_count); free(bad); free(entries); free(diag);
+    return NULL;
+  }
+
+  // Turn the counts into each thread's starting position within each row.
+  size_t pos = 0;
+  for (size_t i = 0; i < M; ++i) {
+    row_start[i] = pos;
+    for (size_t t = 0; t < T; ++t) {
+      size_t count = hist[t * (M + 1) + i];
+      hist[t * (M + 1) + i] = pos;
+      pos += count;
+    }
+  }
+  row_start[M] = n;
+
+  // 2. Scatter.
+  thread_pool::parallel_for(n, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      size_t* h = hist + t * (M + 1);
+
+      for (size_t k = n * t / T; k < n * (t+1) / T; ++k) {
+        entry& e = entries[ h[coo_index(rows, row_dtype, k)]++ ];
+        e.j = coo_index(cols, col_dtype, k);
+        e.v = vals[k];
+      }
+    }
+  });
+
+  // 3. Sort each row by column, and sum duplicates. The surviving non-diagonal entries move to the front of the row.
+  thread_pool::parallel_for(n + M, nogvl, M, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      entry *first = entries + row_start[i],
+            *last  = entries + row_start[i+1],
+            *out   = first;
+
+      std::stable_sort(first, last, [](const entry& a, const entry& b) { return a.j < b.j; });
+
+      diag[i] = 0;
+      for (entry* e = first; e < last; ) {
+        IType  j   = e->j;
+        LDType sum = e->v;
+        for (++e; e < last && e->j == j; ++e) sum += e->v;
+
+        if (j == i)        diag[i] = sum;
+        else if (sum != 0) {
+          out->j = j;
+          out->v = sum;
+          ++out;
+        }
+      }
+
+      nd_count[i] = out - first;
+    }
+  });
+
+  // 4. Allocate exactly enough, build IA, and copy the rows out.
+  size_t ndnz = 0;
+  for (size_t i = 0; i < M; ++i) ndnz += nd_count[i];
+
+  YALE_STORAGE* s = alloc(dtype, shape, 2, UINT8);
+  s->itype    = itype_of<IType>();
+  s->capacity = M + ndnz + 1;
+  s->ndnz     = ndnz;
+  s->ija      = ALLOC_N( IType, s->capacity );
+  s->a        = ALLOC_N( LDType, s->capacity );
+
+  IType*  ija = reinterpret_cast<IType*>(s->ija);
+  LDType* a   = reinterpret_cast<LDType*>(s->a);
+
+  pos = M + 1;
+  for (size_t i = 0; i < M; ++i) {
+    ija[i] = pos;
+    pos   += nd_count[i];
+  }
+  ija[M] = pos;
+  a[M]   = 0;
+
+  thread_pool::parallel_for(n + M, nogvl, M, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const entry* e = entries + row_start[i];
+      a[i] = diag[i];
+
+      for (size_t p = ija[i]; p < ija[i+1]; ++p, ++e) {
+        ija[p] = e->j;
+        a[p]   = e->v;
+      }
+    }
+  });
+
+  free(hist); free(row_start); free(nd_count); free(bad); free(entries); free(diag);
+
+  return s;
+}
+
 /*
  * Take two Yale storages and merge them into a new Yale storage.
  *
@@ -304,132 +546,470 @@ size_t max_size(YALE_STORAGE* s) {
 ///////////////
 
 /*
- * Returns a slice of YALE_STORAGE object by copy
+ * Position in IJA just past the last entry of row i (allowing for slack, if the rows are gapped).
+ */
+template <typename IType>
+static inline size_t row_stop(const YALE_STORAGE* s, size_t i) {
+  return s->row_end ? reinterpret_cast<const IType*>(s->row_end)[i] : reinterpret_cast<const IType*>(s->ija)[i+1];
+}
+
+/*
+ * Lays s out again with spare slots after the entries of each row: slack of them or, if proportional is set,
+ * as many as the row already has entries when that's more. No row gets more slots than it has columns. The slack
+ * holds zeros. Leaves s gapped.
+ */
+template <typename DType, typename IType>
+static void spread_rows(YALE_STORAGE* s, size_t slack, bool proportional) {
+  const size_t M = s->shape[0],
+               N = s->shape[1];
+
+  IType* ija = reinterpret_cast<IType*>(s->ija);
+  DType* a   = reinterpret_cast<DType*>(s->a);
+
+  auto room = [&](size_t len) -> size_t {
+    return std::min(len + (proportional ? std::max(slack, len) : slack), N);
+  };
+
+  size_t size = M + 1;
+  for (size_t i = 0; i < M; ++i) size += room(row_stop<IType>(s, i) - ija[i]);
+
+  IType* new_ija = ALLOC_N(IType, size);
+  DType* new_a   = ALLOC_N(DType, size);
+  IType* new_end = ALLOC_N(IType, M);
+
+  std::copy(a, a + M + 1, new_a); // diagonal and zero
+
+  size_t pos = M + 1;
+  for (size_t i = 0; i < M; ++i) {
+    size_t start = ija[i],
+           stop  = row_stop<IType>(s, i),
+           next  = pos + room(stop - start);
+
+    new_ija[i] = pos;
+    std::copy(ija + start, ija + stop, new_ija + pos);
+    std::copy(a + start, a + stop, new_a + pos);
+
+    pos       += stop - start;
+    new_end[i] = pos;
+    std::fill(new_ija + pos, new_ija + next, 0);
+    std::fill(new_a + pos, new_a + next, a[M]);
+    pos        = next;
+  }
+  new_ija[M] = pos;
+
+  free(s->ija);
+  free(s->a);
+  free(s->row_end);
+
+  s->ija      = new_ija;
+  s->a        = new_a;
+  s->row_end  = new_end;
+  s->capacity = size;
+}
+
+/*
+ * Slides the entries of a gapped matrix's rows together, leaving the usual compact layout. Nothing is reallocated,
+ * so the capacity stays the same.
+ */
+template <typename DType, typename IType>
+static void close_gaps(YALE_STORAGE* s) {
+  IType* ija = reinterpret_cast<IType*>(s->ija);
+  IType* end = reinterpret_cast<IType*>(s->row_end);
+  DType* a   = reinterpret_cast<DType*>(s->a);
+
+  size_t pos = s->shape[0] + 1;
+  for (size_t i = 0; i < s->shape[0]; ++i) {
+    size_t start = ija[i];
+    ija[i] = pos;
+
+    for (size_t p = start; p < end[i]; ++p, ++pos) {
+      ija[pos] = ija[p];
+      a[pos]   = a[p];
+    }
+  }
+  ija[s->shape[0]] = pos;
+
+  free(s->row_end);
+  s->row_end = NULL;
+}
+
+/*
+ * set, for a matrix with gapped rows: only the entries after the new one in its own row have to move. When the row
+ * has no slack left, every row is given room to grow in proportion to its length first, so the cost of doing that
+ * is spread over many inserts.
+ */
+template <typename DType, typename IType>
+static char gapped_set(YALE_STORAGE* s, size_t i, size_t j, const DType& v) {
+  IType* ija = reinterpret_cast<IType*>(s->ija);
+  IType* end = reinterpret_cast<IType*>(s->row_end);
+  DType* a   = reinterpret_cast<DType*>(s->a);
+
+  size_t pos = std::lower_bound(ija + ija[i], ija + end[i], static_cast<IType>(j)) - ija;
+
+  if (pos < end[i] && ija[pos] == j) {
+    a[pos] = v;
+    return 'r';
+  }
+
+  if (end[i] == ija[i+1]) {
+    spread_rows<DType,IType>(s, NM_YALE_ROW_SLACK, true);
+    return gapped_set<DType,IType>(s, i, j, v);
+  }
+
+  std::copy_backward(ija + pos, ija + end[i], ija + end[i] + 1);
+  std::copy_backward(a + pos, a + end[i], a + end[i] + 1);
+
+  ija[pos] = j;
+  a[pos]   = v;
+  ++end[i];
+  ++s->ndnz;
+
+  return 'i';
+}
+
+/*
+ * Returns a slice of YALE_STORAGE object by copy.
+ *
+ * Each source row's column indices are sorted, so the entries falling inside the slice's column window are a
+ * contiguous run, found by binary search. The source diagonal entry (stored separately) is merged into that run
+ * where it falls. The cost is O(rows * log(row length) + nonzeros in the slice) rather than one scan per cell.
  */
 template <typename DType,typename IType>
 void* get(YALE_STORAGE* storage, SLICE* slice) {
-  
-  size_t *offset = slice->coords;
+  const size_t* offset = slice->coords;
+
   // Copy shape for yale construction
   size_t* shape = ALLOC_N(size_t, 2);
   shape[0] = slice->lengths[0];
   shape[1] = slice->lengths[1];
 
-  IType* src_ija = reinterpret_cast<IType*>(storage->ija);
-  DType* src_a   = reinterpret_cast<DType*>(storage->a);
+  const IType* src_ija = reinterpret_cast<const IType*>(storage->ija);
+  const DType* src_a   = reinterpret_cast<const DType*>(storage->a);
+  const size_t col_end = offset[1] + shape[1];
+
+  // Position of the first entry of source row k at or after the window's first column
+  auto window_begin = [&](size_t k) -> size_t {
+    return std::lower_bound(src_ija + src_ija[k], src_ija + src_ija[k+1], static_cast<IType>(offset[1])) - src_ija;
+  };
+
+  // Whether the source diagonal entry of row k becomes a non-diagonal entry of the slice
+  auto diag_is_nd = [&](size_t i, size_t k) -> bool {
+    return k >= offset[1] && k < col_end && k - offset[1] != i && src_a[k] != 0;
+  };
 
   // Calc ndnz for the destination
-  size_t ndnz  = 0;
-  size_t i,j; // indexes of destination matrix
-  size_t k,l; // indexes of source matrix
-  for (i = 0; i < shape[0]; i++) {
-    k = i + offset[0];
-    for (j = 0; j < shape[1]; j++) {
-      l = j + offset[1];
-
-      if (j == i)  continue;
-
-      if (k == l) { // for diagonal element of source
-        if (src_a[k] != 0) ++ndnz;
-      } else { // for non-diagonal element
-        for (size_t c = src_ija[k]; c < src_ija[k+1]; c++) {
-          if (src_ija[c] == l) {
-            ++ndnz;
-            break;
-          }
-        }
-      }
+  size_t ndnz = 0;
+  for (size_t i = 0; i < shape[0]; ++i) {
+    size_t k = i + offset[0];
 
-    }
+    for (size_t c = window_begin(k); c < src_ija[k+1] && src_ija[c] < col_end; ++c)
+      if (src_ija[c] - offset[1] != i) ++ndnz;
+
+    if (diag_is_nd(i, k)) ++ndnz;
   }
 
   size_t request_capacity = shape[0] + ndnz + 1;
-  //fprintf(stderr, "yale get copy: shape0=%d, shape1=%d, ndnz=%d, request_capacity=%d\n", shape[0], shape[1], ndnz, request_capacity);
-  YALE_STORAGE* ns = nm_yale_storage_create(storage->dtype, shape, 2, request_capacity, storage->itype);
+  YALE_STORAGE* ns = create_with_itype(storage->dtype, shape, request_capacity, storage->itype);
 
   if (ns->capacity < request_capacity)
     rb_raise(nm_eStorageTypeError, "conversion failed; capacity of %ld requested, max allowable is %ld", request_capacity, ns->capacity);
 
-   // Initialize the A and IJA arrays
+  // Initialize the A and IJA arrays
   init<DType,IType>(ns);
   IType* dst_ija = reinterpret_cast<IType*>(ns->ija);
   DType* dst_a   = reinterpret_cast<DType*>(ns->a);
- 
+
   size_t ija = shape[0] + 1;
-  DType val = src_a[storage->shape[0]]; // use 0 as the default for copy
-  for (i = 0; i < shape[0]; ++i) {
-    k = i + offset[0];
-    for (j = 0; j < shape[1]; ++j) {
-      bool found = false;
-      l = j + offset[1];
-    
-      // Get value from source matrix
-      if (k == l) { // source diagonal
-        if (src_a[k] != 0) { // don't bother copying non-zero values from the diagonal
-          val = src_a[k];
-          found = true;
-        }
-      } else {
-        // copy one non-diagonal element
-        for (size_t c = src_ija[k]; !found && c < src_ija[k+1]; ++c) {
-          if (src_ija[c] == l) {
-            val   = src_a[c];
-            found = true;
-          }
-        }
-      }
+  for (size_t i = 0; i < shape[0]; ++i) {
+    size_t k = i + offset[0];
+    bool   diag_pending = diag_is_nd(i, k);
 
-      if (found) {
-        // Set value in destination matrix
-        if (i == j) {
-          dst_a[i] = val;
-        } else {
-          // copy non-diagonal element
-          dst_ija[ija] = j;
-          dst_a[ija]   = val;
+    dst_ija[i] = ija;
 
-          ++ija;
-          for (size_t c = i + 1; c <= shape[0]; ++c) {
-            dst_ija[c] = ija;
-          }
-        }
+    for (size_t c = window_begin(k); c < src_ija[k+1] && src_ija[c] < col_end; ++c) {
+      size_t j = src_ija[c] - offset[1];
+
+      // Slot in the source diagonal before the first column past it.
+      if (diag_pending && k < src_ija[c]) {
+        dst_ija[ija] = k - offset[1];
+        dst_a[ija++] = src_a[k];
+        diag_pending = false;
+      }
+
+      if (j == i) dst_a[i] = src_a[c];
+      else {
+        dst_ija[ija] = j;
+        dst_a[ija++] = src_a[c];
       }
     }
+
+    if (diag_pending) {
+      dst_ija[ija] = k - offset[1];
+      dst_a[ija++] = src_a[k];
+    }
+
+    // The source diagonal can also land on the slice's diagonal.
+    if (k >= offset[1] && k < col_end && k - offset[1] == i) dst_a[i] = src_a[k];
   }
 
   dst_ija[shape[0]] = ija; // indicate the end of the last row
   ns->ndnz = ndnz;
   return ns;
 }
+
+/*
+ * Builds the column index of s (which must be gap-free, unpacked and not a reference): each column's non-diagonal
+ * entries, as positions in IJA and A. A counting sort by column does it in O(nnz), and going through the rows in
+ * order leaves each column's entries in order of row.
+ */
+template <typename IType>
+static YALE_COL_INDEX* build_col_index(const YALE_STORAGE* s) {
+  const size_t n    = s->shape[0],
+               m    = s->shape[1];
+  const IType* ija  = reinterpret_cast<const IType*>(s->ija);
+  const size_t ndnz = ija[n] - (n+1);
+
+  IType* ptr  = ALLOC_N(IType, m+1);
+  IType* pos  = ALLOC_N(IType, ndnz);
+  IType* row  = ALLOC_N(IType, ndnz);
+  IType* next = ALLOC_N(IType, m);
+
+  std::fill(ptr, ptr + m + 1, 0);
+  for (size_t p = n + 1; p < ija[n]; ++p) ++ptr[ija[p] + 1];
+  for (size_t j = 0; j < m; ++j)          ptr[j+1] += ptr[j];
+
+  std::copy(ptr, ptr + m, next);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t p = ija[i]; p < ija[i+1]; ++p) {
+      const size_t q = next[ija[p]]++;
+      pos[q] = p;
+      row[q] = i;
+    }
+  }
+  xfree(next);
+
+  YALE_COL_INDEX* index = ALLOC(YALE_COL_INDEX);
+  index->ptr = ptr;
+  index->pos = pos;
+  index->row = row;
+
+  return index;
+}
+
+/*
+ * Returns rows r0...r0+len of column j of s, which must have a column index, as a len x 1 Yale matrix. The same as
+ * get on that slice, but it costs O(log(column length) + entries in the window) instead of a search in every row.
+ */
+template <typename DType, typename IType>
+static YALE_STORAGE* get_column(const YALE_STORAGE* s, size_t r0, size_t len, size_t j) {
+  const IType* ptr   = reinterpret_cast<const IType*>(s->col_index->ptr);
+  const IType* pos   = reinterpret_cast<const IType*>(s->col_index->pos);
+  const IType* row   = reinterpret_cast<const IType*>(s->col_index->row);
+  const DType* src_a = reinterpret_cast<const DType*>(s->a);
+  const size_t r_end = r0 + len;
+
+  const IType* first = std::lower_bound(row + ptr[j], row + ptr[j+1], static_cast<IType>(r0)),
+             * last  = std::lower_bound(first, row + ptr[j+1], static_cast<IType>(r_end));
+
+  // The source diagonal entry A[j,j], if it's in the window. Like get, a zero one isn't stored off the diagonal.
+  const bool diag = j < s->shape[0] && j >= r0 && j < r_end && (j == r0 || src_a[j] != 0);
+
+  size_t ndnz = (last - first) + (diag && j != r0 ? 1 : 0);
+  if (first != last && *first == r0) --ndnz; // lands on the slice's diagonal
+
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = len;
+  shape[1] = 1;
+
+  YALE_STORAGE* ns = create_with_itype(s->dtype, shape, len + ndnz + 1, s->itype);
+  init<DType,IType>(ns);
+  IType* dst_ija = reinterpret_cast<IType*>(ns->ija);
+  DType* dst_a   = reinterpret_cast<DType*>(ns->a);
+
+  // Each row of the slice has at most one entry, so the rows are filled in as they come, and the empty ones between
+  // them are given the position of the next.
+  size_t ija = len + 1, next_row = 1;
+  auto put = [&](size_t r, const DType& v) {
+    if (r == r0) {
+      dst_a[0] = v;
+      return;
+    }
+
+    for (; next_row <= r - r0; ++next_row) dst_ija[next_row] = ija;
+    dst_ija[ija] = 0;
+    dst_a[ija++] = v;
+  };
+
+  bool diag_pending = diag;
+  for (const IType* r = first; r != last; ++r) {
+    if (diag_pending && j < *r) {
+      put(j, src_a[j]);
+      diag_pending = false;
+    }
+    put(*r, src_a[pos[r - row]]);
+  }
+  if (diag_pending) put(j, src_a[j]);
+
+  for (; next_row <= len; ++next_row) dst_ija[next_row] = ija;
+
+  ns->ndnz = ndnz;
+  return ns;
+}
+
+/*
+ * Calls f(i, j, p) for each entry of root stored in the window of the given shape whose top-left corner is at offset,
+ * row by row and in column order within a row. (i, j) are coordinates within the window and p is the entry's position
+ * in root's A vector. Diagonal entries of root count as stored wherever they fall in the window.
+ *
+ * Costs O(rows * log(row length) + entries visited); nothing is allocated.
+ */
+template <typename IType, typename F>
+static void each_stored_in_window(const YALE_STORAGE* root, const size_t* offset, const size_t* shape, F f) {
+  const IType* ija     = reinterpret_cast<const IType*>(root->ija);
+  const size_t col_end = offset[1] + shape[1];
+
+  for (size_t i = 0; i < shape[0]; ++i) {
+    size_t k = i + offset[0];
+    bool   diag_pending = k >= offset[1] && k < col_end;
+    size_t p = std::lower_bound(ija + ija[k], ija + ija[k+1], static_cast<IType>(offset[1])) - ija;
+
+    for (; p < ija[k+1] && ija[p] < col_end; ++p) {
+      if (diag_pending && k < ija[p]) {
+        f(i, k - offset[1], k);
+        diag_pending = false;
+      }
+      f(i, ija[p] - offset[1], p);
+    }
+
+    if (diag_pending) f(i, k - offset[1], k);
+  }
+}
+
+/*
+ * each_stored_in_window for a packed root: calls f(i, j, p, mirrored) for each entry of the whole symmetric matrix
+ * falling in the window, where mirrored says whether it's the mirror image of the entry stored at p. The diagonal
+ * comes first, then the entries of each stored row and their mirror images, so this isn't in row-major order.
+ *
+ * Only rows which cross the window, or whose mirror images do, are looked at.
+ */
+template <typename IType, typename F>
+static void each_packed_in_window(const YALE_STORAGE* root, const size_t* offset, const size_t* shape, F f) {
+  const IType* ija     = reinterpret_cast<const IType*>(root->ija);
+  const size_t row_end = offset[0] + shape[0],
+               col_end = offset[1] + shape[1];
+
+  auto in_window = [&](size_t r, size_t c) {
+    return r >= offset[0] && r < row_end && c >= offset[1] && c < col_end;
+  };
+
+  for (size_t k = std::max(offset[0], offset[1]); k < std::min(row_end, col_end); ++k)
+    f(k - offset[0], k - offset[1], k, false);
+
+  for (size_t r = std::min(offset[0], offset[1]); r < std::max(row_end, col_end); ++r) {
+    for (size_t p = ija[r]; p < ija[r+1]; ++p) {
+      const size_t c = ija[p];
+      if (in_window(r, c)) f(r - offset[0], c - offset[1], p, false);
+      if (in_window(c, r)) f(c - offset[0], r - offset[1], p, true);
+    }
+  }
+}
+
+/*
+ * Number of entries of s (a reference, or a packed matrix) as it appears, whether stored or mirrored.
+ */
+template <typename IType>
+static size_t count_stored(const YALE_STORAGE* s) {
+  const YALE_STORAGE* src = reinterpret_cast<const YALE_STORAGE*>(s->src);
+  const size_t origin[2]  = {0, 0};
+  const size_t* offset    = nm_yale_storage_is_ref(s) ? s->offset : origin;
+
+  size_t count = 0;
+  if (src->symm != NONSYMM)
+    each_packed_in_window<IType>(src, offset, s->shape, [&count](size_t, size_t, size_t, bool) { ++count; });
+  else
+    each_stored_in_window<IType>(src, offset, s->shape, [&count](size_t, size_t, size_t) { ++count; });
+
+  return count;
+}
+
 /*
  * Returns a pointer to the correct location in the A vector of a YALE_STORAGE object, given some set of coordinates
  * (the coordinates are stored in slice).
+ *
+ * For a slice of more than one element, returns a reference instead: a YALE_STORAGE which is just a window on
+ * storage, sharing its IJA and A vectors. Making one costs O(1), however many entries the window holds.
+ *
+ * storage must not itself be a reference; nm_yale_storage_ref translates slices of references into slices of their
+ * sources.
  */
 template <typename DType,typename IType>
 void* ref(YALE_STORAGE* storage, SLICE* slice) {
   size_t* coords = slice->coords;
 
-  if (!slice->single) rb_raise(rb_eNotImpError, "This type slicing not supported yet.");
+  if (!slice->single) {
+    YALE_STORAGE* ns = ALLOC( YALE_STORAGE );
+    ns->dim      = storage->dim;
+    ns->dtype    = storage->dtype;
+    ns->itype    = storage->itype;
+    ns->shape    = ALLOC_N(size_t, ns->dim);
+    ns->offset   = ALLOC_N(size_t, ns->dim);
+
+    for (size_t i = 0; i < ns->dim; ++i) {
+      ns->offset[i] = coords[i];
+      ns->shape[i]  = slice->lengths[i];
+    }
+
+    // The source's vectors may be reallocated by insertions, so a reference always goes through src to get them.
+    ns->ndnz     = 0;
+    ns->capacity = 0;
+    ns->a        = NULL;
+    ns->ija      = NULL;
+    ns->row_end  = NULL;
+    ns->symm     = NONSYMM;
+    ns->col_index = NULL;
+    ns->levels[0] = ns->levels[1] = NULL;
+    ns->symbolic[0] = ns->symbolic[1] = NULL;
+
+    ns->count    = 1;
+    storage->count++;
+    ns->src      = storage;
+
+    return ns;
+  }
 
   DType* a = reinterpret_cast<DType*>(storage->a);
   IType* ija = reinterpret_cast<IType*>(storage->ija);
 
-  if (coords[0] == coords[1])
-    return &(a[ coords[0] ]); // return diagonal entry
+  // A packed matrix holds the cells below the diagonal in their mirror images above it.
+  const bool mirrored = storage->symm != NONSYMM && coords[0] > coords[1];
+  const size_t i = mirrored ? coords[1] : coords[0],
+               j = mirrored ? coords[0] : coords[1];
+
+  if (i == j)
+    return &(a[ i ]); // return diagonal entry
 
-  if (ija[coords[0]] == ija[coords[0]+1])
+  size_t stop = row_stop<IType>(storage, i);
+
+  if (ija[i] == stop)
     return &(a[ storage->shape[0] ]); // return zero pointer
 
 	// binary search for the column's location
   int pos = binary_search<IType>(storage,
-                                          ija[coords[0]],
-                                          ija[coords[0]+1]-1,
-                                          coords[1]);
-
-  if (pos != -1 && ija[pos] == coords[1])
-    return &(a[pos]); // found exact value
+                                          ija[i],
+                                          stop-1,
+                                          j);
+
+  if (pos == -1 || ija[pos] != j)
+    return &(a[ storage->shape[0] ]); // return a pointer that happens to be zero
+
+  if (mirrored && storage->symm == HERM) {
+    // The conjugate isn't stored anywhere, so hand back a copy (good until the next call).
+    static DType conjugate;
+    conjugate = mirror(a[pos], true);
+    return &conjugate;
+  }
 
-  return &(a[ storage->shape[0] ]); // return a pointer that happens to be zero
+  return &(a[pos]); // found exact value
 }
 
 /*
@@ -439,7 +1019,16 @@ void* ref(YALE_STORAGE* storage, SLICE* slice) {
 template <typename DType, typename IType>
 char set(YALE_STORAGE* storage, SLICE* slice, void* value) {
   DType* v = reinterpret_cast<DType*>(value);
-  size_t* coords = slice->coords;
+
+  // A packed matrix sets a cell below the diagonal through its mirror image above it, which sets both.
+  const bool mirrored = storage->symm != NONSYMM && slice->coords[0] > slice->coords[1];
+  size_t coords[2] = { mirrored ? slice->coords[1] : slice->coords[0], mirrored ? slice->coords[0] : slice->coords[1] };
+
+  DType mirrored_v;
+  if (mirrored) {
+    mirrored_v = mirror(*v, storage->symm == HERM);
+    v          = &mirrored_v;
+  }
 
   bool found = false;
   char ins_type;
@@ -449,6 +1038,8 @@ char set(YALE_STORAGE* storage, SLICE* slice, void* value) {
     return 'r';
   }
 
+  if (storage->row_end) return gapped_set<DType,IType>(storage, coords[0], coords[1], *v);
+
   // Get IJA positions of the beginning and end of the row
   if (reinterpret_cast<IType*>(storage->ija)[coords[0]] == reinterpret_cast<IType*>(storage->ija)[coords[0]+1]) {
   	// empty row
@@ -633,6 +1224,122 @@ static bool ndrow_is_empty(const YALE_STORAGE* s, IType ija, const IType ija_nex
 #define YALE_IJ(s) (reinterpret_cast<IType*>(s->ija) + s->shape[0] + 1)
 #define YALE_COUNT(yale) (yale->ndnz + yale->shape[0])
 
+/*
+ * In-place element-wise operation: left = left op right, or left op *rscalar when right is NULL. right (or the
+ * scalar) must already have left's dtype.
+ *
+ * When both matrices store exactly the same positions, the A arrays are combined directly. Otherwise the result
+ * is computed out of place and its arrays are moved into left.
+ */
+template <typename nm::ewop_t op, typename IType, typename DType>
+static void ew_op_in_place(YALE_STORAGE* left, const YALE_STORAGE* right, const void* rscalar) {
+  const size_t n    = left->shape[0];
+  const size_t size = YALE_IA(left)[n];
+  DType*       la   = reinterpret_cast<DType*>(left->a);
+
+  if (!right) {
+    const DType s    = *reinterpret_cast<const DType*>(rscalar);
+    const DType zero = zero_of<DType>();
+
+    // Entries which aren't stored would have to become (0 op s).
+    if (ew_op_switch<op, DType, DType>(zero, s) != zero)
+      rb_raise(rb_eNotImpError, "in-place operation would make every entry of the Yale matrix nonzero; use the non-destructive operator instead");
+
+    for (size_t i = 0; i < n; ++i)        la[i] = ew_op_switch<op, DType, DType>(la[i], s);
+    for (size_t k = n + 1; k < size; ++k) la[k] = ew_op_switch<op, DType, DType>(la[k], s);
+
+  } else if (size == YALE_IA(right)[n] && !memcmp(left->ija, right->ija, sizeof(IType) * size)) {
+    const DType* ra = reinterpret_cast<const DType*>(right->a);
+
+    for (size_t i = 0; i < n; ++i)        la[i] = ew_op_switch<op, DType, DType>(la[i], ra[i]);
+    for (size_t k = n + 1; k < size; ++k) la[k] = ew_op_switch<op, DType, DType>(la[k], ra[k]);
+
+  } else {
+    YALE_STORAGE* result = ew_op<op, IType, DType>(left, right, left->dtype);
+
+    std::swap(left->a,        result->a);
+    std::swap(left->ija,      result->ija);
+    std::swap(left->ndnz,     result->ndnz);
+    std::swap(left->capacity, result->capacity);
+    std::swap(left->itype,    result->itype);
+
+    nm_yale_storage_delete(result);
+  }
+}
+
+/*
+ * Whether (0 op scalar) == 0, i.e. whether the entries a Yale matrix doesn't store stay zero under a scalar
+ * operation -- true for multiplication, and for division by anything but zero, but not for most scalar additions.
+ *
+ * May raise (integer division by zero), so call it before allocating anything.
+ */
+template <typename nm::ewop_t op, typename LDType, typename RDType>
+static bool scalar_keeps_zeros(const void* rscalar) {
+  return ew_elem<op,LDType,RDType>::apply(zero_of<LDType>(), *reinterpret_cast<const RDType*>(rscalar)) == 0;
+}
+
+/*
+ * Element-wise operation between a Yale matrix and a scalar, applied to the diagonal and the stored entries only: the
+ * result has the same structure as left. Arithmetic keeps left's dtype and comparisons give BYTEs, as for dense.
+ *
+ * That's only right if scalar_keeps_zeros holds for the scalar, which the caller must have checked.
+ */
+template <typename nm::ewop_t op, typename LDType, typename RDType>
+static YALE_STORAGE* scalar_ew_op(const YALE_STORAGE* left, const void* rscalar) {
+  typedef ew_elem<op,LDType,RDType>   elem;
+  typedef typename elem::result_type RType;
+
+  const RDType s = *reinterpret_cast<const RDType*>(rscalar);
+
+  const size_t n    = left->shape[0],
+               size = nm_yale_storage_get_size(left);
+
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = left->shape[0];
+  shape[1] = left->shape[1];
+
+  YALE_STORAGE* result = create_with_itype(static_cast<uint8_t>(op) < NUM_NONCOMP_EWOPS ? left->dtype : BYTE,
+                                           shape, size, left->itype);
+  memcpy(result->ija, left->ija, size * ITYPE_SIZES[left->itype]);
+  result->ndnz = left->ndnz;
+
+  const LDType* la = reinterpret_cast<const LDType*>(left->a);
+  RType*        ra = reinterpret_cast<RType*>(result->a);
+
+  thread_pool::parallel_for(size, ew_op_nogvl<op, LDType, RDType>::value, size, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) ra[k] = elem::apply(la[k], s);
+  });
+  ra[n] = 0;
+
+  return result;
+}
+
+/*
+ * Reduction along rows (dim 0) or columns (dim 1). The diagonal and the non-diagonal entries are stored
+ * separately, but each is visited in a single sequential pass; unstored entries are zero.
+ */
+template <typename DType, typename IType>
+static void reduce(reduce_t op, const YALE_STORAGE* s, size_t dim, double* result) {
+  const size_t  n    = s->shape[0],
+                m    = s->shape[1];
+  const DType*  a    = reinterpret_cast<const DType*>(s->a);
+  const IType*  ija  = reinterpret_cast<const IType*>(s->ija);
+
+  sparse_reduction red(op, dim == 0 ? m : n, s->shape[dim], 0);
+
+  do {
+    for (size_t i = 0; i < std::min(n, m); ++i)
+      red.add(i, reduce_value(a[i]));
+
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t k = ija[i]; k < ija[i+1]; ++k)
+        red.add(dim == 0 ? ija[k] : i, reduce_value(a[k]));
+    }
+  } while (red.second_pass());
+
+  red.finish(result);
+}
+
 template <typename nm::ewop_t op, typename IType, typename DType>
 YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t dtype) {
 	size_t  init_capacity;
@@ -663,7 +1370,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 	
 	init_capacity = std::min(left->ndnz + right->ndnz + new_shape[0], new_shape[0] * new_shape[1]);
 	
-	dest	= nm_yale_storage_create(dtype, new_shape, 2, init_capacity, left->itype);
+	dest	= create_with_itype(dtype, new_shape, init_capacity, left->itype);
 	da		= reinterpret_cast<DType*>(dest->a);
 	
 	// Calculate diagonal values.
@@ -672,7 +1379,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 	}
 	
 	// Set the zero representation seperator.
-	da[da_index] = typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0;
+	da[da_index] = zero_of<DType>();
 	
 	/*
 	 * Calculate the offset between start of the A arrays and the non-diagonal
@@ -752,7 +1459,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 				if (op != EW_MUL) {
 					// If this is multiplion there is no point in doing the operation.
 					
-					tmp_result = ew_op_switch<op, DType, DType>(la[la_index], typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0);
+					tmp_result = ew_op_switch<op, DType, DType>(la[la_index], zero_of<DType>());
 				
 					printf("Setting value for [%d, %d].\n", (int)row_index, (int)YALE_IJ(left)[la_index]);
 				
@@ -774,7 +1481,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 				if (op != EW_MUL) {
 					// If this is multiplion there is no point in doing the operation.
 					
-					tmp_result = ew_op_switch<op, DType, DType>(typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0, ra[ra_index]);
+					tmp_result = ew_op_switch<op, DType, DType>(zero_of<DType>(), ra[ra_index]);
 				
 					printf("Setting value for [%d, %d].\n", (int)row_index, (int)YALE_IJ(right)[ra_index]);
 				
@@ -807,7 +1514,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 				
 				printf("Marker 1\n");
 				
-				tmp_result = ew_op_switch<op, DType, DType>(la[la_index], typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0);
+				tmp_result = ew_op_switch<op, DType, DType>(la[la_index], zero_of<DType>());
 				
 				printf("Setting value for [%d, %d].\n", (int)row_index, (int)YALE_IJ(left)[la_index]);
 				
@@ -828,7 +1535,7 @@ YALE_STORAGE* ew_op(const YALE_STORAGE* left, const YALE_STORAGE* right, dtype_t
 				
 				printf("Marker 2\n");
 				
-				tmp_result = ew_op_switch<op, DType, DType>(typeid(DType) == typeid(RubyObject) ? INT2FIX(0) : 0, ra[ra_index]);
+				tmp_result = ew_op_switch<op, DType, DType>(zero_of<DType>(), ra[ra_index]);
 				
 				printf("Setting value for [%d, %d].\n", (int)row_index, (int)YALE_IJ(right)[ra_index]);
 				
@@ -942,11 +1649,11 @@ static char vector_insert_resize(YALE_STORAGE* s, size_t current_size, size_t po
 
   // Copy all values subsequent to the insertion site to the new IJA and new A, leaving room (size n) for insertion.
   if (struct_only) {
-    for (size_t i = pos; i < current_size - pos + n - 1; ++i) {
+    for (size_t i = pos; i < current_size; ++i) {
       new_ija[i+n] = old_ija[i];
     }
   } else {
-    for (size_t i = pos; i < current_size - pos + n - 1; ++i) {
+    for (size_t i = pos; i < current_size; ++i) {
       new_ija[i+n] = old_ija[i];
       new_a[i+n] = old_a[i];
     }
@@ -1124,6 +1831,14 @@ static YALE_STORAGE* copy_alloc_struct(const YALE_STORAGE* rhs, const dtype_t ne
   lhs->capacity     = new_capacity;
   lhs->dtype        = new_dtype;
   lhs->ndnz         = rhs->ndnz;
+  lhs->offset       = NULL;
+  lhs->row_end      = NULL;
+  lhs->symm         = rhs->symm;
+  lhs->col_index    = NULL;
+  lhs->levels[0]    = lhs->levels[1] = NULL;
+  lhs->symbolic[0]  = lhs->symbolic[1] = NULL;
+  lhs->count        = 1;
+  lhs->src          = lhs;
 
   lhs->ija          = ALLOC_N( IType, lhs->capacity );
   lhs->a            = ALLOC_N( char, DTYPE_SIZES[new_dtype] * lhs->capacity );
@@ -1136,39 +1851,686 @@ static YALE_STORAGE* copy_alloc_struct(const YALE_STORAGE* rhs, const dtype_t ne
   return lhs;
 }
 
+/*
+ * Returns the IJA vector of s with its entries as ITypes. If s has a narrower itype, they're copied into a
+ * malloc'd array, which is also stored in owned so the caller can free it; otherwise owned is set to NULL.
+ */
+template <typename IType>
+static const IType* ija_as(const YALE_STORAGE* s, IType*& owned) {
+  owned = NULL;
+  if (ITYPE_SIZES[s->itype] == sizeof(IType)) return reinterpret_cast<const IType*>(s->ija);
+
+  const size_t size = nm_yale_storage_get_size(s);
+  owned = reinterpret_cast<IType*>(malloc(size * sizeof(IType)));
+  if (!owned) rb_raise(rb_eNoMemError, "insufficient memory");
+
+  for (size_t k = 0; k < size; ++k) owned[k] = ija_at(s->ija, s->itype, k);
+
+  return owned;
+}
+
+/*
+ * Calls f(k, v) for every term left[i,j] * right[j,k] which contributes to row i of a product of Yale matrices, taking
+ * the diagonals (of lengths dl and dr) into account.
+ */
+template <typename DType, typename IType, typename F>
+static inline void each_product_term(size_t i, const IType* ijl, const DType* al, size_t dl,
+                                     const IType* ijr, const DType* ar, size_t dr, F f) {
+  for (size_t jj = ijl[i], end = ijl[i+1]; jj <= end; ++jj) {
+    size_t j;
+    if (jj == end) {
+      if (i >= dl) break;
+      j = i;
+    } else j = ijl[jj];
+
+    const DType& v = jj == end ? al[i] : al[jj];
+
+    if (j < dr) f(j, v * ar[j]);
+    for (size_t kk = ijr[j]; kk < ijr[j+1]; ++kk) f(ijr[kk], v * ar[kk]);
+  }
+}
+
+/*
+ * Sparse-sparse product in two passes over the rows of left, both split across the thread pool.
+ *
+ * The symbolic pass counts the distinct columns in each row of the product, marking them off in a per-thread
+ * array, so a prefix sum over the counts sizes the result exactly. The numeric pass then accumulates each row into a
+ * per-thread dense row, collecting its columns straight into the result, and sorts them before writing out the
+ * sums. Entries which cancel to zero are dropped, and the rows closed up afterwards if there were any.
+ *
+ * IType must be wide enough for left, right, and the result; the caller picks the widest.
+ */
 template <typename DType, typename IType>
 static STORAGE* matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector) {
-  YALE_STORAGE *left  = (YALE_STORAGE*)(casted_storage.left),
-               *right = (YALE_STORAGE*)(casted_storage.right);
+  const YALE_STORAGE *left  = reinterpret_cast<const YALE_STORAGE*>(casted_storage.left),
+                     *right = reinterpret_cast<const YALE_STORAGE*>(casted_storage.right);
+
+  const size_t n  = left->shape[0],
+               p  = left->shape[1],
+               m  = right->shape[1],
+               dl = std::min(n, p),
+               dr = std::min(p, m);
+
+  IType *l_owned, *r_owned;
+  const IType* ijl = ija_as<IType>(left, l_owned);
+  const IType* ijr = ija_as<IType>(right, r_owned);
+  const DType* al  = reinterpret_cast<const DType*>(left->a);
+  const DType* ar  = reinterpret_cast<const DType*>(right->a);
+
+  const bool   nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+  const size_t work  = (ijl[n] - n) + (ijr[p] - p) + n;
+  const size_t T     = nogvl && work >= thread_pool::threshold() ? std::min(thread_pool::num_threads(), n) : 1;
+  const IType  unset = std::numeric_limits<IType>::max();
+
+  IType*  mask   = reinterpret_cast<IType*>(malloc(std::max<size_t>(T * m, 1) * sizeof(IType)));
+  DType*  sums   = reinterpret_cast<DType*>(malloc(std::max<size_t>(T * m, 1) * sizeof(DType)));
+  size_t* counts = reinterpret_cast<size_t*>(malloc(std::max<size_t>(n, 1) * sizeof(size_t)));
+
+  if (!mask || !sums || !counts) {
+    free(mask); free(sums); free(counts); free(l_owned); free(r_owned);
+    rb_raise(rb_eNoMemError, "insufficient memory");
+  }
+
+  // 1. Symbolic: count the non-diagonal entries in each row.
+  thread_pool::parallel_for(work, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      IType* mk = mask + t * m;
+      std::fill(mk, mk + m, unset);
+
+      for (size_t i = n*t / T; i < n*(t+1) / T; ++i) {
+        size_t count = 0;
+        each_product_term(i, ijl, al, dl, ijr, ar, dr, [&](size_t k, const DType&) {
+          if (k != i && mk[k] != i) {
+            mk[k] = i;
+            ++count;
+          }
+        });
+        counts[i] = count;
+      }
+    }
+  });
 
-  // We can safely get dtype from the casted matrices; post-condition of binary_storage_cast_alloc is that dtype is the
-  // same for left and right.
-  // int8_t dtype = left->dtype;
+  // 2. Allocate exactly that much, and lay out IA.
+  size_t size = n + 1;
+  for (size_t i = 0; i < n; ++i) size += counts[i];
 
-  // Create result storage.
-  nm::itype_t result_itype = static_cast<uint8_t>(left->itype) < static_cast<uint8_t>(right->itype) ? right->itype : left->itype;
-  YALE_STORAGE* result = nm_yale_storage_create(left->dtype, resulting_shape, 2, left->capacity + right->capacity, result_itype);
-  init<DType,IType>(result);
+  YALE_STORAGE* result = alloc(left->dtype, resulting_shape, 2, UINT8);
+  result->itype    = itype_of<IType>();
+  result->capacity = size;
+  result->ija      = ALLOC_N(IType, size);
+  result->a        = ALLOC_N(DType, size);
 
-  IType* ijl = reinterpret_cast<IType*>(left->ija);
-  IType* ijr = reinterpret_cast<IType*>(right->ija);
   IType* ija = reinterpret_cast<IType*>(result->ija);
+  DType* a   = reinterpret_cast<DType*>(result->a);
+
+  ija[0] = n + 1;
+  for (size_t i = 0; i < n; ++i) ija[i+1] = ija[i] + counts[i];
+  a[n] = 0;
+
+  // 3. Numeric: fill in each row, sorted by column. counts becomes the number of entries that didn't cancel.
+  thread_pool::parallel_for(work, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      IType* mk = mask + t * m;
+      DType* sm = sums + t * m;
+      std::fill(mk, mk + m, unset);
+
+      for (size_t i = n*t / T; i < n*(t+1) / T; ++i) {
+        IType* cols = ija + ija[i];
+        IType* last = cols;
+        DType  diag = 0;
+
+        each_product_term(i, ijl, al, dl, ijr, ar, dr, [&](size_t k, const DType& v) {
+          if (k == i)          diag += v;
+          else if (mk[k] != i) {
+            mk[k]   = i;
+            sm[k]   = v;
+            *last++ = k;
+          } else sm[k] += v;
+        });
+
+        std::sort(cols, last);
+
+        size_t q = ija[i];
+        for (IType* c = cols; c < last; ++c) {
+          if (sm[*c] == 0) continue;
+          ija[q] = *c;
+          a[q++] = sm[*c];
+        }
 
-  // Symbolic multiplication step (build the structure)
-  nm::math::symbmm<IType>(result->shape[0], result->shape[1], ijl, ijl, true, ijr, ijr, true, ija, true);
+        a[i]      = diag;
+        counts[i] = q - ija[i];
+      }
+    }
+  });
+
+  // 4. Close up the rows if anything cancelled.
+  size_t nonzero = n + 1;
+  for (size_t i = 0; i < n; ++i) nonzero += counts[i];
+
+  if (nonzero < size) {
+    size_t q = n + 1;
+    for (size_t i = 0; i < n; ++i) {
+      size_t from = ija[i];
+      ija[i] = q;
+      for (size_t k = from; k < from + counts[i]; ++k, ++q) {
+        ija[q] = ija[k];
+        a[q]   = a[k];
+      }
+    }
+    ija[n] = q;
+
+    result->capacity = nonzero;
+    REALLOC_N(result->ija, IType, nonzero);
+    REALLOC_N(result->a, DType, nonzero);
+  }
 
-  // Numeric multiplication step (fill in the elements)
-  nm::math::numbmm<DType,IType>(result->shape[0], result->shape[1],
-                                ijl, ijl, reinterpret_cast<DType*>(left->a), true,
-                                ijr, ijr, reinterpret_cast<DType*>(right->a), true,
-                                ija, ija, reinterpret_cast<DType*>(result->a), true);
+  result->ndnz = nonzero - (n + 1);
 
-  // Sort the columns
-  nm::math::smmp_sort_columns<DType,IType>(result->shape[0], ija, ija, reinterpret_cast<DType*>(result->a));
+  free(mask); free(sums); free(counts); free(l_owned); free(r_owned);
 
   return reinterpret_cast<STORAGE*>(result);
 }
 
+/*
+ * Transposes rhs into lhs, which must already have the transposed shape and enough capacity. lhs's itype is
+ * IType; rhs's may be narrower.
+ *
+ * Each thread counts the entries per column in its own block of rows. Those counts are turned into every thread's
+ * starting position within each column, with the columns split across the threads, and then each thread scatters
+ * its block of rows. The blocks are in row order, so the rows within each column of lhs come out sorted.
+ */
+template <typename DType, typename IType>
+static void transpose(const YALE_STORAGE* rhs, YALE_STORAGE* lhs) {
+  IType* owned;
+  const IType* ija = ija_as<IType>(rhs, owned);
+  const DType* a   = reinterpret_cast<const DType*>(rhs->a);
+
+  const size_t n    = rhs->shape[0],
+               m    = rhs->shape[1],
+               ndnz = ija[n] - (n + 1);
+
+  IType* ijb = reinterpret_cast<IType*>(lhs->ija);
+  DType* b   = reinterpret_cast<DType*>(lhs->a);
+
+  // Every thread needs a count for each column, so only use several when that's cheap next to the entries.
+  const bool nogvl = ew_op_nogvl<EW_ADD,DType,DType>::value;
+  size_t T = nogvl ? std::min(thread_pool::num_threads(), n) : 1;
+  if (ndnz < thread_pool::threshold() || T * m > ndnz) T = 1;
+
+  size_t* pos = reinterpret_cast<size_t*>(calloc(std::max<size_t>(T * m, 1), sizeof(size_t)));
+  if (!pos) {
+    free(owned);
+    rb_raise(rb_eNoMemError, "insufficient memory");
+  }
+
+  // 1. Count.
+  thread_pool::parallel_for(ndnz, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      size_t* count = pos + t * m;
+      for (size_t k = ija[n*t / T]; k < ija[n*(t+1) / T]; ++k) ++count[ija[k]];
+    }
+  });
+
+  // 2. Each thread's start within each column, relative to the column; the column sizes go in IA.
+  thread_pool::parallel_for(T * m, nogvl, m, [&](size_t begin, size_t end) {
+    for (size_t j = begin; j < end; ++j) {
+      size_t sum = 0;
+      for (size_t t = 0; t < T; ++t) {
+        size_t c = pos[t*m + j];
+        pos[t*m + j] = sum;
+        sum += c;
+      }
+      ijb[j+1] = sum;
+    }
+  });
+
+  ijb[0] = m + 1;
+  for (size_t j = 0; j < m; ++j) ijb[j+1] += ijb[j];
+
+  // 3. Scatter, and copy the diagonal.
+  thread_pool::parallel_for(ndnz, nogvl, T, [&](size_t t_begin, size_t t_end) {
+    for (size_t t = t_begin; t < t_end; ++t) {
+      size_t* p = pos + t * m;
+
+      for (size_t i = n*t / T; i < n*(t+1) / T; ++i) {
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          size_t q = ijb[ija[k]] + p[ija[k]]++;
+          ijb[q] = i;
+          b[q]   = a[k];
+        }
+      }
+    }
+  });
+
+  const size_t d = std::min(n, m);
+  for (size_t i = 0; i < m; ++i) b[i] = i < d ? a[i] : DType(0);
+  b[m] = 0;
+
+  lhs->ndnz = ndnz;
+
+  free(pos); free(owned);
+}
+
+/*
+ * Checks that s (which must be square, gap-free and not a reference) is symmetric, or Hermitian, and if so drops its
+ * lower triangle, leaving the diagonal and the strict upper triangle. Returns false, leaving s as it was, if not.
+ *
+ * Every entry below the diagonal must have its mirror image stored above it. Since no cell is stored twice, there
+ * being as many entries above as below then accounts for every entry above too.
+ */
+template <typename DType, typename IType>
+static bool pack(YALE_STORAGE* s, bool hermitian) {
+  IType*        ija = reinterpret_cast<IType*>(s->ija);
+  DType*        a   = reinterpret_cast<DType*>(s->a);
+  const size_t  n   = s->shape[0];
+
+  size_t lower = 0, upper = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (mirror(a[i], hermitian) != a[i]) return false;
+
+    for (size_t p = ija[i]; p < ija[i+1]; ++p) {
+      const size_t j = ija[p];
+      if (j > i) {
+        ++upper;
+        continue;
+      }
+
+      const IType* q = std::lower_bound(ija + ija[j], ija + ija[j+1], static_cast<IType>(i));
+      if (q == ija + ija[j+1] || *q != i || a[q - ija] != mirror(a[p], hermitian)) return false;
+      ++lower;
+    }
+  }
+
+  if (lower != upper) return false;
+
+  // Close each row up over its dropped entries.
+  size_t pos = n + 1, start = ija[0];
+  for (size_t i = 0; i < n; ++i) {
+    const size_t end = ija[i+1];
+    ija[i] = pos;
+
+    for (size_t p = start; p < end; ++p) {
+      if (ija[p] > i) {
+        ija[pos] = ija[p];
+        a[pos++] = a[p];
+      }
+    }
+    start = end;
+  }
+  ija[n] = pos;
+
+  s->ndnz = pos - (n + 1);
+  s->symm = hermitian ? HERM : SYMM;
+  return true;
+}
+
+/*
+ * Writes packed s out in full into full, which must already have the right capacity (and may have a wider itype).
+ *
+ * The lower triangle of row i is the upper triangle's column i, and going through the upper triangle row by row
+ * visits each column's entries in row order, so one pass to count them and one to scatter them build it without
+ * any sorting.
+ */
+template <typename DType, typename IType>
+static void unpack(const YALE_STORAGE* s, YALE_STORAGE* full) {
+  const size_t n    = s->shape[0];
+  const bool   herm = s->symm == HERM;
+  size_t*      next = ALLOC_N(size_t, n);
+
+  IType* owned;
+  const IType* ija = ija_as<IType>(s, owned);
+  const DType* a   = reinterpret_cast<const DType*>(s->a);
+
+  IType* ijf = reinterpret_cast<IType*>(full->ija);
+  DType* af  = reinterpret_cast<DType*>(full->a);
+
+  // Each row has its own entries, plus those above it in its column.
+  std::fill(next, next + n, 0);
+  for (size_t p = n + 1; p < ija[n]; ++p) ++next[ija[p]];
+
+  size_t pos = n + 1;
+  for (size_t i = 0; i < n; ++i) {
+    ijf[i]   = pos;
+    pos     += next[i] + ija[i+1] - ija[i];
+    next[i]  = ijf[i];
+  }
+  ijf[n] = pos;
+
+  // The lower triangle, then the upper one after it in each row.
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t p = ija[j]; p < ija[j+1]; ++p) {
+      size_t q = next[ija[p]]++;
+      ijf[q] = j;
+      af[q]  = mirror(a[p], herm);
+    }
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t p = ija[i]; p < ija[i+1]; ++p) {
+      size_t q = next[i]++;
+      ijf[q] = ija[p];
+      af[q]  = a[p];
+    }
+  }
+
+  // The diagonal, and the zero.
+  for (size_t i = 0; i <= n; ++i) af[i] = a[i];
+
+  full->ndnz = pos - (n + 1);
+
+  free(owned);
+  xfree(next);
+}
+
+/*
+ * sparse_dense_multiply for a reference (on an unpacked matrix), which is read in place: the rows of its source which
+ * cross the window, and in each only the entries in the window's columns (see each_stored_in_window). The plain
+ * product is split over the rows, like the one for a whole matrix; the transposed one scatters, and isn't split.
+ */
+template <typename DType, typename IType>
+static void ref_dense_multiply(const YALE_STORAGE* left, const void* x_, size_t nrhs, void* y_, bool transposed) {
+  const DType*        x   = reinterpret_cast<const DType*>(x_);
+  DType*              y   = reinterpret_cast<DType*>(y_);
+  const YALE_STORAGE* src = reinterpret_cast<const YALE_STORAGE*>(left->src);
+  const DType*        a   = reinterpret_cast<const DType*>(src->a);
+  const IType*        ija = reinterpret_cast<const IType*>(src->ija);
+  const size_t        n   = left->shape[0],
+                      m   = left->shape[1],
+                      r0  = left->offset[0],
+                      work = (ija[r0+n] - ija[r0] + n) * nrhs; // at most; the columns outside the window are skipped
+  const bool          nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+
+  if (!transposed) {
+    thread_pool::parallel_for(work, nogvl, n, [&](size_t begin, size_t end) {
+      const size_t offset[2] = { r0 + begin, left->offset[1] },
+                   shape[2]  = { end - begin, m };
+
+      for (size_t p = begin*nrhs; p < end*nrhs; ++p) y[p] = 0;
+
+      each_stored_in_window<IType>(src, offset, shape, [&](size_t i, size_t j, size_t p) {
+        DType*       yi = y + (begin + i)*nrhs;
+        const DType* xj = x + j*nrhs;
+        for (size_t c = 0; c < nrhs; ++c) yi[c] += a[p] * xj[c];
+      });
+    });
+
+  } else {
+    thread_pool::parallel_for(work, nogvl, 1, [&](size_t, size_t) {
+      for (size_t p = 0; p < m*nrhs; ++p) y[p] = 0;
+
+      each_stored_in_window<IType>(src, left->offset, left->shape, [&](size_t i, size_t j, size_t p) {
+        DType*       yj = y + j*nrhs;
+        const DType* xi = x + i*nrhs;
+        for (size_t c = 0; c < nrhs; ++c) yj[c] += a[p] * xi[c];
+      });
+    });
+  }
+}
+
+/*
+ * Sparse times dense: y = A x, or y = A^T x if transposed, where x is a row-major dense matrix with nrhs columns (one
+ * for a vector). Reads the diagonal and the non-diagonal entries of A where they are, without any conversion.
+ *
+ * The plain product is split over the rows of A, each of which fills its own row of y. The transposed one scatters
+ * into y instead, so every thread gets a private copy of y to accumulate into, and the copies are summed at the end.
+ * (Unless A has a column index, which turns A^T into rows too: see nm_yale_storage_build_col_index.)
+ * So does the product with a packed symmetric or Hermitian A, each of whose stored entries also stands for its
+ * mirror image below the diagonal; it reads half as many entries as the unpacked matrix would need.
+ */
+template <typename DType, typename IType>
+static void sparse_dense_multiply(const YALE_STORAGE* left, const void* x_, size_t nrhs, void* y_, bool transposed) {
+  if (nm_yale_storage_is_ref(left)) {
+    ref_dense_multiply<DType,IType>(left, x_, nrhs, y_, transposed);
+    return;
+  }
+
+  const DType*  x     = reinterpret_cast<const DType*>(x_);
+  DType*        y     = reinterpret_cast<DType*>(y_);
+  const DType*  a     = reinterpret_cast<const DType*>(left->a);
+  const IType*  ija   = reinterpret_cast<const IType*>(left->ija);
+  const size_t  n      = left->shape[0],
+                m      = left->shape[1],
+                d      = std::min(n, m),
+                work   = (ija[n] - (n+1) + d) * nrhs;
+  const bool    nogvl  = ew_op_nogvl<EW_MUL,DType,DType>::value,
+                packed = left->symm != NONSYMM,
+                herm   = left->symm == HERM;
+
+  if (transposed && !packed && left->col_index) {
+    // Each column of A is a row of A^T, so with the column index the transposed product goes just like the plain one.
+    const IType* ptr = reinterpret_cast<const IType*>(left->col_index->ptr);
+    const IType* pos = reinterpret_cast<const IType*>(left->col_index->pos);
+    const IType* row = reinterpret_cast<const IType*>(left->col_index->row);
+
+    thread_pool::parallel_for(work, nogvl, m, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; ++j) {
+        DType* yj = y + j*nrhs;
+
+        if (j < d) for (size_t c = 0; c < nrhs; ++c) yj[c] = a[j] * x[j*nrhs + c];
+        else       for (size_t c = 0; c < nrhs; ++c) yj[c] = 0;
+
+        for (size_t q = ptr[j]; q < ptr[j+1]; ++q) {
+          const DType  aq = a[pos[q]];
+          const DType* xi = x + row[q]*nrhs;
+          for (size_t c = 0; c < nrhs; ++c) yj[c] += aq * xi[c];
+        }
+      }
+    });
+    return;
+  }
+
+  if (!transposed && !packed) {
+    thread_pool::parallel_for(work, nogvl, n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        DType* yi = y + i*nrhs;
+
+        if (i < d) for (size_t c = 0; c < nrhs; ++c) yi[c] = a[i] * x[i*nrhs + c];
+        else       for (size_t c = 0; c < nrhs; ++c) yi[c] = 0;
+
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          const DType* xj = x + ija[k]*nrhs;
+          for (size_t c = 0; c < nrhs; ++c) yi[c] += a[k] * xj[c];
+        }
+      }
+    });
+    return;
+  }
+
+  const size_t ylen = m * nrhs;
+  const size_t T    = nogvl && work >= thread_pool::threshold() ? std::min(thread_pool::num_threads(), n) : 1;
+
+  // Copy 0 is y itself; the others have to be allocated here, while we hold the GVL.
+  DType* partial = T > 1 ? ALLOC_N(DType, (T-1) * ylen) : NULL;
+
+  thread_pool::parallel_for(work, nogvl, T, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; ++t) {
+      DType* yt = t == 0 ? y : partial + (t-1)*ylen;
+      for (size_t p = 0; p < ylen; ++p) yt[p] = 0;
+
+      for (size_t i = n*t / T; i < n*(t+1) / T; ++i) {
+        const DType* xi = x + i*nrhs;
+
+        if (i < d) for (size_t c = 0; c < nrhs; ++c) yt[i*nrhs + c] += a[i] * xi[c];
+
+        for (size_t k = ija[i]; k < ija[i+1]; ++k) {
+          DType* yj = yt + ija[k]*nrhs;
+
+          if (packed) {
+            // A_ij is stored and A_ji is its mirror image; A^T swaps them.
+            const DType  aij = mirror(a[k], herm && transposed),
+                         aji = mirror(a[k], herm && !transposed);
+            const DType* xj  = x + ija[k]*nrhs;
+            DType*       yi  = yt + i*nrhs;
+
+            for (size_t c = 0; c < nrhs; ++c) {
+              yi[c] += aij * xj[c];
+              yj[c] += aji * xi[c];
+            }
+
+          } else {
+            for (size_t c = 0; c < nrhs; ++c) yj[c] += a[k] * xi[c];
+          }
+        }
+      }
+    }
+  });
+
+  if (partial) {
+    thread_pool::parallel_for(ylen * T, nogvl, ylen, [&](size_t begin, size_t end) {
+      for (size_t t = 1; t < T; ++t) {
+        const DType* yt = partial + (t-1)*ylen;
+        for (size_t p = begin; p < end; ++p) y[p] += yt[p];
+      }
+    });
+    xfree(partial);
+  }
+}
+
+/*
+ * Whether any of the diagonal entries of square s is zero.
+ */
+template <typename DType>
+static bool zero_on_diagonal(const YALE_STORAGE* s) {
+  const DType* a = reinterpret_cast<const DType*>(s->a);
+
+  for (size_t i = 0; i < s->shape[0]; ++i)
+    if (a[i] == 0) return true;
+
+  return false;
+}
+
+/*
+ * Position in IJA of the first entry of row i in the lower (if lower is set) or upper triangle of s, and the position
+ * just past its last one. Rows are sorted, so one search splits them.
+ */
+template <typename IType>
+static inline std::pair<size_t,size_t> triangle_of_row(const IType* ija, size_t i, bool lower) {
+  const size_t split = std::lower_bound(ija + ija[i], ija + ija[i+1], static_cast<IType>(i)) - ija;
+  return lower ? std::make_pair(static_cast<size_t>(ija[i]), split) : std::make_pair(split, static_cast<size_t>(ija[i+1]));
+}
+
+/*
+ * Works out the level schedule of the lower (or upper) triangle of square s: row i is in level 0 if it has no
+ * entries in that triangle, and otherwise one level after the last of the rows it does have entries in. The rows of
+ * a level depend only on earlier levels, so they can be solved for all at once.
+ */
+template <typename IType>
+static YALE_LEVELS* build_levels(const YALE_STORAGE* s, bool lower) {
+  const size_t n   = s->shape[0];
+  const IType* ija = reinterpret_cast<const IType*>(s->ija);
+
+  IType* level = ALLOC_N(IType, n);
+  size_t count = 0;
+
+  for (size_t t = 0; t < n; ++t) {
+    const size_t i = lower ? t : n - 1 - t;
+    const std::pair<size_t,size_t> tri = triangle_of_row<IType>(ija, i, lower);
+
+    size_t l = 0;
+    for (size_t p = tri.first; p < tri.second; ++p) l = std::max<size_t>(l, level[ija[p]] + 1);
+
+    level[i] = l;
+    count    = std::max(count, l + 1);
+  }
+
+  // Sort the rows by level.
+  IType* ptr = ALLOC_N(IType, count + 1);
+  IType* row = ALLOC_N(IType, n);
+
+  std::fill(ptr, ptr + count + 1, 0);
+  for (size_t i = 0; i < n; ++i)     ++ptr[level[i] + 1];
+  for (size_t l = 0; l < count; ++l) ptr[l+1] += ptr[l];
+  for (size_t i = 0; i < n; ++i)     row[ptr[level[i]]++] = i;
+
+  // That left each ptr[l] where level l+1 starts.
+  for (size_t l = count; l > 0; --l) ptr[l] = ptr[l-1];
+  ptr[0] = 0;
+
+  xfree(level);
+
+  YALE_LEVELS* levels = ALLOC(YALE_LEVELS);
+  levels->count = count;
+  levels->ptr   = ptr;
+  levels->row   = row;
+
+  return levels;
+}
+
+/*
+ * Solves L X = B in place, with L the lower triangle and diagonal of square s, or U X = B with the upper triangle if
+ * lower is false; entries in the other triangle are ignored. x holds B, a row-major matrix with nrhs columns, on the
+ * way in, and X on the way out. If unit is set, the diagonal is taken to be all ones and isn't read.
+ *
+ * A small solve is plain forward (or back) substitution, a row at a time. A large one is done by levels (see
+ * build_levels): each level's rows are shared out among the threads, which wait for each other at the end of it. The
+ * schedule is kept in s, so working it out is only paid for once for any number of solves.
+ */
+template <typename DType, typename IType>
+static void triangular_solve(const YALE_STORAGE* s, bool lower, bool unit, void* x_, size_t nrhs) {
+  const size_t  n     = s->shape[0],
+                work  = (nm_yale_storage_get_size(s) - 1) * nrhs,
+                T     = thread_pool::num_threads();
+  const DType*  a     = reinterpret_cast<const DType*>(s->a);
+  const IType*  ija   = reinterpret_cast<const IType*>(s->ija);
+  DType*        x     = reinterpret_cast<DType*>(x_);
+  const bool    nogvl = ew_op_nogvl<EW_MUL,DType,DType>::value;
+
+  auto solve_row = [&](size_t i) {
+    const std::pair<size_t,size_t> tri = triangle_of_row<IType>(ija, i, lower);
+    DType* xi = x + i*nrhs;
+
+    for (size_t p = tri.first; p < tri.second; ++p) {
+      const DType* xj = x + ija[p]*nrhs;
+      for (size_t c = 0; c < nrhs; ++c) xi[c] = xi[c] - a[p] * xj[c];
+    }
+
+    if (!unit) for (size_t c = 0; c < nrhs; ++c) xi[c] = xi[c] / a[i];
+  };
+
+  auto substitute = [&]() {
+    thread_pool::parallel_for(work, nogvl, 1, [&](size_t, size_t) {
+      for (size_t t = 0; t < n; ++t) solve_row(lower ? t : n - 1 - t);
+    });
+  };
+
+  if (!nogvl || T < 2 || work < thread_pool::threshold()) {
+    substitute();
+    return;
+  }
+
+  // The schedule only depends on where the entries are, so it's kept until they move (see drop_caches).
+  YALE_LEVELS*& levels = const_cast<YALE_STORAGE*>(s)->levels[lower ? 0 : 1];
+  if (!levels) levels = build_levels<IType>(s, lower);
+
+  // A long chain of dependencies leaves too little in each level to share out.
+  if (levels->count * 2*T > n) {
+    substitute();
+    return;
+  }
+
+  const IType* ptr = reinterpret_cast<const IType*>(levels->ptr);
+  const IType* row = reinterpret_cast<const IType*>(levels->row);
+
+  thread_pool::without_gvl([&]() {
+    for (size_t l = 0; l < levels->count; ++l) {
+      const IType* level = row + ptr[l];
+      const size_t width = ptr[l+1] - ptr[l];
+
+      auto f = [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r) solve_row(level[r]);
+      };
+
+      // A narrow level isn't worth waking the other threads for.
+      if (width < 2*T) {
+        f(0, width);
+      } else {
+        thread_pool::block_job<decltype(f)> job = { f, width, T };
+        thread_pool::run(T, thread_pool::block_job<decltype(f)>::run, &job);
+      }
+    }
+  });
+}
+
 
 } // end of namespace nm::yale_storage
 
@@ -1176,10 +2538,61 @@ static STORAGE* matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resu
 // Helper function used only for the RETURN_SIZED_ENUMERATOR macro. Returns the length of
 // the matrix's storage.
 static VALUE nm_yale_enumerator_length(VALUE nmatrix) {
-  long len = nm_yale_storage_get_size(NM_STORAGE_YALE(nmatrix));
+  NAMED_ITYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::count_stored, size_t, const YALE_STORAGE*);
+
+  YALE_STORAGE* s = NM_STORAGE_YALE(nmatrix);
+  nm_yale_storage_close_gaps(s);
+
+  long len = nm_yale_storage_is_ref(s) || nm_yale_storage_is_packed(s) ? ttable[s->itype](s) : nm_yale_storage_get_size(s);
   return LONG2NUM(len);
 }
 
+// Same, for each, which visits every element.
+static VALUE nm_yale_each_length(VALUE nmatrix) {
+  return LONG2NUM(NM_SHAPE0(nmatrix) * NM_SHAPE1(nmatrix));
+}
+
+/*
+ * The Ruby value of the element at position p in s's A vector.
+ */
+static inline VALUE element_rval(const YALE_STORAGE* s, size_t p) {
+  if (s->dtype == nm::RUBYOBJ) return reinterpret_cast<VALUE*>(s->a)[p];
+  return rubyobj_from_cval(reinterpret_cast<char*>(s->a) + p * DTYPE_SIZES[s->dtype], s->dtype).rval;
+}
+
+/*
+ * The Ruby value of the mirror image of the element at position p in packed s: the same, or its conjugate if s is
+ * Hermitian.
+ */
+static inline VALUE mirrored_rval(const YALE_STORAGE* s, size_t p) {
+  if (s->symm != nm::HERM) return element_rval(s, p);
+
+  if (s->dtype == nm::COMPLEX64) {
+    nm::Complex64 v = reinterpret_cast<nm::Complex64*>(s->a)[p].conjugate();
+    return rubyobj_from_cval(&v, s->dtype).rval;
+  }
+
+  nm::Complex128 v = reinterpret_cast<nm::Complex128*>(s->a)[p].conjugate();
+  return rubyobj_from_cval(&v, s->dtype).rval;
+}
+
+/*
+ * The Ruby value of the element at (i, j) of packed s, which must be gap-free.
+ */
+template <typename IType>
+static VALUE packed_cell_rval(const YALE_STORAGE* s, size_t i, size_t j) {
+  if (i == j) return element_rval(s, i);
+
+  const IType* ija = reinterpret_cast<const IType*>(s->ija);
+  const size_t r   = std::min(i, j),
+               c   = std::max(i, j);
+
+  const IType* q = std::lower_bound(ija + ija[r], ija + ija[r+1], static_cast<IType>(c));
+  if (q == ija + ija[r+1] || *q != c) return element_rval(s, s->shape[0]);
+
+  return i > j ? mirrored_rval(s, q - ija) : element_rval(s, q - ija);
+}
+
 
 template <typename DType, typename IType>
 struct yale_each_stored_with_indices_helper {
@@ -1267,6 +2680,85 @@ static VALUE yale_each_stored_with_indices(VALUE nm) {
   return yale_each_stored_with_indices_helper<DType, IType>::iterate(nm);
 }
 
+/*
+ * each_stored_with_indices for a reference: the entries its source stores inside the window, row by row, with
+ * indices relative to the window.
+ */
+template <typename IType>
+static VALUE yale_ref_each_stored_with_indices(VALUE nm) {
+  YALE_STORAGE*       s   = NM_STORAGE_YALE(nm);
+  const YALE_STORAGE* src = reinterpret_cast<const YALE_STORAGE*>(s->src);
+
+  RETURN_SIZED_ENUMERATOR(nm, 0, 0, nm_yale_enumerator_length);
+
+  yale_storage::each_stored_in_window<IType>(src, s->offset, s->shape, [src](size_t i, size_t j, size_t p) {
+    rb_yield_values(3, element_rval(src, p), LONG2NUM(i), LONG2NUM(j));
+  });
+
+  return nm;
+}
+
+/*
+ * each_stored_with_indices for a packed matrix, or a reference to one: the diagonal, then each stored entry in the
+ * window followed by its mirror image (if that's in the window too).
+ */
+template <typename IType>
+static VALUE yale_packed_each_stored_with_indices(VALUE nm) {
+  YALE_STORAGE*       s   = NM_STORAGE_YALE(nm);
+  const YALE_STORAGE* src = reinterpret_cast<const YALE_STORAGE*>(s->src);
+
+  RETURN_SIZED_ENUMERATOR(nm, 0, 0, nm_yale_enumerator_length);
+
+  const size_t origin[2] = {0, 0};
+  const size_t* offset   = nm_yale_storage_is_ref(s) ? s->offset : origin;
+
+  yale_storage::each_packed_in_window<IType>(src, offset, s->shape, [src](size_t i, size_t j, size_t p, bool mirrored) {
+    rb_yield_values(3, mirrored ? mirrored_rval(src, p) : element_rval(src, p), LONG2NUM(i), LONG2NUM(j));
+  });
+
+  return nm;
+}
+
+/*
+ * Yields every element of a Yale matrix or reference in row-major order, zeros included.
+ */
+template <typename IType>
+static VALUE yale_each(VALUE nm) {
+  YALE_STORAGE*       s   = NM_STORAGE_YALE(nm);
+  const YALE_STORAGE* src = reinterpret_cast<const YALE_STORAGE*>(s->src);
+
+  RETURN_SIZED_ENUMERATOR(nm, 0, 0, nm_yale_each_length);
+
+  const size_t origin[2] = {0, 0};
+  const size_t* offset   = nm_yale_storage_is_ref(s) ? s->offset : origin;
+  VALUE zero = element_rval(src, src->shape[0]);
+
+  // Half of a packed matrix's rows are in its columns, so look each element up.
+  if (src->symm != NONSYMM) {
+    for (size_t i = 0; i < s->shape[0]; ++i)
+      for (size_t j = 0; j < s->shape[1]; ++j)
+        rb_yield(packed_cell_rval<IType>(src, offset[0] + i, offset[1] + j));
+
+    return nm;
+  }
+
+  for (size_t i = 0; i < s->shape[0]; ++i) {
+    size_t row[2]       = {offset[0] + i, offset[1]},
+           row_shape[2] = {1, s->shape[1]},
+           j_next       = 0;
+
+    yale_storage::each_stored_in_window<IType>(src, row, row_shape, [&](size_t, size_t j, size_t p) {
+      for (; j_next < j; ++j_next) rb_yield(zero);
+      rb_yield(element_rval(src, p));
+      ++j_next;
+    });
+
+    for (; j_next < s->shape[1]; ++j_next) rb_yield(zero);
+  }
+
+  return nm;
+}
+
 
 } // end of namespace nm.
 
@@ -1274,7 +2766,8 @@ static VALUE yale_each_stored_with_indices(VALUE nm) {
 // Ruby Bindings //
 ///////////////////
 
-/* These bindings are mostly only for debugging Yale. They are called from Init_nmatrix. */
+/* These bindings are mostly only for debugging Yale. They are called from Init_nmatrix. On a reference, they show
+ * the vectors of its source. Gapped rows are closed up first. */
 
 extern "C" {
 
@@ -1304,17 +2797,53 @@ void nm_init_yale_functions() {
 // C ACCESSORS //
 /////////////////
 
+/*
+ * Slices of a reference are slices of its source, shifted by the reference's offset. Returns the source of s, and
+ * sets src_slice to slice translated into the source's coordinates (using coords as storage for them).
+ */
+static YALE_STORAGE* slice_of_src(YALE_STORAGE* s, const SLICE* slice, SLICE* src_slice, size_t* coords) {
+  *src_slice = *slice;
+  if (!nm_yale_storage_is_ref(s)) return s;
+
+  for (size_t i = 0; i < s->dim; ++i)
+    coords[i] = slice->coords[i] + s->offset[i];
+  src_slice->coords = coords;
+
+  return reinterpret_cast<YALE_STORAGE*>(s->src);
+}
 
 
 VALUE nm_yale_each_stored_with_indices(VALUE nmatrix) {
   nm::dtype_t d = NM_DTYPE(nmatrix);
   nm::itype_t i = NM_ITYPE(nmatrix);
 
+  nm_yale_storage_close_gaps(NM_STORAGE_YALE(nmatrix));
+
+  if (nm_yale_storage_is_packed(NM_STORAGE_YALE(nmatrix))) {
+    NAMED_ITYPE_TEMPLATE_TABLE(packed_ttable, nm::yale_packed_each_stored_with_indices, VALUE, VALUE);
+    return packed_ttable[i](nmatrix);
+  }
+
+  if (nm_yale_storage_is_ref(NM_STORAGE_YALE(nmatrix))) {
+    NAMED_ITYPE_TEMPLATE_TABLE(ref_ttable, nm::yale_ref_each_stored_with_indices, VALUE, VALUE);
+    return ref_ttable[i](nmatrix);
+  }
+
   NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_each_stored_with_indices, VALUE, VALUE)
 
   return ttable[d][i](nmatrix);
 }
 
+/*
+ * Iterate over every element of a Yale matrix (or reference), zeros included, in row-major order.
+ */
+VALUE nm_yale_each(VALUE nmatrix) {
+  NAMED_ITYPE_TEMPLATE_TABLE(ttable, nm::yale_each, VALUE, VALUE);
+
+  nm_yale_storage_close_gaps(NM_STORAGE_YALE(nmatrix));
+  return ttable[NM_ITYPE(nmatrix)](nmatrix);
+}
+
 
 /*
  * C accessor for inserting some value in a matrix (or replacing an existing cell).
@@ -1322,9 +2851,16 @@ VALUE nm_yale_each_stored_with_indices(VALUE nmatrix) {
 char nm_yale_storage_set(STORAGE* storage, SLICE* slice, void* v) {
   NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::set, char, YALE_STORAGE* storage, SLICE* slice, void* value);
 
-  YALE_STORAGE* casted_storage = (YALE_STORAGE*)storage;
+  SLICE  src_slice;
+  size_t coords[2];
+  YALE_STORAGE* casted_storage = slice_of_src((YALE_STORAGE*)storage, slice, &src_slice, coords);
+  reserve_growth(casted_storage, 1);
 
-  return ttable[casted_storage->dtype][casted_storage->itype](casted_storage, slice, v);
+  // Replacing an entry leaves everything where it was, but an insertion moves the entries after it.
+  char result = ttable[casted_storage->dtype][casted_storage->itype](casted_storage, &src_slice, v);
+  if (result != 'r') drop_caches(casted_storage);
+
+  return result;
 }
 
 /*
@@ -1334,11 +2870,36 @@ char nm_yale_storage_set(STORAGE* storage, SLICE* slice, void* v) {
  */
 void* nm_yale_storage_get(STORAGE* storage, SLICE* slice) {
   NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::get, void*, YALE_STORAGE* storage, SLICE* slice);
-  YALE_STORAGE* s = (YALE_STORAGE*)storage;
 
+  SLICE  src_slice;
+  size_t coords[2];
+  YALE_STORAGE* casted_storage = slice_of_src((YALE_STORAGE*)storage, slice, &src_slice, coords);
+  nm_yale_storage_close_gaps(casted_storage);
+
+  // A (piece of a) column is read off the column index, which is built the first time it's needed.
+  if (src_slice.lengths[1] == 1 && casted_storage->symm == nm::NONSYMM) {
+    NAMED_LI_DTYPE_TEMPLATE_TABLE(col_ttable, nm::yale_storage::get_column, YALE_STORAGE*, const YALE_STORAGE*, size_t, size_t, size_t);
+
+    nm_yale_storage_build_col_index(casted_storage);
+    return col_ttable[casted_storage->dtype][casted_storage->itype](casted_storage, src_slice.coords[0], src_slice.lengths[0], src_slice.coords[1]);
+  }
+
+  if (casted_storage->symm != nm::NONSYMM) {
+    // A window centred on the diagonal is symmetric itself, and its upper triangle is all that's stored of it. Any
+    // other window needs the lower triangle written out.
+    if (src_slice.coords[0] == src_slice.coords[1] && src_slice.lengths[0] == src_slice.lengths[1]) {
+      YALE_STORAGE* ns = reinterpret_cast<YALE_STORAGE*>(ttable[casted_storage->dtype][casted_storage->itype](casted_storage, &src_slice));
+      ns->symm = casted_storage->symm;
+      return ns;
+    }
+
+    YALE_STORAGE* full = unpacked_copy(casted_storage);
+    void* ns = ttable[full->dtype][full->itype](full, &src_slice);
+    nm_yale_storage_delete(full);
+    return ns;
+  }
 
-  YALE_STORAGE* casted_storage = (YALE_STORAGE*)storage;
-  return ttable[casted_storage->dtype][casted_storage->itype](casted_storage, slice);
+  return ttable[casted_storage->dtype][casted_storage->itype](casted_storage, &src_slice);
 }
 
 /*
@@ -1362,13 +2923,17 @@ static void nm_yale_storage_increment_ia_after(YALE_STORAGE* s, size_t ija_size,
 
 /*
  * C accessor for yale_storage::ref, which returns a pointer to the correct location in a YALE_STORAGE object
- * for some set of coordinates.
+ * for some set of coordinates, or a reference to a window on it. A reference to a reference is a reference to
+ * the original source.
  */
 void* nm_yale_storage_ref(STORAGE* storage, SLICE* slice) {
   NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::ref, void*, YALE_STORAGE* storage, SLICE* slice);
 
-  YALE_STORAGE* casted_storage = (YALE_STORAGE*)storage;
-  return ttable[casted_storage->dtype][casted_storage->itype](casted_storage, slice);
+  SLICE  src_slice;
+  size_t coords[2];
+  YALE_STORAGE* casted_storage = slice_of_src((YALE_STORAGE*)storage, slice, &src_slice, coords);
+
+  return ttable[casted_storage->dtype][casted_storage->itype](casted_storage, &src_slice);
 }
 
 /*
@@ -1379,9 +2944,20 @@ void* nm_yale_storage_ref(STORAGE* storage, SLICE* slice) {
 bool nm_yale_storage_eqeq(const STORAGE* left, const STORAGE* right) {
   NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::eqeq, bool, const YALE_STORAGE* left, const YALE_STORAGE* right);
 
-  const YALE_STORAGE* casted_left = reinterpret_cast<const YALE_STORAGE*>(left);
+  YALE_STORAGE* casted_left  = nm_yale_storage_copy_if_ref(reinterpret_cast<const YALE_STORAGE*>(left)),
+              * casted_right = nm_yale_storage_copy_if_ref(reinterpret_cast<const YALE_STORAGE*>(right));
+
+  // A shrunk matrix may have a narrower itype than the other.
+  nm::itype_t itype = std::max(casted_left->itype, casted_right->itype);
+  casted_left  = widen_copy(casted_left, left, itype);
+  casted_right = widen_copy(casted_right, right, itype);
+
+  bool result = ttable[casted_left->dtype][right->dtype][casted_left->itype](casted_left, casted_right);
 
-  return ttable[casted_left->dtype][right->dtype][casted_left->itype](casted_left, (const YALE_STORAGE*)right);
+  if (casted_left != left)   nm_yale_storage_delete(casted_left);
+  if (casted_right != right) nm_yale_storage_delete(casted_right);
+
+  return result;
 }
 
 /*
@@ -1391,10 +2967,46 @@ STORAGE* nm_yale_storage_cast_copy(const STORAGE* rhs, nm::dtype_t new_dtype) {
   NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::cast_copy, YALE_STORAGE*, const YALE_STORAGE* rhs, nm::dtype_t new_dtype);
 
   const YALE_STORAGE* casted_rhs = reinterpret_cast<const YALE_STORAGE*>(rhs);
+  nm_yale_storage_close_gaps(casted_rhs);
+
+  if (nm_yale_storage_is_ref(casted_rhs)) {
+    YALE_STORAGE* copy = nm_yale_storage_copy_if_ref(casted_rhs);
+    if (copy->dtype == new_dtype) return (STORAGE*)copy;
+
+    STORAGE* result = (STORAGE*)ttable[new_dtype][copy->dtype][copy->itype](copy, new_dtype);
+    nm_yale_storage_delete(copy);
+    return result;
+  }
 
   return (STORAGE*)ttable[new_dtype][casted_rhs->dtype][casted_rhs->itype](casted_rhs, new_dtype);
 }
 
+/*
+ * A reference's entries are scattered through its source's vectors, and a packed matrix only stores half of its
+ * own, so most operations first copy them out into a plain matrix. Returns that copy if s is a reference or packed
+ * (or a reference to a packed matrix), or s itself otherwise; the caller must delete the result if it differs from
+ * s. Either way, closes any gaps in the rows first.
+ */
+YALE_STORAGE* nm_yale_storage_copy_if_ref(const YALE_STORAGE* s) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::get, void*, YALE_STORAGE* storage, SLICE* slice);
+
+  nm_yale_storage_close_gaps(s);
+  SLICE slice = { s->offset, s->shape, false };
+
+  if (nm_yale_storage_is_packed(s)) {
+    YALE_STORAGE* full = unpacked_copy(reinterpret_cast<const YALE_STORAGE*>(s->src));
+    if (!nm_yale_storage_is_ref(s)) return full;
+
+    YALE_STORAGE* window = reinterpret_cast<YALE_STORAGE*>(ttable[full->dtype][full->itype](full, &slice));
+    nm_yale_storage_delete(full);
+    return window;
+  }
+
+  if (!nm_yale_storage_is_ref(s)) return const_cast<YALE_STORAGE*>(s);
+
+  return reinterpret_cast<YALE_STORAGE*>(ttable[s->dtype][s->itype](reinterpret_cast<YALE_STORAGE*>(s->src), &slice));
+}
+
 /*
  * Returns size of Yale storage as a size_t (no matter what the itype is). (C accessor)
  */
@@ -1404,6 +3016,228 @@ size_t nm_yale_storage_get_size(const YALE_STORAGE* storage) {
   return ttable[storage->itype](storage);
 }
 
+/*
+ * Gives every row of s slack spare slots after its entries, so that inserting into a row only has to move entries
+ * within that row. Rows which already had slack end up with exactly that much.
+ */
+void nm_yale_storage_gap(YALE_STORAGE* s, size_t slack) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::spread_rows, void, YALE_STORAGE*, size_t, bool);
+
+  // The spread-out vectors may need a wider itype than the packed ones did.
+  const nm::itype_t itype = itype_for_capacity(s, nm_yale_storage_get_size(s) + s->shape[0] * slack);
+  if (itype > s->itype) resize_vectors(s, itype, s->capacity);
+
+  drop_caches(s);
+  ttable[s->dtype][s->itype](s, slack, false);
+}
+
+/*
+ * Takes the slack back out of the rows of s (or of its source, if s is a reference), if they have any. This changes
+ * the layout but not the contents, so it's allowed on a const matrix.
+ */
+void nm_yale_storage_close_gaps(const YALE_STORAGE* s) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::close_gaps, void, YALE_STORAGE*);
+
+  YALE_STORAGE* src = reinterpret_cast<YALE_STORAGE*>(s->src);
+  if (src->row_end) ttable[src->dtype][src->itype](src);
+}
+
+/*
+ * Gives s (or its source, if s is a reference) a column index, unless it already has one: see yale.h. Closes any gaps
+ * first. Does nothing to a packed matrix, whose columns are its rows. This only adds to s, so it's allowed on a const
+ * matrix.
+ */
+void nm_yale_storage_build_col_index(const YALE_STORAGE* s) {
+  NAMED_ITYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::build_col_index, YALE_COL_INDEX*, const YALE_STORAGE*);
+
+  YALE_STORAGE* src = reinterpret_cast<YALE_STORAGE*>(s->src);
+  if (src->col_index || src->symm != nm::NONSYMM) return;
+
+  nm_yale_storage_close_gaps(src);
+  src->col_index = ttable[src->itype](src);
+}
+
+/*
+ * Throws away the column index, level schedules and symbolic factorizations of s, if it has any. Anything which
+ * moves entries around in the vectors of s, or changes its itype, has to call this.
+ */
+static void drop_caches(YALE_STORAGE* s) {
+  if (s->col_index) {
+    xfree(s->col_index->ptr);
+    xfree(s->col_index->pos);
+    xfree(s->col_index->row);
+    xfree(s->col_index);
+    s->col_index = NULL;
+  }
+
+  for (size_t t = 0; t < 2; ++t) {
+    if (!s->levels[t]) continue;
+
+    xfree(s->levels[t]->ptr);
+    xfree(s->levels[t]->row);
+    xfree(s->levels[t]);
+    s->levels[t] = NULL;
+  }
+
+  for (size_t t = 0; t < 2; ++t) {
+    nm_yale_storage_symbolic_delete(s->symbolic[t]);
+    s->symbolic[t] = NULL;
+  }
+}
+
+/*
+ * Reallocates the IJA and A vectors of s (and row_end, if it's gapped) to hold capacity entries, with IJA (and
+ * row_end) in the given itype. The entries in use are kept.
+ */
+static void resize_vectors(YALE_STORAGE* s, nm::itype_t itype, size_t capacity) {
+  const size_t size = std::min(nm_yale_storage_get_size(s), capacity);
+
+  if (itype == s->itype) {
+    REALLOC_N(s->ija, char, ITYPE_SIZES[itype] * capacity);
+  } else {
+    char* ija = ALLOC_N(char, ITYPE_SIZES[itype] * capacity);
+    for (size_t k = 0; k < size; ++k) nm::yale_storage::ija_set(ija, itype, k, nm::yale_storage::ija_at(s->ija, s->itype, k));
+    xfree(s->ija);
+    s->ija = ija;
+    drop_caches(s); // its vectors are in the old itype
+
+    if (s->row_end) {
+      char* row_end = ALLOC_N(char, ITYPE_SIZES[itype] * s->shape[0]);
+      for (size_t i = 0; i < s->shape[0]; ++i) nm::yale_storage::ija_set(row_end, itype, i, nm::yale_storage::ija_at(s->row_end, s->itype, i));
+      xfree(s->row_end);
+      s->row_end = row_end;
+    }
+  }
+
+  REALLOC_N(s->a, char, DTYPE_SIZES[s->dtype] * capacity);
+  s->itype    = itype;
+  s->capacity = capacity;
+}
+
+/*
+ * Gives s the (wider) itype, so it can be used alongside a matrix of that itype. If s is the caller's own matrix,
+ * original, it's copied first; a copy the caller made is changed in place. Either way, the caller should delete
+ * the result if it isn't original.
+ */
+static YALE_STORAGE* widen_copy(YALE_STORAGE* s, const STORAGE* original, nm::itype_t itype) {
+  if (s->itype == itype) return s;
+
+  if (reinterpret_cast<const STORAGE*>(s) == original)
+    s = reinterpret_cast<YALE_STORAGE*>(nm_yale_storage_cast_copy(s, s->dtype));
+
+  resize_vectors(s, itype, s->capacity);
+  return s;
+}
+
+/*
+ * The smallest itype s could use with the given capacity: every row pointer and column index has to fit.
+ */
+static nm::itype_t itype_for_capacity(const YALE_STORAGE* s, size_t capacity) {
+  return nm_yale_storage_itype_for(std::max(capacity, std::max(s->shape[0], s->shape[1])));
+}
+
+/*
+ * Reallocates s (which must not be a reference) to exactly the size it needs, closing any gaps, and with the
+ * smallest itype that will hold it. Returns the number of bytes freed.
+ */
+size_t nm_yale_storage_shrink(YALE_STORAGE* s) {
+  nm_yale_storage_close_gaps(s);
+
+  const size_t size   = nm_yale_storage_get_size(s),
+               before = s->capacity * (ITYPE_SIZES[s->itype] + DTYPE_SIZES[s->dtype]);
+
+  resize_vectors(s, itype_for_capacity(s, size), size);
+
+  return before - s->capacity * (ITYPE_SIZES[s->itype] + DTYPE_SIZES[s->dtype]);
+}
+
+/*
+ * Makes sure s (which must not be a reference) has room for ndnz non-diagonal entries without another resize,
+ * widening its itype if it needs to.
+ */
+void nm_yale_storage_reserve(YALE_STORAGE* s, size_t ndnz) {
+  nm_yale_storage_close_gaps(s);
+
+  const size_t capacity = std::min(s->shape[0] + 1 + ndnz, nm::yale_storage::max_size(s));
+  if (capacity <= s->capacity) return;
+
+  resize_vectors(s, std::max(s->itype, itype_for_capacity(s, capacity)), capacity);
+}
+
+/*
+ * Copies packed s (which must be gap-free and not a reference) out in full, widening the itype if it has to.
+ */
+static YALE_STORAGE* unpacked_copy(const YALE_STORAGE* s) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::unpack, void, const YALE_STORAGE*, YALE_STORAGE*);
+
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = s->shape[0];
+  shape[1] = s->shape[1];
+
+  // Every entry off the diagonal appears twice.
+  const size_t size  = 2 * nm_yale_storage_get_size(s) - (s->shape[0] + 1);
+  nm::itype_t  itype = std::max(s->itype, itype_for_capacity(s, size));
+
+  YALE_STORAGE* full = create_with_itype(s->dtype, shape, size, itype);
+  ttable[full->dtype][full->itype](s, full);
+
+  return full;
+}
+
+/*
+ * Drops the lower triangle of square s (which must not be a reference), if it's symmetric, or Hermitian when
+ * hermitian is set (which only makes a difference to complex matrices). Returns false, leaving s as it was, if it
+ * isn't. See yale_storage::pack.
+ */
+bool nm_yale_storage_pack(YALE_STORAGE* s, bool hermitian) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::pack, bool, YALE_STORAGE*, bool);
+
+  hermitian = hermitian && (s->dtype == nm::COMPLEX64 || s->dtype == nm::COMPLEX128);
+  if (s->symm == (hermitian ? nm::HERM : nm::SYMM)) return true;
+
+  nm_yale_storage_unpack(s);
+  nm_yale_storage_close_gaps(s);
+  if (!ttable[s->dtype][s->itype](s, hermitian)) return false;
+
+  drop_caches(s);
+  return true;
+}
+
+/*
+ * Writes the lower triangle of packed s back out, in place. Does nothing to a matrix which isn't packed.
+ */
+void nm_yale_storage_unpack(YALE_STORAGE* s) {
+  if (s->symm == nm::NONSYMM) return;
+
+  nm_yale_storage_close_gaps(s);
+  YALE_STORAGE* full = unpacked_copy(s);
+
+  drop_caches(s);
+  std::swap(s->ija, full->ija);
+  std::swap(s->a,   full->a);
+  s->capacity = full->capacity;
+  s->itype    = full->itype;
+  s->ndnz     = full->ndnz;
+  s->symm     = nm::NONSYMM;
+
+  nm_yale_storage_delete(full);
+}
+
+/*
+ * A matrix which has been shrunk may have a narrower itype than its shape calls for. Before n more entries are
+ * inserted into s, this widens it back to that itype if growing could overflow its current one.
+ */
+static void reserve_growth(YALE_STORAGE* s, size_t n) {
+  const nm::itype_t shape_itype = nm_yale_storage_default_itype(s);
+  if (s->itype >= shape_itype) return;
+
+  // The most a resize can grow the vectors to: see vector_insert_resize and spread_rows.
+  const size_t bound = std::max<size_t>(s->capacity * nm::yale_storage::GROWTH_CONSTANT + n,
+                                        2 * s->capacity + s->shape[0] * NM_YALE_ROW_SLACK);
+
+  if (itype_for_capacity(s, bound) > s->itype) resize_vectors(s, shape_itype, s->capacity);
+}
+
 /*
  * C accessor for allocating a yale storage object for cast-copying. Copies the IJA vector, does not copy the A vector.
  */
@@ -1417,39 +3251,116 @@ static YALE_STORAGE* nm_copy_alloc_struct(const YALE_STORAGE* rhs, const nm::dty
  * Transposing copy constructor.
  */
 STORAGE* nm_yale_storage_copy_transposed(const STORAGE* rhs_base) {
-  YALE_STORAGE* rhs = (YALE_STORAGE*)rhs_base;
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::transpose, void, const YALE_STORAGE*, YALE_STORAGE*);
+
+  nm_yale_storage_close_gaps((const YALE_STORAGE*)rhs_base);
+
+  // A symmetric matrix is its own transpose. (A Hermitian one is its own conjugate, and gets unpacked.)
+  if (((const YALE_STORAGE*)rhs_base)->symm == nm::SYMM)
+    return nm_yale_storage_cast_copy(rhs_base, rhs_base->dtype);
+
+  YALE_STORAGE* rhs = nm_yale_storage_copy_if_ref((const YALE_STORAGE*)rhs_base);
 
   size_t* shape = ALLOC_N(size_t, 2);
   shape[0] = rhs->shape[1];
   shape[1] = rhs->shape[0];
 
-  size_t size   = nm_yale_storage_get_size(rhs);
+  size_t size = nm_yale_storage_get_size(rhs) - rhs->shape[0] + shape[0];
 
-  YALE_STORAGE* lhs = nm_yale_storage_create(rhs->dtype, shape, 2, size, nm::UINT8);
-  nm_yale_storage_init(lhs);
+  // The transposed shape may need a wider itype than rhs has, but never a narrower one.
+  YALE_STORAGE* lhs = alloc(rhs->dtype, shape, 2, rhs->itype);
+  lhs->capacity = size;
+  lhs->ija      = ALLOC_N(char, ITYPE_SIZES[lhs->itype] * size);
+  lhs->a        = ALLOC_N(char, DTYPE_SIZES[lhs->dtype] * size);
 
-  NAMED_LI_DTYPE_TEMPLATE_TABLE(transp, nm::math::transpose_yale, void, const size_t n, const size_t m, const void* ia_, const void* ja_, const void* a_, const bool diaga, void* ib_, void* jb_, void* b_, const bool move);
+  ttable[lhs->dtype][lhs->itype](rhs, lhs);
 
-  transp[lhs->dtype][lhs->itype](rhs->shape[0], rhs->shape[1], rhs->ija, rhs->ija, rhs->a, true, lhs->ija, lhs->ija, lhs->a, true);
+  if (rhs != rhs_base) nm_yale_storage_delete(rhs);
 
   return (STORAGE*)lhs;
 }
 
 /*
- * C accessor for multiplying two YALE_STORAGE matrices, which have already been casted to the same dtype.
- *
- * FIXME: What happens if the two matrices have different itypes?
+ * C accessor for multiplying two YALE_STORAGE matrices, which have already been casted to the same dtype. They may
+ * have different itypes; the product is done in the widest of theirs and the result's.
  */
 STORAGE* nm_yale_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector) {
   LI_DTYPE_TEMPLATE_TABLE(nm::yale_storage::matrix_multiply, STORAGE*, const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
 
-  YALE_STORAGE* storage_access = (YALE_STORAGE*)(casted_storage.left);
+  const YALE_STORAGE* left  = reinterpret_cast<const YALE_STORAGE*>(casted_storage.left);
+  const YALE_STORAGE* right = reinterpret_cast<const YALE_STORAGE*>(casted_storage.right);
+
+  nm_yale_storage_close_gaps(left);
+  nm_yale_storage_close_gaps(right);
+
+  // The product of symmetric matrices isn't symmetric, so packed operands are multiplied in full.
+  if (left->symm != nm::NONSYMM || right->symm != nm::NONSYMM) {
+    STORAGE_PAIR full;
+    full.left  = (STORAGE*)nm_yale_storage_copy_if_ref(left);
+    full.right = (STORAGE*)nm_yale_storage_copy_if_ref(right);
+
+    STORAGE* result = nm_yale_storage_matrix_multiply(full, resulting_shape, vector);
+
+    if (full.left != casted_storage.left)   nm_yale_storage_delete(full.left);
+    if (full.right != casted_storage.right) nm_yale_storage_delete(full.right);
+
+    return result;
+  }
+
+  // alloc() picks the result's itype the same way.
+  nm::itype_t itype = std::max(std::max(left->itype, right->itype), nm_yale_storage_itype_by_shape(resulting_shape));
+
+  return ttable[left->dtype][itype](casted_storage, resulting_shape, vector);
+}
+
+/*
+ * C accessor for multiplying a YALE_STORAGE matrix by a DENSE_STORAGE one (or by its transpose, if transposed), which
+ * have already been casted to the same dtype. The result is dense. The yale matrix may be a reference, unless its
+ * source is packed.
+ */
+STORAGE* nm_yale_storage_dense_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool transposed) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::sparse_dense_multiply, void, const YALE_STORAGE*, const void*, size_t, void*, bool);
+
+  const YALE_STORAGE*  left  = reinterpret_cast<const YALE_STORAGE*>(casted_storage.left);
+  const DENSE_STORAGE* right = reinterpret_cast<const DENSE_STORAGE*>(casted_storage.right);
+
+  nm_yale_storage_close_gaps(left);
+
+  DENSE_STORAGE* result = nm_dense_storage_create(left->dtype, resulting_shape, 2, NULL, 0);
+  ttable[left->dtype][left->itype](left, right->elements, right->shape[1], result->elements, transposed);
+
+  return result;
+}
+
+/*
+ * C accessor for solving a triangular system, L X = B (or U X = B, if lower is false), where L is the lower triangle
+ * and diagonal of a square YALE_STORAGE matrix and B a DENSE_STORAGE one, already casted to the same dtype. The result
+ * X is dense. See yale_storage::triangular_solve.
+ */
+STORAGE* nm_yale_storage_triangular_solve(const STORAGE_PAIR& casted_storage, bool lower, bool unit) {
+  NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::triangular_solve, void, const YALE_STORAGE*, bool, bool, void*, size_t);
+  NAMED_DTYPE_TEMPLATE_TABLE(zero_ttable, nm::yale_storage::zero_on_diagonal, bool, const YALE_STORAGE*);
+
+  const YALE_STORAGE* original = reinterpret_cast<const YALE_STORAGE*>(casted_storage.left);
+  YALE_STORAGE*       left     = nm_yale_storage_copy_if_ref(original);
+
+  if (!unit && zero_ttable[left->dtype](left)) {
+    if (left != original) nm_yale_storage_delete(left);
+    rb_raise(rb_eZeroDivError, "triangular matrix is singular (there's a zero on its diagonal)");
+  }
+
+  DENSE_STORAGE* result = nm_dense_storage_copy(reinterpret_cast<const DENSE_STORAGE*>(casted_storage.right));
+  ttable[left->dtype][left->itype](left, lower, unit, result->elements, result->shape[1]);
+
+  if (left != original) nm_yale_storage_delete(left);
 
-  return ttable[storage_access->dtype][storage_access->itype](casted_storage, resulting_shape, vector);
+  return result;
 }
 
 /*
- * Documentation goes here.
+ * Element-wise operation between two Yale matrices of the same shape, or between a Yale matrix and scalar (if right
+ * is NULL). A scalar operation returns NULL if it would turn the zeros into something else, since the result is
+ * then dense; see yale_storage::scalar_keeps_zeros.
  */
 STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar) {
 	OP_ITYPE_DTYPE_TEMPLATE_TABLE(nm::yale_storage::ew_op, YALE_STORAGE*, const YALE_STORAGE*, const YALE_STORAGE*, nm::dtype_t);
@@ -1460,6 +3371,58 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 	const YALE_STORAGE* casted_l, * casted_r;
 	
 	nm::dtype_t new_dtype;
+
+	nm_yale_storage_close_gaps((const YALE_STORAGE*)left);
+
+	if (!right) {
+		NAMED_OP_LR_DTYPE_TEMPLATE_TABLE(keeps_zeros_ttable, nm::yale_storage::scalar_keeps_zeros, bool, const void*);
+		NAMED_OP_LR_DTYPE_TEMPLATE_TABLE(scalar_ttable, nm::yale_storage::scalar_ew_op, YALE_STORAGE*, const YALE_STORAGE*, const void*);
+
+		const YALE_STORAGE* casted_left = (const YALE_STORAGE*)left;
+
+		// Converting and checking the scalar may raise, so both happen before left is copied.
+		nm::dtype_t r_dtype = nm_dtype_guess_for(scalar, casted_left->dtype);
+		void* r_scalar = ALLOCA_N(char, DTYPE_SIZES[r_dtype]);
+		rubyval_to_cval(scalar, r_dtype, r_scalar);
+
+		if (!keeps_zeros_ttable[op][casted_left->dtype][r_dtype](r_scalar)) return NULL;
+
+		// A symmetric matrix stays symmetric, so it can be worked on packed. A Hermitian one needn't stay Hermitian.
+		YALE_STORAGE* l = casted_left->symm == nm::SYMM ? const_cast<YALE_STORAGE*>(casted_left) : nm_yale_storage_copy_if_ref(casted_left);
+
+		result = scalar_ttable[op][l->dtype][r_dtype](l, r_scalar);
+		if (result) result->symm = l->symm;
+
+		if (l != left) nm_yale_storage_delete(l);
+		return result;
+	}
+
+	nm_yale_storage_close_gaps((const YALE_STORAGE*)right);
+
+	// The result is written in left's itype, and may have as many entries as both operands together.
+	const size_t union_size = nm_yale_storage_get_size((const YALE_STORAGE*)left) + nm_yale_storage_get_size((const YALE_STORAGE*)right);
+
+	// Work on copies if either is a reference, if they're packed differently (two matrices packed the same way are
+	// worked on packed, and so is the result), if their itypes differ, or if the result might not fit theirs.
+	if (nm_yale_storage_is_ref((const YALE_STORAGE*)left) || nm_yale_storage_is_ref((const YALE_STORAGE*)right) ||
+	    ((const YALE_STORAGE*)left)->symm != ((const YALE_STORAGE*)right)->symm ||
+	    ((const YALE_STORAGE*)left)->itype != ((const YALE_STORAGE*)right)->itype ||
+	    itype_for_capacity((const YALE_STORAGE*)left, union_size) > ((const YALE_STORAGE*)left)->itype) {
+		new_l = nm_yale_storage_copy_if_ref((const YALE_STORAGE*)left);
+		new_r = nm_yale_storage_copy_if_ref((const YALE_STORAGE*)right);
+
+		nm::itype_t itype = std::max(std::max(new_l->itype, new_r->itype),
+		                             itype_for_capacity(new_l, nm_yale_storage_get_size(new_l) + nm_yale_storage_get_size(new_r)));
+		new_l = widen_copy(new_l, left, itype);
+		new_r = widen_copy(new_r, right, itype);
+
+		STORAGE* result = nm_yale_storage_ew_op(op, new_l, new_r, scalar);
+
+		if (new_l != left)  nm_yale_storage_delete(new_l);
+		if (new_r != right) nm_yale_storage_delete(new_r);
+
+		return result;
+	}
 	
 	if (left->dtype != right->dtype) {
 		
@@ -1474,7 +3437,7 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 		}
 		
 		if (static_cast<uint8_t>(op) < nm::NUM_NONCOMP_EWOPS) {
-			result = ttable[op][new_l->itype][new_dtype](	left->dtype  == new_dtype ?
+			result = ttable[op][((const YALE_STORAGE*)left)->itype][new_dtype](	left->dtype  == new_dtype ?
 																											reinterpret_cast<const YALE_STORAGE*>( left) :
 																											reinterpret_cast<const YALE_STORAGE*>(new_l),
 																										
@@ -1483,6 +3446,7 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 																											reinterpret_cast<const YALE_STORAGE*>(new_r),
 																										
 																										new_dtype);
+			result->symm = ((const YALE_STORAGE*)left)->symm;
 			
 		} else {
 			rb_raise(rb_eNotImpError, "Elementwise comparison is not yet implemented for the Yale storage class.");
@@ -1505,7 +3469,9 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 		
 		if (static_cast<uint8_t>(op) < nm::NUM_NONCOMP_EWOPS) {
 			
-			return ttable[op][casted_l->itype][casted_l->dtype](casted_l, casted_r, casted_l->dtype);
+			result = ttable[op][casted_l->itype][casted_l->dtype](casted_l, casted_r, casted_l->dtype);
+			result->symm = casted_l->symm;
+			return result;
 		
 		} else {
 			rb_raise(rb_eNotImpError, "Elementwise comparison is not yet implemented for the Yale storage class.");
@@ -1513,6 +3479,93 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
 	}
 }
 
+/*
+ * In-place element-wise operations for Yale storage: left = left op right, or left op scalar when right is NULL.
+ *
+ * Only arithmetic operations may be done in place, and the caller must have checked that the result fits in the
+ * left-hand dtype. A scalar operation is only possible when it leaves zeros alone (e.g., multiplication).
+ */
+void nm_yale_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar) {
+	OP_ITYPE_DTYPE_TEMPLATE_TABLE(nm::yale_storage::ew_op_in_place, void, YALE_STORAGE*, const YALE_STORAGE*, const void*);
+
+	YALE_STORAGE* l = reinterpret_cast<YALE_STORAGE*>(left);
+
+	if (static_cast<uint8_t>(op) >= nm::NUM_NONCOMP_EWOPS)
+		rb_raise(rb_eArgError, "comparisons cannot be done in place");
+
+	if (nm_yale_storage_is_ref(l))
+		rb_raise(nm_eStorageTypeError, "in-place operations are not supported on yale references");
+
+	nm_yale_storage_close_gaps(l);
+	if (right) nm_yale_storage_close_gaps((const YALE_STORAGE*)right);
+
+	if (right) {
+		YALE_STORAGE* r = reinterpret_cast<YALE_STORAGE*>(const_cast<STORAGE*>(right));
+
+		// Two matrices packed the same way can be worked on packed. Otherwise, both are unpacked (l in place).
+		if (l->symm != r->symm) {
+			nm_yale_storage_unpack(l);
+			if (r->symm != nm::NONSYMM) r = nm_yale_storage_copy_if_ref(r);
+		}
+
+		// Bring right to left's dtype (copying it out if it's a reference); the caller has already made sure this
+		// isn't a downcast.
+		if (r->dtype != l->dtype || nm_yale_storage_is_ref(r)) {
+			YALE_STORAGE* cast = reinterpret_cast<YALE_STORAGE*>(nm_yale_storage_cast_copy(r, l->dtype));
+			if (r != right) nm_yale_storage_delete(r);
+			r = cast;
+		}
+
+		// Either may have been shrunk to a narrower itype, and l has to be able to take in all of r's entries.
+		nm::itype_t itype = std::max(r->itype, itype_for_capacity(l, nm_yale_storage_get_size(l) + nm_yale_storage_get_size(r)));
+		if (l->itype < itype) resize_vectors(l, itype, l->capacity);
+		r = widen_copy(r, right, l->itype);
+
+		drop_caches(l); // unless the two have the same structure, l's is replaced
+		ttable[op][l->itype][l->dtype](l, r, NULL);
+
+		if (r != right) nm_yale_storage_delete(r);
+
+	} else {
+		// A symmetric matrix stays symmetric, but a Hermitian one needn't stay Hermitian.
+		if (l->symm == nm::HERM) nm_yale_storage_unpack(l);
+
+		void* r_scalar = ALLOCA_N(char, DTYPE_SIZES[l->dtype]);
+		rubyval_to_cval(scalar, l->dtype, r_scalar);
+
+		ttable[op][l->itype][l->dtype](l, NULL, r_scalar);
+	}
+}
+
+/*
+ * Reduce a Yale matrix along dimension dim, giving a FLOAT64 dense matrix with that dimension collapsed to 1.
+ * Returns NULL for complex matrices, which the caller handles some other way.
+ */
+STORAGE* nm_yale_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim) {
+	NAMED_LI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::reduce, void, nm::reduce_t, const YALE_STORAGE*, size_t, double*);
+
+	const YALE_STORAGE* y = reinterpret_cast<const YALE_STORAGE*>(s);
+	if (y->dtype == nm::COMPLEX64 || y->dtype == nm::COMPLEX128) return NULL;
+
+	nm_yale_storage_close_gaps(y);
+
+	if (nm_yale_storage_is_ref(y) || nm_yale_storage_is_packed(y)) {
+		YALE_STORAGE* copy = nm_yale_storage_copy_if_ref(y);
+		STORAGE* result = nm_yale_storage_reduce(op, copy, dim);
+		nm_yale_storage_delete(copy);
+		return result;
+	}
+
+	size_t* shape = ALLOC_N(size_t, 2);
+	shape[0] = dim == 0 ? 1 : y->shape[0];
+	shape[1] = dim == 1 ? 1 : y->shape[1];
+
+	DENSE_STORAGE* result = nm_dense_storage_create(nm::FLOAT64, shape, 2, NULL, 0);
+	ttable[y->dtype][y->itype](op, y, dim, reinterpret_cast<double*>(result->elements));
+
+	return result;
+}
+
 ///////////////
 // Lifecycle //
 ///////////////
@@ -1526,16 +3579,38 @@ STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE
  */
 
 YALE_STORAGE* nm_yale_storage_create(nm::dtype_t dtype, size_t* shape, size_t dim, size_t init_capacity, nm::itype_t min_itype) {
-  YALE_STORAGE* s;
-  size_t max_capacity;
-
 	// FIXME: This error should be handled in the nmatrix.c file.
   if (dim != 2) {
    	rb_raise(rb_eNotImpError, "Can only support 2D matrices");
   }
 
-  s = alloc(dtype, shape, dim, min_itype);
-  max_capacity = nm::yale_storage::max_size(s);
+  return alloc_vectors(alloc(dtype, shape, dim, min_itype), init_capacity);
+}
+
+/*
+ * Like nm_yale_storage_create, but with exactly the given itype rather than at least the one the shape calls for.
+ * For results which are written in the itype of their source, which may be narrower than that (see
+ * nm_yale_storage_shrink).
+ */
+static YALE_STORAGE* create_with_itype(nm::dtype_t dtype, size_t* shape, size_t init_capacity, nm::itype_t itype) {
+  YALE_STORAGE* s = alloc(dtype, shape, 2, itype);
+  s->itype = itype;
+
+  return alloc_vectors(s, init_capacity);
+}
+
+/*
+ * C accessor for create_with_itype, for matrices read in with the itype they were written in (see nm_read).
+ */
+YALE_STORAGE* nm_yale_storage_create_with_itype(nm::dtype_t dtype, size_t* shape, size_t init_capacity, nm::itype_t itype) {
+  return create_with_itype(dtype, shape, init_capacity, itype);
+}
+
+/*
+ * Allocates the IJA and A vectors of s, with init_capacity clamped to the range a matrix of its shape can use.
+ */
+static YALE_STORAGE* alloc_vectors(YALE_STORAGE* s, size_t init_capacity) {
+  size_t max_capacity = nm::yale_storage::max_size(s);
 
   // Set matrix capacity (and ensure its validity)
   if (init_capacity < NM_YALE_MINIMUM(s)) {
@@ -1562,9 +3637,26 @@ YALE_STORAGE* nm_yale_storage_create(nm::dtype_t dtype, size_t* shape, size_t di
 void nm_yale_storage_delete(STORAGE* s) {
   if (s) {
     YALE_STORAGE* storage = (YALE_STORAGE*)s;
+    if (storage->count-- == 1) {
+      free(storage->shape);
+      free(storage->ija);
+      free(storage->a);
+      free(storage->row_end);
+      drop_caches(storage);
+      free(storage);
+    }
+  }
+}
+
+/*
+ * Destructor for yale storage references (slicing). The source goes too if this was the last thing using it.
+ */
+void nm_yale_storage_delete_ref(STORAGE* s) {
+  if (s) {
+    YALE_STORAGE* storage = (YALE_STORAGE*)s;
+    nm_yale_storage_delete(storage->src);
     free(storage->shape);
-    free(storage->ija);
-    free(storage->a);
+    free(storage->offset);
     free(storage);
   }
 }
@@ -1587,6 +3679,10 @@ void nm_yale_storage_mark(void* storage_base) {
   YALE_STORAGE* storage = (YALE_STORAGE*)storage_base;
   size_t i;
 
+  // A reference has no vectors of its own, and may outlive the matrix it's a window on (which its count keeps
+  // around), so it has to mark what's stored there.
+  if (storage && nm_yale_storage_is_ref(storage)) storage = reinterpret_cast<YALE_STORAGE*>(storage->src);
+
   if (storage && storage->dtype == nm::RUBYOBJ) {
   	for (i = storage->capacity; i-- > 0;) {
       rb_gc_mark(*((VALUE*)((char*)(storage->a) + i*DTYPE_SIZES[nm::RUBYOBJ])));
@@ -1606,6 +3702,14 @@ static YALE_STORAGE* alloc(nm::dtype_t dtype, size_t* shape, size_t dim, nm::ity
   s->dtype       = dtype;
   s->shape       = shape;
   s->dim         = dim;
+  s->offset      = NULL;
+  s->row_end     = NULL;
+  s->count       = 1;
+  s->src         = s;
+  s->symm        = nm::NONSYMM;
+  s->col_index   = NULL;
+  s->levels[0]   = s->levels[1] = NULL;
+  s->symbolic[0] = s->symbolic[1] = NULL;
   s->itype       = nm_yale_storage_itype_by_shape(shape);
 
   // See if a higher itype has been requested.
@@ -1615,6 +3719,21 @@ static YALE_STORAGE* alloc(nm::dtype_t dtype, size_t* shape, size_t dim, nm::ity
   return s;
 }
 
+/*
+ * Create yale storage of the given dtype from n (row, column, value) triplets. rows and cols may be of any integer
+ * dtype; the values are converted from vals_dtype. Takes ownership of shape. Returns NULL if an index is out of
+ * range. See yale_storage::create_from_coo.
+ */
+YALE_STORAGE* nm_yale_storage_create_from_coo(nm::dtype_t dtype, size_t* shape, size_t n, const void* rows, nm::dtype_t rows_dtype,
+                                              const void* cols, nm::dtype_t cols_dtype, const void* vals, nm::dtype_t vals_dtype) {
+  NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::create_from_coo, YALE_STORAGE*, nm::dtype_t, size_t*, size_t, const void*, nm::dtype_t, const void*, nm::dtype_t, const void*);
+
+  // alloc() picks the itype the same way.
+  nm::itype_t itype = nm_yale_storage_itype_by_shape(shape);
+
+  return ttable[dtype][vals_dtype][itype](dtype, shape, n, rows, rows_dtype, cols, cols_dtype, vals);
+}
+
 YALE_STORAGE* nm_yale_storage_create_from_old_yale(nm::dtype_t dtype, size_t* shape, void* ia, void* ja, void* a, nm::dtype_t from_dtype) {
 
   NAMED_LRI_DTYPE_TEMPLATE_TABLE(ttable, nm::yale_storage::create_from_old_yale, YALE_STORAGE*, nm::dtype_t dtype, size_t* shape, void* r_ia, void* r_ja, void* r_a);
@@ -1641,7 +3760,8 @@ YALE_STORAGE* nm_yale_storage_create_from_old_yale(nm::dtype_t dtype, size_t* sh
  * For capacity (the maximum number of elements that can be stored without a resize), use capacity instead.
  */
 static VALUE nm_size(VALUE self) {
-  YALE_STORAGE* s = (YALE_STORAGE*)NM_STORAGE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
 
   return rubyobj_from_cval_by_itype((char*)(s->ija) + ITYPE_SIZES[s->itype]*(s->shape[0]), s->itype).rval;
 }
@@ -1658,7 +3778,8 @@ static VALUE nm_a(int argc, VALUE* argv, VALUE self) {
   VALUE idx;
   rb_scan_args(argc, argv, "01", &idx);
 
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
   size_t size = nm_yale_storage_get_size(s);
 
   if (idx == Qnil) {
@@ -1693,7 +3814,8 @@ static VALUE nm_d(int argc, VALUE* argv, VALUE self) {
   VALUE idx;
   rb_scan_args(argc, argv, "01", &idx);
 
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
 
   if (idx == Qnil) {
     VALUE* vals = ALLOCA_N(VALUE, s->shape[0]);
@@ -1717,7 +3839,8 @@ static VALUE nm_d(int argc, VALUE* argv, VALUE self) {
  * Get the non-diagonal ("LU") portion of the A array of a Yale matrix.
  */
 static VALUE nm_lu(VALUE self) {
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
 
   size_t size = nm_yale_storage_get_size(s);
 
@@ -1743,7 +3866,8 @@ static VALUE nm_lu(VALUE self) {
  * JA and LU portions of the IJA and A arrays, respectively.
  */
 static VALUE nm_ia(VALUE self) {
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
 
   VALUE* vals = ALLOCA_N(VALUE, s->shape[0] + 1);
 
@@ -1762,7 +3886,8 @@ static VALUE nm_ia(VALUE self) {
  * positions in the LU portion of the A array.
  */
 static VALUE nm_ja(VALUE self) {
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
 
   size_t size = nm_yale_storage_get_size(s);
 
@@ -1791,7 +3916,8 @@ static VALUE nm_ija(int argc, VALUE* argv, VALUE self) {
   VALUE idx;
   rb_scan_args(argc, argv, "01", &idx);
 
-  YALE_STORAGE* s = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s = (YALE_STORAGE*)NM_YALE_SRC(self);
+  nm_yale_storage_close_gaps(s);
   size_t size = nm_yale_storage_get_size(s);
 
   if (idx == Qnil) {
@@ -1840,10 +3966,12 @@ static VALUE nm_nd_row(int argc, VALUE* argv, VALUE self) {
 
   size_t i = FIX2INT(i_);
 
-  YALE_STORAGE* s   = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s   = (YALE_STORAGE*)NM_YALE_SRC(self);
   nm::dtype_t dtype = NM_DTYPE(self);
   nm::itype_t itype = NM_ITYPE(self);
 
+  nm_yale_storage_close_gaps(s);
+
   // get the position as a size_t
   // TODO: Come up with a faster way to get this than transforming to a Ruby object first.
   size_t pos = FIX2INT(rubyobj_from_cval_by_itype((char*)(s->ija) + ITYPE_SIZES[itype]*i, itype).rval);
@@ -1912,9 +4040,13 @@ static VALUE nm_vector_insert(int argc, VALUE* argv, VALUE self) { //, VALUE i_,
   if (len != vvlen)
     rb_raise(rb_eArgError, "lengths must match between j array (%d) and value array (%d)", len, vvlen);
 
-  YALE_STORAGE* s   = NM_STORAGE_YALE(self);
+  YALE_STORAGE* s   = (YALE_STORAGE*)NM_YALE_SRC(self);
   nm::dtype_t dtype = NM_DTYPE(self);
-  nm::itype_t itype = NM_ITYPE(self);
+
+  nm_yale_storage_close_gaps(s);
+  reserve_growth(s, len);
+
+  nm::itype_t itype = s->itype;
 
   size_t i   = FIX2INT(i_);    // get the row
 
@@ -1933,6 +4065,7 @@ static VALUE nm_vector_insert(int argc, VALUE* argv, VALUE self) { //, VALUE i_,
     rubyval_to_cval(rb_ary_entry(vv, idx), dtype, (char*)vals + idx * DTYPE_SIZES[dtype]);
   }
 
+  drop_caches(s);
   char ins_type = nm_yale_storage_vector_insert(s, pos, j, vals, len, false, dtype, itype);
   nm_yale_storage_increment_ia_after(s, s->shape[0], i, len, itype);
   s->ndnz += len;
@@ -32,8 +32,38 @@
 //        max(rows,cols)
 //      * that means vector ija stores only index dtype, but a stores
 //        dtype
+//      * a matrix which has been shrunk may have a narrower index
+//        dtype, just wide enough for its size and dimensions; one
+//        which grows past that is widened
 // * vectors must be able to grow as necessary
 //      * maximum size is rows*cols+1
+// * a reference (a slice taken with []) has no vectors of its own
+//      * src is the matrix it's a window on, and offset the window's
+//        top-left corner in src; shape is the window's shape
+//      * a, ija and capacity are NULL/0, since src's vectors can be
+//        reallocated while the reference is alive
+// * rows may be gapped, to make inserting cheap: each row then has
+//   spare slots after its entries
+//      * row i occupies ija[ija[i]...ija[i+1]) as usual, but its
+//        entries stop at row_end[i]; the rest is slack
+//      * only single-element get and set understand gaps. Anything
+//        else closes them first (nm_yale_storage_close_gaps), which
+//        leaves the usual compact layout
+// * a matrix may carry a column index (col_index), built the first
+//   time a column or A^T x is asked for: the non-diagonal entries
+//   again, sorted by column, as positions in IJA and A
+//      * column j's are pos[ptr[j]...ptr[j+1]), in order of row,
+//        and row holds their rows; all three are in the itype
+//      * only kept for gap-free, unpacked matrices. Anything which
+//        moves entries or changes the itype throws it away (so
+//        replacing a value keeps it, but inserting one doesn't)
+// * likewise, level schedules (levels) for large triangular solves
+//   with the lower or upper triangle: the rows grouped so that each
+//   group only depends on the ones before it
+// * and the symbolic analysis (symbolic) of sparse Cholesky and LU
+//   factorizations: the fill-reducing ordering, and for Cholesky
+//   the elimination tree and where the factor's entries go. So
+//   factorizing again after replacing values only does the numbers
 
 #ifndef YALE_H
 #define YALE_H
@@ -63,6 +93,7 @@ extern "C" {
    */
 
   #define NM_YALE_MINIMUM(sptr)               (((YALE_STORAGE*)(sptr))->shape[0]*2 + 1) // arbitrarily defined
+  #define NM_YALE_ROW_SLACK                   4 // spare slots per row when a gapped matrix has to grow
 
   #ifndef NM_CHECK_ALLOC
    #define NM_CHECK_ALLOC(x) if (!x) rb_raise(rb_eNoMemError, "insufficient memory");
@@ -87,9 +118,13 @@ extern "C" {
   ///////////////
 
   YALE_STORAGE* nm_yale_storage_create(nm::dtype_t dtype, size_t* shape, size_t dim, size_t init_capacity, nm::itype_t itype);
+  YALE_STORAGE* nm_yale_storage_create_with_itype(nm::dtype_t dtype, size_t* shape, size_t init_capacity, nm::itype_t itype);
   YALE_STORAGE* nm_yale_storage_create_from_old_yale(nm::dtype_t dtype, size_t* shape, void* ia, void* ja, void* a, nm::dtype_t from_dtype);
+  YALE_STORAGE* nm_yale_storage_create_from_coo(nm::dtype_t dtype, size_t* shape, size_t n, const void* rows, nm::dtype_t rows_dtype,
+                                                const void* cols, nm::dtype_t cols_dtype, const void* vals, nm::dtype_t vals_dtype);
   YALE_STORAGE*	nm_yale_storage_create_merged(const YALE_STORAGE* merge_template, const YALE_STORAGE* other);
   void          nm_yale_storage_delete(STORAGE* s);
+  void          nm_yale_storage_delete_ref(STORAGE* s);
   void					nm_yale_storage_init(YALE_STORAGE* s);
   void					nm_yale_storage_mark(void*);
 
@@ -97,6 +132,7 @@ extern "C" {
   // Accessors //
   ///////////////
 
+  VALUE nm_yale_each(VALUE nmatrix);
   VALUE nm_yale_each_stored_with_indices(VALUE nmatrix);
   void* nm_yale_storage_get(STORAGE* s, SLICE* slice);
   void*	nm_yale_storage_ref(STORAGE* s, SLICE* slice);
@@ -107,6 +143,14 @@ extern "C" {
 
   size_t  nm_yale_storage_get_size(const YALE_STORAGE* storage);
 
+  void    nm_yale_storage_gap(YALE_STORAGE* s, size_t slack);
+  void    nm_yale_storage_close_gaps(const YALE_STORAGE* s);
+  size_t  nm_yale_storage_shrink(YALE_STORAGE* s);
+  void    nm_yale_storage_reserve(YALE_STORAGE* s, size_t ndnz);
+  bool    nm_yale_storage_pack(YALE_STORAGE* s, bool hermitian);
+  void    nm_yale_storage_unpack(YALE_STORAGE* s);
+  void    nm_yale_storage_build_col_index(const YALE_STORAGE* s);
+
   ///////////
   // Tests //
   ///////////
@@ -118,29 +162,36 @@ extern "C" {
   //////////
 	
 	STORAGE* nm_yale_storage_ew_op(nm::ewop_t op, const STORAGE* left, const STORAGE* right, VALUE scalar);
+	void     nm_yale_storage_ew_op_in_place(nm::ewop_t op, STORAGE* left, const STORAGE* right, VALUE scalar);
+  STORAGE* nm_yale_storage_reduce(nm::reduce_t op, const STORAGE* s, size_t dim);
   STORAGE* nm_yale_storage_matrix_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool vector);
+  STORAGE* nm_yale_storage_dense_multiply(const STORAGE_PAIR& casted_storage, size_t* resulting_shape, bool transposed);
+  STORAGE* nm_yale_storage_triangular_solve(const STORAGE_PAIR& casted_storage, bool lower, bool unit);
+
+  ///////////////////
+  // Factorization //
+  ///////////////////
+
+  YALE_STORAGE* nm_yale_storage_cholesky(const YALE_STORAGE* s, size_t** perm);
+  void          nm_yale_storage_lu(const YALE_STORAGE* s, YALE_STORAGE** l, YALE_STORAGE** u, size_t** p, size_t** q);
+  void          nm_yale_storage_symbolic_delete(YALE_SYMBOLIC* sym);
 
   /////////////
   // Utility //
   /////////////
 
   /*
-   * Calculates the itype a YALE_STORAGE object would need without actually needing
-   * to see the YALE_STORAGE object. Does this just by looking at the shape.
-   *
-   * Useful for creating Yale Storage by other means than NMatrix.new(:yale, ...),
-   * e.g., from a MATLAB v5 .mat file.
+   * The smallest itype which can hold every index up to max_index. The top two
+   * values of each itype are reserved (see nm_yale_storage_default_itype).
    */
-  inline nm::itype_t nm_yale_storage_itype_by_shape(const size_t* shape) {
-    uint64_t yale_max_size = shape[0] * (shape[1]+1);
-
-    if (yale_max_size < static_cast<uint64_t>(std::numeric_limits<uint8_t>::max()) - 2) {
+  inline nm::itype_t nm_yale_storage_itype_for(uint64_t max_index) {
+    if (max_index < static_cast<uint64_t>(std::numeric_limits<uint8_t>::max()) - 2) {
       return nm::UINT8;
 
-    } else if (yale_max_size < static_cast<uint64_t>(std::numeric_limits<uint16_t>::max()) - 2) {
+    } else if (max_index < static_cast<uint64_t>(std::numeric_limits<uint16_t>::max()) - 2) {
       return nm::UINT16;
 
-    } else if (yale_max_size < std::numeric_limits<uint32_t>::max() - 2) {
+    } else if (max_index < std::numeric_limits<uint32_t>::max() - 2) {
       return nm::UINT32;
 
     } else {
@@ -148,6 +199,17 @@ extern "C" {
     }
   }
 
+  /*
+   * Calculates the itype a YALE_STORAGE object would need without actually needing
+   * to see the YALE_STORAGE object. Does this just by looking at the shape.
+   *
+   * Useful for creating Yale Storage by other means than NMatrix.new(:yale, ...),
+   * e.g., from a MATLAB v5 .mat file.
+   */
+  inline nm::itype_t nm_yale_storage_itype_by_shape(const size_t* shape) {
+    return nm_yale_storage_itype_for(shape[0] * (shape[1]+1));
+  }
+
   /*
    * Determine the index dtype (which will be used for the ija vector). This is
    * determined by matrix shape, not IJA/A vector capacity. Note that it's MAX-2
@@ -158,6 +220,28 @@ extern "C" {
     return nm_yale_storage_itype_by_shape(s->shape);
   }
 
+  /*
+   * Is s a reference to (a window on) another YALE_STORAGE?
+   */
+  inline bool nm_yale_storage_is_ref(const YALE_STORAGE* s) {
+    return s->src != s;
+  }
+
+  /*
+   * Do the rows of s (or of its source, for a reference) have slack in them?
+   */
+  inline bool nm_yale_storage_is_gapped(const YALE_STORAGE* s) {
+    return reinterpret_cast<const YALE_STORAGE*>(s->src)->row_end != NULL;
+  }
+
+  /*
+   * Does s (or its source, for a reference) store only the diagonal and upper triangle of a symmetric or Hermitian
+   * matrix?
+   */
+  inline bool nm_yale_storage_is_packed(const YALE_STORAGE* s) {
+    return reinterpret_cast<const YALE_STORAGE*>(s->src)->symm != nm::NONSYMM;
+  }
+
 
   /////////////////////////
   // Copying and Casting //
@@ -165,6 +249,7 @@ extern "C" {
 
   STORAGE*      nm_yale_storage_cast_copy(const STORAGE* rhs, nm::dtype_t new_dtype);
   STORAGE*      nm_yale_storage_copy_transposed(const STORAGE* rhs_base);
+  YALE_STORAGE* nm_yale_storage_copy_if_ref(const YALE_STORAGE* s);
 
 
 
@@ -0,0 +1,827 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == yale_factor.cpp
+//
+// Sparse Cholesky and LU factorization of square Yale matrices, with
+// a fill-reducing ordering. See yale.h.
+//
+// Each is done in two phases. The symbolic one only looks at where
+// the entries are: it picks the ordering and, for Cholesky, works out
+// where the entries of the factor will be. It's kept with the matrix
+// (like the column index), so factorizing again after the values
+// have changed, but not the structure, only does the numeric phase.
+
+/*
+ * Standard Includes
+ */
+
+#include <ruby.h>
+#include <algorithm> // std::remove_if, std::max
+#include <cmath>     // std::sqrt, std::fabs, std::hypot
+#include <vector>
+
+/*
+ * Project Includes
+ */
+
+#include "data/data.h"
+#include "common.h"
+#include "yale.h"
+
+/*
+ * Macros
+ */
+
+/*
+ * Global Variables
+ */
+
+/*
+ * Forward Declarations
+ */
+
+namespace nm { namespace yale_factor {
+
+/*
+ * Types
+ */
+
+/*
+ * A square Yale matrix copied out with plain indices: row i's non-diagonal entries are col[ptr[i]...ptr[i+1]), with
+ * values in val, and diag is the diagonal.
+ */
+template <typename DType>
+struct rows {
+  size_t              n;
+  std::vector<size_t> ptr, col;
+  std::vector<DType>  val, diag;
+};
+
+/*
+ * Functions
+ */
+
+template <typename DType> static inline DType  conj_of(const DType& v)            { return v; }
+template <typename Type>  static inline Complex<Type> conj_of(const Complex<Type>& v) { return Complex<Type>(v.r, -v.i); }
+template <typename DType> static inline double real_of(const DType& v)            { return v; }
+template <typename Type>  static inline double real_of(const Complex<Type>& v)    { return v.r; }
+template <typename DType> static inline double abs_of(const DType& v)             { return std::fabs(v); }
+template <typename Type>  static inline double abs_of(const Complex<Type>& v)     { return std::hypot(v.r, v.i); }
+
+template <typename DType, typename IType>
+static void read_rows(const YALE_STORAGE* s, rows<DType>& a) {
+  const IType* ija = reinterpret_cast<const IType*>(s->ija);
+  const DType* sa  = reinterpret_cast<const DType*>(s->a);
+  const size_t n   = s->shape[0];
+
+  a.n = n;
+  a.ptr.resize(n + 1);
+  for (size_t i = 0; i <= n; ++i) a.ptr[i] = ija[i] - (n + 1);
+
+  a.col.assign(ija + n + 1, ija + ija[n]);
+  a.val.assign(sa + n + 1, sa + ija[n]);
+  a.diag.assign(sa, sa + n);
+}
+
+/*
+ * Copies s (which must be gap-free, unpacked and not a reference) out into a.
+ */
+template <typename DType>
+static void read_rows(const YALE_STORAGE* s, rows<DType>& a) {
+  switch (s->itype) {
+  case UINT8:  read_rows<DType,uint8_t>(s, a);  break;
+  case UINT16: read_rows<DType,uint16_t>(s, a); break;
+  case UINT32: read_rows<DType,uint32_t>(s, a); break;
+  default:     read_rows<DType,uint64_t>(s, a); break;
+  }
+}
+
+/*
+ * Approximate minimum degree ordering. Writes the order in which to eliminate the variables into perm.
+ *
+ * This works on a quotient graph, which never writes out the fill: eliminating a variable p turns it into an
+ * element, a clique made of the variables p was adjacent to, directly or through the elements it was in (which are
+ * absorbed into the new one). vars[i] are the variables adjacent to variable i, elems[i] the elements it's in, and
+ * members[e] the variables of element e. Elements 0...n are the variables themselves, once eliminated; any after
+ * that are cliques to start out with (the rows of A, when ordering the columns for LU, since each is a clique in the
+ * graph of A^T A).
+ *
+ * The variable of least degree is eliminated each time. Degrees aren't kept exactly, but bounded as in AMD: by
+ * |vars[i]| + |new element| + the sum of |e \ new element| over i's other elements. Elements which that shows to be
+ * inside the new one are absorbed too. There's no detection of indistinguishable variables, so this can be slower
+ * than AMD, but gives much the same orderings.
+ */
+static void minimum_degree(std::vector<std::vector<size_t> >& vars, std::vector<std::vector<size_t> >& elems,
+                           std::vector<std::vector<size_t> >& members, size_t* perm) {
+  const size_t n = vars.size(), ne = members.size(), none = n;
+
+  std::vector<size_t> deg(n), head(n, none), next(n, none), prev(n, none), mark(n, 0), w(ne, 0), w_mark(ne, 0);
+  std::vector<char>   var_alive(n, 1), elem_alive(ne, 0);
+  std::fill(elem_alive.begin() + n, elem_alive.end(), 1);
+
+  // Variables are kept in a list for each degree.
+  auto insert = [&](size_t i) {
+    next[i] = head[deg[i]];
+    prev[i] = none;
+    if (head[deg[i]] != none) prev[head[deg[i]]] = i;
+    head[deg[i]] = i;
+  };
+
+  auto remove = [&](size_t i) {
+    if (prev[i] != none) next[prev[i]] = next[i];
+    else                 head[deg[i]]  = next[i];
+    if (next[i] != none) prev[next[i]] = prev[i];
+  };
+
+  for (size_t i = 0; i < n; ++i) {
+    size_t d = vars[i].size();
+    for (size_t e : elems[i]) d += members[e].size() - 1;
+
+    deg[i] = std::min(d, n - 1);
+    insert(i);
+  }
+
+  std::vector<size_t> lp;
+  size_t min_deg = 0, stamp = 0;
+
+  for (size_t k = 0; k < n; ++k) {
+    while (head[min_deg] == none) ++min_deg;
+
+    const size_t p = head[min_deg];
+    remove(p);
+    var_alive[p] = 0;
+    perm[k]      = p;
+
+    // The new element.
+    mark[p] = ++stamp;
+    lp.clear();
+
+    for (size_t v : vars[p]) {
+      if (var_alive[v] && mark[v] != stamp) {
+        mark[v] = stamp;
+        lp.push_back(v);
+      }
+    }
+
+    for (size_t e : elems[p]) {
+      if (!elem_alive[e]) continue;
+
+      for (size_t v : members[e]) {
+        if (var_alive[v] && mark[v] != stamp) {
+          mark[v] = stamp;
+          lp.push_back(v);
+        }
+      }
+
+      elem_alive[e] = 0;
+      std::vector<size_t>().swap(members[e]);
+    }
+
+    std::vector<size_t>().swap(vars[p]);
+    std::vector<size_t>().swap(elems[p]);
+    members[p]    = lp;
+    elem_alive[p] = 1;
+
+    // w[e] = |members[e] \ lp| for the other elements of the variables in lp. Eliminated variables are pruned from
+    // the elements on the way.
+    for (size_t i : lp) {
+      for (size_t e : elems[i]) {
+        if (!elem_alive[e] || e == p) continue;
+
+        if (w_mark[e] != stamp) {
+          std::vector<size_t>& m = members[e];
+          m.erase(std::remove_if(m.begin(), m.end(), [&](size_t v) { return !var_alive[v]; }), m.end());
+
+          w_mark[e] = stamp;
+          w[e]      = m.size();
+        }
+
+        --w[e];
+      }
+    }
+
+    // Update the variables in lp, dropping what the new element now covers.
+    const size_t others = n - k - 1; // variables left, besides p
+
+    for (size_t i : lp) {
+      remove(i);
+      size_t d = lp.size() - 1, out = 0;
+
+      for (size_t e : elems[i]) {
+        if (!elem_alive[e] || e == p) continue;
+
+        if (w[e] == 0) { // it's inside the new element
+          elem_alive[e] = 0;
+          std::vector<size_t>().swap(members[e]);
+          continue;
+        }
+
+        elems[i][out++] = e;
+        d += w[e];
+      }
+      elems[i].resize(out);
+      elems[i].push_back(p);
+
+      out = 0;
+      for (size_t v : vars[i]) {
+        if (var_alive[v] && mark[v] != stamp) vars[i][out++] = v;
+      }
+      vars[i].resize(out);
+      d += out;
+
+      deg[i]  = std::min(d, others - 1);
+      insert(i);
+      min_deg = std::min(min_deg, deg[i]);
+    }
+  }
+}
+
+/*
+ * Symbolic Cholesky, first part: orders the graph of A (from its lower triangle, the only part that's read) by
+ * minimum degree. The rest of the analysis is done on the reordered matrix, by elimination_tree.
+ */
+template <typename DType>
+static YALE_SYMBOLIC* order_cholesky(const rows<DType>& a) {
+  const size_t n = a.n;
+
+  YALE_SYMBOLIC* sym = ALLOC(YALE_SYMBOLIC);
+  sym->perm   = ALLOC_N(size_t, n);
+  sym->parent = ALLOC_N(size_t, n);
+  sym->l_ptr  = ALLOC_N(size_t, n + 1);
+  sym->lnz    = sym->unz = 0;
+
+  std::vector<std::vector<size_t> > vars(n), elems(n), members(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t p = a.ptr[i]; p < a.ptr[i+1] && a.col[p] < i; ++p) {
+      vars[i].push_back(a.col[p]);
+      vars[a.col[p]].push_back(i);
+    }
+  }
+
+  minimum_degree(vars, elems, members, sym->perm);
+
+  return sym;
+}
+
+/*
+ * The strict lower triangle of C = P A P^T, by rows, and its diagonal, from the lower triangle of A; the upper one
+ * isn't read. A[r,c], c < r, lands in C at (pinv[r], pinv[c]) if that's below the diagonal, and otherwise stands
+ * for its (conjugated) mirror image, which does.
+ */
+template <typename DType>
+static void permuted_lower(const rows<DType>& a, const size_t* perm, rows<DType>& c) {
+  const size_t n = a.n;
+
+  std::vector<size_t> pinv(n);
+  for (size_t k = 0; k < n; ++k) pinv[perm[k]] = k;
+
+  c.n = n;
+  c.ptr.assign(n + 1, 0);
+  c.diag.resize(n);
+
+  for (size_t r = 0; r < n; ++r) {
+    c.diag[pinv[r]] = a.diag[r];
+
+    for (size_t p = a.ptr[r]; p < a.ptr[r+1] && a.col[p] < r; ++p)
+      ++c.ptr[std::max(pinv[r], pinv[a.col[p]]) + 1];
+  }
+  for (size_t k = 0; k < n; ++k) c.ptr[k+1] += c.ptr[k];
+
+  c.col.resize(c.ptr[n]);
+  c.val.resize(c.ptr[n]);
+  std::vector<size_t> next(c.ptr.begin(), c.ptr.end() - 1);
+
+  for (size_t r = 0; r < n; ++r) {
+    for (size_t p = a.ptr[r]; p < a.ptr[r+1] && a.col[p] < r; ++p) {
+      const size_t i = pinv[r], j = pinv[a.col[p]];
+
+      if (i > j) {
+        c.col[next[i]]   = j;
+        c.val[next[i]++] = a.val[p];
+      } else {
+        c.col[next[j]]   = i;
+        c.val[next[j]++] = conj_of(a.val[p]);
+      }
+    }
+  }
+}
+
+/*
+ * Symbolic Cholesky, second part: the elimination tree of C = P A P^T (as from permuted_lower) and the number of
+ * entries in each column of its factor L.
+ *
+ * Row k of L has an entry in column i wherever i is on the path in the tree from some j (C[k,j] != 0, j < k) up to k,
+ * so following those paths, and stopping at anything already seen for this row, counts every entry once.
+ */
+template <typename DType>
+static void elimination_tree(const rows<DType>& c, YALE_SYMBOLIC* sym) {
+  const size_t n      = c.n;
+  size_t*      parent = sym->parent;
+  size_t*      l_ptr  = sym->l_ptr;
+
+  std::vector<size_t> ancestor(n), flag(n);
+
+  // Elimination tree, with path compression through ancestor.
+  for (size_t k = 0; k < n; ++k) {
+    parent[k] = ancestor[k] = n;
+
+    for (size_t p = c.ptr[k]; p < c.ptr[k+1]; ++p) {
+      for (size_t i = c.col[p]; i < k; ) {
+        const size_t next = ancestor[i];
+        ancestor[i] = k;
+        if (next == n) parent[i] = k;
+        i = next;
+      }
+    }
+  }
+
+  // Column counts.
+  std::fill(l_ptr, l_ptr + n + 1, 0);
+  for (size_t k = 0; k < n; ++k) {
+    flag[k] = k;
+
+    for (size_t p = c.ptr[k]; p < c.ptr[k+1]; ++p) {
+      for (size_t i = c.col[p]; flag[i] != k; i = parent[i]) {
+        flag[i] = k;
+        ++l_ptr[i+1];
+      }
+    }
+  }
+  for (size_t j = 0; j < n; ++j) l_ptr[j+1] += l_ptr[j];
+}
+
+/*
+ * Numeric Cholesky of C = P A P^T = L L^H (as from permuted_lower), a row of L at a time. Conjugated, row k left
+ * of the diagonal solves L[0...k,0...k] y = conj(C[k,0...k]); its pattern is what elimination_tree found, and
+ * visiting it in the order that walk up the tree gives solves it in the right order.
+ *
+ * Fills in diag, and the columns of L below it (as laid out by sym->l_ptr). Returns n, or the column at which the
+ * matrix turned out not to be positive definite.
+ */
+template <typename DType>
+static size_t cholesky_numeric(const rows<DType>& c, const YALE_SYMBOLIC* sym, DType* diag, size_t* l_row, DType* l_val) {
+  const size_t  n      = c.n;
+  const size_t* parent = sym->parent,
+              * l_ptr  = sym->l_ptr;
+
+  std::vector<size_t> next(l_ptr, l_ptr + n), flag(n), stack(n);
+  std::vector<DType>  x(n, 0);
+
+  for (size_t k = 0; k < n; ++k) {
+    size_t top = n;
+    flag[k] = k;
+
+    // Scatter row k of C into x, and find the pattern of row k of L in stack[top...n).
+    for (size_t p = c.ptr[k]; p < c.ptr[k+1]; ++p) {
+      size_t i = c.col[p];
+      x[i] = conj_of(c.val[p]);
+
+      size_t len = 0;
+      for (; flag[i] != k; i = parent[i]) {
+        stack[len++] = i;
+        flag[i]      = k;
+      }
+      while (len > 0) stack[--top] = stack[--len];
+    }
+
+    double d = real_of(c.diag[k]);
+
+    for (; top < n; ++top) {
+      const size_t i = stack[top];
+      const DType  y = x[i] / diag[i];
+      x[i] = 0;
+
+      for (size_t q = l_ptr[i]; q < next[i]; ++q) x[l_row[q]] = x[l_row[q]] - l_val[q] * y;
+
+      d -= real_of(y * conj_of(y));
+      l_row[next[i]]   = k;
+      l_val[next[i]++] = conj_of(y);
+    }
+
+    if (!(d > 0)) return k;
+    diag[k] = std::sqrt(d);
+  }
+
+  return n;
+}
+
+/*
+ * Cholesky factorization of full (gap-free and unpacked), taken to be the symmetric (or Hermitian) matrix with its
+ * lower triangle. *sym holds the symbolic analysis if there already is one, and gets a new one otherwise. Returns L,
+ * with P A P^T = L L^H and P the ordering in (*sym)->perm, or NULL if the matrix isn't positive definite.
+ */
+template <typename DType>
+static YALE_STORAGE* cholesky(const YALE_STORAGE* full, YALE_SYMBOLIC** sym) {
+  rows<DType> a, c;
+  read_rows<DType>(full, a);
+
+  const size_t n     = a.n;
+  const bool   fresh = !*sym;
+
+  if (fresh) *sym = order_cholesky<DType>(a);
+  permuted_lower<DType>(a, (*sym)->perm, c);
+  if (fresh) elimination_tree<DType>(c, *sym);
+
+  const size_t lnz = (*sym)->l_ptr[n];
+  std::vector<size_t> l_row(lnz);
+  std::vector<DType>  l_val(lnz), diag(n);
+
+  if (cholesky_numeric<DType>(c, *sym, diag.data(), l_row.data(), l_val.data()) < n) return NULL;
+
+  // Out into a Yale matrix, by way of (row, column, value) triplets.
+  std::vector<int64_t> rows_of(lnz + n), cols_of(lnz + n);
+  std::vector<DType>   vals(lnz + n);
+
+  size_t t = 0;
+  for (size_t j = 0; j < n; ++j) {
+    rows_of[t] = cols_of[t] = j;
+    vals[t++]  = diag[j];
+
+    for (size_t q = (*sym)->l_ptr[j]; q < (*sym)->l_ptr[j+1]; ++q, ++t) {
+      rows_of[t] = l_row[q];
+      cols_of[t] = j;
+      vals[t]    = l_val[q];
+    }
+  }
+
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = shape[1] = n;
+
+  return nm_yale_storage_create_from_coo(full->dtype, shape, t, rows_of.data(), INT64, cols_of.data(), INT64, vals.data(), full->dtype);
+}
+
+/*
+ * Column ordering for LU: minimum degree on the graph of A^T A, which is what Cholesky of A^T A would use. That
+ * bounds the fill of LU with any row pivoting (as COLAMD does). Each row of A is a clique in that graph, so rather
+ * than forming A^T A, the rows start out as the elements of the quotient graph.
+ */
+template <typename DType>
+static YALE_SYMBOLIC* analyze_lu(const rows<DType>& a) {
+  const size_t n = a.n;
+
+  std::vector<std::vector<size_t> > vars(n), elems(n), members(2 * n);
+
+  for (size_t i = 0; i < n; ++i) {
+    std::vector<size_t>& row = members[n + i];
+
+    for (size_t p = a.ptr[i]; p < a.ptr[i+1]; ++p) row.push_back(a.col[p]);
+    if (a.diag[i] != 0) row.push_back(i);
+
+    for (size_t j : row) elems[j].push_back(n + i);
+  }
+
+  YALE_SYMBOLIC* sym = ALLOC(YALE_SYMBOLIC);
+  sym->perm   = ALLOC_N(size_t, n);
+  sym->parent = NULL;
+  sym->l_ptr  = NULL;
+  sym->lnz    = sym->unz = 0;
+
+  minimum_degree(vars, elems, members, sym->perm);
+
+  return sym;
+}
+
+/*
+ * The factors of an LU factorization, column by column. L's rows are those of A until the end, and U's are in the
+ * order they were chosen as pivots.
+ */
+template <typename DType>
+struct lu_factors {
+  std::vector<size_t> l_ptr, l_row, u_ptr, u_row;
+  std::vector<DType>  l_val, u_val, u_diag;
+};
+
+/*
+ * Numeric LU with partial pivoting, left-looking, a column of (A Q) at a time (as Gilbert and Peierls do it). For
+ * column k, solve L x = A[:,q[k]] with the columns of L so far; the rows already chosen as pivots then make up
+ * column k of U, and the largest of the others (or the diagonal, on a tie) is the pivot, which the rest are divided
+ * by to give column k of L.
+ *
+ * x is sparse, and found by a depth-first search from the entries of A[:,q[k]] through the graph of L: its pattern,
+ * in the order the search finishes with each row, is one the triangular solve can go through in reverse.
+ *
+ * pinv[i] is the pivot step at which row i of A was chosen. Returns n, or the column at which A turned out singular.
+ */
+template <typename DType>
+static size_t lu_numeric(const rows<DType>& a, const size_t* q, lu_factors<DType>& f, size_t* pinv) {
+  const size_t n = a.n, none = n;
+
+  // Columns of A.
+  std::vector<size_t> c_ptr(n + 1, 0), c_row, next;
+  std::vector<DType>  c_val;
+
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t p = a.ptr[i]; p < a.ptr[i+1]; ++p) ++c_ptr[a.col[p] + 1];
+    if (a.diag[i] != 0) ++c_ptr[i + 1];
+  }
+  for (size_t j = 0; j < n; ++j) c_ptr[j+1] += c_ptr[j];
+
+  c_row.resize(c_ptr[n]);
+  c_val.resize(c_ptr[n]);
+  next.assign(c_ptr.begin(), c_ptr.end() - 1);
+
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t p = a.ptr[i]; p < a.ptr[i+1]; ++p) {
+      const size_t at = next[a.col[p]]++;
+      c_row[at] = i;
+      c_val[at] = a.val[p];
+    }
+
+    if (a.diag[i] != 0) {
+      const size_t at = next[i]++;
+      c_row[at] = i;
+      c_val[at] = a.diag[i];
+    }
+  }
+
+  std::vector<size_t> mark(n, 0), xi(n), stack(n), pstack(n);
+  std::vector<DType>  x(n, 0);
+  std::fill(pinv, pinv + n, none);
+
+  f.l_ptr.assign(1, 0);
+  f.u_ptr.assign(1, 0);
+  f.u_diag.resize(n);
+
+  for (size_t k = 0; k < n; ++k) {
+    const size_t col   = q[k],
+                 stamp = k + 1;
+    size_t       top   = n;
+
+    // Pattern of x: everything reachable from the rows of A[:,col].
+    for (size_t p = c_ptr[col]; p < c_ptr[col+1]; ++p) {
+      if (mark[c_row[p]] == stamp) continue;
+
+      size_t head = 0;
+      stack[0] = c_row[p];
+
+      while (true) {
+        const size_t j  = stack[head],
+                     jj = pinv[j];
+
+        if (mark[j] != stamp) {
+          mark[j]      = stamp;
+          pstack[head] = jj == none ? 0 : f.l_ptr[jj];
+        }
+
+        const size_t end = jj == none ? 0 : f.l_ptr[jj+1];
+        bool done = true;
+
+        for (size_t r = pstack[head]; r < end; ++r) {
+          const size_t i = f.l_row[r];
+          if (mark[i] == stamp) continue;
+
+          pstack[head]    = r + 1;
+          stack[++head]   = i;
+          done            = false;
+          break;
+        }
+
+        if (done) {
+          xi[--top] = j;
+          if (head == 0) break;
+          --head;
+        }
+      }
+    }
+
+    // x = L \ A[:,col].
+    for (size_t p = c_ptr[col]; p < c_ptr[col+1]; ++p) x[c_row[p]] = c_val[p];
+
+    for (size_t t = top; t < n; ++t) {
+      const size_t j  = xi[t],
+                   jj = pinv[j];
+      if (jj == none) continue;
+
+      for (size_t r = f.l_ptr[jj]; r < f.l_ptr[jj+1]; ++r) x[f.l_row[r]] = x[f.l_row[r]] - f.l_val[r] * x[j];
+    }
+
+    // Pick the pivot, and write column k of U.
+    size_t pivot = none;
+    double best  = -1;
+
+    for (size_t t = top; t < n; ++t) {
+      const size_t i = xi[t];
+
+      if (pinv[i] == none) {
+        const double v = abs_of(x[i]);
+        if (v > best || (v == best && i == col)) {
+          best  = v;
+          pivot = i;
+        }
+      } else {
+        f.u_row.push_back(pinv[i]);
+        f.u_val.push_back(x[i]);
+      }
+    }
+    f.u_ptr.push_back(f.u_row.size());
+
+    if (pivot == none || best <= 0) return k;
+
+    const DType piv = x[pivot];
+    f.u_diag[k]  = piv;
+    pinv[pivot]  = k;
+
+    // Column k of L.
+    for (size_t t = top; t < n; ++t) {
+      const size_t i = xi[t];
+
+      if (pinv[i] == none) {
+        f.l_row.push_back(i);
+        f.l_val.push_back(x[i] / piv);
+      }
+      x[i] = 0;
+    }
+    f.l_ptr.push_back(f.l_row.size());
+  }
+
+  return n;
+}
+
+/*
+ * LU factorization of full (gap-free and unpacked), with P A Q = L U. Q is the column ordering in (*sym)->perm
+ * (worked out if there isn't one yet) and P comes from partial pivoting; L has ones on its diagonal. Writes the rows
+ * of A in P order into p. Returns false if the matrix is singular.
+ */
+template <typename DType>
+static bool lu(const YALE_STORAGE* full, YALE_SYMBOLIC** sym, YALE_STORAGE** l, YALE_STORAGE** u, size_t* p) {
+  rows<DType> a;
+  read_rows<DType>(full, a);
+
+  const size_t n = a.n;
+  if (!*sym) *sym = analyze_lu<DType>(a);
+
+  lu_factors<DType> f;
+  f.l_row.reserve((*sym)->lnz);
+  f.l_val.reserve((*sym)->lnz);
+  f.u_row.reserve((*sym)->unz);
+  f.u_val.reserve((*sym)->unz);
+
+  std::vector<size_t> pinv(n);
+  if (lu_numeric<DType>(a, (*sym)->perm, f, pinv.data()) < n) return false;
+
+  (*sym)->lnz = f.l_row.size();
+  (*sym)->unz = f.u_row.size();
+
+  for (size_t i = 0; i < n; ++i) p[pinv[i]] = i;
+
+  // Out into Yale matrices, by way of (row, column, value) triplets.
+  const size_t most = std::max(f.l_row.size(), f.u_row.size()) + n;
+  std::vector<int64_t> rows_of(most), cols_of(most);
+  std::vector<DType>   vals(most);
+
+  size_t t = 0;
+  for (size_t j = 0; j < n; ++j) {
+    rows_of[t] = cols_of[t] = j;
+    vals[t++]  = 1;
+
+    for (size_t r = f.l_ptr[j]; r < f.l_ptr[j+1]; ++r, ++t) {
+      rows_of[t] = pinv[f.l_row[r]];
+      cols_of[t] = j;
+      vals[t]    = f.l_val[r];
+    }
+  }
+
+  size_t* shape = ALLOC_N(size_t, 2);
+  shape[0] = shape[1] = n;
+  *l = nm_yale_storage_create_from_coo(full->dtype, shape, t, rows_of.data(), INT64, cols_of.data(), INT64, vals.data(), full->dtype);
+
+  t = 0;
+  for (size_t j = 0; j < n; ++j) {
+    rows_of[t] = cols_of[t] = j;
+    vals[t++]  = f.u_diag[j];
+
+    for (size_t r = f.u_ptr[j]; r < f.u_ptr[j+1]; ++r, ++t) {
+      rows_of[t] = f.u_row[r];
+      cols_of[t] = j;
+      vals[t]    = f.u_val[r];
+    }
+  }
+
+  shape = ALLOC_N(size_t, 2);
+  shape[0] = shape[1] = n;
+  *u = nm_yale_storage_create_from_coo(full->dtype, shape, t, rows_of.data(), INT64, cols_of.data(), INT64, vals.data(), full->dtype);
+
+  return true;
+}
+
+}} // end of namespace nm::yale_factor
+
+extern "C" {
+
+/*
+ * Frees a symbolic factorization (see yale_factor.cpp). Does nothing to NULL.
+ */
+void nm_yale_storage_symbolic_delete(YALE_SYMBOLIC* sym) {
+  if (!sym) return;
+
+  xfree(sym->perm);
+  xfree(sym->parent);
+  xfree(sym->l_ptr);
+  xfree(sym);
+}
+
+/*
+ * Sparse Cholesky factorization of square s, taken to be the symmetric (or Hermitian) matrix A with its lower
+ * triangle (the upper one isn't read), which must be positive definite: returns L, lower triangular, with
+ * L L^H = P A P^T, where row and column k of P A P^T are row and column (*perm)[k] of A. *perm is allocated here.
+ *
+ * Only for floating-point dtypes. The symbolic analysis is kept with s (unless it's a reference), so factorizing
+ * again after changing only values skips it.
+ */
+YALE_STORAGE* nm_yale_storage_cholesky(const YALE_STORAGE* s, size_t** perm) {
+  static YALE_STORAGE* (*ttable[nm::NUM_DTYPES])(const YALE_STORAGE*, YALE_SYMBOLIC**) = {
+    NULL, NULL, NULL, NULL, NULL, // integers not allowed due to division
+    nm::yale_factor::cholesky<float>,
+    nm::yale_factor::cholesky<double>,
+    nm::yale_factor::cholesky<nm::Complex64>,
+    nm::yale_factor::cholesky<nm::Complex128>,
+    NULL, NULL, NULL, NULL        // nor are rationals and Ruby objects, due to square roots
+  };
+
+  if (!ttable[s->dtype])
+    rb_raise(nm_eDataTypeError, "sparse factorization is only implemented for floating-point dtypes");
+
+  const size_t    n    = s->shape[0];
+  YALE_SYMBOLIC*  own  = NULL;
+  YALE_SYMBOLIC** sym  = nm_yale_storage_is_ref(s) ? &own : &const_cast<YALE_STORAGE*>(s)->symbolic[0];
+  YALE_STORAGE*   full = nm_yale_storage_copy_if_ref(s);
+
+  YALE_STORAGE* l = ttable[s->dtype](full, sym);
+
+  if (l) {
+    *perm = ALLOC_N(size_t, n);
+    std::copy((*sym)->perm, (*sym)->perm + n, *perm);
+  }
+
+  if (full != s) nm_yale_storage_delete(full);
+  nm_yale_storage_symbolic_delete(own);
+
+  if (!l) rb_raise(rb_eArgError, "matrix is not positive definite");
+  return l;
+}
+
+/*
+ * Sparse LU factorization of square s, with partial pivoting: P A Q = L U, where row i of P A Q is row (*p)[i] of A,
+ * column j is column (*q)[j], and L has ones on its diagonal. *p and *q are allocated here.
+ *
+ * Only for floating-point dtypes. The column ordering is kept with s (unless it's a reference), so factorizing again
+ * after changing only values skips working it out.
+ */
+void nm_yale_storage_lu(const YALE_STORAGE* s, YALE_STORAGE** l, YALE_STORAGE** u, size_t** p, size_t** q) {
+  static bool (*ttable[nm::NUM_DTYPES])(const YALE_STORAGE*, YALE_SYMBOLIC**, YALE_STORAGE**, YALE_STORAGE**, size_t*) = {
+    NULL, NULL, NULL, NULL, NULL, // integers not allowed due to division
+    nm::yale_factor::lu<float>,
+    nm::yale_factor::lu<double>,
+    nm::yale_factor::lu<nm::Complex64>,
+    nm::yale_factor::lu<nm::Complex128>,
+    NULL, NULL, NULL, NULL        // nor are rationals and Ruby objects, which can't be compared to pick pivots
+  };
+
+  if (!ttable[s->dtype])
+    rb_raise(nm_eDataTypeError, "sparse factorization is only implemented for floating-point dtypes");
+
+  const size_t    n    = s->shape[0];
+  YALE_SYMBOLIC*  own  = NULL;
+  YALE_SYMBOLIC** sym  = nm_yale_storage_is_ref(s) ? &own : &const_cast<YALE_STORAGE*>(s)->symbolic[1];
+  YALE_STORAGE*   full = nm_yale_storage_copy_if_ref(s);
+
+  size_t* rows = ALLOC_N(size_t, n);
+  bool    ok   = ttable[s->dtype](full, sym, l, u, rows);
+
+  if (ok) {
+    *p = rows;
+    *q = ALLOC_N(size_t, n);
+    std::copy((*sym)->perm, (*sym)->perm + n, *q);
+  } else {
+    xfree(rows);
+  }
+
+  if (full != s) nm_yale_storage_delete(full);
+  nm_yale_storage_symbolic_delete(own);
+
+  if (!ok) rb_raise(rb_eZeroDivError, "matrix is singular");
+}
+
+} // end of extern "C" block
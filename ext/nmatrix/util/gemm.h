@@ -0,0 +1,229 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == gemm.h
+//
+// Packed, cache-blocked GEMM for the dtypes CBLAS doesn't cover.
+//
+// The loop structure is the usual one from GotoBLAS: C is computed a
+// kc x nc panel of B at a time (sized for L3), and within that an
+// mc x kc block of A at a time (sized for L2). Both are first copied
+// into contiguous buffers laid out in the order the micro-kernel reads
+// them, so that the innermost loop streams through memory. The
+// micro-kernel computes one mr x GEMM_NR tile of C in registers; it
+// comes from simd.h when there's a vectorized one for the current ISA.
+//
+// Like gemm_nothrow, everything here is column-major.
+
+#ifndef GEMM_H
+#define GEMM_H
+
+/*
+ * Standard Includes
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Project Includes
+ */
+
+#include "data/data.h"
+#include "simd.h"
+
+/*
+ * Macros
+ */
+
+// Depth of a packed block, i.e. the length of the micro-kernel's inner loop.
+#define NM_GEMM_KC        256
+// Bytes of A packed at a time (about half of a typical L2).
+#define NM_GEMM_MC_BYTES  (128 * 1024)
+// Columns of B packed at a time.
+#define NM_GEMM_NC        2048
+// Rows per tile for the portable micro-kernel.
+#define NM_GEMM_GENERIC_MR 4
+// Below this many multiply-adds, packing costs more than it saves.
+#define NM_GEMM_MIN_WORK  4096
+
+namespace nm { namespace math {
+
+/*
+ * Which dtypes go through gemm_blocked rather than gemm_nothrow.
+ */
+template <typename DType> struct blocked_gemm          { static const bool value = false; };
+template <>               struct blocked_gemm<uint8_t> { static const bool value = true; };
+template <>               struct blocked_gemm<int8_t>  { static const bool value = true; };
+template <>               struct blocked_gemm<int16_t> { static const bool value = true; };
+template <>               struct blocked_gemm<int32_t> { static const bool value = true; };
+template <>               struct blocked_gemm<int64_t> { static const bool value = true; };
+
+/*
+ * Portable micro-kernel, for when there's no vectorized one. Same layout as simd::gemm_kernel_t.
+ */
+template <typename DType>
+static void gemm_generic_kernel(size_t kc, const void* av, const void* bv, void* abv) {
+  const size_t MR = NM_GEMM_GENERIC_MR, NR = simd::GEMM_NR;
+  const DType* a  = reinterpret_cast<const DType*>(av);
+  const DType* b  = reinterpret_cast<const DType*>(bv);
+  DType*       ab = reinterpret_cast<DType*>(abv);
+
+  DType c[MR * NR] = {};
+
+  for (size_t l = 0; l < kc; ++l, a += MR, b += NR) {
+    for (size_t j = 0; j < NR; ++j)
+      for (size_t i = 0; i < MR; ++i)
+        c[i + j*MR] += a[i] * b[j];
+  }
+
+  memcpy(ab, c, sizeof(c));
+}
+
+/*
+ * Copy the mc x kc block of op(A) at (ic, pc) into ap, as mr-row panels stored column by column, padding the last
+ * panel with zeros.
+ */
+template <typename DType>
+static void gemm_pack_a(const enum CBLAS_TRANSPOSE TransA, const DType* A, const int lda, size_t ic, size_t pc,
+                        size_t mc, size_t kc, size_t mr, DType* ap) {
+  for (size_t ir = 0; ir < mc; ir += mr) {
+    size_t rows = std::min(mr, mc - ir);
+
+    for (size_t l = 0; l < kc; ++l, ap += mr) {
+      for (size_t i = 0; i < rows; ++i) {
+        size_t row = ic + ir + i, col = pc + l;
+        ap[i] = TransA == CblasNoTrans ? A[row + col*lda] : A[col + row*lda];
+      }
+      for (size_t i = rows; i < mr; ++i) ap[i] = 0;
+    }
+  }
+}
+
+/*
+ * Copy the kc x nc panel of op(B) at (pc, jc) into bp, as GEMM_NR-column panels stored row by row, padding the
+ * last panel with zeros.
+ */
+template <typename DType>
+static void gemm_pack_b(const enum CBLAS_TRANSPOSE TransB, const DType* B, const int ldb, size_t pc, size_t jc,
+                        size_t kc, size_t nc, DType* bp) {
+  const size_t NR = simd::GEMM_NR;
+
+  for (size_t jr = 0; jr < nc; jr += NR) {
+    size_t cols = std::min(NR, nc - jr);
+
+    for (size_t l = 0; l < kc; ++l, bp += NR) {
+      for (size_t j = 0; j < cols; ++j) {
+        size_t row = pc + l, col = jc + jr + j;
+        bp[j] = TransB == CblasNoTrans ? B[row + col*ldb] : B[col + row*ldb];
+      }
+      for (size_t j = cols; j < NR; ++j) bp[j] = 0;
+    }
+  }
+}
+
+/*
+ * C = alpha*op(A)*op(B) + beta*C, column-major, with the same arguments as gemm_nothrow.
+ *
+ * Returns false without touching C if it declined to do the multiplication (because it's too small to be worth
+ * packing, or a buffer couldn't be allocated), in which case the caller should use gemm_nothrow. Doesn't call
+ * into Ruby, so it's safe to run without the GVL.
+ */
+template <typename DType>
+inline bool gemm_blocked(const enum CBLAS_TRANSPOSE TransA, const enum CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+                         const DType* alpha, const DType* A, const int lda, const DType* B, const int ldb, const DType* beta, DType* C, const int ldc)
+{
+  if (!blocked_gemm<DType>::value) return false;
+  if (M <= 0 || N <= 0 || K <= 0 || *alpha == 0) return false;
+  if (static_cast<size_t>(M) * N * K < NM_GEMM_MIN_WORK) return false;
+
+  const size_t NR = simd::GEMM_NR;
+
+  simd::gemm_kernel_info kernel = simd::gemm_kernels[std::max(simd::kernel_dtype<DType>::value, 0)];
+  if (!kernel.fn) {
+    kernel.fn = gemm_generic_kernel<DType>;
+    kernel.mr = NM_GEMM_GENERIC_MR;
+  }
+
+  const size_t mr = kernel.mr,
+               kc_max = std::min<size_t>(K, NM_GEMM_KC),
+               mc_max = std::max(mr, std::min<size_t>((M + mr - 1) / mr * mr, NM_GEMM_MC_BYTES / (kc_max * sizeof(DType)) / mr * mr)),
+               nc_max = std::min<size_t>((N + NR - 1) / NR * NR, NM_GEMM_NC);
+
+  DType* ap = reinterpret_cast<DType*>(malloc(sizeof(DType) * mc_max * kc_max));
+  DType* bp = reinterpret_cast<DType*>(malloc(sizeof(DType) * kc_max * nc_max));
+  DType* ab = reinterpret_cast<DType*>(malloc(sizeof(DType) * mr * NR));
+
+  if (!ap || !bp || !ab) {
+    free(ap); free(bp); free(ab);
+    return false;
+  }
+
+  for (size_t jc = 0; jc < static_cast<size_t>(N); jc += nc_max) {
+    size_t nc = std::min<size_t>(nc_max, N - jc);
+
+    for (size_t pc = 0; pc < static_cast<size_t>(K); pc += kc_max) {
+      size_t kc    = std::min<size_t>(kc_max, K - pc);
+      bool   first = pc == 0; // beta only applies the first time round; after that we accumulate
+
+      gemm_pack_b<DType>(TransB, B, ldb, pc, jc, kc, nc, bp);
+
+      for (size_t ic = 0; ic < static_cast<size_t>(M); ic += mc_max) {
+        size_t mc = std::min<size_t>(mc_max, M - ic);
+
+        gemm_pack_a<DType>(TransA, A, lda, ic, pc, mc, kc, mr, ap);
+
+        for (size_t jr = 0; jr < nc; jr += NR) {
+          size_t cols = std::min(NR, nc - jr);
+
+          for (size_t ir = 0; ir < mc; ir += mr) {
+            size_t rows = std::min(mr, mc - ir);
+
+            kernel.fn(kc, ap + ir * kc, bp + jr * kc, ab);
+
+            for (size_t j = 0; j < cols; ++j) {
+              DType* c = C + (ic + ir) + (jc + jr + j) * ldc;
+
+              for (size_t i = 0; i < rows; ++i) {
+                if (!first || *beta == 1) c[i] += *alpha * ab[i + j*mr];
+                else if (*beta == 0)      c[i]  = *alpha * ab[i + j*mr];
+                else                      c[i]  = *alpha * ab[i + j*mr] + *beta * c[i];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  free(ap);
+  free(bp);
+  free(ab);
+
+  return true;
+}
+
+}} // end of namespace nm::math
+
+#endif // GEMM_H
@@ -83,7 +83,9 @@ extern "C" { // These need to be in an extern "C" block or you'll get all kinds
  * Project Includes
  */
 #include "data/data.h"
+#include "gemm.h"
 #include "lapack.h"
+#include "thread_pool.h"
 
 /*
  * Macros
@@ -826,8 +828,15 @@ inline void gemm(const enum CBLAS_ORDER Order, const enum CBLAS_TRANSPOSE TransA
     */
   }
 
-  if (Order == CblasRowMajor)    gemm_nothrow<DType>(TransB, TransA, N, M, K, alpha, B, ldb, A, lda, beta, C, ldc);
-  else                           gemm_nothrow<DType>(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+  // The integer dtypes get the packed, blocked version; everything else (and anything too small to be worth
+  // packing) the reference one.
+  if (Order == CblasRowMajor) {
+    if (!gemm_blocked<DType>(TransB, TransA, N, M, K, alpha, B, ldb, A, lda, beta, C, ldc))
+      gemm_nothrow<DType>(TransB, TransA, N, M, K, alpha, B, ldb, A, lda, beta, C, ldc);
+  } else {
+    if (!gemm_blocked<DType>(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc))
+      gemm_nothrow<DType>(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+  }
 
 }
 
@@ -1518,6 +1527,55 @@ inline int getrf(const enum CBLAS_ORDER Order, const int M, const int N, DType*
 }
 
 
+/*
+ * Row-major getrf with the same recursion (and so the same results) as getrf_nothrow, but with the bulk of the
+ * work split between the threads of the pool: once the upper half of the rows has been factored, each of the
+ * lower rows can be pivoted, solved against U and updated independently of the others. The final pivoting of
+ * the upper rows is split the same way.
+ *
+ * Small matrices, and blocks of the recursion small enough to be below thread_pool::threshold(), just call
+ * getrf_nothrow. Doesn't touch the GVL, so the caller decides whether to release it.
+ */
+template <typename DType>
+inline int getrf_parallel(const int M, const int N, DType* A, const int lda, int* ipiv) {
+  const int MN = std::min(M, N);
+
+  if (MN <= 64 || size_t(M) * N * MN < nm::thread_pool::threshold() || nm::thread_pool::num_threads() == 1)
+    return getrf_nothrow<true,DType>(M, N, A, lda, ipiv);
+
+  const DType neg_one = -1, one = 1;
+  const int   N_ul = MN >> 1,
+              N_dr = M - N_ul;
+
+  int ierr = getrf_parallel<DType>(N_ul, N, A, lda, ipiv);
+
+  DType *Ar = &(A[N_ul * lda]),
+        *Ac = &(A[N_ul]),
+        *An = &(Ar[N_ul]);
+
+  nm::thread_pool::for_blocks(N_dr, [=](size_t begin, size_t end) {
+    const int rows = end - begin;
+
+    nm::math::laswp<DType>(rows, Ar + begin * lda, lda, 0, N_ul, ipiv, 1);
+    nm::math::trsm<DType>(CblasRowMajor, CblasRight, CblasUpper, CblasNoTrans, CblasUnit, rows, N_ul, one, A, lda, Ar + begin * lda, lda);
+    nm::math::gemm<DType>(CblasRowMajor, CblasNoTrans, CblasNoTrans, rows, N-N_ul, N_ul, &neg_one, Ar + begin * lda, lda, Ac, lda, &one, An + begin * lda, lda);
+  });
+
+  int i = getrf_parallel<DType>(N_dr, N-N_ul, An, lda, ipiv+N_ul);
+  if (i && !ierr) ierr = N_ul + i;
+
+  for (i = N_ul; i != MN; i++) {
+    ipiv[i] += N_ul;
+  }
+
+  nm::thread_pool::for_blocks(N_ul, [=](size_t begin, size_t end) {
+    nm::math::laswp<DType>(end - begin, A + begin * lda, lda, N_ul, MN, ipiv, 1);  /* apply pivots */
+  });
+
+  return ierr;
+}
+
+
 /*
  * From ATLAS 3.8.0:
  *
@@ -2168,6 +2226,14 @@ inline int clapack_getrf(const enum CBLAS_ORDER order, const int m, const int n,
   return getrf<DType>(order, m, n, reinterpret_cast<DType*>(a), lda, ipiv);
 }
 
+/*
+ * The same, split between threads (see getrf_parallel). Row-major only.
+ */
+template <typename DType>
+inline int clapack_getrf_parallel(const enum CBLAS_ORDER order, const int m, const int n, void* a, const int lda, int* ipiv) {
+  return getrf_parallel<DType>(m, n, reinterpret_cast<DType*>(a), lda, ipiv);
+}
+
 
 /*
 * Function signature conversion for calling LAPACK's potrf functions as directly as possible.
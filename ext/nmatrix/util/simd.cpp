@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == simd.cpp
+//
+// Runtime selection of the vectorized element-wise kernels.
+
+/*
+ * Standard Includes
+ */
+
+#include <ruby.h>
+#include <cstring>
+
+/*
+ * Project Includes
+ */
+
+#include "storage/common.h"
+#include "simd.h"
+
+/*
+ * Kernels
+ *
+ * One copy per ISA. SSE2 is part of the x86-64 baseline, so it needs no target options.
+ */
+
+#ifdef NM_HAVE_X86_SIMD
+
+  #define NM_SIMD_NAMESPACE sse2
+  #define NM_SIMD_BYTES     16
+  #include "simd_kernels.h"
+  #undef NM_SIMD_BYTES
+  #undef NM_SIMD_NAMESPACE
+
+  #pragma GCC push_options
+  #pragma GCC target("avx2")
+  #define NM_SIMD_NAMESPACE avx2
+  #define NM_SIMD_BYTES     32
+  #include "simd_kernels.h"
+  #undef NM_SIMD_BYTES
+  #undef NM_SIMD_NAMESPACE
+  #pragma GCC pop_options
+
+  #pragma GCC push_options
+  #pragma GCC target("avx512f,avx512bw")
+  #define NM_SIMD_NAMESPACE avx512
+  #define NM_SIMD_BYTES     64
+  #include "simd_kernels.h"
+  #undef NM_SIMD_BYTES
+  #undef NM_SIMD_NAMESPACE
+  #pragma GCC pop_options
+
+#endif
+
+namespace nm { namespace simd {
+
+/*
+ * Global Variables
+ */
+
+const char* const ISA_NAMES[NUM_ISAS] = { "none", "sse2", "avx2", "avx512" };
+
+ew_kernel_t ew_kernels[NUM_EWOPS][NUM_DTYPES];
+
+gemm_kernel_info gemm_kernels[NUM_DTYPES];
+
+static isa_t current = ISA_NONE;
+
+/*
+ * Functions
+ */
+
+/*
+ * Widest instruction set supported by both this build and the CPU we're running on.
+ */
+isa_t max_isa() {
+#ifdef NM_HAVE_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return ISA_AVX512;
+  if (__builtin_cpu_supports("avx2"))                                          return ISA_AVX2;
+  if (__builtin_cpu_supports("sse2"))                                          return ISA_SSE2;
+#endif
+  return ISA_NONE;
+}
+
+isa_t current_isa() {
+  return current;
+}
+
+/*
+ * Install the kernels for isa. The caller is responsible for checking isa <= max_isa().
+ */
+void select_isa(isa_t isa) {
+  memset(ew_kernels,   0, sizeof(ew_kernels));
+  memset(gemm_kernels, 0, sizeof(gemm_kernels));
+
+  switch (isa) {
+#ifdef NM_HAVE_X86_SIMD
+    case ISA_SSE2:   sse2::fill(ew_kernels, gemm_kernels);   break;
+    case ISA_AVX2:   avx2::fill(ew_kernels, gemm_kernels);   break;
+    case ISA_AVX512: avx512::fill(ew_kernels, gemm_kernels); break;
+#endif
+    default:         isa = ISA_NONE;
+  }
+
+  current = isa;
+}
+
+}} // end of namespace nm::simd
+
+extern "C" {
+
+/*
+ * Called from Init_nmatrix: pick the best kernels for this host.
+ */
+void nm_simd_init(void) {
+  nm::simd::select_isa(nm::simd::max_isa());
+}
+
+} // end of extern "C" block
@@ -0,0 +1,144 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == simd.h
+//
+// Vectorized element-wise kernels for the machine dtypes, with the
+// instruction set picked at load time. Each ISA's kernels are built
+// from the same source (simd_kernels.h) under a different target, so
+// a single build runs on any x86-64 host and uses the widest vectors
+// that host supports.
+
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * Standard Includes
+ */
+
+#include <cstddef>
+
+/*
+ * Project Includes
+ */
+
+#include "types.h"
+#include "data/data.h"
+
+/*
+ * Macros
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define NM_HAVE_X86_SIMD
+#endif
+
+/*
+ * Types
+ */
+
+namespace nm { namespace simd {
+
+  enum isa_t {
+    ISA_NONE   = 0,
+    ISA_SSE2   = 1,
+    ISA_AVX2   = 2,
+    ISA_AVX512 = 3
+  };
+
+  const int NUM_ISAS = 4;
+
+  /*
+   * Computes res[i] = l[i] op r[i] for i in [0, n). If r_scalar is true, r points to a single
+   * value which is used for every i. l and r have the same dtype; res is of that dtype for
+   * arithmetic, and BYTE for comparisons.
+   */
+  typedef void (*ew_kernel_t)(size_t n, const void* l, const void* r, bool r_scalar, void* res);
+
+  /*
+   * GEMM micro-kernel (see gemm.h): ab = a * b, where a is a packed mr x kc panel stored column by column,
+   * b a packed kc x GEMM_NR panel stored row by row, and ab an mr x GEMM_NR tile stored column by column.
+   */
+  typedef void (*gemm_kernel_t)(size_t kc, const void* a, const void* b, void* ab);
+
+  struct gemm_kernel_info {
+    gemm_kernel_t fn;
+    size_t        mr;
+  };
+
+  const size_t GEMM_NR = 4;
+
+  /*
+   * Data
+   */
+
+  extern const char* const ISA_NAMES[NUM_ISAS];
+
+  // NULL wherever there is no vectorized kernel for the current ISA.
+  extern ew_kernel_t ew_kernels[NUM_EWOPS][NUM_DTYPES];
+
+  // fn is NULL wherever there is no vectorized GEMM micro-kernel for the current ISA.
+  extern gemm_kernel_info gemm_kernels[NUM_DTYPES];
+
+  /*
+   * Functions
+   */
+
+  isa_t max_isa();
+  isa_t current_isa();
+  void  select_isa(isa_t isa);
+
+  /*
+   * Maps a C type to the dtype whose kernels apply to it, or -1 for the dtypes we don't vectorize.
+   */
+  template <typename T> struct kernel_dtype { static const int value = -1; };
+  template <> struct kernel_dtype<uint8_t>  { static const int value = BYTE; };
+  template <> struct kernel_dtype<int8_t>   { static const int value = INT8; };
+  template <> struct kernel_dtype<int16_t>  { static const int value = INT16; };
+  template <> struct kernel_dtype<int32_t>  { static const int value = INT32; };
+  template <> struct kernel_dtype<int64_t>  { static const int value = INT64; };
+  template <> struct kernel_dtype<float32_t> { static const int value = FLOAT32; };
+  template <> struct kernel_dtype<float64_t> { static const int value = FLOAT64; };
+
+  template <typename LDType, typename RDType>
+  struct same_dtype { static const int value = -1; };
+
+  template <typename DType>
+  struct same_dtype<DType,DType> { static const int value = kernel_dtype<DType>::value; };
+
+  /*
+   * Kernel for op on an LDType, RDType pair, or NULL if the pair has to go through the scalar path.
+   */
+  template <ewop_t op, typename LDType, typename RDType>
+  inline ew_kernel_t ew_kernel() {
+    const int dtype = same_dtype<LDType,RDType>::value;
+    return dtype < 0 ? NULL : ew_kernels[op][dtype];
+  }
+
+}} // end of namespace nm::simd
+
+extern "C" {
+  void nm_simd_init(void);
+}
+
+#endif // SIMD_H
@@ -0,0 +1,223 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == simd_kernels.h
+//
+// Body of the vectorized element-wise kernels. This file has no
+// include guard on purpose: simd.cpp includes it once per ISA, with
+// NM_SIMD_NAMESPACE and NM_SIMD_BYTES set and the matching target
+// options in effect, so that each copy is compiled for its own
+// vector width.
+
+#ifndef NM_SIMD_NAMESPACE
+  #error "simd_kernels.h must be included from simd.cpp with NM_SIMD_NAMESPACE defined"
+#endif
+
+namespace nm { namespace simd { namespace NM_SIMD_NAMESPACE {
+
+  /*
+   * GCC vector types. v is the register type; u is the same vector with aligned(1), which lets us
+   * load and store through pointers into the middle of a matrix. Attributes on a typedef are lost
+   * when it is used as a template argument, so only u is ever dereferenced and only v is ever
+   * passed around.
+   */
+  template <typename T> struct vec;
+
+  #define NM_SIMD_VEC(type)                                                 \
+  template <> struct vec<type> {                                            \
+    typedef type v __attribute__((vector_size(NM_SIMD_BYTES)));             \
+    typedef v    u __attribute__((aligned(1), may_alias));                  \
+  };
+
+  NM_SIMD_VEC(uint8_t)
+  NM_SIMD_VEC(int8_t)
+  NM_SIMD_VEC(int16_t)
+  NM_SIMD_VEC(int32_t)
+  NM_SIMD_VEC(int64_t)
+  NM_SIMD_VEC(float)
+  NM_SIMD_VEC(double)
+
+  #undef NM_SIMD_VEC
+
+  template <ewop_t op, typename V>
+  static inline V arith(V l, V r) {
+    switch (op) {
+      case EW_ADD: return l + r;
+      case EW_SUB: return l - r;
+      case EW_MUL: return l * r;
+      default:     return l / r; // EW_DIV, only registered for the float types
+    }
+  }
+
+  template <ewop_t op, typename V>
+  static inline auto comp(V l, V r) -> decltype(l == r) {
+    switch (op) {
+      case EW_EQEQ: return l == r;
+      case EW_NEQ:  return l != r;
+      case EW_LT:   return l <  r;
+      case EW_GT:   return l >  r;
+      case EW_LEQ:  return l <= r;
+      default:      return l >= r; // EW_GEQ
+    }
+  }
+
+  template <ewop_t op, typename T>
+  static void ew_arith(size_t n, const void* lv, const void* rv, bool r_scalar, void* resv) {
+    typedef typename vec<T>::v V;
+    typedef typename vec<T>::u U;
+    const size_t W = sizeof(V) / sizeof(T);
+
+    const T* l   = reinterpret_cast<const T*>(lv);
+    const T* r   = reinterpret_cast<const T*>(rv);
+    T*       res = reinterpret_cast<T*>(resv);
+    size_t   i   = 0;
+
+    if (r_scalar) {
+      const T s  = *r;
+      const V sv = V{} + s;
+      for (; i + W <= n; i += W)
+        *reinterpret_cast<U*>(res + i) = arith<op,V>(*reinterpret_cast<const U*>(l + i), sv);
+      for (; i < n; ++i) res[i] = ew_op_switch<op,T,T>(l[i], s);
+
+    } else {
+      for (; i + W <= n; i += W)
+        *reinterpret_cast<U*>(res + i) = arith<op,V>(*reinterpret_cast<const U*>(l + i), *reinterpret_cast<const U*>(r + i));
+      for (; i < n; ++i) res[i] = ew_op_switch<op,T,T>(l[i], r[i]);
+    }
+  }
+
+  /*
+   * Comparison masks are all-ones or all-zeros lanes of the operand width; narrow them to 0/1 bytes.
+   */
+  template <typename M>
+  static inline void store_mask(uint8_t* res, M m) {
+    const size_t W = sizeof(M) / sizeof(m[0]);
+    for (size_t j = 0; j < W; ++j) res[j] = m[j] & 1;
+  }
+
+  template <ewop_t op, typename T>
+  static void ew_comp(size_t n, const void* lv, const void* rv, bool r_scalar, void* resv) {
+    typedef typename vec<T>::v V;
+    typedef typename vec<T>::u U;
+    const size_t W = sizeof(V) / sizeof(T);
+
+    const T* l   = reinterpret_cast<const T*>(lv);
+    const T* r   = reinterpret_cast<const T*>(rv);
+    uint8_t* res = reinterpret_cast<uint8_t*>(resv);
+    size_t   i   = 0;
+
+    if (r_scalar) {
+      const T s  = *r;
+      const V sv = V{} + s;
+      for (; i + W <= n; i += W)
+        store_mask(res + i, comp<op,V>(*reinterpret_cast<const U*>(l + i), sv));
+      for (; i < n; ++i) res[i] = ew_comp_switch<op,T,T>(l[i], s);
+
+    } else {
+      for (; i + W <= n; i += W)
+        store_mask(res + i, comp<op,V>(*reinterpret_cast<const U*>(l + i), *reinterpret_cast<const U*>(r + i)));
+      for (; i < n; ++i) res[i] = ew_comp_switch<op,T,T>(l[i], r[i]);
+    }
+  }
+
+  /*
+   * GEMM micro-kernel for an mr x GEMM_NR tile, mr being two vectors' worth of rows. The eight accumulators
+   * stay in registers for the whole inner loop, which does two vector loads from a and four broadcasts from
+   * b per step. Integer products wrap, which gives the same result as the reference gemm's truncation.
+   */
+  template <typename T>
+  static void gemm_kernel(size_t kc, const void* av, const void* bv, void* abv) {
+    typedef typename vec<T>::v V;
+    typedef typename vec<T>::u U;
+    const size_t W = sizeof(V) / sizeof(T), MR = 2 * W;
+
+    const T* a  = reinterpret_cast<const T*>(av);
+    const T* b  = reinterpret_cast<const T*>(bv);
+    T*       ab = reinterpret_cast<T*>(abv);
+
+    V c00 = V{}, c01 = V{}, c02 = V{}, c03 = V{},
+      c10 = V{}, c11 = V{}, c12 = V{}, c13 = V{};
+
+    for (size_t l = 0; l < kc; ++l, a += MR, b += GEMM_NR) {
+      const V a0 = *reinterpret_cast<const U*>(a),
+              a1 = *reinterpret_cast<const U*>(a + W);
+      V bj;
+
+      bj = V{} + b[0];  c00 += a0 * bj;  c10 += a1 * bj;
+      bj = V{} + b[1];  c01 += a0 * bj;  c11 += a1 * bj;
+      bj = V{} + b[2];  c02 += a0 * bj;  c12 += a1 * bj;
+      bj = V{} + b[3];  c03 += a0 * bj;  c13 += a1 * bj;
+    }
+
+    *reinterpret_cast<U*>(ab + 0*MR) = c00;  *reinterpret_cast<U*>(ab + 0*MR + W) = c10;
+    *reinterpret_cast<U*>(ab + 1*MR) = c01;  *reinterpret_cast<U*>(ab + 1*MR + W) = c11;
+    *reinterpret_cast<U*>(ab + 2*MR) = c02;  *reinterpret_cast<U*>(ab + 2*MR + W) = c12;
+    *reinterpret_cast<U*>(ab + 3*MR) = c03;  *reinterpret_cast<U*>(ab + 3*MR + W) = c13;
+  }
+
+  #define NM_SIMD_COMP_KERNELS(table, dtype, type)       \
+    table[EW_EQEQ][dtype] = ew_comp<EW_EQEQ,type>;       \
+    table[EW_NEQ][dtype]  = ew_comp<EW_NEQ,type>;        \
+    table[EW_LT][dtype]   = ew_comp<EW_LT,type>;         \
+    table[EW_GT][dtype]   = ew_comp<EW_GT,type>;         \
+    table[EW_LEQ][dtype]  = ew_comp<EW_LEQ,type>;        \
+    table[EW_GEQ][dtype]  = ew_comp<EW_GEQ,type>;
+
+  #define NM_SIMD_INT_KERNELS(table, dtype, type)        \
+    table[EW_ADD][dtype]  = ew_arith<EW_ADD,type>;       \
+    table[EW_SUB][dtype]  = ew_arith<EW_SUB,type>;       \
+    table[EW_MUL][dtype]  = ew_arith<EW_MUL,type>;       \
+    NM_SIMD_COMP_KERNELS(table, dtype, type)
+
+  // Integer division floors and raises on zero, so it stays on the scalar path.
+  #define NM_SIMD_FLOAT_KERNELS(table, dtype, type)      \
+    NM_SIMD_INT_KERNELS(table, dtype, type)              \
+    table[EW_DIV][dtype]  = ew_arith<EW_DIV,type>;
+
+  // Only the integer dtypes: float32 and float64 GEMM always goes through CBLAS.
+  #define NM_SIMD_GEMM_KERNEL(table, dtype, type)        \
+    table[dtype].fn = gemm_kernel<type>;                 \
+    table[dtype].mr = 2 * NM_SIMD_BYTES / sizeof(type);
+
+  void fill(ew_kernel_t table[NUM_EWOPS][NUM_DTYPES], gemm_kernel_info gemm_table[NUM_DTYPES]) {
+    NM_SIMD_INT_KERNELS(table,   BYTE,    uint8_t)
+    NM_SIMD_INT_KERNELS(table,   INT8,    int8_t)
+    NM_SIMD_INT_KERNELS(table,   INT16,   int16_t)
+    NM_SIMD_INT_KERNELS(table,   INT32,   int32_t)
+    NM_SIMD_INT_KERNELS(table,   INT64,   int64_t)
+    NM_SIMD_FLOAT_KERNELS(table, FLOAT32, float)
+    NM_SIMD_FLOAT_KERNELS(table, FLOAT64, double)
+
+    NM_SIMD_GEMM_KERNEL(gemm_table, BYTE,  uint8_t)
+    NM_SIMD_GEMM_KERNEL(gemm_table, INT8,  int8_t)
+    NM_SIMD_GEMM_KERNEL(gemm_table, INT16, int16_t)
+    NM_SIMD_GEMM_KERNEL(gemm_table, INT32, int32_t)
+    NM_SIMD_GEMM_KERNEL(gemm_table, INT64, int64_t)
+  }
+
+  #undef NM_SIMD_GEMM_KERNEL
+  #undef NM_SIMD_FLOAT_KERNELS
+  #undef NM_SIMD_INT_KERNELS
+  #undef NM_SIMD_COMP_KERNELS
+
+}}} // end of namespace nm::simd::NM_SIMD_NAMESPACE
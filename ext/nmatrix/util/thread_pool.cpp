@@ -0,0 +1,175 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == thread_pool.cpp
+//
+// Worker threads for the parallel dense kernels.
+
+/*
+ * Standard Includes
+ */
+
+#include <ruby.h>
+#include <pthread.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Project Includes
+ */
+
+#include "thread_pool.h"
+
+namespace nm { namespace thread_pool {
+
+/*
+ * Global Variables
+ */
+
+static size_t n_threads = 1;
+static size_t min_work  = NM_DEFAULT_PARALLEL_THRESHOLD;
+
+/*
+ * Workers are started the first time they're needed. Worker i (from 1) runs task i of each job; the
+ * thread that submitted the job runs task 0.
+ *
+ * The pool lives on the heap and is never freed: the workers are still waiting on its condition variables
+ * when the process exits, and destroying those would hang.
+ */
+struct pool_t {
+  std::vector<std::thread*> workers;
+
+  std::mutex              busy;   // held by whoever is currently submitting jobs
+  std::mutex              lock;   // protects everything below
+  std::condition_variable wake, done;
+
+  size_t generation, pending, n_tasks;
+  task_t fn;
+  void*  arg;
+
+  pool_t() : generation(0), pending(0), n_tasks(0), fn(NULL), arg(NULL) { }
+};
+
+static pool_t* pool = new pool_t;
+
+/*
+ * Functions
+ */
+
+static void worker_main(size_t id) {
+  size_t seen = 0;
+
+  for (;;) {
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->wake.wait(guard, [&seen]() { return pool->generation != seen; });
+    seen = pool->generation;
+
+    if (id >= pool->n_tasks) continue;
+
+    task_t fn  = pool->fn;
+    void*  arg = pool->arg;
+    guard.unlock();
+
+    fn(id, arg);
+
+    guard.lock();
+    if (--pool->pending == 0) pool->done.notify_one();
+  }
+}
+
+/*
+ * Make sure there are at least n-1 workers.
+ */
+static void ensure_workers(size_t n) {
+  while (pool->workers.size() + 1 < n)
+    pool->workers.push_back(new std::thread(worker_main, pool->workers.size() + 1));
+}
+
+size_t num_threads() {
+  return n_threads;
+}
+
+void set_num_threads(size_t n) {
+  n_threads = n < 1 ? 1 : n;
+}
+
+size_t threshold() {
+  return min_work;
+}
+
+void set_threshold(size_t n) {
+  min_work = n;
+}
+
+/*
+ * Threads don't survive a fork, and the child gets the mutexes in whatever state they were in at the time --
+ * possibly held by a thread which no longer exists. So the child starts over with a fresh pool, and the old one
+ * (workers, mutexes and all) is deliberately leaked.
+ */
+static void reset_after_fork() {
+  pool = new pool_t;
+}
+
+void run(size_t n_tasks, task_t fn, void* arg) {
+  std::unique_lock<std::mutex> owner(pool->busy, std::try_to_lock);
+
+  if (!owner.owns_lock() || n_tasks <= 1) {
+    for (size_t t = 0; t < n_tasks; ++t) fn(t, arg);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    ensure_workers(n_tasks);
+
+    pool->fn      = fn;
+    pool->arg     = arg;
+    pool->n_tasks = n_tasks;
+    pool->pending = n_tasks - 1;
+    ++pool->generation;
+  }
+  pool->wake.notify_all();
+
+  fn(0, arg);
+
+  std::unique_lock<std::mutex> guard(pool->lock);
+  pool->done.wait(guard, []() { return pool->pending == 0; });
+}
+
+}} // end of namespace nm::thread_pool
+
+extern "C" {
+
+/*
+ * Called from Init_nmatrix: one thread per core by default.
+ */
+void nm_thread_pool_init(void) {
+  size_t n = std::thread::hardware_concurrency();
+  nm::thread_pool::set_num_threads(n > 0 ? n : 1);
+
+  pthread_atfork(NULL, NULL, nm::thread_pool::reset_after_fork);
+}
+
+} // end of extern "C" block
@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////
+// = NMatrix
+//
+// A linear algebra library for scientific computation in Ruby.
+// NMatrix is part of SciRuby.
+//
+// NMatrix was originally inspired by and derived from NArray, by
+// Masahiro Tanaka: http://narray.rubyforge.org
+//
+// == Copyright Information
+//
+// SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+// NMatrix is Copyright (c) 2013, Ruby Science Foundation
+//
+// Please see LICENSE.txt for additional copyright notices.
+//
+// == Contributing
+//
+// By contributing source code to SciRuby, you agree to be bound by
+// our Contributor Agreement:
+//
+// * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+//
+// == thread_pool.h
+//
+// A small pool of worker threads for the heavy dense kernels, and
+// helpers for running them with the GVL released so that other Ruby
+// threads keep going in the meantime.
+//
+// Work is always split into the same contiguous blocks for a given
+// thread count, so results are reproducible run to run. Code that
+// runs without the GVL must not touch the Ruby API in any way: no
+// rb_raise, no ALLOC, and no RubyObject elements.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/*
+ * Standard Includes
+ */
+
+#include <ruby.h>
+#include <cstddef>
+
+#ifdef HAVE_RUBY_THREAD_H
+  #include <ruby/thread.h>
+#endif
+
+/*
+ * Project Includes
+ */
+
+/*
+ * Macros
+ */
+
+// Below this many elements (or multiply-adds), operations run on the calling thread and keep the GVL.
+#define NM_DEFAULT_PARALLEL_THRESHOLD 65536
+
+namespace nm { namespace thread_pool {
+
+/*
+ * Types
+ */
+
+typedef void (*task_t)(size_t task, void* arg);
+
+/*
+ * Functions
+ */
+
+size_t num_threads();
+void   set_num_threads(size_t n);
+
+size_t threshold();
+void   set_threshold(size_t n);
+
+/*
+ * Calls fn(t, arg) for every t in [0, n_tasks), on the pool's workers and the calling thread, and
+ * returns once they've all finished. n_tasks must not exceed num_threads(). If the pool is already
+ * busy (e.g., another Ruby thread is using it), the tasks simply run one after another here.
+ */
+void run(size_t n_tasks, task_t fn, void* arg);
+
+/*
+ * Templated Functions
+ */
+
+template <typename F>
+static void* call_without_gvl(void* f) {
+  (*reinterpret_cast<F*>(f))();
+  return NULL;
+}
+
+/*
+ * Calls f() with the GVL released.
+ */
+template <typename F>
+inline void without_gvl(F f) {
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+  rb_thread_call_without_gvl(call_without_gvl<F>, &f, NULL, NULL);
+#else
+  f();
+#endif
+}
+
+template <typename F>
+struct block_job {
+  F      f;
+  size_t n, n_tasks;
+
+  static void run(size_t t, void* arg) {
+    block_job* job = reinterpret_cast<block_job*>(arg);
+    size_t begin = job->n * t / job->n_tasks, end = job->n * (t+1) / job->n_tasks;
+    if (begin < end) job->f(begin, end);
+  }
+};
+
+/*
+ * Splits [0, n) into one contiguous block per thread and calls f(begin, end) on each, in parallel, without
+ * touching the GVL. For code that's already running without it; otherwise use parallel_for.
+ */
+template <typename F>
+inline void for_blocks(size_t n, F f) {
+  block_job<F> job = { f, n, n < num_threads() ? n : num_threads() };
+
+  if (job.n_tasks <= 1) job.f(0, job.n);
+  else                  run(job.n_tasks, block_job<F>::run, &job);
+}
+
+/*
+ * Splits [0, n) into one contiguous block per thread and calls f(begin, end) on each, in parallel.
+ *
+ * work is a rough measure of the total cost (elements touched, multiply-adds, ...). Below threshold(),
+ * or if nogvl is false because f might call into Ruby, f(0, n) just runs here with the GVL held.
+ * Otherwise the GVL is released for the duration, even if there's only one thread to run on.
+ */
+template <typename F>
+inline void parallel_for(size_t work, bool nogvl, size_t n, F f) {
+  if (!nogvl || work < threshold() || n == 0) {
+    f(0, n);
+    return;
+  }
+
+  without_gvl([n, &f]() { for_blocks(n, f); });
+}
+
+}} // end of namespace nm::thread_pool
+
+extern "C" {
+  void nm_thread_pool_init(void);
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,156 @@
+#--
+# = NMatrix
+#
+# A linear algebra library for scientific computation in Ruby.
+# NMatrix is part of SciRuby.
+#
+# NMatrix was originally inspired by and derived from NArray, by
+# Masahiro Tanaka: http://narray.rubyforge.org
+#
+# == Copyright Information
+#
+# SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+# NMatrix is Copyright (c) 2013, Ruby Science Foundation
+#
+# Please see LICENSE.txt for additional copyright notices.
+#
+# == Contributing
+#
+# By contributing source code to SciRuby, you agree to be bound by
+# our Contributor Agreement:
+#
+# * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+#
+# == lazy.rb
+#
+# Lazily evaluated element-wise expressions. Rather than allocating a
+# new matrix for every operator in an expression like a*b + c - d/2,
+# the operators record themselves, and the whole expression is
+# evaluated at the end in one pass over the result.
+#++
+
+class NMatrix
+  # call-seq:
+  #     lazy -> NMatrix::Lazy
+  #
+  # Returns a lazy version of this matrix: element-wise arithmetic on it
+  # (+, -, *, /) builds up an expression instead of computing anything.
+  # Call #to_nm on the expression to evaluate it.
+  #
+  #   (a.lazy * b + c - d / 2).to_nm
+  #
+  def lazy
+    NMatrix::Lazy.new([self])
+  end
+
+  class << self
+    # call-seq:
+    #     NMatrix.lazy(*matrices) { |*lazy_matrices| ... } -> NMatrix
+    #
+    # Yields lazy versions of the given matrices, and evaluates whatever
+    # expression the block returns.
+    #
+    #   NMatrix.lazy(a, b, c, d) { |a, b, c, d| a*b + c - d/2 }
+    #
+    def lazy(*matrices)
+      result = yield(*matrices.map { |m| m.lazy })
+      result.is_a?(NMatrix::Lazy) ? result.to_nm : result
+    end
+  end
+
+  #
+  # An element-wise expression over dense matrices and scalars, stored in
+  # postfix order. Results are exactly those of the non-lazy operators.
+  #
+  class Lazy
+    OPERATORS = [:+, :-, :*, :/]
+
+    def initialize(program) #:nodoc:
+      @program = program
+    end
+
+    OPERATORS.each do |op|
+      define_method(op) do |other|
+        NMatrix::Lazy.new(@program + operand(other) << op)
+      end
+    end
+
+    # call-seq:
+    #     shape -> Array
+    #
+    # Shape of the result: that of the matrices, broadcast against each
+    # other as the non-lazy operators would.
+    def shape
+      shapes = @program.select { |t| t.is_a?(NMatrix) }.map(&:shape)
+      dim    = shapes.map(&:size).max
+      (0...dim).map do |d|
+        shapes.map { |s| d + s.size >= dim ? s[d + s.size - dim] : 1 }.max
+      end
+    end
+
+    # call-seq:
+    #     dtype -> Symbol
+    #
+    # Dtype of the result. As with the non-lazy operators, this is the
+    # dtype of the leftmost matrix.
+    def dtype
+      @program.first.dtype
+    end
+
+    # call-seq:
+    #     to_nm -> NMatrix
+    #
+    # Evaluates the expression. Dense matrices which all share one dtype
+    # and shape are evaluated in a single fused pass; anything else
+    # (including broadcasting) falls back to applying the operators one
+    # at a time.
+    def to_nm
+      return @program.first.clone if @program.size == 1
+      NMatrix.__ew_fused__(@program) || evaluate_unfused
+    end
+    alias :evaluate :to_nm
+
+    def inspect #:nodoc:
+      stack = @program.map do |t|
+        if OPERATORS.include?(t) then t
+        elsif t.is_a?(NMatrix)   then "#<NMatrix #{t.shape.inspect}>"
+        else                          t.inspect
+        end
+      end
+      "#<NMatrix::Lazy #{infix(stack.reverse)}>"
+    end
+
+  protected
+
+    attr_reader :program
+
+    def operand(other)
+      case other
+      when NMatrix::Lazy then other.program
+      when NMatrix, Numeric then [other]
+      else raise(ArgumentError, "cannot apply an element-wise operation to #{other.class}")
+      end
+    end
+
+    def evaluate_unfused
+      stack = []
+      @program.each do |t|
+        if OPERATORS.include?(t)
+          right = stack.pop
+          stack.push(stack.pop.send(t, right))
+        else
+          stack.push(t)
+        end
+      end
+      stack.first
+    end
+
+    # Turns the reversed postfix token list into an infix string (for inspect).
+    def infix(stack)
+      t = stack.shift
+      return t unless t.is_a?(Symbol)
+      right = infix(stack)
+      "(#{infix(stack)} #{t} #{right})"
+    end
+  end
+end
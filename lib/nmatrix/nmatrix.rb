@@ -30,6 +30,7 @@
 require_relative './shortcuts.rb'
 require_relative './lapack.rb'
 require_relative './yale_functions.rb'
+require_relative './lazy.rb'
 
 class NMatrix
   # Read and write extensions for NMatrix. These are only loaded when needed.
@@ -378,7 +379,7 @@ class NMatrix
   # @see #reduce_along_dim
   #
   def mean(dimen=0)
-    reduce_along_dim(dimen, 0.0) do |mean, sub_mat|
+    __reduce__(:mean, dimen) || reduce_along_dim(dimen, 0.0) do |mean, sub_mat|
       mean + sub_mat/shape[dimen]
     end
   end
@@ -391,11 +392,25 @@ class NMatrix
   #
   # @see #reduce_along_dim
   def sum(dimen=0)
-    reduce_along_dim(dimen, 0.0) do |sum, sub_mat|
+    __reduce__(:sum, dimen) || reduce_along_dim(dimen, 0.0) do |sum, sub_mat|
       sum + sub_mat
     end
   end
 
+  #
+  # call-seq:
+  #     prod -> ...
+  #
+  # Calculates the product along the specified dimension.
+  #
+  # @see #reduce_along_dim
+  #
+  def prod(dimen=0)
+    __reduce__(:prod, dimen) || reduce_along_dim(dimen, 1.0) do |prod, sub_mat|
+      prod * sub_mat
+    end
+  end
+
 
   #
   # call-seq:
@@ -406,7 +421,7 @@ class NMatrix
   # @see #reduce_along_dim
   #
   def min(dimen=0)
-    reduce_along_dim(dimen, Float::MAX) do |min, sub_mat|
+    __reduce__(:min, dimen) || reduce_along_dim(dimen, Float::MAX) do |min, sub_mat|
       min * (min <= sub_mat) + ((min)*0.0 + (min > sub_mat)) * sub_mat
     end
   end
@@ -420,7 +435,7 @@ class NMatrix
   # @see #reduce_along_dim
   #
   def max(dimen=0)
-    reduce_along_dim(dimen, -1.0*Float::MAX) do |max, sub_mat|
+    __reduce__(:max, dimen) || reduce_along_dim(dimen, -1.0*Float::MAX) do |max, sub_mat|
       max * (max >= sub_mat) + ((max)*0.0 + (max < sub_mat)) * sub_mat
     end
   end
@@ -435,6 +450,9 @@ class NMatrix
   # @see #reduce_along_dim
   #
   def variance(dimen=0)
+    native = __reduce__(:variance, dimen)
+    return native if native
+
     m = mean(dimen)
     reduce_along_dim(dimen, 0.0) do |var, sub_mat|
       var + (m - sub_mat)*(m - sub_mat)/(shape[dimen]-1)
@@ -450,7 +468,7 @@ class NMatrix
   # @see #reduce_along_dim
   #
   def std(dimen=0)
-    variance(dimen).map! { |e| Math.sqrt(e) }
+    __reduce__(:std, dimen) || variance(dimen).map! { |e| Math.sqrt(e) }
   end
 
   #
@@ -580,6 +598,8 @@ protected
           "lu:#{__yale_ary__to_s(:lu)}" << "yale_size:#{__yale_size__}"
       end
 
+    elsif stype == :bsr
+      ary << "block_shape:[#{block_shape.join(',')}]" << "capacity:#{capacity}"
     end
 
     ary
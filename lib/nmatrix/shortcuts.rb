@@ -280,6 +280,62 @@ as dimension."
       NMatrix.seq(size, :complex64)
     end
 
+    #
+    # call-seq:
+    #     from_coo(shape, rows, cols, values) -> NMatrix
+    #     from_coo(shape, rows, cols, values, dtype: dtype) -> NMatrix
+    #
+    # Builds a +:yale+ matrix from coordinate (COO) triplets: element k is
+    # <tt>values[k]</tt>, at row <tt>rows[k]</tt> and column <tt>cols[k]</tt>.
+    # The triplets may come in any order. Values given more than once for the
+    # same cell are added together, and cells which come out zero aren't
+    # stored.
+    #
+    # This sorts the triplets and writes the matrix out in one pass, so it's
+    # much faster than setting the elements one by one.
+    #
+    # * *Arguments* :
+    #   - +shape+ -> Array (or integer for square matrix) specifying the dimensions.
+    #   - +rows+, +cols+ -> Indices, as dense NMatrix/NVector objects of any integer dtype, Arrays, or packed binary Strings.
+    #   - +values+ -> Values, as a dense NMatrix/NVector, an Array, or a packed binary String.
+    # * *Options* :
+    #   - +:dtype+ -> Dtype of the result. Defaults to the dtype of +values+ if it's an NMatrix, and +:float64+ otherwise.
+    #   - +:index_dtype+ -> Dtype of +rows+ and +cols+ when they're Strings. Defaults to +:int64+.
+    #   - +:values_dtype+ -> Dtype of +values+ when it's a String. Defaults to +:dtype+.
+    # * *Returns* :
+    #   - A +:yale+ NMatrix.
+    #
+    # Examples:
+    #
+    #   NMatrix.from_coo([2, 3], [0, 1, 1], [2, 0, 0], [5, 1, 2], dtype: :int32)  # => 0  0  5
+    #                                                                                  3  0  0
+    #
+    def from_coo(shape, rows, cols, values, opts = {})
+      dtype = opts[:dtype] || (values.is_a?(NMatrix) ? values.dtype : :float64)
+      index_dtype = opts[:index_dtype] || :int64
+
+      NMatrix.__from_coo__(shape, coo_operand(rows, index_dtype), coo_operand(cols, index_dtype),
+                           coo_operand(values, opts[:values_dtype] || dtype), dtype)
+    end
+
+  private
+
+    # Puts an argument to from_coo into a form __from_coo__ accepts.
+    def coo_operand(v, dtype) #:nodoc:
+      case v
+      when String then [v, dtype]
+      when Array
+        if dtype == :int64 then [v.pack("q*"), :int64]
+        elsif v.empty?     then ["", dtype]
+        else                    NMatrix.new(:dense, [v.size, 1], v, dtype)
+        end
+      when NMatrix
+        v.stype == :dense && !v.is_ref? ? v : v.cast(:dense, v.dtype)
+      else
+        raise(ArgumentError, "expected an NMatrix, an Array or a String, not #{v.class}")
+      end
+    end
+
   end
 
   #
@@ -0,0 +1,55 @@
+#!/usr/bin/env ruby
+# = NMatrix
+#
+# A linear algebra library for scientific computation in Ruby.
+# NMatrix is part of SciRuby.
+#
+# == benchmark_simd.rb
+#
+# Microbenchmark for the vectorized dense element-wise kernels. For
+# each dtype and operation, times the same matrix-matrix and
+# matrix-scalar operations with the kernels disabled (:none) and
+# under every instruction set the CPU supports, and prints the
+# speedup over :none.
+#
+# Usage: ruby -Ilib scripts/benchmark_simd.rb [elements] [repetitions]
+
+require File.expand_path(File.join(File.dirname(__FILE__), "..", "lib", "nmatrix"))
+require "benchmark"
+
+SIZE  = (ARGV[0] || 1_000_000).to_i
+REPS  = (ARGV[1] || 20).to_i
+ISAS  = [:none, :sse2, :avx2, :avx512]
+BEST  = NMatrix.simd_isa
+AVAIL = ISAS[0..ISAS.index(BEST)]
+
+DTYPES = [:byte, :int8, :int16, :int32, :int64, :float32, :float64]
+OPS    = { "+" => :+, "-" => :-, "*" => :*, "/" => :/, "<" => :<, "=~" => :=~ }
+
+def time_op(a, b, op)
+  Benchmark.realtime { REPS.times { a.send(op, b) } } / REPS
+end
+
+puts "#{SIZE} elements, #{REPS} repetitions, best ISA: #{BEST}"
+puts "%-8s %-4s %-7s %12s  %s" % ["dtype", "op", "rhs", "none (ms)", AVAIL[1..-1].map { |i| "%8s" % i }.join(" ")]
+
+DTYPES.each do |dtype|
+  a = NMatrix.new(:dense, [SIZE], (1..SIZE).map { |i| i % 100 + 1 }, dtype)
+  b = NMatrix.new(:dense, [SIZE], (1..SIZE).map { |i| i % 7 + 1 }, dtype)
+
+  OPS.each_pair do |name, op|
+    next if op == :/ && ![:float32, :float64].include?(dtype) # integer division is never vectorized
+
+    { "matrix" => b, "scalar" => 3 }.each_pair do |rhs_name, rhs|
+      times = AVAIL.map do |isa|
+        NMatrix.simd_isa = isa
+        time_op(a, rhs, op)
+      end
+
+      speedups = times[1..-1].map { |t| "%7.2fx" % (times[0] / t) }
+      puts "%-8s %-4s %-7s %12.3f  %s" % [dtype, name, rhs_name, times[0] * 1000, speedups.join(" ")]
+    end
+  end
+end
+
+NMatrix.simd_isa = BEST
@@ -176,5 +176,277 @@ describe NMatrix do
         r.should == NMatrix.new(:dense, [2,2], [1, 1, 0, 1], :byte)
       end
     end
+
+    context "vectorized kernels" do
+      after :each do
+        NMatrix.simd_isa = @isa
+      end
+
+      before :each do
+        @isa = NMatrix.simd_isa
+      end
+
+      it "reports the instruction set in use" do
+        [:none, :sse2, :avx2, :avx512].should include(NMatrix.simd_isa)
+      end
+
+      it "gives the same results as the scalar path" do
+        [:byte, :int8, :int16, :int32, :int64, :float32, :float64].each do |dtype|
+          n = NMatrix.new(:dense, [5,13], (0...65).map { |i| (i*7) % 13 + 1 }, dtype)
+          m = NMatrix.new(:dense, [5,13], (0...65).map { |i| (i*5) % 11 + 1 }, dtype)
+
+          ops = lambda { [n+m, n-m, n*m, n/m, n+3, n*2, n<m, n>=m, n<=6, n.send(:=~, m)] }
+
+          NMatrix.simd_isa = :none
+          expected = ops.call
+
+          NMatrix.simd_isa = @isa
+          ops.call.should == expected
+        end
+      end
+
+      it "refuses an unknown instruction set" do
+        expect { NMatrix.simd_isa = :mmx }.to raise_error(ArgumentError)
+      end
+
+      it "wants the instruction set as a symbol" do
+        expect { NMatrix.simd_isa = "sse2" }.to raise_error(TypeError)
+        expect { NMatrix.simd_isa = 1 }.to raise_error(TypeError)
+      end
+    end
+
+    context "elementwise operations on references" do
+      before :each do
+        @n = NMatrix.new(:dense, [3,3], (1..9).to_a, :int64)
+        @m = NMatrix.new(:dense, [3,3], (1..9).map { |x| x*10 }, :int64)
+      end
+
+      it "adds slices with different offsets" do
+        r = @n[0..1, 1..2] + @m[1..2, 0..1]
+        r.should == NMatrix.new(:dense, [2,2], [42, 53, 75, 86], :int64)
+      end
+
+      it "operates on a slice and a scalar" do
+        r = @n[1..2, 0..2] * 2
+        r.should == NMatrix.new(:dense, [2,3], [8, 10, 12, 14, 16, 18], :int64)
+      end
+
+      it "compares a slice with a matrix" do
+        r = @n[0..2, 1..1] > NMatrix.new(:dense, [3,1], [2, 5, 9], :int64)
+        r.should == NMatrix.new(:dense, [3,1], [0, 0, 0], :byte)
+        r = @n[0..2, 2..2] >= NMatrix.new(:dense, [3,1], [2, 7, 9], :int64)
+        r.should == NMatrix.new(:dense, [3,1], [1, 0, 1], :byte)
+      end
+    end
+
+    context "in-place operations" do
+      it "adds into a dense reference, writing through to the source" do
+        n = NMatrix.new(:dense, [3,3], (1..9).to_a, :int64)
+        n[0..1, 1..2].add!(NMatrix.new(:dense, [2,2], [10, 20, 30, 40], :int64))
+        n.should == NMatrix.new(:dense, [3,3], [1, 12, 23, 4, 35, 46, 7, 8, 9], :int64)
+      end
+
+      it "returns the receiver" do
+        n = NMatrix.new(:dense, [2,2], [1, 2, 3, 4], :float64)
+        n.mul!(2).should equal(n)
+        n.should == NMatrix.new(:dense, [2,2], [2.0, 4.0, 6.0, 8.0], :float64)
+      end
+
+      it "refuses an operation that would need to upcast the receiver" do
+        n = NMatrix.new(:dense, [2,2], [1, 2, 3, 4], :int32)
+        expect { n.add!(1.5) }.to raise_error(DataTypeError)
+        expect { n.add!(NMatrix.new(:dense, [2,2], [1, 2, 3, 4], :float64)) }.to raise_error(DataTypeError)
+      end
+
+      it "operates in place on list matrices" do
+        n = NMatrix.new(:list, [2,2], 0, :int64)
+        n[0,0] = 3
+        m = NMatrix.new(:list, [2,2], 0, :int64)
+        m[0,0] = 1
+        m[1,1] = 4
+        n.add!(m)
+        n[0,0].should == 4
+        n[1,1].should == 4
+        n[0,1].should == 0
+        n.sub!(4)
+        n[0,0].should == 0
+        n[0,1].should == -4
+      end
+
+      it "operates in place on yale matrices" do
+        n = NMatrix.new(:yale, [3,3], 3, :int64)
+        n[0,0] = 1
+        n[0,2] = 2
+        n[2,1] = 3
+        m = NMatrix.new(:yale, [3,3], 3, :int64)
+        m[0,2] = 5
+        m[1,0] = 7
+        n.mul!(2)
+        n[0,2].should == 4
+        n.add!(m)
+        n[0,0].should == 2
+        n[0,2].should == 9
+        n[1,0].should == 7
+        n[2,1].should == 6
+        n[1,1].should == 0
+      end
+    end
+
+    context "lazy expressions" do
+      before :each do
+        @a = NMatrix.new(:dense, [3,4], (1..12).to_a, :float64)
+        @b = NMatrix.new(:dense, [3,4], (1..12).map { |x| x * 0.5 }, :float64)
+        @c = NMatrix.new(:dense, [3,4], (1..12).map { |x| 13 - x }, :float64)
+      end
+
+      it "gives the same result as the eager operators" do
+        (@a.lazy * @b + @c - @a / 2).to_nm.should == @a * @b + @c - @a / 2
+        NMatrix.lazy(@a, @b, @c) { |a, b, c| a - (b + c) * 3 }.should == @a - (@b + @c) * 3
+      end
+
+      it "fuses expressions over references" do
+        x = @a[0..1, 1..3]
+        y = @c[1..2, 0..2]
+        (x.lazy + y * 2).to_nm.should == x + y * 2
+      end
+
+      it "falls back to eager evaluation for mixed dtypes" do
+        i = NMatrix.new(:dense, [3,4], (1..12).to_a, :int32)
+        r = (i.lazy / 2 + @a).to_nm
+        r.dtype.should == :int32
+        r.should == i / 2 + @a
+      end
+
+      it "broadcasts operands of different shapes like the eager operators" do
+        row = NMatrix.new(:dense, [1,4], [1, 2, 3, 4], :float64)
+        (row.lazy + @a).shape.should == [3,4]
+        (@a.lazy + row).to_nm.should == @a + row
+        (@a.lazy * 2 - row).to_nm.should == @a * 2 - row
+      end
+
+      it "keeps integer division semantics" do
+        i = NMatrix.new(:dense, [2,2], [-7, 7, 9, -9], :int64)
+        j = NMatrix.new(:dense, [2,2], [2, -2, 4, 4], :int64)
+        (i.lazy / j + 1).to_nm.should == i / j + 1
+      end
+    end
+
+    context "multiple threads" do
+      before :each do
+        @threads, @threshold = NMatrix.num_threads, NMatrix.parallel_threshold
+        NMatrix.parallel_threshold = 1
+      end
+
+      after :each do
+        NMatrix.num_threads, NMatrix.parallel_threshold = @threads, @threshold
+      end
+
+      it "gives the same results as a single thread" do
+        n = NMatrix.new(:dense, [7,9,5], (0...315).map { |i| i % 17 + 1 }, :float64)
+        m = NMatrix.new(:dense, [7,9,5], (0...315).map { |i| i % 5 + 1 }, :float64)
+        ops = lambda { [n+m, n*3, n[1..5, 2..7, 0..4] - m[0..4, 0..5, 0..4], n > m, (n.lazy * m - n / 2).to_nm, n.cast(:dense, :int32)] }
+
+        NMatrix.num_threads = 1
+        expected = ops.call
+
+        NMatrix.num_threads = 4
+        ops.call.should == expected
+      end
+
+      it "refuses fewer than one thread" do
+        expect { NMatrix.num_threads = 0 }.to raise_error(ArgumentError)
+      end
+    end
+
+    context "broadcasting" do
+      before :each do
+        @m = NMatrix.new(:dense, [2,3], [1, 2, 3, 4, 5, 6], :int64)
+      end
+
+      it "stretches a row across every row" do
+        r = NMatrix.new(:dense, [1,3], [10, 20, 30], :int64)
+        (@m + r).should == NMatrix.new(:dense, [2,3], [11, 22, 33, 14, 25, 36], :int64)
+        (r - @m).should == NMatrix.new(:dense, [2,3], [9, 18, 27, 6, 15, 24], :int64)
+      end
+
+      it "stretches a column across every column, and adds missing leading dimensions" do
+        c = NMatrix.new(:dense, [2,1], [10, 100], :int64)
+        (@m * c).should == NMatrix.new(:dense, [2,3], [10, 20, 30, 400, 500, 600], :int64)
+
+        v = NMatrix.new(:dense, [3], [1, 0, 1], :int64)
+        (@m > v).should == NMatrix.new(:dense, [2,3], [0, 1, 1, 1, 1, 1], :byte)
+      end
+
+      it "broadcasts both sides at once" do
+        c = NMatrix.new(:dense, [2,1], [1, 2], :int64)
+        r = NMatrix.new(:dense, [1,3], [10, 20, 30], :int64)
+        (c + r).should == NMatrix.new(:dense, [2,3], [11, 21, 31, 12, 22, 32], :int64)
+      end
+
+      it "broadcasts the right-hand side of an in-place operation" do
+        @m.sub!(NMatrix.new(:dense, [1,3], [1, 2, 3], :int64))
+        @m.should == NMatrix.new(:dense, [2,3], [0, 0, 0, 3, 3, 3], :int64)
+        expect { NMatrix.new(:dense, [1,3], [1, 2, 3], :int64).add!(@m) }.to raise_error(ArgumentError)
+      end
+
+      it "stretches a reference to a row of a larger matrix" do
+        big = NMatrix.new(:dense, [3,3], [1, 2, 3, 10, 20, 30, 100, 200, 300], :int64)
+        (@m + big[1..1, 0..2]).should == NMatrix.new(:dense, [2,3], [11, 22, 33, 14, 25, 36], :int64)
+        (@m * big[0..1, 2..2]).should == NMatrix.new(:dense, [2,3], [3, 6, 9, 120, 150, 180], :int64)
+      end
+
+      it "refuses incompatible shapes" do
+        expect { @m + NMatrix.new(:dense, [2,2], [1, 2, 3, 4], :int64) }.to raise_error(ArgumentError)
+      end
+    end
+  end
+
+  context "yale" do
+    before :each do
+      @m = NMatrix.new(:yale, [3,4], :int64)
+      @m[0,0] = 2
+      @m[0,3] = -4
+      @m[2,1] = 6
+      @m.extend(NMatrix::YaleFunctions)
+    end
+
+    it "scales by a scalar without changing the structure" do
+      n = (@m * 3).extend(NMatrix::YaleFunctions)
+      n.stype.should == :yale
+      n.dtype.should == :int64
+      n.yale_ija.compact.should == @m.yale_ija.compact
+      n[0,0].should == 6
+      n[0,3].should == -12
+      n[2,1].should == 18
+      n[1,2].should == 0
+    end
+
+    it "divides by a scalar in the Ruby way" do
+      n = @m / 4
+      n.stype.should == :yale
+      n[0,3].should == -1
+      n[2,1].should == 1
+    end
+
+    it "raises on integer division of a slice by zero" do
+      expect { @m[0..2, 1..3] / 0 }.to raise_error(ZeroDivisionError)
+    end
+
+    it "compares with a scalar, giving a byte matrix" do
+      n = @m > 0
+      n.stype.should == :yale
+      n.dtype.should == :byte
+      n[0,0].should == 1
+      n[0,3].should == 0
+      n[1,1].should == 0
+    end
+
+    it "gives a dense matrix when the zeros would change" do
+      n = @m + 1
+      n.stype.should == :dense
+      n.should == NMatrix.new(:dense, [3,4], [3, 1, 1, -3, 1, 1, 1, 1, 1, 7, 1, 1], :int64)
+
+      (@m =~ 0).stype.should == :dense
+    end
   end
 end
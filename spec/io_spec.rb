@@ -78,6 +78,25 @@ describe NMatrix::IO do
     n.should == m
   end
 
+  it "reads and writes NMatrix yale with an itype narrower than its shape calls for" do
+    n = NMatrix.new(:yale, [300,300], :int64)
+    n[0,299] = 1
+    n[299,0] = 2
+    n[5,5]   = 3
+    n.shrink_to_fit
+    n.itype.should == :uint16
+    n.write("test-out")
+
+    m = NMatrix.read("test-out")
+    m.itype.should == :uint16
+    m.should == n
+    m[0,299].should == 1
+    m[299,0].should == 2
+
+    m[100,200] = 4
+    m[100,200].should == 4
+  end
+
   it "reads and writes NMatrix dense as symmetric" do
     n = NMatrix.new(:dense, 3, [0,1,2,1,3,4,2,4,5], :int16)
     n.write("test-out", :symmetric)
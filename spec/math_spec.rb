@@ -152,4 +152,99 @@ describe "math" do
       end
     end
   end
+
+  [:byte,:int8,:int16,:int32,:int64].each do |dtype|
+    it "dense handles #{dtype} dot #{dtype} multiplication of matrices big enough to be blocked" do
+      m, k, n = 37, 300, 29
+      a = NMatrix.new(:dense, [m,k], (0...m*k).map { |i| i % 3 }, dtype)
+      b = NMatrix.new(:dense, [k,n], (0...k*n).map { |i| i % 5 == 0 ? 1 : 0 }, dtype)
+      expected = a.cast(:dense, :float64).dot(b.cast(:dense, :float64))
+
+      best = NMatrix.simd_isa
+      begin
+        [:none, best].each do |isa|
+          NMatrix.simd_isa = isa
+          r = a.dot(b)
+          r.dtype.should == dtype
+          r.cast(:dense, :float64).should == expected
+        end
+      ensure
+        NMatrix.simd_isa = best
+      end
+    end
+  end
+
+  context "multiple threads" do
+    before :each do
+      @threads, @threshold = NMatrix.num_threads, NMatrix.parallel_threshold
+      NMatrix.parallel_threshold = 1
+    end
+
+    after :each do
+      NMatrix.num_threads, NMatrix.parallel_threshold = @threads, @threshold
+    end
+
+    it "splits products along whichever dimension is long enough and gives the same results as a single thread" do
+      shapes = [[9,5,3], [2,5,9], [2,50,3], [9,5,1], [2,50,1]] # split along M, N, K; then matrix-vector along M and K
+      products = lambda do |dtype|
+        shapes.map do |m, k, n|
+          a = NMatrix.new(:dense, [m,k], (0...m*k).map { |i| i % 7 - 3 }, dtype)
+          b = NMatrix.new(:dense, [k,n], (0...k*n).map { |i| i % 4 }, dtype)
+          a.dot(b)
+        end
+      end
+
+      [:int32, :float64].each do |dtype|
+        NMatrix.num_threads = 1
+        expected = products.call(dtype)
+
+        NMatrix.num_threads = 4
+        products.call(dtype).should == expected
+      end
+    end
+
+    it "splits an LU factorization between threads and gives the same result as a single thread" do
+      m, n = 150, 140
+      a = NMatrix.new(:dense, [m,n], (0...m*n).map { |i| (i * 37) % 101 - 50 + (i % (n+1) == 0 ? 500 : 0) }, :float64)
+
+      NMatrix.num_threads = 1
+      expected = a.factorize_lu
+
+      NMatrix.num_threads = 4
+      a.factorize_lu.should == expected
+    end
+  end
+
+  context "batch_dot" do
+    [[4,4,4], [8,8,8], [3,5,2], [20,30,10]].each do |m, k, n|
+      it "multiplies a stack of #{m}x#{k} matrices by a stack of #{k}x#{n} matrices, or by a single one" do
+        b = 3
+        left  = NMatrix.new(:dense, [b,m,k], (0...b*m*k).map { |i| i % 9 - 4 }, :int32)
+        right = NMatrix.new(:dense, [b,k,n], (0...b*k*n).map { |i| i % 5 }, :float64)
+        one   = NMatrix.new(:dense, [k,n], (0...k*n).map { |i| i % 3 }, :int32)
+
+        stacked   = left.batch_dot(right)
+        broadcast = left.batch_dot(one)
+        stacked.shape.should == [b,m,n]
+        stacked.dtype.should == :float64
+
+        b.times do |t|
+          l = NMatrix.new(:dense, [m,k], (0...m*k).map { |i| left[t, i / k, i % k] }, :int32)
+          r = NMatrix.new(:dense, [k,n], (0...k*n).map { |i| right[t, i / n, i % n] }, :float64)
+
+          expected = l.cast(:dense, :float64).dot(r)
+          (0...m*n).each { |i| stacked[t, i / n, i % n].should == expected[i / n, i % n] }
+
+          expected = l.dot(one)
+          (0...m*n).each { |i| broadcast[t, i / n, i % n].should == expected[i / n, i % n] }
+        end
+      end
+    end
+
+    it "rejects mismatched shapes" do
+      left = NMatrix.new(:dense, [2,3,4], 1, :int32)
+      expect { left.batch_dot(NMatrix.new(:dense, [2,3,4], 1, :int32)) }.to raise_error(ArgumentError)
+      expect { left.batch_dot(NMatrix.new(:dense, [3,4,2], 1, :int32)) }.to raise_error(ArgumentError)
+    end
+  end
 end
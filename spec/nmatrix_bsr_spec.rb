@@ -0,0 +1,108 @@
+# = NMatrix
+#
+# A linear algebra library for scientific computation in Ruby.
+# NMatrix is part of SciRuby.
+#
+# NMatrix was originally inspired by and derived from NArray, by
+# Masahiro Tanaka: http://narray.rubyforge.org
+#
+# == Copyright Information
+#
+# SciRuby is Copyright (c) 2010 - 2013, Ruby Science Foundation
+# NMatrix is Copyright (c) 2013, Ruby Science Foundation
+#
+# Please see LICENSE.txt for additional copyright notices.
+#
+# == Contributing
+#
+# By contributing source code to SciRuby, you agree to be bound by
+# our Contributor Agreement:
+#
+# * https://github.com/SciRuby/sciruby/wiki/Contributor-Agreement
+#
+# == nmatrix_bsr_spec.rb
+#
+# Basic tests for NMatrix's block-CSR storage type.
+#
+require "./lib/nmatrix"
+
+describe NMatrix do
+  context :bsr do
+    # 2x2 blocks on the diagonal of a 5x5 matrix, plus one off it; the last block row and column stick out.
+    let(:yale) do
+      a = NMatrix.new(:yale, [5,5], :float64)
+      a[0,0] = 1; a[0,1] = 2; a[1,0] = 3; a[1,1] = 4
+      a[2,2] = 5; a[2,3] = 6; a[3,2] = 7; a[3,3] = 8
+      a[4,4] = 9
+      a[0,4] = -1
+      a
+    end
+
+    it "converts to and from yale and dense without changing the entries" do
+      b = yale.to_bsr(2)
+      b.stype.should == :bsr
+      b.block_shape.should == [2,2]
+      b.capacity.should == 4*4 # the bottom right block is mostly padding
+
+      b.cast(:yale, :float64).should == yale
+      b.cast(:dense, :float64).should == yale.cast(:dense, :float64)
+      yale.cast(:dense, :float64).to_bsr([2,2]).should == b
+
+      b[1,0].should == 3
+      b[4,0].should == 0
+      b[0,4].should == -1
+    end
+
+    it "picks a block shape when cast" do
+      a = NMatrix.new(:yale, [6,6], :float64)
+      (0...6).each { |i| (0...6).each { |j| a[i,j] = i*6 + j + 1 if i/2 == j/2 } }
+
+      b = a.cast(:bsr, :float64)
+      b.block_shape.should == [2,2]
+      b.cast(:yale, :float64).should == a
+
+      # Too much padding in 2x2 blocks.
+      yale.cast(:bsr, :float64).block_shape.should == [1,1]
+      NMatrix.new(:yale, [4,4], :float64).cast(:bsr, :float64).block_shape.should == [1,1]
+    end
+
+    it "multiplies by a dense matrix or vector" do
+      x = NMatrix.new(:dense, [5,2], [1, 2, 3, 4, 5, 6, 7, 8, 9, 10], :float64)
+      v = NVector.new(:dense, [5,1], [1, 2, 3, 4, 5], :float64)
+
+      [1, 2, 3, [2,3]].each do |shape|
+        b = yale.to_bsr(shape)
+        (b.dot x).should == yale.dot(x)
+        (b.dot v).should == yale.dot(v)
+        (b.dot v).stype.should == :dense
+      end
+    end
+
+    it "transposes" do
+      b = yale.to_bsr([2,3])
+      b.transpose.block_shape.should == [3,2]
+      b.transpose.cast(:yale, :float64).should == yale.transpose
+    end
+
+    it "reads zeros outside its stored blocks for every dtype" do
+      [:int32, :float64, :complex128, :rational64, :object].each do |dtype|
+        a = NMatrix.new(:yale, [4,4], dtype)
+        a[0,0] = 1
+        a[1,1] = 2
+
+        b = a.to_bsr(2)
+        b[0,0].should == 1
+        b[0,1].should == 0 # in a stored block
+        b[3,3].should == 0 # in one which isn't
+        b[0,2].should == 0
+      end
+    end
+
+    it "refuses to be modified" do
+      b = yale.to_bsr(2)
+      expect { b[0,0] = 1 }.to raise_error(StorageTypeError)
+      expect { b + b }.to raise_error(NotImplementedError)
+      expect { b.each { } }.to raise_error(NotImplementedError, /cast to yale/)
+    end
+  end
+end
@@ -374,6 +374,31 @@ describe NMatrix do
       expect { @nm_1d.mean(3) }.to raise_exception(ArgumentError)
     end
 
+    it "should calculate the product along the specified dimension" do
+      @nm_1d.prod.should eq N[0.0]
+      @nm_2d.prod(1).should eq N[[0.0], [6.0]]
+    end
+
+    it "should reduce integer matrices and references natively" do
+      m = NMatrix.new(:dense, [3,4], (1..12).to_a, :int32)
+      m.sum(0).should eq NMatrix.new(:dense, [1,4], [15.0, 18.0, 21.0, 24.0], :float64)
+      m[1..2, 1..2].sum(1).should eq NMatrix.new(:dense, [2,1], [13.0, 21.0], :float64)
+      m.max(1).should eq NMatrix.new(:dense, [3,1], [4.0, 8.0, 12.0], :float64)
+    end
+
+    it "should reduce list and yale matrices, counting unstored entries" do
+      l = NMatrix.new(:list, [2,3], 1.0, :float64)
+      l[0,1] = 4.0
+      l.sum(0).should eq NMatrix.new(:dense, [1,3], [2.0, 5.0, 2.0], :float64)
+      l.min(1).should eq NMatrix.new(:dense, [2,1], [1.0, 1.0], :float64)
+
+      y = NMatrix.new(:yale, [2,3], :float64)
+      y[0,0] = 2.0
+      y[1,2] = 4.0
+      y.sum(1).should eq NMatrix.new(:dense, [2,1], [2.0, 4.0], :float64)
+      y.mean(0).should eq NMatrix.new(:dense, [1,3], [1.0, 0.0, 2.0], :float64)
+    end
+
     it "should convert to float if it contains only a single element" do 
       N[4.0].to_f.should eq 4.0
       N[[[[4.0]]]].to_f.should eq 4.0
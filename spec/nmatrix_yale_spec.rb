@@ -291,5 +291,395 @@ describe NMatrix do
       b[2,3].should == 0.0
       b[3,3].should == 6.0
     end
+
+    it "transposes rectangular matrices, keeping each row sorted" do
+      a = NMatrix.new(:yale, [3,5], :int32)
+      a[2,0] = 1
+      a[0,4] = 2
+      a[1,1] = 3
+      a[0,0] = 4
+      a[1,0] = 5
+      a[2,4] = 6
+
+      b = a.transpose.extend(NMatrix::YaleFunctions)
+      b.shape.should == [5,3]
+      b.should == a.cast(:dense, :int32).transpose.cast(:yale, :int32)
+      b.yale_ija[0...6].should == [6,8,8,8,8,10]
+      b.yale_ja.compact.should == [1,2,0,2]
+      b.yale_d.should == [4,3,0,0,0]
+    end
+
+    it "builds from COO triplets, summing duplicates" do
+      n = NMatrix.from_coo([3,4], [0,2,1,0,2,1], [3,0,1,3,0,2], [1,2,3,4,-2,5], dtype: :int32)
+      n.extend(NMatrix::YaleFunctions)
+
+      n.stype.should == :yale
+      n.dtype.should == :int32
+      n.yale_d.should == [0, 3, 0]
+      n.yale_ia.should == [4,5,6,6]
+      n.yale_ja.should == [3,2]
+      n.yale_lu.should == [5,5]
+      n.capacity.should == 6
+    end
+
+    it "builds from COO triplets given as packed strings" do
+      n = NMatrix.from_coo([2,2], [1,0].pack("q*"), [0,1].pack("q*"), [1.5, 2.5], index_dtype: :int64, dtype: :float64)
+      n[0,1].should == 2.5
+      n[1,0].should == 1.5
+      n[0,0].should == 0.0
+    end
+
+    it "dots rectangular matrices, dropping entries which cancel" do
+      a = NMatrix.new(:yale, [3,2], :int32)
+      a[0,0] = 1
+      a[0,1] = 1
+      a[1,1] = 2
+      a[2,0] = 3
+
+      b = NMatrix.new(:yale, [2,4], :int32)
+      b[0,2] = 1
+      b[0,3] = 5
+      b[1,2] = -1
+      b[1,0] = 4
+
+      c = a.dot(b).extend(NMatrix::YaleFunctions)
+      c.shape.should == [3,4]
+      c.should == a.cast(:dense, :int32).dot(b.cast(:dense, :int32)).cast(:yale, :int32)
+      c.yale_ija[0...4].should == [4,5,7,8]
+      c.yale_ja.compact.should == [3,0,2,3]
+      c.yale_d.should == [4,0,3]
+      c[0,2].should == 0
+    end
+
+    it "multiplies by a dense matrix or vector, and by one through its transpose" do
+      a = NMatrix.new(:yale, [3,4], :int64)
+      a[0,0] = 2
+      a[0,3] = -1
+      a[1,2] = 3
+      a[2,0] = 4
+      a[2,2] = 5
+
+      x = NMatrix.new(:dense, [4,2], [1, 2, 3, 4, 5, 6, 7, 8], :int64)
+      v = NVector.new(:dense, [4,1], [1, 2, 3, 4], :int64)
+      w = NVector.new(:dense, [3,1], [1, 2, 3], :int64)
+
+      (a.dot x).should == NMatrix.new(:dense, [3,2], [-5, -4, 15, 18, 29, 38], :int64)
+      (a.dot v).should == NMatrix.new(:dense, [3,1], [-2, 9, 19], :int64)
+      (a.dot v).stype.should == :dense
+
+      a.transpose_dot(w).should == a.transpose.cast(:dense, :int64).dot(w)
+      a.transpose_dot(w).should == NMatrix.new(:dense, [4,1], [14, 0, 21, -1], :int64)
+    end
+
+    it "raises when a COO index is out of range" do
+      expect { NMatrix.from_coo([2,2], [0,2], [0,0], [1,1]) }.to raise_error(RangeError)
+    end
+
+    it "sets and gets elements in gapped rows" do
+      n = NMatrix.new(:yale, [5,6], :int32)
+      n.gap!(2)
+      n.gapped?.should be_true
+
+      entries = {}
+      [[0,5,1], [3,1,2], [0,2,3], [0,3,4], [0,1,5], [4,4,6], [3,0,7], [0,4,8], [1,0,9], [0,2,10]].each do |i,j,v|
+        n[i,j] = v
+        entries[[i,j]] = v
+      end
+
+      5.times { |i| 6.times { |j| n[i,j].should == (entries[[i,j]] || 0) } }
+      n.should == NMatrix.from_coo([5,6], *entries.keys.transpose, entries.values, dtype: :int32)
+    end
+
+    it "shrinks to its exact size and a narrower itype, and can still grow" do
+      n = NMatrix.new(:yale, [300,300], :int64)
+      n.itype.should == :uint32
+      n.reserve(1000)
+      n.capacity.should == 1301
+
+      n[0,299] = 1
+      n[299,0] = 2
+      n[5,5]   = 3
+
+      n.shrink_to_fit.should == 1301 * (4 + 8) - 303 * (2 + 8)
+      n.capacity.should == 303
+      n.itype.should == :uint16
+
+      n[100,200] = 4
+      n[100,200].should == 4
+      n[0,299].should == 1
+
+      m = NMatrix.new(:yale, [300,300], :int64)
+      m[0,299] = 1
+      m[299,0] = 2
+      m[5,5]   = 3
+      m[100,200] = 4
+      n.should == m
+      (n + m)[100,200].should == 8
+    end
+
+    it "slices, scales and gaps a shrunk matrix in its narrower itype" do
+      n = NMatrix.new(:yale, [300,300], :int64)
+      n[0,299] = 1
+      n[299,0] = 2
+      n[5,5]   = 3
+      n.shrink_to_fit
+      n.itype.should == :uint16
+
+      n.transpose[299,0].should == 1
+      (n * 2)[299,0].should == 4
+      n[0..9,0..9][5,5].should == 3
+
+      n.gap!
+      n[100,200] = 4
+      n[100,200].should == 4
+      (n + n)[100,200].should == 8
+    end
+
+    it "packs a symmetric matrix into its upper triangle without changing how it looks" do
+      n = NMatrix.new(:yale, [4,4], :float64)
+      n[0,0] = 2.0
+      n[0,2] = n[2,0] = 1.0
+      n[1,3] = n[3,1] = 3.0
+      n[3,3] = 4.0
+      full = n.dup
+
+      n.pack_symmetric!
+      n.extend(NMatrix::YaleFunctions)
+      n.packed_symmetry.should == :symmetric
+      n.yale_size.should == 7
+
+      n[2,0].should == 1.0
+      n[3,1].should == 3.0
+      n.should == full
+      n.each_stored_with_indices.to_a.sort.should == full.each_stored_with_indices.to_a.sort
+      n.each.to_a.should == full.each.to_a
+
+      x = NMatrix.new(:dense, [4,2], [1.0,0.5, 2.0,0.0, 3.0,1.0, 4.0,2.0], :float64)
+      n.dot(x).should == full.dot(x)
+      n.transpose_dot(x).should == full.transpose_dot(x)
+
+      n.slice(1..3,1..3).packed_symmetry.should == :symmetric
+      n.slice(1..3,1..3).should == full.slice(1..3,1..3)
+      n.slice(0..1,2..3).should == full.slice(0..1,2..3)
+      n[2..3,0..1].should == full[2..3,0..1]
+
+      (n + n).packed_symmetry.should == :symmetric
+      (n + n)[3,1].should == 6.0
+      n.transpose.should == full
+
+      n[3,0] = 5.0
+      n[0,3].should == 5.0
+      n.unpack_symmetric!
+      n.packed_symmetry.should be_nil
+      n[3,0].should == 5.0
+      n[0,3].should == 5.0
+    end
+
+    it "packs a Hermitian matrix, conjugating what it mirrors" do
+      n = NMatrix.new(:yale, [2,2], :complex128)
+      n[0,0] = Complex(3,0)
+      n[0,1] = Complex(1,2)
+      n[1,0] = Complex(1,-2)
+
+      n.pack_symmetric!(true)
+      n.packed_symmetry.should == :hermitian
+      n[1,0].should == Complex(1,-2)
+
+      y = n.dot(NMatrix.new(:dense, [2,1], [Complex(1,0), Complex(1,0)], :complex128))
+      y[0,0].should == Complex(4,2)
+      y[1,0].should == Complex(1,-2)
+    end
+
+    it "refuses to pack a matrix which isn't symmetric" do
+      n = NMatrix.new(:yale, [2,2], :int32)
+      n[0,1] = 1
+      expect { n.pack_symmetric! }.to raise_error(ArgumentError)
+      n.packed_symmetry.should be_nil
+    end
+
+    it "closes gaps with compact! without changing the contents" do
+      n = NMatrix.new(:yale, [3,3], :float64)
+      n.extend(NMatrix::YaleFunctions)
+      n[0,1] = 1.0
+      n.gap!
+      n[2,0] = 2.0
+      n[0,2] = 3.0
+      n[1,1] = 4.0
+
+      n.compact!.gapped?.should be_false
+      n.yale_ia.should == [4,6,6,7]
+      n.yale_ja.compact.should == [1,2,0]
+      n.yale_lu.compact.should == [1.0,3.0,2.0]
+      n.yale_d.should == [0.0,4.0,0.0]
+    end
+
+    it "gets columns, and multiplies through its transpose, the same way before and after it's changed" do
+      n = NMatrix.new(:yale, [4,3], :int64)
+      n[0,0] = 1; n[0,2] = 2; n[1,2] = 3; n[2,0] = 4; n[2,2] = 5; n[3,1] = 6
+      x = NVector.new(:dense, [4,1], [1, 2, 3, 4], :int64)
+
+      check = lambda do
+        d = n.cast(:dense, :int64)
+        (0...3).each { |j| n.column(j).cast(:dense, :int64).should == d.column(j) }
+        n.slice(1..3, 2).cast(:dense, :int64).should == d.slice(1..3, 2)
+        n.slice(1..2, 1).cast(:dense, :int64).should == d.slice(1..2, 1)
+        n.transpose_dot(x).should == n.transpose.cast(:dense, :int64).dot(x)
+      end
+
+      check.call
+      n[1,2] = 7 # replaced in place
+      check.call
+      n[3,0] = 8 # inserted, moving the entries after it
+      check.call
+      n[1,1] = 9
+      n.gap!
+      n[0,1] = 10
+      check.call
+    end
+
+    context "solve_triangular" do
+      let(:a) do # the lower triangle is [[2,0,0],[1,4,0],[0,3,1]] and the upper one [[2,5,0],[0,4,0],[0,0,1]]
+        a = NMatrix.new(:yale, [3,3], :float64)
+        a[0,0] = 2; a[0,1] = 5; a[1,0] = 1; a[1,1] = 4; a[2,1] = 3; a[2,2] = 1
+        a
+      end
+
+      let(:x) { NMatrix.new(:dense, [3,2], [1, 2, 1, 1, 4, 5], :float64) }
+
+      it "does forward and back substitution with one triangle, ignoring the other" do
+        a.solve_triangular(NMatrix.new(:dense, [3,2], [2, 4, 5, 6, 7, 8], :float64)).should == x
+        a.solve_triangular(NMatrix.new(:dense, [3,2], [7, 9, 4, 4, 4, 5], :float64), :upper).should == x
+      end
+
+      it "takes the diagonal to be ones if asked" do
+        a.solve_triangular(NMatrix.new(:dense, [3,2], [1, 2, 2, 3, 7, 8], :float64), :lower, :unit).should == x
+      end
+
+      it "solves for a vector, upcasting" do
+        b = NVector.new(:dense, [3,1], [2, 5, 7], :int64)
+        a.solve_triangular(b).should == NVector.new(:dense, [3,1], [1, 1, 4], :float64)
+      end
+
+      it "raises on a zero on the diagonal" do
+        a[1,1] = 0
+        expect { a.solve_triangular(x) }.to raise_error(ZeroDivisionError)
+      end
+
+      it "gives the same answers by levels on several threads" do
+        threads, threshold = NMatrix.num_threads, NMatrix.parallel_threshold
+
+        begin
+          # Each row depends on the one 50 before it, so there are four levels of 50 rows.
+          l = NMatrix.new(:yale, [200,200], :float64)
+          (0...200).each { |i| l[i,i] = 2; l[i,i-50] = 1 if i >= 50 }
+          b = NMatrix.new(:dense, [200,3], (0...600).map { |i| i % 7 }, :float64)
+
+          NMatrix.num_threads = 1
+          expected = l.solve_triangular(b)
+
+          NMatrix.num_threads, NMatrix.parallel_threshold = 4, 1
+          l.solve_triangular(b).should == expected
+          l.solve_triangular(b).should == expected # with the levels kept from the last solve
+          l.dot(expected).should == b
+
+          l[199,100] = 1 # an insertion, so the levels are worked out again
+          l.dot(l.solve_triangular(b)).should == b
+        ensure
+          NMatrix.num_threads, NMatrix.parallel_threshold = threads, threshold
+        end
+      end
+    end
+
+    context "sparse factorization" do
+      # An arrow: dense first row and column, so eliminating 0 first would fill everything in.
+      let(:spd) do
+        a = NMatrix.new(:yale, [6,6], :float64)
+        (0...6).each { |i| a[i,i] = 10 + i }
+        (1...6).each { |i| a[0,i] = a[i,0] = 1 }
+        a[2,3] = a[3,2] = -2
+        a
+      end
+
+      def should_match(product, a, rows, cols)
+        (0...rows.size).each do |i|
+          (0...cols.size).each { |j| product[i,j].should be_within(1e-10).of(a[rows[i], cols[j]]) }
+        end
+      end
+
+      it "factorizes a symmetric positive definite matrix as L L^T, reordered" do
+        l, perm = spd.factorize_cholesky
+        perm.sort.should == (0...6).to_a
+        l.stype.should == :yale
+
+        # No fill: the dense row and column went last.
+        ld = l.cast(:dense, :float64)
+        (0...6).inject(0) { |sum, i| sum + (0...6).count { |j| ld[i,j] != 0 } }.should == 6 + 6
+        (0...6).each { |i| (i+1...6).each { |j| ld[i,j].should == 0 } }
+
+        should_match(ld.dot(ld.transpose), spd, perm, perm)
+      end
+
+      it "factorizes again after the values change" do
+        spd.factorize_cholesky
+        spd[4,4] = 100
+
+        l, perm = spd.factorize_cholesky
+        ld = l.cast(:dense, :float64)
+        should_match(ld.dot(ld.transpose), spd, perm, perm)
+      end
+
+      it "reads only the lower triangle" do
+        lower = NMatrix.new(:yale, [2,2], :float64)
+        lower[0,0] = 4
+        lower[1,0] = 1
+        lower[1,1] = 3
+
+        full = lower.dup
+        full[0,1] = 1
+
+        [lower, full].each do |a|
+          l, perm = a.factorize_cholesky
+          ld = l.cast(:dense, :float64)
+          should_match(ld.dot(ld.transpose), full, perm, perm)
+        end
+
+        # Likewise with the arrow, reordered so that some of its lower triangle ends up above the diagonal.
+        spd_lower = spd.dup
+        (1...6).each { |i| spd_lower[0,i] = 0 }
+        spd_lower[2,3] = 0
+
+        l, perm = spd_lower.factorize_cholesky
+        ld = l.cast(:dense, :float64)
+        should_match(ld.dot(ld.transpose), spd, perm, perm)
+      end
+
+      it "raises if the matrix isn't positive definite" do
+        spd[5,5] = -1
+        expect { spd.factorize_cholesky }.to raise_error(ArgumentError)
+      end
+
+      it "factorizes with pivoting as L U" do
+        a = spd.dup
+        a[1,0] = 20 # bigger than the diagonal
+        a[4,5] = 3
+        a[5,5] = 0
+
+        l, u, p, q = a.factorize_lu
+        p.sort.should == (0...6).to_a
+        q.sort.should == (0...6).to_a
+        (0...6).each { |i| l[i,i].should == 1 }
+
+        should_match(l.cast(:dense, :float64).dot(u.cast(:dense, :float64)), a, p, q)
+      end
+
+      it "raises if the matrix is singular" do
+        (0...6).each { |i| spd[i,2] = 0 }
+        expect { spd.factorize_lu }.to raise_error(ZeroDivisionError)
+      end
+
+      it "only works on floating-point dtypes" do
+        expect { spd.cast(:yale, :int64).factorize_cholesky }.to raise_error(DataTypeError)
+      end
+    end
   end
 end
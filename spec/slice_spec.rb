@@ -33,23 +33,21 @@ describe "Slice operation" do
         @m = create_matrix(stype)
       end
 
-      unless stype == :yale
-        it "should have #is_ref? method" do
-          a = @m[0..1, 0..1]
-          b = @m.slice(0..1, 0..1)
+      it "should have #is_ref? method" do
+        a = @m[0..1, 0..1]
+        b = @m.slice(0..1, 0..1)
 
 
-          @m.is_ref?.should be_false
-          a.is_ref?.should be_true
-          b.is_ref?.should be_false
-        end
+        @m.is_ref?.should be_false
+        a.is_ref?.should be_true
+        b.is_ref?.should be_false
+      end
 
-        it "reference should compare with non-reference" do
-          @m.slice(1..2,0..1).should == @m[1..2, 0..1]
-          @m[1..2,0..1].should == @m.slice(1..2, 0..1)
-          @m[1..2,0..1].should == @m[1..2, 0..1]
-        end
-      end # unless stype == :yale
+      it "reference should compare with non-reference" do
+        @m.slice(1..2,0..1).should == @m[1..2, 0..1]
+        @m[1..2,0..1].should == @m.slice(1..2, 0..1)
+        @m[1..2,0..1].should == @m[1..2, 0..1]
+      end
 
       context "with copying" do
         it 'should return an NMatrix' do
@@ -108,9 +106,82 @@ describe "Slice operation" do
 
 
       if stype == :yale
-        context "by reference" do
-          it "should raise an error" do
-            expect{ @m[1..2,1..2] }.to raise_error(NotImplementedError)
+        context "by reference, into a larger matrix" do
+          before :each do
+            @y = NMatrix.new(:yale, [12,15], :int32)
+            @d = NMatrix.new(:dense, [12,15], 0, :int32)
+            (0...12).each do |i|
+              (0...15).each do |j|
+                next unless (i * 7 + j * 3) % 5 == 0 || i == j
+                @y[i,j] = @d[i,j] = i * 15 + j + 1
+              end
+            end
+          end
+
+          it "should iterate over the entries stored inside the window" do
+            stored = []
+            @y[2..9, 4..12].each_stored_with_indices { |v,i,j| stored << [v,i,j] }
+
+            expected = []
+            (2..9).each do |i|
+              (4..12).each do |j|
+                expected << [@d[i,j], i-2, j-4] if (i * 7 + j * 3) % 5 == 0 || i == j
+              end
+            end
+            stored.should == expected
+          end
+
+          it "should iterate over every element of the window with #each" do
+            @y[5..11, 0..3].each.to_a.should == @d[5..11, 0..3].each.to_a
+          end
+
+          it "should see and make changes to its source, even when they reallocate the source's vectors" do
+            n = @y[1..10, 2..13]
+            (0...10).each { |i| n[i, 11 - i] = -i - 1 }
+            (0...10).each { |i| @y[i+1, 13 - i].should == -i - 1 }
+
+            @y[3,5] = 77
+            n[2,3].should == 77
+          end
+
+          it "should slice a reference relative to its own window" do
+            nm_eql(@y[2..9, 4..12][1..5, 2..6].cast(:dense, :int32), @d[3..7, 6..10]).should be_true
+          end
+
+          it "should multiply and operate element-wise like a copy" do
+            r = @y[0..5, 0..5]
+            c = @y.slice(0..5, 0..5)
+            (r.dot r).should == (c.dot c)
+            (r + r).should == (c + c)
+          end
+
+          it "should multiply by a dense matrix or vector in place, like a copy" do
+            x = NMatrix.new(:dense, [6,2], (1..12).to_a, :int32)
+            w = NVector.new(:dense, [4,1], [1, -2, 3, -4], :int32)
+
+            (@y[3..6, 5..10].dot x).should == (@d[3..6, 5..10].dot x)
+            (@y[3..6, 5..10].dot x).should == (@y.slice(3..6, 5..10).dot x)
+            @y[3..6, 5..10].transpose_dot(w).should == @y.slice(3..6, 5..10).transpose_dot(w)
+          end
+
+          it "should outlive its source" do
+            n = nil
+            1.times { n = NMatrix.new(:dense, [4,4], (1..16).to_a, :int64).cast(:yale, :int64)[1..2, 1..3] }
+            GC.start
+            n.should == NMatrix.new(:dense, [2,3], [6,7,8,10,11,12], :int64).cast(:yale, :int64)
+          end
+
+          it "should keep the Ruby objects of its source alive" do
+            n = nil
+            1.times do
+              m = NMatrix.new(:yale, [3,3], :object)
+              (0...3).each { |i| m[i,i] = "s#{i}" * 100; m[i, 2-i] = "t#{i}" * 100 }
+              n = m[1..2, 0..2]
+            end
+            GC.start
+            n[0,1].should == "t1" * 100 # set twice
+            n[1,0].should == "t2" * 100
+            n[1,2].should == "s2" * 100
           end
         end
 
@@ -122,171 +193,195 @@ describe "Slice operation" do
             column_slice[1].should == 0
             column_slice[2].should == 0
           end
-        end
-      else
-        context "by reference" do
-          it 'should return an NMatrix' do
-            n = @m[0..1,0..1]
-            nm_eql(n, NMatrix.new([2,2], [0,1,3,4], :int32)).should be_true
-          end
 
-          it 'should return a 2x2 matrix with refs to self elements' do
-            n = @m[1..2,0..1]
-            n.shape.should eql([2,2])
+          it "should copy only the entries inside the window, wherever they fall relative to the diagonal" do
+            y = NMatrix.new(:yale, [12,15], :int32)
+            d = NMatrix.new(:dense, [12,15], 0, :int32)
+            (0...12).each do |i|
+              (0...15).each do |j|
+                next unless (i * 7 + j * 3) % 5 == 0 || i == j
+                y[i,j] = d[i,j] = i * 15 + j + 1
+              end
+            end
 
-            n[0,0].should == @m[1,0]
-            n[0,0] = -9
-            @m[1,0].should eql(-9)
+            [[0..11, 0..14], [2..9, 4..12], [5..11, 0..3], [0..3, 10..14], [3..3, 0..14], [1..10, 2..2]].each do |rows, cols|
+              nm_eql(y.slice(rows, cols).cast(:dense, :int32), d.slice(rows, cols)).should be_true
+            end
           end
 
-          it 'should return a 1x2 vector with refs to self elements' do
-            n = @m[0,1..2]
-            n.shape.should eql([1,2])
+          it "should leave out diagonal entries which fall outside a narrow column window" do
+            y = NMatrix.new(:yale, [5,5], :int32)
+            (0...5).each { |i| y[i,i] = i + 1 }
 
-            n[0].should == @m[0,1]
-            n[0] = -9
-            @m[0,1].should eql(-9)
+            s = y.slice(0..4, 0..1)
+            s.shape.should == [5,2]
+            (0...5).each { |i| (0...2).each { |j| s[i,j].should == (i == j ? i + 1 : 0) } }
           end
+        end
+      end
 
-          it 'should return a 2x1 vector with refs to self elements' do
-            n = @m[0..1,1]
-            n.shape.should eql([2,1])
+      context "by reference" do
+        it 'should return an NMatrix' do
+          n = @m[0..1,0..1]
+          nm_eql(n, NMatrix.new([2,2], [0,1,3,4], :int32)).should be_true
+        end
 
-            n[0].should == @m[0,1]
-            n[0] = -9
-            @m[0,1].should eql(-9)
-          end
+        it 'should return a 2x2 matrix with refs to self elements' do
+          n = @m[1..2,0..1]
+          n.shape.should eql([2,2])
 
-          it 'should set value from NMatrix'
+          n[0,0].should == @m[1,0]
+          n[0,0] = -9
+          @m[1,0].should eql(-9)
+        end
 
-          it 'should slice again' do
-            n = @m[1..2, 1..2]
-            nm_eql(n[1,0..1], NVector.new(2, [7,8], :int32).transpose).should be_true
-          end
+        it 'should return a 1x2 vector with refs to self elements' do
+          n = @m[0,1..2]
+          n.shape.should eql([1,2])
 
-          it 'should be correct slice for range 0..2 and 0...3' do
-            @m[0..2,0..2].should == @m[0...3,0...3]
-          end
+          n[0].should == @m[0,1]
+          n[0] = -9
+          @m[0,1].should eql(-9)
+        end
 
-          if stype == :dense
-            [:byte,:int8,:int16,:int32,:int64,:float32,:float64,:rational64,:rational128].each do |left_dtype|
-              [:byte,:int8,:int16,:int32,:int64,:float32,:float64,:rational64,:rational128].each do |right_dtype|
-
-                # Won't work if they're both 1-byte, due to overflow.
-                next if [:byte,:int8].include?(left_dtype) && [:byte,:int8].include?(right_dtype)
-
-                # For now, don't bother testing int-int mult.
-                #next if [:int8,:int16,:int32,:int64].include?(left_dtype) && [:int8,:int16,:int32,:int64].include?(right_dtype)
-                it "handles #{left_dtype.to_s} dot #{right_dtype.to_s} matrix multiplication" do
-                  #STDERR.puts "dtype=#{dtype.to_s}"
-                  #STDERR.puts "2"
-
-                  nary = if left_dtype.to_s =~ /complex/
-                           COMPLEX_MATRIX43A_ARRAY
-                         elsif left_dtype.to_s =~ /rational/
-                           RATIONAL_MATRIX43A_ARRAY
-                         else
-                           MATRIX43A_ARRAY
-                         end
-
-                  mary = if right_dtype.to_s =~ /complex/
-                           COMPLEX_MATRIX32A_ARRAY
-                         elsif right_dtype.to_s =~ /rational/
-                           RATIONAL_MATRIX32A_ARRAY
-                         else
-                           MATRIX32A_ARRAY
-                         end
-
-                  n = NMatrix.new([4,3], nary, left_dtype)[1..3,1..2]
-                  m = NMatrix.new([3,2], mary, right_dtype)[1..2,0..1]
-
-                  r = n.dot m
-                  r.shape.should eql([3,2])
-
-                  r[0,0].should == 219.0
-                  r[0,1].should == 185.0
-                  r[1,0].should == 244.0
-                  r[1,1].should == 205.0
-                  r[2,0].should == 42.0
-                  r[2,1].should == 35.0
-
-                end
-              end
-            end
+        it 'should return a 2x1 vector with refs to self elements' do
+          n = @m[0..1,1]
+          n.shape.should eql([2,1])
 
-            context "operations" do 
+          n[0].should == @m[0,1]
+          n[0] = -9
+          @m[0,1].should eql(-9)
+        end
 
-              it "correctly transposes slices" do
-                @m[0...3,0].transpose.should eq N[[0, 3, 6]]
-              end
+        it 'should set value from NMatrix'
 
-              it "adds slices" do 
-                (N[[0,0,0]] + @m[1,0..2]).should eq N[[3, 4, 5]]
-              end
+        it 'should slice again' do
+          n = @m[1..2, 1..2]
+          nm_eql(n[1,0..1], NVector.new(2, [7,8], :int32).transpose).should be_true
+        end
 
-              it "scalar adds to slices" do 
-                (@m[1,0..2]+1).should eq N[[4, 5, 6]]
-              end
+        it 'should be correct slice for range 0..2 and 0...3' do
+          @m[0..2,0..2].should == @m[0...3,0...3]
+        end
 
-              it "compares slices to scalars" do 
-                (@m[1, 0..2] > 2).each { |e| (e != 0).should be_true }
-              end
+        if stype == :dense
+          [:byte,:int8,:int16,:int32,:int64,:float32,:float64,:rational64,:rational128].each do |left_dtype|
+            [:byte,:int8,:int16,:int32,:int64,:float32,:float64,:rational64,:rational128].each do |right_dtype|
+
+              # Won't work if they're both 1-byte, due to overflow.
+              next if [:byte,:int8].include?(left_dtype) && [:byte,:int8].include?(right_dtype)
+
+              # For now, don't bother testing int-int mult.
+              #next if [:int8,:int16,:int32,:int64].include?(left_dtype) && [:int8,:int16,:int32,:int64].include?(right_dtype)
+              it "handles #{left_dtype.to_s} dot #{right_dtype.to_s} matrix multiplication" do
+                #STDERR.puts "dtype=#{dtype.to_s}"
+                #STDERR.puts "2"
+
+                nary = if left_dtype.to_s =~ /complex/
+                         COMPLEX_MATRIX43A_ARRAY
+                       elsif left_dtype.to_s =~ /rational/
+                         RATIONAL_MATRIX43A_ARRAY
+                       else
+                         MATRIX43A_ARRAY
+                       end
+
+                mary = if right_dtype.to_s =~ /complex/
+                         COMPLEX_MATRIX32A_ARRAY
+                       elsif right_dtype.to_s =~ /rational/
+                         RATIONAL_MATRIX32A_ARRAY
+                       else
+                         MATRIX32A_ARRAY
+                       end
+
+                n = NMatrix.new([4,3], nary, left_dtype)[1..3,1..2]
+                m = NMatrix.new([3,2], mary, right_dtype)[1..2,0..1]
+
+                r = n.dot m
+                r.shape.should eql([3,2])
+
+                r[0,0].should == 219.0
+                r[0,1].should == 185.0
+                r[1,0].should == 244.0
+                r[1,1].should == 205.0
+                r[2,0].should == 42.0
+                r[2,1].should == 35.0
 
-              it "iterates only over elements in the slice" do 
-                els = []
-                @m[1, 0..2].each { |e| els << e }
-                els.size.should eq 3
-                els[0].should eq 3
-                els[1].should eq 4
-                els[2].should eq 5
               end
+            end
+          end
 
-              it "iterates with index only over elements in the slice" do 
-                els = []
-                @m[1, 0..2].each_stored_with_indices { |a| els << a }
-                els.size.should eq 3
-                els[0].should eq [3, 0, 0]
-                els[1].should eq [4, 0, 1]
-                els[2].should eq [5, 0, 2]
-              end
+          context "operations" do 
 
+            it "correctly transposes slices" do
+              @m[0...3,0].transpose.should eq N[[0, 3, 6]]
             end
 
-          end
+            it "adds slices" do 
+              (N[[0,0,0]] + @m[1,0..2]).should eq N[[3, 4, 5]]
+            end
 
-          it 'should be cleaned up by garbage collector without errors'  do
-            1.times do
-              n = @m[1..2,0..1]
+            it "scalar adds to slices" do 
+              (@m[1,0..2]+1).should eq N[[4, 5, 6]]
             end
-            GC.start
-            @m.should == NMatrix.new(:dense, [3,3], (0..9).to_a, :int32).cast(stype, :int32)
-            n = nil
-            1.times do
-              m = NMatrix.new(:dense, [2,2], [1,2,3,4]).cast(stype, :int32)
-              n = m[0..1,0..1]
+
+            it "compares slices to scalars" do 
+              (@m[1, 0..2] > 2).each { |e| (e != 0).should be_true }
             end
-            GC.start
-            n.should == NMatrix.new(:dense, [2,2], [1,2,3,4]).cast(stype, :int32)
+
+            it "iterates only over elements in the slice" do 
+              els = []
+              @m[1, 0..2].each { |e| els << e }
+              els.size.should eq 3
+              els[0].should eq 3
+              els[1].should eq 4
+              els[2].should eq 5
+            end
+
+            it "iterates with index only over elements in the slice" do 
+              els = []
+              @m[1, 0..2].each_stored_with_indices { |a| els << a }
+              els.size.should eq 3
+              els[0].should eq [3, 0, 0]
+              els[1].should eq [4, 0, 1]
+              els[2].should eq [5, 0, 2]
+            end
+
+          end
+
+        end
+
+        it 'should be cleaned up by garbage collector without errors'  do
+          1.times do
+            n = @m[1..2,0..1]
+          end
+          GC.start
+          @m.should == NMatrix.new(:dense, [3,3], (0..9).to_a, :int32).cast(stype, :int32)
+          n = nil
+          1.times do
+            m = NMatrix.new(:dense, [2,2], [1,2,3,4]).cast(stype, :int32)
+            n = m[0..1,0..1]
           end
+          GC.start
+          n.should == NMatrix.new(:dense, [2,2], [1,2,3,4]).cast(stype, :int32)
+        end
 
-          [:dense, :list, :yale].each do |cast_type|
-            it "should cast from #{stype.upcase} to #{cast_type.upcase}" do
-              nm_eql(@m[1..2, 1..2].cast(cast_type, :int32), @m[1..2,1..2]).should be_true
-              nm_eql(@m[0..1, 1..2].cast(cast_type, :int32), @m[0..1,1..2]).should be_true
-              nm_eql(@m[1..2, 0..1].cast(cast_type, :int32), @m[1..2,0..1]).should be_true
-              nm_eql(@m[0..1, 0..1].cast(cast_type, :int32), @m[0..1,0..1]).should be_true
+        [:dense, :list, :yale].each do |cast_type|
+          it "should cast from #{stype.upcase} to #{cast_type.upcase}" do
+            nm_eql(@m[1..2, 1..2].cast(cast_type, :int32), @m[1..2,1..2]).should be_true
+            nm_eql(@m[0..1, 1..2].cast(cast_type, :int32), @m[0..1,1..2]).should be_true
+            nm_eql(@m[1..2, 0..1].cast(cast_type, :int32), @m[1..2,0..1]).should be_true
+            nm_eql(@m[0..1, 0..1].cast(cast_type, :int32), @m[0..1,0..1]).should be_true
 
-              # Non square
-              nm_eql(@m[0..2, 1..2].cast(cast_type, :int32), @m[0..2,1..2]).should be_true
-              nm_eql(@m[1..2, 0..2].cast(cast_type, :int32), @m[1..2,0..2]).should be_true
+            # Non square
+            nm_eql(@m[0..2, 1..2].cast(cast_type, :int32), @m[0..2,1..2]).should be_true
+            nm_eql(@m[1..2, 0..2].cast(cast_type, :int32), @m[1..2,0..2]).should be_true
 
-              # Full
-              nm_eql(@m[0..2, 0..2].cast(cast_type, :int32), @m).should be_true
-            end
+            # Full
+            nm_eql(@m[0..2, 0..2].cast(cast_type, :int32), @m).should be_true
           end
         end
       end
-    end # unless stype == :yale
+    end
   end
 
   # Stupid but independent comparison